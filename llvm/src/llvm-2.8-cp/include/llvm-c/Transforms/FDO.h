@@ -21,6 +21,9 @@ extern "C" {
 #endif
 
 void LLVMAddFDOInlinerPass(LLVMPassManagerRef PM);
+void LLVMAddFDOSplitterPass(LLVMPassManagerRef PM);
+void LLVMAddFDOFunctionOrderPass(LLVMPassManagerRef PM);
+void LLVMAddFDOSuperblockPass(LLVMPassManagerRef PM);
 
 #ifdef __cplusplus
 }
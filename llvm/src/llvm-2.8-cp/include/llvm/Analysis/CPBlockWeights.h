@@ -0,0 +1,86 @@
+//===- CPBlockWeights.h ---------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Edge and block weights of the IR CFG, read from a combined edge
+// profile with one statistic per histogram (the mean, or a quantile
+// over all runs) and rebuilt down the edge dominator tree.  Weights are
+// per function entry.  For clients that run after the IR has been
+// changed (code generation): load() must see the module as profiled,
+// and the weights stay keyed by the original blocks.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPBLOCKWEIGHTS_H
+#define CPBLOCKWEIGHTS_H
+
+#include "llvm/Analysis/EdgeDominatorTree.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+  class CombinedEdgeProfile;
+  class DominatorTree;
+  class Function;
+  class Module;
+
+  class CPBlockWeights {
+  public:
+    // the statistic taken from each histogram; MinCoverage is the
+    // smallest non-zero value times the coverage
+    enum Statistic { Mean, Quantile, MinCoverage };
+
+    CPBlockWeights() : _stat(Mean), _quantile(0.5) {}
+
+    // quantile < 0 takes the mean of each histogram
+    bool load(Module& M, const std::string& filename, double quantile = -1.0)
+    {return(load(M, filename, (quantile < 0) ? Mean : Quantile, quantile));};
+    bool load(Module& M, const std::string& filename, Statistic stat,
+              double quantile);
+    void clear();
+
+    // a function is profiled if anything past its entry has weight
+    bool profiled(const Function* F) const {return(_profiled.count(F) != 0);};
+    // a function never ran if its entry block has out-edges and none
+    // of them was taken in any run
+    bool neverRan(const Function* F) const {return(_neverRan.count(F) != 0);};
+    // source NULL is the function entry; 0 for unknown edges
+    double edgeWeight(const BasicBlock* source,
+                      const BasicBlock* target) const;
+    double blockWeight(const BasicBlock* BB) const;
+    // sum of the coverage of the histograms of the edges into BB
+    double blockCoverage(const BasicBlock* BB) const;
+
+  private:
+    typedef std::pair<const BasicBlock*,const BasicBlock*> BlockEdge;
+
+    Statistic _stat;
+    double _quantile;
+    std::map<BlockEdge,double> _edges;
+    std::map<const BasicBlock*,double> _blocks;
+    std::map<const BasicBlock*,double> _coverage;
+    std::set<const Function*> _profiled;
+    std::set<const Function*> _neverRan;
+
+    double statistic(CombinedEdgeProfile& cep, EdgeIndex e) const;
+    double weight(CombinedEdgeProfile& cep, EdgeIndex e, EdgeNodeMap& edges,
+                  std::map<EdgeIndex,double>& done) const;
+  };
+
+  // The maximal dominator subtrees whose blocks are all in cold, each
+  // with its header first, as ExtractCodeRegion wants.  The entry block
+  // is never in one.
+  void findColdSubtrees(DominatorTree& DT, const std::set<BasicBlock*>& cold,
+                        std::vector<std::vector<BasicBlock*> >& regions);
+
+} // namespace llvm
+
+#endif // CPBLOCKWEIGHTS_H
@@ -0,0 +1,88 @@
+//===- CPConvergence.h ----------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Incremental convergence monitor for profile collection.  Raw runs are
+// added one at a time, and each run's drift says how far it moved the
+// combined edge and call profiles of all the runs so far.
+//
+// The drift of one histogram is the earth-mover distance between the
+// shapes of its non-zero part before and after the run (CPHistogram's
+// earthMover, as a fraction of the range) plus the change in its share
+// of 0s.  A run's drift is the mean over all histograms, weighted by
+// how many runs have reached each one, so cold indices barely count.
+//
+// Histograms are updated in place (CPHistogram::addValue), and only the
+// ones the run reaches are touched: the drift of the others is only in
+// their share of 0s, which is summed in closed form.  The profile is
+// converged when the last few runs all drifted less than a tolerance.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPCONVERGENCE_H
+#define CPCONVERGENCE_H
+
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+  class Module;
+  class CPHistogram;
+
+  class CPConvergence {
+  public:
+    explicit CPConvergence(Module& M, unsigned bincount = DEFAULT_BINS);
+    ~CPConvergence();
+
+    // add one raw profile; edge and call sections are used, other
+    // counter sections are skipped.  Returns false on a read error.
+    bool addRun(const std::string& filename);
+    bool addRun(FILE* file);
+
+    unsigned runs() const {return(_drift.size());};
+    // drift of run r (from 0); the first run is all new: 1.0
+    double drift(unsigned r) const {return(_drift[r]);};
+    double lastDrift() const {return(_drift.empty() ? 1.0 : _drift.back());};
+
+    // the last 'window' runs all drifted less than tolerance
+    bool converged(double tolerance, unsigned window) const;
+
+    void clear();
+
+  private:
+    Module& _M;
+    unsigned _bincount;
+    CombinedEdgeProfile* _cep;
+    CombinedCallProfile* _ccp;
+
+    // edges first, then call blocks; NULL until non-zero in some run
+    CPHistVec _histograms;
+    unsigned _edgeCount;
+
+    // over all histograms: sum of non-zero weights and their squares
+    double _sumWeight;
+    double _sumWeight2;
+
+    std::vector<double> _drift;
+
+    void addValues(const std::vector<double>& values, unsigned offset,
+                   double& weighted, double& weight);
+
+  private:
+    CPConvergence(); // do not implement
+    CPConvergence(const CPConvergence&); // do not implement
+  }; // CPConvergence
+
+} // namespace llvm
+
+#endif // CPCONVERGENCE_H
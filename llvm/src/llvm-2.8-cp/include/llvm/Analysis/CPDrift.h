@@ -0,0 +1,96 @@
+//===- CPDrift.h ----------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Batch drift computation between two combined profiles.  The bins of
+// every comparable histogram pair are packed into two contiguous
+// arrays, and overlap (0-in and 0-out) and earth-mover distance are
+// computed with straight-line loops over those arrays, split across
+// threads by histogram index.  Results match CPHistogram::overlap and
+// CPHistogram::earthMover.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPDRIFT_H
+#define CPDRIFT_H
+
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+
+namespace llvm {
+
+  class CPHistogram;
+  class CombinedProfile;
+  class CombinedPathProfile;
+
+  class CPDrift {
+  public:
+    explicit CPDrift(unsigned threads = 1);
+
+    // Histograms are matched by index.  Only indices that are
+    // non-zero in at least one profile are compared.
+    void compare(const CombinedProfile& cp1, const CombinedProfile& cp2);
+    // Histograms are matched by PathID.  Paths that only exist in
+    // one profile, and pairs of points, are skipped.
+    void compare(CombinedPathProfile& cp1, CombinedPathProfile& cp2);
+
+    void clear();
+    unsigned size() const {return(_ids.size());};
+
+    double zeroOut(unsigned i) const {return(_zeroOut[i]);};
+    double zeroIn(unsigned i) const {return(_zeroIn[i]);};
+    // < 0 if the pair has no meaningful earth-mover distance
+    double earthMover(unsigned i) const {return(_emd[i]);};
+
+    // same format as CombinedProfile::printDrift, optionally with an
+    // extra earth-mover column
+    void print(llvm::raw_ostream& stream, const std::string& name,
+               bool printEMD = false) const;
+
+  private:
+    // how a pair of histograms is compared
+    enum PairKind {
+      Bins,       // bin-by-bin comparison
+      SamePoint,  // two points at the same value
+      MixedPoint, // a point and a non-point: only the 0s overlap
+      Mismatch,   // not comparable (overlap() reports an error): 100% drift
+      Disjoint    // 100% drift
+    };
+
+    struct Pair {
+      PairKind kind;
+      unsigned offset;   // into _bins1/_bins2
+      unsigned bins;
+      double nzw;        // non-zero weight (equal for both, if comparable)
+      double tw;         // total weight (equal for both, if comparable)
+      double zeroMin;    // min(zeroWeight1, zeroWeight2)
+    };
+
+    unsigned _threads;
+    bool _pathIDs;  // _ids are <function,path> rather than <index,0>
+
+    std::vector<std::pair<unsigned,unsigned> > _ids;
+    std::vector<Pair> _pairs;
+    std::vector<double> _bins1;
+    std::vector<double> _bins2;
+
+    std::vector<double> _zeroOut;
+    std::vector<double> _zeroIn;
+    std::vector<double> _emd;
+
+    void add(unsigned id1, unsigned id2,
+             const CPHistogram* h1, const CPHistogram* h2);
+    void run();
+    void computeRange(unsigned begin, unsigned end);
+
+    static void* threadMain(void* arg);
+  };
+
+} // namespace llvm
+
+#endif // CPDRIFT_H
@@ -8,8 +8,8 @@
 //===----------------------------------------------------------------------===//
 //
 // Takes raw and/or combined profiles from one or more profile file
-// and combines the like-typed profiles (edge/path/call) into a single
-// combined profile of that type.
+// and combines the like-typed profiles (edge/path/call/trip count/value)
+// into a single combined profile of that type.
 //
 //===----------------------------------------------------------------------===//
 
@@ -36,12 +36,29 @@ namespace llvm {
     ~CPFactory();
 
     bool buildProfiles(const FilenameVec& filenames);
+    // Time-decayed merge: every profile in filenames[i] counts for
+    // weights[i] times its own weight.  Raw runs are added with that
+    // weight, combined profiles are scaled (CombinedProfile::scaleWeight).
+    bool buildProfiles(const FilenameVec& filenames,
+                       const std::vector<double>& weights);
     bool buildProfiles(cl::list<std::string>& filenames);
     bool buildProfiles(const std::string& filename);
+    // like buildProfiles, but indexed profiles are mapped and read
+    // lazily (see CombinedProfile::mapIndexed)
+    bool loadProfiles(const std::string& filename);
+    // whether the last loadProfiles read an indexed file
+    bool loadedIndexed() const {return(_indexed);};
+
+    // The keys of the module's functions (CPFunctionKeys.h), computed
+    // on first use.  Written in front of combined profiles; profiles
+    // read after the keys of another build are remapped to the module.
+    const CPFunctionKeys& getFunctionKeys();
 
     bool hasCallCP() {return(_callCP != NULL);};
     bool hasEdgeCP() {return(_edgeCP != NULL);};
     bool hasPathCP() {return(_pathCP != NULL);};
+    bool hasTripCountCP() {return(_tripCP != NULL);};
+    bool hasValueCP() {return(_valueCP != NULL);};
 
     // the caller of a 'take' method also takes responsibility for
     // deallocating the CP.  A CP can only be taken once.
@@ -54,20 +71,40 @@ namespace llvm {
     CombinedPathProfile* takePathCP()
     { CombinedPathProfile* tmp = _pathCP; _pathCP = NULL; return(tmp); };
 
+    CombinedTripCountProfile* takeTripCountCP()
+    { CombinedTripCountProfile* tmp = _tripCP; _tripCP = NULL; return(tmp); };
+
+    CombinedValueProfile* takeValueCP()
+    { CombinedValueProfile* tmp = _valueCP; _valueCP = NULL; return(tmp); };
+
     static const std::string& profilingTypeToString(ProfilingType p);
 
+    // weight of an input 'age' old, halving every halfLife (0: no decay)
+    static double decayWeight(double age, double halfLife);
+
+    // skip a raw ArgumentInfo section; file is just past the type word
+    static bool skipArgumentInfo(FILE* file);
+
     void clear();
 
-    // free the static data of CP classes (CPFactory itself doesn't have any)
+    // free the static data of CP classes (CPFactory itself doesn't have
+    // any); the next CP rebuilds it from its module.  Call once no CPs are
+    // left, and after passes that change the CFG or the set of functions.
     static void freeStaticData();
 
   protected:
     CombinedCallProfile* _callCP;
     CombinedEdgeProfile* _edgeCP;
     CombinedPathProfile* _pathCP;
+    CombinedTripCountProfile* _tripCP;
+    CombinedValueProfile* _valueCP;
 
-    bool skipArgumentInfo(FILE* file);
+    CombinedProfile* newIndexedCP(FILE* file);
+    // NULL if fileKeys are the module's; otherwise the caller owns it
+    CPFunctionMap* matchFunctions(const CPFunctionKeys& fileKeys);
     Module& _M;
+    CPFunctionKeys* _keys;
+    bool _indexed;
 
   private:
     CPFactory(); // do not implement
@@ -0,0 +1,119 @@
+//===- CPFunctionKeys.h ---------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Stable function identity for combined profiles.  The edge, call,
+// trip count and value profiles number their histograms by position
+// in the module, and the path and value profiles name functions by
+// their number, so a profile only fits the exact build it came from.
+//
+// A CombinedFunctionKeys section written in front of the profiles
+// records, for each function, a hash of its name, and for each profile
+// a checksum of what that profile's histograms hang off and how many it
+// has.  When the profiles are read for a different module, a
+// CPFunctionMap matches the functions of the two: by name, then by
+// checksums alone for a function that is the only one with them on
+// both sides (a rename).  A matched function keeps the histograms of
+// each profile whose checksum and count are unchanged, so a new call
+// leaves its edge profile alone; the rest, and those of functions that
+// went away, are dropped.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPFUNCTIONKEYS_H
+#define CPFUNCTIONKEYS_H
+
+#include "llvm/Analysis/ProfileInfoTypes.h"
+#include "llvm/System/DataTypes.h"
+
+#include <cstdio>
+#include <vector>
+
+// CPFunctionMap entry for a function with no match
+#define CP_NO_FUNCTION (~0u)
+
+namespace llvm {
+
+  class Module;
+  class Function;
+
+  // the histogram counts in CPFunctionKey
+  enum CPSlotKind {
+    CPEdgeSlots,
+    CPCallSlots,
+    CPLoopSlots,
+    CPSiteSlots
+  };
+
+  class CPFunctionKeys {
+  public:
+    CPFunctionKeys() {};
+    // the keys of M's functions, in function number order
+    explicit CPFunctionKeys(Module& M);
+
+    // the whole section, type word first
+    bool serialize(FILE* f) const;
+    // everything after the type word
+    bool deserialize(FILE* f);
+    // same, from [data,end); advances data
+    bool deserialize(const char*& data, const char* end);
+
+    unsigned size() const {return(_keys.size());};
+    const CPFunctionKey& operator[](unsigned i) const {return(_keys[i]);};
+    bool operator==(const CPFunctionKeys& other) const;
+    bool operator!=(const CPFunctionKeys& other) const
+    {return( !(*this == other) );};
+
+    static unsigned getSlots(const CPFunctionKey& key, CPSlotKind kind);
+    static unsigned getChecksum(const CPFunctionKey& key, CPSlotKind kind);
+    // index of each function's first histogram of a kind; one extra
+    // entry holds the total
+    void getFirstSlots(CPSlotKind kind, std::vector<unsigned>& first) const;
+
+    static CPFunctionKey getKey(Function& F);
+    static uint64_t hashName(const char* name, unsigned length);
+
+  private:
+    std::vector<CPFunctionKey> _keys;
+  };
+
+
+  class CPFunctionMap {
+  public:
+    // match the functions of 'from' to those of 'to'
+    CPFunctionMap(const CPFunctionKeys& from, const CPFunctionKeys& to);
+
+    const CPFunctionKeys& from() const {return(_from);};
+    const CPFunctionKeys& to() const {return(_to);};
+
+    // function number (from 0) in 'to' of function f of 'from', or
+    // CP_NO_FUNCTION if it went away
+    unsigned operator[](unsigned f) const {return(_map[f]);};
+    // same, but CP_NO_FUNCTION if f's histograms of a kind changed
+    unsigned operator()(unsigned f, CPSlotKind kind) const
+    {return(_kindMap[kind][f]);};
+    unsigned matched() const {return(_matched);};
+    unsigned renamed() const {return(_renamed);};
+    // matched functions with some histograms dropped
+    unsigned changed() const {return(_changed);};
+
+  private:
+    const CPFunctionKeys& _from;
+    const CPFunctionKeys& _to;
+    std::vector<unsigned> _map;
+    std::vector<unsigned> _kindMap[CPSiteSlots+1];
+    unsigned _matched;
+    unsigned _renamed;
+    unsigned _changed;
+
+    CPFunctionMap(); // do not implement
+  };
+
+} // namespace llvm
+
+#endif // CPFUNCTIONKEYS_H
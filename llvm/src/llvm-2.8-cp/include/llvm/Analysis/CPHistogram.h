@@ -19,7 +19,7 @@
 
 #include <stdio.h>
 
-//#include "llvm/Analysis/ProfileInfoTypes.h"
+#include "llvm/Analysis/ProfileInfoTypes.h"
 #include "llvm/Support/raw_ostream.h"
 #include <vector>
 #include <list>
@@ -56,6 +56,23 @@ namespace llvm {
     CPHistogram& operator=(const CPHistogram& rhs);
     CPHistogram* cross(const CPHistogram& other) const;
     CPHistogram* cross(const CPHistogramList& others) const;
+
+    // Bounded-cost products.  The intermediate product is collapsed
+    // to at most 'bincount' impulses after every pairwise step, so a
+    // chain of N histograms costs O(N*B^2) instead of O(B^N).  Each
+    // collapsed impulse sits at the weighted mean of the values it
+    // replaces, so weight and mean are preserved exactly.  bincount 0
+    // uses the largest bin count of the operands.
+    CPHistogram* crossRebin(const CPHistogramList& others,
+                            unsigned bincount = 0) const;
+    // crossRebin(H) for every H in others, in one pass: the impulses
+    // of this are computed once and shared by all the products.
+    // Products are appended to 'products' in the order of 'others';
+    // the caller owns them.  bincount 0 uses the larger bin count of
+    // each pair.
+    void crossEach(const CPHistogramList& others,
+                   CPHistogramList& products, unsigned bincount = 0) const;
+
     CPHistogram* asUniform() const;
     CPHistogram* asNormal() const;
     double earthMover(const CPHistogram& other) const;
@@ -87,7 +104,8 @@ namespace llvm {
     double maxLikelyhood() const;
     double span() const;
 
-    double quantile(double q) const;
+    // with inclZeros, q is over all runs: 0 if q falls in the 0s
+    double quantile(double q, bool inclZeros=false) const;
     std::pair<double,double> quantileRange(double min, double max);
     double probLessThan(double v) const;
     double probBetween(double l, double u) const;
@@ -122,10 +140,23 @@ namespace llvm {
     void addToList(double v, double w = 1.0);
     void addToList(const WeightedValue& wv);
 
+    // Add straight to the bins and stats, without the add list.  The
+    // range grows to fit v by doubling its span, merging bins; a point
+    // or empty histogram gets 'bincount' bins once it has two values.
+    void addValue(double v, double w, unsigned bincount);
+    // just the range change addValue(v, ...) would make
+    void fitRange(double v, unsigned bincount);
+    // multiply every weight (bins, stats and add list) by f; the shape
+    // and the share of 0s are unchanged
+    void scale(double f);
+
     // returns true on success, false on error
     bool serialize(unsigned ID, FILE* f) const;
     // returns ID on success, -1 on errro
     int deserialize(unsigned bincount, double totalweight, FILE* f);
+    // same, from the serialized bytes in [data,end); advances data
+    int deserialize(unsigned bincount, double totalweight,
+                    const char*& data, const char* end);
     void print(llvm::raw_ostream& stream) const;
     void printStats(llvm::raw_ostream& stream) const;
 
@@ -169,9 +200,27 @@ namespace llvm {
 		void setBinWeight(unsigned b, double w);
     void setRange(double min, double max);
 
+    // apply a serialized header; returns the number of bins that
+    // follow it, or -1 on error
+    int readHeader(const CPHistogramHeader& entry, unsigned bincount,
+                   double totalweight);
+
     double addToBin(unsigned b, double w);
     //void add(Range r, double w);
 
+    // <value,weight> impulses for the non-zero part of the histogram:
+    // one per used bin (at the bin center), or one for a point.
+    void getImpulses(WeightedValueVec& vals) const;
+    // merge impulses falling in the same one of 'bincount' equal
+    // sub-ranges of [min,max] into one impulse at their weighted mean
+    static void collapseImpulses(WeightedValueVec& vals, unsigned bincount,
+                                 double min, double max);
+    // one step of a product: every impulse of vals times every
+    // impulse of other, replacing the contents of out
+    static void crossImpulses(const WeightedValueVec& vals,
+                              const CPHistogram& other,
+                              WeightedValueVec& out);
+
     // update incremental statistics with weights/values from list
     //void updateStats(const WeightedValueVec vals);
     // reset stats by estimating from current histogram
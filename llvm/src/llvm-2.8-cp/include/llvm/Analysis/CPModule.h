@@ -0,0 +1,53 @@
+//===- CPModule.h ---------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Support for lazily-loaded modules (getLazyBitcodeModule) in the CP
+// classes.  They only need function order, CFG shape and the direct
+// calls in each block, so function bodies are read in one at a time
+// while the program structure is computed, and dropped again as soon
+// as it has been.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPMODULE_H
+#define CPMODULE_H
+
+namespace llvm {
+
+  class Function;
+
+  // In a lazily-loaded module, a function whose body has not been read
+  // in is still a definition.
+  bool isCPDefinition(const Function& F);
+
+  // Reads F's body in, if it isn't already, for the lifetime of the
+  // object, and drops it again afterwards.  Pointers into a temporary
+  // body must not outlive the CPFunctionBody.
+  class CPFunctionBody {
+  public:
+    explicit CPFunctionBody(Function& F);
+    ~CPFunctionBody();
+
+    // false if the body could not be read
+    bool ok() const {return(_ok);};
+    // true if the body will be dropped on destruction
+    bool temporary() const {return(_temporary);};
+
+  private:
+    Function& _F;
+    bool _ok;
+    bool _temporary;
+
+    CPFunctionBody(); // do not implement
+    CPFunctionBody(const CPFunctionBody&); // do not implement
+  };
+
+} // namespace llvm
+
+#endif // CPMODULE_H
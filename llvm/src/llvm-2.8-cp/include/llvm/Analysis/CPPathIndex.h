@@ -0,0 +1,108 @@
+//===- CPPathIndex.h ------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Hot path queries over a combined path profile.  The paths of each
+// function are ranked once, when the index is built, by one statistic
+// of their histograms:
+//
+//   mean      the path's mean frequency (executions per call of the
+//             function), counting the runs it did not execute in as 0
+//   quantile  the q quantile of that frequency, also counting the 0s
+//   coverage  the fraction of runs the path executed in
+//
+// The top K paths of a function, or the fewest best paths that carry
+// a given fraction of its path executions (by mean frequency), are
+// then a prefix of its ranking.  Decoded block sequences are kept, so each
+// path is only walked through the Ball-Larus DAG once.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPPATHINDEX_H
+#define CPPATHINDEX_H
+
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/PathProfileInfo.h"
+
+#include <map>
+#include <vector>
+
+namespace llvm {
+
+  class BallLarusDag;
+  class CPFunctionBody;
+  class Function;
+
+  enum CPPathRank {
+    CPRankMean,
+    CPRankQuantile,
+    CPRankCoverage
+  };
+
+  struct CPHotPath {
+    PathIndex path;
+    double score;  // the ranking statistic
+    double freq;   // mean frequency
+  };
+
+  typedef std::vector<CPHotPath> CPHotPathVec;
+
+  class CPPathIndex {
+  public:
+    // q is only used by CPRankQuantile
+    explicit CPPathIndex(CombinedPathProfile& cpp,
+                         CPPathRank rank = CPRankMean, double q = 0.5);
+    ~CPPathIndex();
+
+    CPPathRank getRank() const {return(_rank);};
+    static const char* getRankName(CPPathRank rank);
+
+    // functions with paths in the profile, in number order
+    void getFunctions(std::vector<FunctionIndex>& functions) const;
+    FunctionIndex getFunctionIndex(Function* F) const;
+
+    // every path of f in the profile, best first
+    const CPHotPathVec& getPaths(FunctionIndex f) const;
+    // the (up to) k best paths of f
+    void getTopPaths(FunctionIndex f, unsigned k, CPHotPathVec& paths) const;
+    // the fewest best paths of f whose frequencies add up to at least
+    // fraction of f's total
+    void getCoveringPaths(FunctionIndex f, double fraction,
+                          CPHotPathVec& paths) const;
+
+    // The blocks of path p of f, in execution order.  f's body is read
+    // in, if it has to be, and kept until the index is destroyed, so
+    // the blocks stay valid as long as the index does.
+    const PathBlockVector& getPathBlocks(FunctionIndex f, PathIndex p);
+
+  private:
+    typedef std::map<FunctionIndex,CPHotPathVec> RankMap;
+    typedef std::map<FunctionIndex,std::vector<double> > FreqMap;
+    typedef std::map<PathID,PathBlockVector> BlockMap;
+    typedef std::map<FunctionIndex,CPFunctionBody*> BodyMap;
+
+    CombinedPathProfile& _cpp;
+    CPPathRank _rank;
+
+    RankMap _ranked;
+    FreqMap _cumulative;  // running total of the ranked frequencies
+
+    // decoded paths, the bodies they point into, and the DAG of the
+    // last function decoded
+    BlockMap _blocks;
+    BodyMap _bodies;
+    BallLarusDag* _dag;
+    FunctionIndex _dagFunction;
+
+    CPPathIndex(); // do not implement
+    CPPathIndex(const CPPathIndex&); // do not implement
+  };
+
+} // namespace llvm
+
+#endif // CPPATHINDEX_H
@@ -0,0 +1,111 @@
+//===- CPServer.h ---------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Long-lived profile server for the CP tools.  The module, the static
+// structure of the CP classes (edge dominator tree, call maps) and
+// every combined profile that has been loaded stay resident between
+// commands, so repeated merges and queries only pay for reading the
+// profile data itself.
+//
+// Commands are read one per line; words are separated by whitespace:
+//
+//   merge <out.cp> <in>...     build a combined profile, like llvm-cprof
+//   summary <cp>               like llvm-cpmetrics -summary
+//   stats <cp>                 like llvm-cpmetrics -stats
+//   print <cp>                 like llvm-cpmetrics -print
+//   drift <cp1> <cp2> [emd]    like llvm-cpmetrics -drift [-emd]
+//   query <cp> <index>         print one histogram; <func>-<path> for paths
+//   load <cp>                  load (or reload) a profile into the cache
+//   drop [<cp>]                evict one, or all, cached profiles
+//   watch <raw>...             add raw runs to the convergence monitor
+//                              (CPConvergence.h); prints each run's drift
+//   converged <tol> <window>   "yes" if the last <window> runs drifted
+//                              less than <tol>, else "no"
+//   unwatch                    forget the runs added by watch
+//   quit                       stop the server
+//
+// The output of every command is followed by a line that is either
+// "ok" or "error: <reason>".  Cached profiles are reloaded when the
+// file's modification time changes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPSERVER_H
+#define CPSERVER_H
+
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/System/TimeValue.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+  class Module;
+  class CombinedProfile;
+  class CPConvergence;
+
+  class CPServer {
+  public:
+    explicit CPServer(Module& M, unsigned driftThreads = 1);
+    ~CPServer();
+
+    // execute one command line; returns false if the command failed
+    bool execute(const std::string& line, llvm::raw_ostream& out);
+
+    // serve commands from in until EOF or quit
+    void serve(FILE* in, llvm::raw_ostream& out);
+
+    // serve connections on a Unix domain socket, one at a time, until
+    // a client sends quit.  Returns false if the socket can't be set up
+    // or accept fails with anything but EINTR or ECONNABORTED.
+    bool serveSocket(const std::string& path);
+
+    bool quitRequested() const {return(_quit);};
+
+    // evict cached profiles
+    void drop(const std::string& filename);
+    void dropAll();
+
+  private:
+    struct CacheEntry {
+      CacheEntry(CombinedProfile* c, const sys::TimeValue& t) :
+        cp(c), modTime(t) {};
+      CombinedProfile* cp;
+      sys::TimeValue modTime;
+    };
+    typedef std::map<std::string,CacheEntry> CPCache;
+    typedef std::vector<std::string> WordVec;
+
+    Module& _M;
+    unsigned _driftThreads;
+    bool _quit;
+    CPCache _cache;
+    CPConvergence* _watch;  // created by the first watch
+
+    CombinedProfile* getCP(const std::string& filename, std::string& error);
+
+    bool merge(const WordVec& words, std::string& error);
+    bool watch(const WordVec& words, llvm::raw_ostream& out,
+               std::string& error);
+    bool query(CombinedProfile* cp, const std::string& id,
+               llvm::raw_ostream& out, std::string& error);
+
+    static void split(const std::string& line, WordVec& words);
+
+  private:
+    CPServer(); // do not implement
+    CPServer(const CPServer&); // do not implement
+  }; // CPServer
+
+} // namespace llvm
+
+#endif // CPSERVER_H
@@ -0,0 +1,75 @@
+//===- CPStats.h ----------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Phase timers and counters for the combined profiling code.  With
+// -time-cprof, the phases below are timed in a "Combined Profiling"
+// TimerGroup and the counters are kept; a tool's -stats may turn on
+// just the counters.  Both are printed to stderr at llvm_shutdown.
+//
+// Phases nest where the work does: reading the first edge profile
+// includes building the EDT, and with a lazily read module, building
+// the EDT includes reading the function bodies.
+//
+// When disabled, a phase is a TimeRegion on a NULL timer and a counter
+// is a test of a flag.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPSTATS_H
+#define CPSTATS_H
+
+#include "llvm/System/DataTypes.h"
+
+namespace llvm {
+
+  class Timer;
+  class raw_ostream;
+
+  enum CPPhase {
+    CPTimeBitcode,       // reading the module
+    CPTimeEDT,           // CombinedEdgeProfile constructor
+    CPTimeReadRaw,       // raw profiles, into add lists
+    CPTimeReadCombined,  // combined profiles, and remapping them
+    CPTimeBuild,         // buildHistograms
+    CPTimeMerge,         // buildFromList
+    CPTimeWrite,         // serialize/serializeIndexed
+    CPNumPhases
+  };
+
+  enum CPCounter {
+    CPHistogramsBuilt,   // from add lists, or by merging
+    CPSamplesAdded,      // raw values put on add lists
+    CPBytesRead,         // profile files read
+    CPBytesWritten,      // combined profiles written
+    CPNumCounters
+  };
+
+  class CPStats {
+  public:
+    static bool Timing;    // -time-cprof
+    static bool Counting;  // a tool's -stats
+
+    // the timer of a phase, for a TimeRegion; NULL unless timing
+    static Timer* getTimer(CPPhase phase)
+    {return(Timing ? getPhaseTimer(phase) : 0);};
+
+    static void count(CPCounter counter, uint64_t n = 1)
+    {if(Timing || Counting) addCount(counter, n);};
+
+    // print the timers that ran and the counters, and reset them
+    static void print(raw_ostream& stream);
+
+  private:
+    static Timer* getPhaseTimer(CPPhase phase);
+    static void addCount(CPCounter counter, uint64_t n);
+  };
+
+} // namespace llvm
+
+#endif // CPSTATS_H
@@ -24,17 +24,24 @@
 #include <map>
 #include <set>
 #include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPFunctionKeys.h"
 
 #define DEFAULT_BINS 20
 
+// _lazyOffsets entry for a histogram that is not in the mapped file
+#define CP_NOT_INDEXED (~0u)
+
 namespace llvm {
   class Module;
   class Function;
   class EdgeDominatorTree;
+  class MemoryBuffer;
 	class CombinedProfile;
 	class CombinedEdgeProfile;
 	class CombinedPathProfile;
   class CombinedCallProfile;
+  class CombinedTripCountProfile;
+  class CombinedValueProfile;
 
 	// --------------------------------------------------------------------------
 	// CombinedProfile - Implements a set of common functions and variables used
@@ -45,8 +52,29 @@ namespace llvm {
 
   typedef std::set<unsigned> IndexSet;
 
+  typedef std::vector<unsigned> UnsignedVec;
+  typedef std::vector<Function*> FunctionVec;
+
 	typedef std::list<CombinedProfile*> CPList;
 
+  // A mapped profile file, shared by the profiles of its indexed
+  // sections.  The file is unmapped when the last one releases it.
+  class CPMappedFile {
+  public:
+    explicit CPMappedFile(MemoryBuffer* buffer) : _buffer(buffer), _refs(0) {}
+
+    const MemoryBuffer& getBuffer() const {return(*_buffer);};
+    void retain() {_refs++;};
+    void release() {if(--_refs == 0) delete this;};
+
+  private:
+    MemoryBuffer* _buffer;
+    unsigned _refs;
+
+    ~CPMappedFile();
+    CPMappedFile(const CPMappedFile&); // do not implement
+  };
+
   class CombinedProfile {
   public:
 		CombinedProfile();
@@ -63,6 +91,12 @@ namespace llvm {
 
     // read in a raw profile from the file
     virtual bool addProfile(FILE* file) = 0;
+    // Fold a raw profile into the built (or read, or mapped) histograms
+    // in place with CPHistogram::addValue, instead of the add lists.
+    // Only the histograms the run reaches are read or changed.  For the
+    // rest, the run's 0 is just the bump to the profile weight: it is
+    // their total weight when they are written or first read.
+    bool updateProfile(FILE* file);
 		virtual unsigned serialize(FILE* f) = 0;
 		virtual bool deserialize(FILE* f) = 0;
 
@@ -70,6 +104,29 @@ namespace llvm {
 		void buildHistograms(unsigned binCount);
     virtual bool buildFromList(CPList& list, unsigned bincount = 0) = 0;
 
+    // Indexed format: an offset table in front of the histograms, so
+    // one histogram can be read without reading the rest.  The
+    // section starts with IndexedCombinedInfo and getProfilingType();
+    // (de)serializeIndexed handle everything after those two words.
+    unsigned serializeIndexed(FILE* f);
+    bool deserializeIndexed(FILE* f);
+    // Map the indexed section at offset in file (after the two type
+    // words) and read histograms as they are accessed through
+    // operator[]/getHistogram/getHistogramAt.  Holds on to file until
+    // everything is read.  On success, offset is moved past the
+    // section.
+    bool mapIndexed(CPMappedFile* file, unsigned& offset);
+    // read any histograms not accessed yet and release the file; done
+    // by everything that walks all histograms
+    void materializeAll();
+
+    // Stale profiles (CPFunctionKeys.h).  setLayout makes room for a
+    // section written for the functions in keys; read it, then
+    // remapFunctions moves the histograms of the functions map matches
+    // to their place in this module and drops the rest.
+    virtual void setLayout(const CPFunctionKeys& keys) = 0;
+    virtual bool remapFunctions(const CPFunctionMap& map) = 0;
+
     // print various info
     void print(llvm::raw_ostream& stream);
     void printHistogramInfo(llvm::raw_ostream& stream);
@@ -82,8 +139,18 @@ namespace llvm {
     unsigned calcBinCount(CPList& list, unsigned fallback = DEFAULT_BINS) const;
 		double getTotalWeight() const;
 		void addWeight(double w = 1.0);
+    // Weight of each raw run read by addProfile from now on (default
+    // 1.0); a run from an older input counts for less.
+    void setRunWeight(double w) {_runWeight = w;};
+    // Multiply the profile's weight and every histogram's by f
+    // (CPHistogram::scale).  Nothing is re-binned, so an old profile
+    // can be decayed before it is merged with new data.
+    void scaleWeight(double f);
 
     unsigned size() const {return(_histograms.size());};
+    // NULL if the index is out of range or the histogram is not
+    // allocated; a mapped histogram is read on first access
+    const CPHistogram* getHistogramAt(unsigned i) const;
     CPHistVec::iterator begin() {return(_histograms.begin());};
     CPHistVec::iterator end() {return(_histograms.begin());};
 
@@ -92,10 +159,40 @@ namespace llvm {
 
 	protected:
 		double _weight;
+    double _runWeight;
 		unsigned _bincount;
+    // set while updateProfile runs addProfile
+    bool _inPlace;
     // the actual histograms.  build an index map on top of
     // _histograms if you need a sparse/non-int mapping from ID-->histogram
     CPHistVec _histograms;  
+
+    // mapped indexed profile: byte offset of each _histograms slot
+    // that hasn't been read yet, relative to _lazyData
+    CPMappedFile* _lazyFile;
+    const char* _lazyData;
+    const char* _lazyEnd;
+    std::vector<unsigned> _lazyOffsets;
+
+    // the histograms to write to an indexed file, in order; offset
+    // holds the index in _histograms
+    virtual void getIndexOrder(std::vector<CPIndexEntry>& order) const = 0;
+    // the _histograms slot for a histogram read from an indexed file,
+    // or CP_NOT_INDEXED if it doesn't fit this profile
+    virtual unsigned addIndexedSlot(unsigned fnNumber, unsigned ID) = 0;
+
+    // add a raw run's value to h: to the add list, or to the bins
+    // when updating in place
+    void addRunValue(CPHistogram& h, double v, double w);
+
+    // setLayout/remapFunctions for profiles numbered by position: each
+    // function has a run of getSlots(key, kind) histograms
+    void setSlotLayout(const CPFunctionKeys& keys, CPSlotKind kind);
+    bool remapSlots(const CPFunctionMap& map, CPSlotKind kind);
+
+    bool readIndexed(const char*& data, const char* end, bool lazy);
+    // read slot i from the mapped file; NULL if it isn't there
+    CPHistogram* materialize(unsigned i);
   };  // class (virtual) CombinedProfile
 
   // --------------------------------------------------------------------------
@@ -115,6 +212,21 @@ namespace llvm {
     ProfilingType getProfilingType() const {return(CombinedEdgeInfo);};
 
     bool addProfile(FILE* f);
+    // the per-edge values addProfile would add for a raw profile
+    bool readNormalized(FILE* f, std::vector<double>& freqs) const;
+    // same, for edge counts already read
+    bool normalize(const std::vector<unsigned>& counts,
+                   std::vector<double>& freqs) const;
+    // add one run's edge counts, as addProfile does
+    bool addCounts(const std::vector<unsigned>& counts);
+
+    // Project a raw path profile (after the PathInfo word) onto the
+    // edges: each path's count goes to every CFG edge it takes,
+    // including the back edge that ends it.  The entry edge counts
+    // the paths that start at the function's entry.
+    bool readPathCounts(FILE* f, std::vector<unsigned>& counts);
+    // addProfile for the edge counts of a raw path profile
+    bool addPathProfile(FILE* f);
 		unsigned serialize(FILE* f);
 		bool deserialize(FILE* f);
     
@@ -125,10 +237,27 @@ namespace llvm {
     
     CPHistogram* operator[](const int index);
 
+    void setLayout(const CPFunctionKeys& keys)
+    {setSlotLayout(keys, CPEdgeSlots);};
+    bool remapFunctions(const CPFunctionMap& map)
+    {return(remapSlots(map, CPEdgeSlots));};
+
     static void freeStaticData();
 
+  protected:
+    void getIndexOrder(std::vector<CPIndexEntry>& order) const;
+    unsigned addIndexedSlot(unsigned fnNumber, unsigned ID);
+
 	private:
     static EdgeDominatorTree* _edt;
+    Module* _module;
+    // for readPathCounts: the path-profiled functions, in function
+    // number order, and the index of each one's entry edge
+    FunctionVec _pathFunctions;
+    UnsignedVec _firstEdge;
+
+    void addFunctionPaths(Function& F, const PathTableEntry* paths,
+                          unsigned pathCount, unsigned* counts);
   };  // class CombinedEdgeProfile
 
 
@@ -174,6 +303,8 @@ namespace llvm {
                     llvm::raw_ostream& stream);
 
 		unsigned getFunctionCount() const;
+    // the function with number f (from 1), or NULL
+    Function* getFunction(FunctionIndex f) const;
     bool valid(const PathID& path) const;
     CPHistogram& getHistogram(const FunctionIndex funcIndex, 
                               const PathIndex pathIndex);
@@ -182,12 +313,21 @@ namespace llvm {
 
     void getPathSet(PathSet& paths) const;
 
+    void setLayout(const CPFunctionKeys& keys)
+    {_functionCount = keys.size();};
+    bool remapFunctions(const CPFunctionMap& map);
+
     static void freeStaticData() {};
 
+  protected:
+    void getIndexOrder(std::vector<CPIndexEntry>& order) const;
+    unsigned addIndexedSlot(unsigned fnNumber, unsigned ID);
+
 	private:
     //_functions can't be static because mapping is not consistent
 		CPPFunctionMap _functions; // sparse map <funcID,pathID> --> histogram index
     std::vector<Function*> _functionRef;
+    unsigned _functionCount;  // functions in the layout being read
   }; // class CombinedPathProfile
 
 
@@ -203,9 +343,6 @@ namespace llvm {
   typedef std::map<BasicBlock*,unsigned> CallProfileMap;
   typedef std::map<Function*,unsigned> FunctionFreqMap;
 
-  typedef std::vector<unsigned> UnsignedVec;
-  typedef std::vector<Function*> FunctionVec;
-
   class CombinedCallProfile : public CombinedProfile {
 	public:
     explicit CombinedCallProfile(Module& M);
@@ -222,6 +359,9 @@ namespace llvm {
     bool deserialize(FILE* f);
 
     bool addProfile(FILE* f);
+    // the per-block values addProfile would add for a raw profile
+    // (0 where it would add nothing)
+    bool readNormalized(FILE* f, std::vector<double>& freqs) const;
 
     //static unsigned calcBinCount(CCPList& list, 
     //                             unsigned fallback = DEFAULT_BINS);
@@ -235,12 +375,21 @@ namespace llvm {
 
     // !! void getCallSet(CallSet& calls) const;
 
-    bool isFDOInliningCandidate(Instruction* I);
-    bool hasFDOInliningCandidate(BasicBlock* BB);
+    static bool isFDOInliningCandidate(Instruction* I);
+    static bool hasFDOInliningCandidate(BasicBlock* BB);
+
+    void setLayout(const CPFunctionKeys& keys)
+    {setSlotLayout(keys, CPCallSlots);};
+    bool remapFunctions(const CPFunctionMap& map)
+    {return(remapSlots(map, CPCallSlots));};
 
     static void freeStaticData() { _profmap.clear(); _funcIndex.clear(); 
       _funcRef.clear(); _entryCalls.clear(); _histCnt = 0; }
 
+  protected:
+    void getIndexOrder(std::vector<CPIndexEntry>& order) const;
+    unsigned addIndexedSlot(unsigned fnNumber, unsigned ID);
+
 	private:
     // Program structure mappings only need to be computed once!
     static CallProfileMap _profmap;  // instr. BB --> index in _histograms
@@ -248,13 +397,145 @@ namespace llvm {
     static FunctionVec _funcRef;     // function index --> function
     static UnsignedVec _entryCalls;  // counter indexes of entry BBs w/ calls
     static unsigned _histCnt;        // number of histograms
-    UnsignedVec _funcFreq;    // function index --> entry frequency
+    UnsignedVec _funcFreq;    // one per function (only the size is used)
 
     // Use CS.getParent() to get BB; look up profile in _profmap.
 
   };  // class CombinedCallProfile
 
 
+  // --------------------------------------------------------------------------
+  // Combined Trip Count Profile
+  // --------------------------------------------------------------------------
+
+  // Loops are numbered per function by the position of their header
+  // in the block list (see getLoopHeaders), and across the module in
+  // function order.  Each histogram holds the header executions per
+  // invocation of one loop, each run weighted equally.
+
+  typedef unsigned LoopIndex;
+
+  class CombinedTripCountProfile : public CombinedProfile {
+	public:
+    explicit CombinedTripCountProfile(Module& M);
+
+    const std::string& getNameStr() const 
+    {
+      static const std::string type="tripcount";
+      return(type);
+    };
+
+    ProfilingType getProfilingType() const {return(CombinedTripCountInfo);};
+
+    unsigned serialize(FILE* f);
+    bool deserialize(FILE* f);
+
+    bool addProfile(FILE* f);
+
+    bool buildFromList(CPList& list, unsigned binCount);
+
+    // functions are numbered from 0, in module order
+    unsigned getFunctionCount() const {return(_firstLoop.size()-1);};
+    unsigned getLoopCount(FunctionIndex f) const
+    {return(_firstLoop[f+1] - _firstLoop[f]);};
+
+    CPHistogram& operator[](const unsigned index);
+    CPHistogram& getHistogram(FunctionIndex f, LoopIndex l)
+    {return( (*this)[_firstLoop[f] + l] );};
+
+    // the headers of F's reachable natural loops, in block order
+    static void getLoopHeaders(Function& F, 
+                               std::vector<BasicBlock*>& headers);
+    // the trip count represented by a raw profile bucket
+    static double bucketValue(unsigned bucket);
+
+    void setLayout(const CPFunctionKeys& keys)
+    {setSlotLayout(keys, CPLoopSlots);};
+    bool remapFunctions(const CPFunctionMap& map)
+    {return(remapSlots(map, CPLoopSlots));};
+
+    static void freeStaticData() {};
+
+  protected:
+    void getIndexOrder(std::vector<CPIndexEntry>& order) const;
+    unsigned addIndexedSlot(unsigned fnNumber, unsigned ID);
+
+	private:
+    // function index --> index of its first loop; one extra entry
+    // holds the number of loops in the module
+    UnsignedVec _firstLoop;
+  };  // class CombinedTripCountProfile
+
+
+  // --------------------------------------------------------------------------
+  // Combined Value Profile
+  // --------------------------------------------------------------------------
+
+  // Indirect call sites are numbered in instruction order (see
+  // getIndirectCalls), across the module in function order.  Targets
+  // are function numbers from 1, in module order; each target's
+  // histogram holds its share of the site's calls.  Target
+  // CVP_ALL_TARGETS holds the number of calls at the site per run.
+
+  typedef unsigned SiteIndex;
+  typedef unsigned TargetIndex;
+
+#define CVP_ALL_TARGETS 0
+
+  // TargetIndex --> index in _histograms
+  typedef std::map<TargetIndex,unsigned> CVPTargetMap;
+  typedef std::map<SiteIndex,CVPTargetMap> CVPSiteMap;
+
+  class CombinedValueProfile : public CombinedProfile {
+	public:
+    explicit CombinedValueProfile(Module& M);
+
+    const std::string& getNameStr() const 
+    {
+      static const std::string type="value";
+      return(type);
+    };
+
+    ProfilingType getProfilingType() const {return(CombinedValueInfo);};
+
+    unsigned serialize(FILE* f);
+    bool deserialize(FILE* f);
+
+    bool addProfile(FILE* f);
+
+    bool buildFromList(CPList& list, unsigned binCount);
+
+    unsigned getSiteCount() const {return(_siteCount);};
+    // the targets seen at site, in target order, without CVP_ALL_TARGETS
+    void getTargets(SiteIndex site, std::vector<TargetIndex>& targets) const;
+    Function* getTarget(TargetIndex t) const
+    {return( ((t > 0) && (t <= _functionRef.size())) 
+             ? _functionRef[t-1] : NULL );};
+
+    bool valid(SiteIndex site, TargetIndex target) const;
+    CPHistogram& getHistogram(SiteIndex site, TargetIndex target);
+
+    // the indirect call sites of F, in instruction order
+    static void getIndirectCalls(Function& F,
+                                 std::vector<Instruction*>& calls);
+    static bool isIndirectCall(Instruction* I);
+
+    void setLayout(const CPFunctionKeys& keys);
+    bool remapFunctions(const CPFunctionMap& map);
+
+    static void freeStaticData() {};
+
+  protected:
+    void getIndexOrder(std::vector<CPIndexEntry>& order) const;
+    unsigned addIndexedSlot(unsigned fnNumber, unsigned ID);
+
+	private:
+    CVPSiteMap _sites;  // sparse map <site,target> --> histogram index
+    FunctionVec _functionRef;
+    unsigned _siteCount;
+  };  // class CombinedValueProfile
+
+
 }  // namespace llvm
 
 #endif
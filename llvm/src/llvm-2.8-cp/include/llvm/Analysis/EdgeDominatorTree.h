@@ -17,6 +17,7 @@
 #include <set>
 #include <map>
 #include <list>
+#include <vector>
 
 // short version of set_intersection for IndexSets
 #define INTERSECT(s1, s2, outSet) set_intersection(s1.begin(), s1.end(), s2.begin(), s2.end(), std::insert_iterator<IndexSet>(outSet,outSet.begin()))
@@ -105,13 +106,15 @@ namespace llvm {
   };
 
 
+  // Edge dominance for a whole module, by EdgeIndex.  Its EdgeNodes
+  // have no source or target blocks: use CFGEdgeDomTree for those.
   class EdgeDominatorTree {
   public:
 		EdgeDominatorTree(Module& M);
     ~EdgeDominatorTree();
     
-		unsigned getDominatorIndex(EdgeIndex e);
-		unsigned getEdgeCount();
+		unsigned getDominatorIndex(EdgeIndex e) const;
+		unsigned getEdgeCount() const;
     unsigned getDepth(EdgeIndex e);
     
 		void writeToFile(std::string filename);
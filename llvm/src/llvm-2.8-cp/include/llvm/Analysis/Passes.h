@@ -94,6 +94,13 @@ namespace llvm {
   ModulePass *createProfileLoaderPass();
   extern char &ProfileLoaderPassID;
 
+  //===--------------------------------------------------------------------===//
+  //
+  // createCombinedProfileInfoPass - This pass provides edge weights from a
+  // combined edge profile, using one statistic of each edge histogram.
+  //
+  ModulePass *createCombinedProfileInfoPass();
+
   //===--------------------------------------------------------------------===//
   //
   // createNoProfileInfoPass - This pass implements the default "no profile".
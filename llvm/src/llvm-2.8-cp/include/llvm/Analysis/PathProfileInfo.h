@@ -22,6 +22,7 @@ namespace llvm {
 	class Path;
   class PathEdge;
   class PathProfileInfo;
+  class CPPathIndex;
 
   typedef std::vector<PathEdge> PathEdgeVector;
   typedef std::vector<PathEdge>::iterator PathEdgeIterator;
@@ -93,12 +94,21 @@ namespace llvm {
     PathIterator pathEnd();
 		unsigned int pathsRun();
 
+    // the blocks of path number along dag, in execution order
+    static void decodePathBlocks(BallLarusDag& dag, unsigned int number,
+                                 PathBlockVector& blocks);
+
+    // hot paths of the combined path profile loaded, or NULL if the
+    // profile was a raw one (see CPPathIndex.h)
+    CPPathIndex* getPathIndex() const;
+
     static char ID; // Pass identification
 		std::string argList;
 
   protected:
     FunctionPathMap _functionPaths;
     FunctionPathCountMap _functionPathCounts;
+    CPPathIndex* _pathIndex;
 
   private:
     BallLarusDag* _currentDag;
@@ -243,6 +243,10 @@ namespace llvm {
   /// it available to the optimizers.
   Pass *createProfileLoaderPass(const std::string &Filename);
 
+  /// createCombinedProfileInfoPass - Like createProfileLoaderPass, for a
+  /// combined edge profile.
+  Pass *createCombinedProfileInfoPass(const std::string &Filename);
+
 } // End llvm namespace
 
 #endif
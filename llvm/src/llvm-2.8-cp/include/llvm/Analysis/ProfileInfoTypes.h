@@ -31,9 +31,37 @@ enum ProfilingType {
   CombinedEdgeInfo = 8, /* Combined edge profiling information */
   CombinedPathInfo = 9, /* Combined path profiling information */
   CallInfo         = 10, /* Callgraph profiling information */
-  CombinedCallInfo = 11 /* Combeind callgraph profiling information */
+  CombinedCallInfo = 11, /* Combeind callgraph profiling information */
+  IndexedCombinedInfo = 12, /* Combined profile with a histogram index */
+  TripCountInfo    = 13, /* Loop trip count profiling information */
+  CombinedTripCountInfo = 14, /* Combined loop trip count information */
+  ValueInfo        = 15, /* Indirect call target profiling information */
+  CombinedValueInfo = 16, /* Combined indirect call target information */
+  CombinedFunctionKeys = 17 /* Identity of the functions of combined profiles */
 };
 
+/*
+ * Raw trip count profiles hold TRIPCOUNT_BUCKETS counters per loop.
+ * Bucket b < TRIPCOUNT_EXACT counts the loop invocations that ran the
+ * header exactly b times; bucket TRIPCOUNT_EXACT+k counts those that
+ * ran it [TRIPCOUNT_EXACT<<k, TRIPCOUNT_EXACT<<(k+1)) times.  The last
+ * bucket is open-ended.
+ */
+#define TRIPCOUNT_EXACT   16
+#define TRIPCOUNT_BUCKETS 32
+
+/*
+ * Raw value profiles hold VALUE_SITE_COUNTERS counters per indirect
+ * call site: VALUE_TARGETS pairs of (target, count), then the count of
+ * calls to any other target.  Targets are function numbers (from 1, in
+ * module order among definitions); 0 marks an unused pair.  Pairs are
+ * claimed by the first targets seen at the site; once the other count
+ * exceeds the smallest pair's count, that pair goes to the next new
+ * target and its count to the other count.
+ */
+#define VALUE_TARGETS 4
+#define VALUE_SITE_COUNTERS (2*VALUE_TARGETS + 1)
+
 /*
  * The header for tables that map path numbers to path counters.
  */
@@ -71,4 +99,30 @@ typedef struct {
 	unsigned char binsUsed;
 } CPHistogramHeader;
 
+/*
+ * Locates one histogram of an indexed combined profile
+ */
+typedef struct {
+	unsigned fnNumber;  /* function (path) or site+1 (value), otherwise 0 */
+	unsigned ID;        /* histogram ID, as in CPHistogramHeader */
+	unsigned offset;    /* from the start of the histogram data */
+} CPIndexEntry;
+
+/*
+ * Identifies one function of the module a combined profile was built
+ * for, so the profile can be matched to a later build of the program.
+ * One per function, in the order function numbers are assigned.
+ */
+typedef struct {
+	unsigned nameHash[2];  /* 64-bit hash of the name, low word first */
+	unsigned cfgChecksum;  /* hash of each block's successors */
+	unsigned callChecksum; /* hash of the blocks with inlining candidates */
+	unsigned loopChecksum; /* hash of the loop headers */
+	unsigned siteChecksum; /* hash of each block's indirect call count */
+	unsigned edges;        /* edge profile histograms */
+	unsigned callBlocks;   /* call profile histograms */
+	unsigned loops;        /* trip count profile histograms */
+	unsigned sites;        /* value profile call sites */
+} CPFunctionKey;
+
 #endif /* LLVM_ANALYSIS_PROFILEINFOTYPES_H */
@@ -11,6 +11,7 @@
 #ifndef LLVM_CODEGEN_CALCSPILLWEIGHTS_H
 #define LLVM_CODEGEN_CALCSPILLWEIGHTS_H
 
+#include "llvm/CodeGen/MachineCPWeights.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/ADT/DenseMap.h"
 
@@ -21,16 +22,20 @@ namespace llvm {
   class MachineLoopInfo;
 
   /// VirtRegAuxInfo - Calculate auxiliary information for a virtual
-  /// register such as its spill weight and allocation hint.
+  /// register such as its spill weight and allocation hint.  Given a
+  /// profile, uses in profiled functions are weighted by block frequency
+  /// instead of loop depth.
   class VirtRegAuxInfo {
     MachineFunction &mf_;
     LiveIntervals &lis_;
     const MachineLoopInfo &loops_;
+    const MachineCPWeights *profile_;
     DenseMap<unsigned, float> hint_;
   public:
     VirtRegAuxInfo(MachineFunction &mf, LiveIntervals &lis,
-                   const MachineLoopInfo &loops) :
-      mf_(mf), lis_(lis), loops_(loops) {}
+                   const MachineLoopInfo &loops,
+                   const MachineCPWeights *profile = 0) :
+      mf_(mf), lis_(lis), loops_(loops), profile_(profile) {}
 
     /// CalculateRegClass - recompute the register class for reg from its uses.
     /// Since the register class can affect the allocation hint, this function
@@ -48,13 +53,19 @@ namespace llvm {
   public:
     static char ID;
 
-    CalculateSpillWeights() : MachineFunctionPass(ID) {}
+    CalculateSpillWeights() : MachineFunctionPass(ID), haveProfile_(false) {}
 
     virtual void getAnalysisUsage(AnalysisUsage &au) const;
 
+    virtual bool doInitialization(Module &m);
+    virtual bool doFinalization(Module &m);
     virtual bool runOnMachineFunction(MachineFunction &fn);
 
   private:
+    /// Block frequencies from -spill-weight-cprof, if given.
+    MachineCPWeights profile_;
+    bool haveProfile_;
+
     /// Returns true if the given live interval is zero length.
     bool isZeroLengthInterval(LiveInterval *li) const;
   };
@@ -0,0 +1,47 @@
+//===-- llvm/CodeGen/MachineCPWeights.h - Profile weights of MBBs -*- C++ -*-=//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Combined edge profile weights of the IR, projected onto the machine CFG.
+// Machine blocks take the weights of the IR blocks they were made from;
+// blocks added by codegen (eg, for split critical edges) stand for the IR
+// edge or block around them.  Weights are per function entry.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CODEGEN_MACHINECPWEIGHTS_H
+#define LLVM_CODEGEN_MACHINECPWEIGHTS_H
+
+#include "llvm/Analysis/CPBlockWeights.h"
+
+namespace llvm {
+
+  class BasicBlock;
+  class MachineBasicBlock;
+
+  class MachineCPWeights : public CPBlockWeights {
+  public:
+    /// getEdgeWeight - The weight of the machine CFG edge Src->Dst.  Edges
+    /// within one IR block (which codegen splits, eg, to expand selects)
+    /// carry the block's weight.
+    double getEdgeWeight(const MachineBasicBlock *Src,
+                         const MachineBasicBlock *Dst) const;
+
+    /// getBlockWeight - The execution weight of MBB.
+    double getBlockWeight(const MachineBasicBlock *MBB) const;
+
+    /// getIRBlock - The IR block MBB was made from.  Blocks added by codegen
+    /// stand for the IR block they lead to (Forward) or come from, as long
+    /// as that is unambiguous.
+    static const BasicBlock *getIRBlock(const MachineBasicBlock *MBB,
+                                        bool Forward);
+  };
+
+}
+
+#endif // LLVM_CODEGEN_MACHINECPWEIGHTS_H
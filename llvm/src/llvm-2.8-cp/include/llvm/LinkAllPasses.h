@@ -73,6 +73,8 @@ namespace {
       (void) llvm::createOptimalEdgeProfilerPass();
       (void) llvm::createPathProfilerPass();
       (void) llvm::createCallProfilerPass();
+      (void) llvm::createTripCountProfilerPass();
+      (void) llvm::createValueProfilerPass();
       (void) llvm::createFunctionInliningPass();
       (void) llvm::createAlwaysInlinerPass();
       (void) llvm::createGlobalDCEPass();
@@ -103,6 +105,7 @@ namespace {
       (void) llvm::createProfileEstimatorPass();
       (void) llvm::createProfileVerifierPass();
       (void) llvm::createProfileLoaderPass();
+      (void) llvm::createCombinedProfileInfoPass();
       (void) llvm::createPathProfileLoaderPass();
       (void) llvm::createPathProfileVerifierPass();
       (void) llvm::createGenerateEdgeDominancePass();
@@ -156,6 +159,11 @@ namespace {
       (void) llvm::createCorrelatedValuePropagationPass();
 
       (void) llvm::createFDOInlinerPass();
+      (void) llvm::createFDOSplitterPass();
+      (void) llvm::createFDOFunctionOrderPass();
+      (void) llvm::createFDOSuperblockPass();
+      (void) llvm::createFDOCallPromotionPass();
+      (void) llvm::createFDOSpecializerPass();
 
       (void)new llvm::IntervalPartition();
       (void)new llvm::FindUsedTypes();
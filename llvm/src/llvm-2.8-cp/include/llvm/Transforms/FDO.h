@@ -28,6 +28,21 @@ namespace llvm {
   // FDO Inlining
   ModulePass* createFDOInlinerPass();
 
+  // FDO Hot/Cold Splitting
+  ModulePass* createFDOSplitterPass();
+
+  // FDO Function Ordering
+  ModulePass* createFDOFunctionOrderPass();
+
+  // FDO Superblock Formation
+  ModulePass* createFDOSuperblockPass();
+
+  // FDO Indirect Call Promotion
+  ModulePass* createFDOCallPromotionPass();
+
+  // FDO Function Specialization
+  ModulePass* createFDOSpecializerPass();
+
 } // End llvm namespace
 
 #endif
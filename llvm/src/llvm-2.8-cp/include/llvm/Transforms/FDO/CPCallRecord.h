@@ -100,8 +100,11 @@ namespace llvm {
     
     CPCallRecord(const CPCallRecord& rhs);
     CPCallRecord(CallSite C, const CPHistogram* P = NULL, double V = 0);
-    CPCallRecord(const CPCallRecord& callRec, const CPCallRecord& oldRec, 
-                 Function* inlinedFunc, const CallSite newCall);
+    // If product is given, it must be callRec.cphist x oldRec.cphist
+    // (eg, from CPHistogram::crossEach); the record takes ownership.
+    CPCallRecord(const CPCallRecord& callRec, const CPCallRecord& oldRec,
+                 Function* inlinedFunc, const CallSite newCall,
+                 CPHistogram* product = NULL);
     ~CPCallRecord();
     
     bool operator<(const CPCallRecord& rhs) const {return( mval < rhs.mval);};
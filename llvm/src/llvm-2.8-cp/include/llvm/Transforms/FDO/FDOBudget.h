@@ -0,0 +1,27 @@
+//===- FDOBudget.h - Code-growth budget for FDO transforms ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The code-growth budget shared by the FDO transforms that duplicate
+// code (inlining, tail duplication, ...).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_FDO_FDOBUDGET_H
+#define LLVM_TRANSFORMS_FDO_FDOBUDGET_H
+
+namespace llvm {
+
+  // Budget (IR instructions) for a program of size instructions.
+  // setting is the user's option: 0 is no limit, 1 computes a growth
+  // factor that shrinks with program size, anything else is the budget.
+  int computeFDOBudget(int size, unsigned setting);
+
+} // End llvm namespace
+
+#endif
@@ -16,12 +16,15 @@
 
 #include "llvm/Module.h"
 #include "llvm/Pass.h"
+#include "llvm/ADT/ValueMap.h"
 #include "llvm/Support/CallSite.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/FDO/CPCallRecord.h"
 #include "llvm/Transforms/FDO/TStream.h"
 #include <map>
 #include <list>
+#include <set>
+#include <vector>
 
 namespace llvm {
 
@@ -40,6 +43,17 @@ namespace llvm {
   typedef std::map<Function*, InlinedArrayAllocasTy> AllocaMap;
   typedef std::map<Function*, InlineFunctionInfo> IFIMap;
 
+  typedef std::set<BasicBlock*> BlockSet;
+
+  // entries go away with their blocks; a block that takes over another
+  // block's uses doesn't take over its flag
+  struct BlockFlagConfig : ValueMapConfig<const BasicBlock*> {
+    enum { FollowRAUW = false };
+  };
+  typedef ValueMap<const BasicBlock*,bool,BlockFlagConfig> BlockFlagMap;
+  typedef std::map<Function*,Function*> CloneMap;
+  typedef std::map<Instruction*,Instruction*> OriginMap;
+
   class FDOInliner : public ModulePass {
   public:
     static char ID;
@@ -134,6 +148,26 @@ namespace llvm {
     AllocaMap _allocas;   // per-caller inlined array allocas
     IFIMap    _funcInfo;  // per-caller inline function infos
 
+    // =====================
+    // Partial inlining
+    // =====================
+
+    // A callee too big for the budget can still have the part that is
+    // hot for every input inlined: the cold blocks (from a combined
+    // edge profile) are outlined from a clone of the callee, and the
+    // clone is inlined instead.  Code inlined into a cold block is
+    // cold.
+
+    bool findColdBlocks(Module& M);
+    Function* getHotClone(Function* callee, CallGraph& CG);
+    void addToCallGraph(Function* F, CallGraph& CG);
+    unsigned removeHotClones(CallGraph& CG);
+
+    BlockFlagMap _coldBlocks;   // cold blocks of every function
+    CloneMap    _hotClones;     // callee --> clone with cold code outlined
+    OriginMap   _cloneOrigins;  // call in a clone --> call in the callee
+    std::vector<Function*> _clones;
+
   
   }; // FDOInliner
 
@@ -31,6 +31,12 @@ ModulePass *createPathProfilerPass();
 // Insert callgraph profiling instrumentation
 ModulePass *createCallProfilerPass();
 
+// Insert loop trip count profiling instrumentation
+ModulePass *createTripCountProfilerPass();
+
+// Insert indirect call target (value) profiling instrumentation
+ModulePass *createValueProfilerPass();
+
 } // End llvm namespace
 
 #endif
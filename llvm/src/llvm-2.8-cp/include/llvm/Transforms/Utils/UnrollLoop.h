@@ -8,8 +8,8 @@
 //===----------------------------------------------------------------------===//
 //
 // This file defines some loop unrolling utilities. It does not define any
-// actual pass or policy, but provides a single function to perform loop
-// unrolling.
+// actual pass or policy, but provides functions to perform loop unrolling
+// and trip count versioning.
 //
 //===----------------------------------------------------------------------===//
 
@@ -21,8 +21,13 @@ namespace llvm {
 class Loop;
 class LoopInfo;
 class LPPassManager;
+class Pass;
 
-bool UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM);
+bool UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM,
+                unsigned TripCount = 0);
+
+Loop *VersionLoopByTripCount(Loop *L, unsigned TripCount, LoopInfo *LI,
+                             LPPassManager *LPM, Pass *P);
 
 }
 
@@ -310,6 +310,8 @@ void CFGEdgeDomTree::computeEdgeDominance()
     
     // if one ancestor is an ancestor of another, it is not the closest.
     // *don't* apply this pruning to the ancestorSets
+    // (collect first: erasing while iterating invalidates a1)
+    IndexSet pruned;
     for(IndexSetIterator a1 = ancestors.begin(), a1End = ancestors.end();
         a1 != a1End; a1++)
       for(IndexSetIterator a2 = ancestors.begin(), a2End = ancestors.end();
@@ -322,9 +324,12 @@ void CFGEdgeDomTree::computeEdgeDominance()
         {
           //errs() << "(" << currIndex << ")   Prune: " << *a1 
           //       << " dominates " << *a2 << "\n";
-          ancestors.erase(*a1);
+          pruned.insert(*a1);
         }
       }
+    for(IndexSetIterator p = pruned.begin(), pEnd = pruned.end();
+        p != pEnd; p++)
+      ancestors.erase(*p);
 
     //errs() << "(" << currIndex << ") Pruned Set:";
     //printIndexSet(errs(), ancestors);
@@ -0,0 +1,217 @@
+//===- CPBlockWeights.cpp -------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// IR edge and block weights from a combined edge profile.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/CPBlockWeights.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/Dominators.h"
+#include "llvm/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+
+void CPBlockWeights::clear()
+{
+  _edges.clear();
+  _blocks.clear();
+  _coverage.clear();
+  _profiled.clear();
+  _neverRan.clear();
+}
+
+
+double CPBlockWeights::statistic(CombinedEdgeProfile& cep, EdgeIndex e) const
+{
+  const CPHistogram* h = cep[e];
+  if( !h->nonZero() )
+    return(0);
+
+  switch(_stat)
+  {
+  case Mean:
+    return(h->mean(true));
+  case Quantile:
+    return(h->quantile(_quantile, true));
+  case MinCoverage:
+    return(h->min() * h->coverage());
+  }
+  return(0);
+}
+
+
+// A dominator can have a larger index than the edges it dominates, so
+// memoize rather than relying on index order.
+double CPBlockWeights::weight(CombinedEdgeProfile& cep, EdgeIndex e,
+                              EdgeNodeMap& edges,
+                              std::map<EdgeIndex,double>& done) const
+{
+  std::map<EdgeIndex,double>::iterator i = done.find(e);
+  if(i != done.end())
+    return(i->second);
+
+  EdgeNode* node = edges[e];
+  double w;
+  if(node->domIndex == e)
+    // roots other than the entry edge leave unreachable blocks
+    w = (node->source == NULL) ? 1.0 : 0.0;
+  else
+    w = statistic(cep, e) * weight(cep, node->domIndex, edges, done);
+
+  done[e] = w;
+  return(w);
+}
+
+
+bool CPBlockWeights::load(Module& M, const std::string& filename,
+                          Statistic stat, double quantile)
+{
+  clear();
+  _stat = stat;
+  _quantile = quantile;
+
+  CPFactory fact(M);
+  if( !fact.loadProfiles(filename) || !fact.hasEdgeCP() )
+  {
+    errs() << "CPBlockWeights::load Error: no combined edge profile in '"
+           << filename << "'\n";
+    return(false);
+  }
+  CombinedEdgeProfile* cep = fact.takeEdgeCP();
+
+  // number edges the same way as EdgeDominatorTree
+  bool ok = true;
+  EdgeIndex edgeCounter = 0;
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if(F->isDeclaration())
+      continue;
+
+    CFGEdgeDomTree funcEDT(*F, edgeCounter);
+    EdgeNodeMap* edges = funcEDT.claimEdgeMap((void*)this);
+    if(edgeCounter + edges->size() > cep->size())
+    {
+      errs() << "CPBlockWeights::load Error: combined profile is "
+             << "inconsistent with the current program\n";
+      funcEDT.unclaimEdgeMap((void*)this);
+      clear();
+      ok = false;
+      break;
+    }
+
+    std::map<EdgeIndex,double> done;
+    // the entry edge normalizes to 1 whether or not F ran, but the
+    // entry block's out-edges are only taken if it did
+    unsigned entryOut = 0, taken = 0;
+    for(EdgeNodeMapIterator i = edges->begin(), IE = edges->end();
+        i != IE; ++i)
+    {
+      EdgeNode* node = i->second;
+      double w = weight(*cep, i->first, *edges, done);
+      // parallel edges (eg, switch cases to the same block) add up
+      _edges[BlockEdge(node->source, node->target)] += w;
+      _blocks[node->target] += w;
+      _coverage[node->target] += (*cep)[i->first]->coverage();
+      if( (node->source != NULL) && (w > 0) )
+        _profiled.insert(F);
+      if(node->source == &F->getEntryBlock())
+      {
+        entryOut++;
+        if( (*cep)[i->first]->nonZero() )
+          taken++;
+      }
+    }
+    if( (entryOut > 0) && (taken == 0) )
+      _neverRan.insert(F);
+
+    edgeCounter += edges->size();
+    funcEDT.unclaimEdgeMap((void*)this);
+  }
+
+  if( ok && (edgeCounter != cep->size()) )
+    errs() << "CPBlockWeights::load Warning: combined profile has "
+           << cep->size() << " edges, the current program " << edgeCounter
+           << "\n";
+
+  delete cep;
+  CPFactory::freeStaticData();
+  return(ok);
+}
+
+
+double CPBlockWeights::edgeWeight(const BasicBlock* source,
+                                  const BasicBlock* target) const
+{
+  std::map<BlockEdge,double>::const_iterator i =
+    _edges.find(BlockEdge(source, target));
+  return( (i == _edges.end()) ? 0 : i->second );
+}
+
+
+double CPBlockWeights::blockWeight(const BasicBlock* BB) const
+{
+  std::map<const BasicBlock*,double>::const_iterator i = _blocks.find(BB);
+  return( (i == _blocks.end()) ? 0 : i->second );
+}
+
+
+double CPBlockWeights::blockCoverage(const BasicBlock* BB) const
+{
+  std::map<const BasicBlock*,double>::const_iterator i = _coverage.find(BB);
+  return( (i == _coverage.end()) ? 0 : i->second );
+}
+
+
+static void addSubtree(DomTreeNode* N, std::vector<BasicBlock*>& region)
+{
+  region.push_back(N->getBlock());
+  for(DomTreeNode::iterator C = N->begin(), E = N->end(); C != E; ++C)
+    addSubtree(*C, region);
+}
+
+
+// Returns true if every block dominated by N is cold, leaving N to the
+// caller; otherwise records the all-cold subtrees below N as regions.
+static bool findRegions(DomTreeNode* N, const std::set<BasicBlock*>& cold,
+                        std::vector<std::vector<BasicBlock*> >& regions)
+{
+  std::vector<DomTreeNode*> coldKids;
+  bool allCold = (cold.count(N->getBlock()) != 0);
+
+  for(DomTreeNode::iterator C = N->begin(), E = N->end(); C != E; ++C)
+  {
+    if(findRegions(*C, cold, regions))
+      coldKids.push_back(*C);
+    else
+      allCold = false;
+  }
+
+  if(allCold)
+    return(true);
+
+  for(unsigned i = 0; i < coldKids.size(); i++)
+  {
+    regions.push_back(std::vector<BasicBlock*>());
+    addSubtree(coldKids[i], regions.back());
+  }
+  return(false);
+}
+
+
+void llvm::findColdSubtrees(DominatorTree& DT,
+                            const std::set<BasicBlock*>& cold,
+                            std::vector<std::vector<BasicBlock*> >& regions)
+{
+  findRegions(DT.getRootNode(), cold, regions);
+}
@@ -0,0 +1,204 @@
+//===- CPConvergence.cpp --------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Incremental convergence monitor for profile collection.  See
+// CPConvergence.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/CPConvergence.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/ProfileInfoTypes.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace llvm;
+
+CPConvergence::CPConvergence(Module& M, unsigned bincount) :
+  _M(M), _bincount(bincount), _cep(NULL), _ccp(NULL), _edgeCount(0),
+  _sumWeight(0), _sumWeight2(0)
+{
+  if(_bincount == 0)
+    _bincount = DEFAULT_BINS;
+}
+
+
+CPConvergence::~CPConvergence()
+{
+  clear();
+  if(_cep != NULL) delete _cep;
+  if(_ccp != NULL) delete _ccp;
+}
+
+
+void CPConvergence::clear()
+{
+  for(unsigned i = 0; i < _histograms.size(); i++)
+    if(_histograms[i] != NULL)
+      delete _histograms[i];
+  _histograms.clear();
+  _edgeCount = 0;
+  _sumWeight = _sumWeight2 = 0;
+  _drift.clear();
+}
+
+
+bool CPConvergence::converged(double tolerance, unsigned window) const
+{
+  if( (window == 0) || (_drift.size() < window) )
+    return(false);
+
+  for(unsigned r = _drift.size() - window; r < _drift.size(); r++)
+    if(_drift[r] >= tolerance)
+      return(false);
+  return(true);
+}
+
+
+bool CPConvergence::addRun(const std::string& filename)
+{
+  FILE* file = fopen(filename.c_str(), "rb");
+  if(!file)
+  {
+    errs() << "CPConvergence::addRun Error: cannot open '" << filename
+           << "'\n";
+    return(false);
+  }
+
+  bool ok = addRun(file);
+  fclose(file);
+  return(ok);
+}
+
+
+bool CPConvergence::addRun(FILE* file)
+{
+  std::vector<double> edges, calls;
+  bool error = false;
+  ProfilingType profType;
+  while( !error && (fread(&profType, sizeof(ProfilingType), 1, file) > 0) )
+  {
+    switch(profType)
+    {
+    case ArgumentInfo:
+      error = !CPFactory::skipArgumentInfo(file);
+      break;
+
+    case EdgeInfo:
+      if(_cep == NULL) _cep = new CombinedEdgeProfile(_M);
+      error = !_cep->readNormalized(file, edges);
+      break;
+
+    case CallInfo:
+      if(_ccp == NULL) _ccp = new CombinedCallProfile(_M);
+      error = !_ccp->readNormalized(file, calls);
+      break;
+
+      // counter arrays that play no part in the edge and call profiles
+    case FunctionInfo:
+    case BlockInfo:
+    case TripCountInfo:
+    case ValueInfo:
+      {
+        unsigned count;
+        error = (fread(&count, sizeof(unsigned), 1, file) != 1) ||
+          (fseek(file, count * sizeof(unsigned), SEEK_CUR) != 0);
+        break;
+      }
+
+    default:
+      error = true;
+    }
+  }
+
+  if(error)
+  {
+    errs() << "CPConvergence::addRun Error: cannot read "
+           << CPFactory::profilingTypeToString(profType) << "\n";
+    return(false);
+  }
+
+  // the first run fixes the layout: edges, then call blocks
+  if(_drift.empty())
+  {
+    _edgeCount = edges.size();
+    _histograms.resize(edges.size() + calls.size(), NULL);
+  }
+  else if( (edges.size() != _edgeCount) ||
+           (_edgeCount + calls.size() != _histograms.size()) )
+  {
+    errs() << "CPConvergence::addRun Error: run does not match the "
+           << "earlier runs (" << edges.size() << " edges, " << calls.size()
+           << " call blocks)\n";
+    return(false);
+  }
+
+  // Every histogram the run doesn't reach gains a 0: with n non-zero
+  // of T runs, its share of 0s moves by n/T - n/(T+1).  Weighted by n
+  // and summed, that's sum(n^2)/(T(T+1)).  addValues takes out the
+  // histograms the run does reach and adds them back with their drift.
+  double runs = _drift.size();
+  double weighted = (runs > 0) ? _sumWeight2 / (runs * (runs + 1)) : 0;
+  double weight = _sumWeight;
+
+  addValues(edges, 0, weighted, weight);
+  addValues(calls, _edgeCount, weighted, weight);
+
+  if( (runs == 0) || (weight <= 0) )
+    _drift.push_back(1.0);
+  else
+    _drift.push_back(std::max(0.0, weighted / weight));
+  return(true);
+}
+
+
+// Add the run's non-zero values at offset+i, and the drift of each
+// histogram changed, to weighted/weight.
+void CPConvergence::addValues(const std::vector<double>& values,
+                              unsigned offset, double& weighted,
+                              double& weight)
+{
+  double runs = _drift.size();
+  for(unsigned i = 0; i < values.size(); i++)
+  {
+    double v = values[i];
+    if(v <= FP_FUDGE_EPS)
+      continue;
+
+    CPHistogram*& h = _histograms[offset + i];
+    if(h == NULL)
+      h = new CPHistogram();
+
+    double n = h->nonZeroWeight();
+    if(runs > 0)
+      weighted -= n * n / (runs * (runs + 1));
+    weight -= n;
+
+    // compare the shapes over the same bins, with the same weight
+    h->fitRange(v, _bincount);
+    CPHistogram before(*h);
+    h->addValue(v, 1.0, _bincount);
+
+    double drift = 0;
+    if( (n > 0) && !h->isPoint() )
+    {
+      before.scale((n + 1) / n);
+      drift = before.earthMover(*h) / _bincount;
+    }
+    if(runs > 0)
+      drift += fabs(n / runs - (n + 1) / (runs + 1));
+
+    weighted += (n + 1) * drift;
+    weight += n + 1;
+    _sumWeight += 1;
+    _sumWeight2 += 2 * n + 1;
+  }
+}
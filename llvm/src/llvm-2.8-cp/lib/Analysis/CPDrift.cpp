@@ -0,0 +1,368 @@
+//===- CPDrift.cpp --------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Batch drift computation between two combined profiles.  All of the
+// checks that CPHistogram::overlap makes (and reports) are done once,
+// sequentially, while packing; the per-index work is then plain loops
+// over contiguous bin arrays with no calls and no error paths.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "cp-drift"
+
+#include "llvm/Config/config.h"
+#include "llvm/Analysis/CPDrift.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+
+#if defined(ENABLE_THREADS) && defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#define CPDRIFT_THREADS 1
+#endif
+
+using namespace llvm;
+
+namespace {
+  // one slice of the pair array for a worker thread
+  struct DriftSlice {
+    CPDrift* drift;
+    unsigned begin;
+    unsigned end;
+  };
+}
+
+
+CPDrift::CPDrift(unsigned threads) : _threads(threads), _pathIDs(false)
+{
+  if(_threads == 0)
+    _threads = 1;
+}
+
+
+void CPDrift::clear()
+{
+  _ids.clear();
+  _pairs.clear();
+  _bins1.clear();
+  _bins2.clear();
+  _zeroOut.clear();
+  _zeroIn.clear();
+  _emd.clear();
+}
+
+
+void CPDrift::compare(const CombinedProfile& cp1, const CombinedProfile& cp2)
+{
+  clear();
+  _pathIDs = false;
+
+  // build union of non-zero histograms, in index order
+  unsigned n = (cp1.size() > cp2.size()) ? cp1.size() : cp2.size();
+  for(unsigned i = 0; i < n; ++i)
+  {
+    const CPHistogram* h1 = cp1.getHistogramAt(i);
+    const CPHistogram* h2 = cp2.getHistogramAt(i);
+    bool nz1 = (h1 != NULL) && h1->nonZero();
+    bool nz2 = (h2 != NULL) && h2->nonZero();
+
+    if( !nz1 && !nz2 )
+      continue;
+
+    // check for 0-overlap (100% drift) cases
+    if( !nz1 || !nz2 )
+    {
+      errs() << "Warning: histogram " << i << " only exists in one profile!\n";
+      add(i, 0, NULL, NULL);
+      continue;
+    }
+
+    if( h1->isPoint() && h2->isPoint() && (h1->min() != h2->min()) )
+    {
+      errs() << "Warning: histogram " << i << " has different point values\n";
+      add(i, 0, NULL, NULL);
+      continue;
+    }
+
+    add(i, 0, h1, h2);
+  }
+
+  if(_ids.size() == 0)
+    errs() << "Warning: no histograms\n";
+
+  run();
+}
+
+
+void CPDrift::compare(CombinedPathProfile& cp1, CombinedPathProfile& cp2)
+{
+  clear();
+  _pathIDs = true;
+
+  PathSet ps;
+  cp1.getPathSet(ps);
+  cp2.getPathSet(ps);
+
+  for(PathSet::iterator p = ps.begin(), E = ps.end(); p != E; ++p)
+  {
+    if( !cp1.valid(*p) || !cp2.valid(*p) )
+    {
+      // if path only exists in one profile, then 0% overlap
+      errs() << "warning: path exists in only 1 profile: "
+             << p->first << "-" << p->second << "\n";
+      continue;
+    }
+
+    CPHistogram& h1 = cp1.getHistogram(*p);
+    CPHistogram& h2 = cp2.getHistogram(*p);
+
+    if( h1.isPoint() && h2.isPoint() )
+      continue;
+
+    add(p->first, p->second, &h1, &h2);
+  }
+
+  run();
+}
+
+
+// Classify the pair and pack its bins.  NULL histograms are a
+// pre-determined 100% drift.  Mismatches are reported exactly as
+// CPHistogram::overlap reports them.
+void CPDrift::add(unsigned id1, unsigned id2,
+                  const CPHistogram* h1, const CPHistogram* h2)
+{
+  Pair p;
+  p.kind = Mismatch;
+  p.offset = _bins1.size();
+  p.bins = 0;
+  p.nzw = 0;
+  p.tw = 0;
+  p.zeroMin = 0;
+
+  _ids.push_back(std::make_pair(id1, id2));
+
+  if( (h1 == NULL) || (h2 == NULL) )
+  {
+    p.kind = Disjoint;
+    _pairs.push_back(p);
+    return;
+  }
+
+  if( h1->bins() != h2->bins() )
+  {
+    errs() << "overlap: Error: differnt numbers of bins! " << h1->bins()
+           << " vs " << h2->bins() << "\n";
+  }
+  else if( (h1->min() != h2->min()) || (h1->max() != h2->max()) )
+  {
+    errs() << "overlap: Error: range mismatch: [" << h1->min() << ", "
+           << h1->max() << "] vs [" << h2->min() << ", " << h2->max()
+           << "]\n";
+  }
+  else if( h1->totalWeight() != h2->totalWeight() )
+  {
+    errs() << "overlap: Error: total weight differs! " << h1->totalWeight()
+           << " vs " << h2->totalWeight() << "\n";
+  }
+  else if( h1->nonZeroWeight() != h2->nonZeroWeight() )
+  {
+    errs() << "overlap: Error: weight differs! " << h1->nonZeroWeight()
+           << " vs " << h2->nonZeroWeight() << "\n";
+  }
+  else
+  {
+    double zw1 = h1->zeroWeight();
+    double zw2 = h2->zeroWeight();
+
+    p.nzw = h1->nonZeroWeight();
+    p.tw = h1->totalWeight();
+    p.zeroMin = (zw1 < zw2) ? zw1 : zw2;
+    if(p.zeroMin < FP_FUDGE_EPS)
+      p.zeroMin = 0;
+
+    if( h1->isPoint() || h2->isPoint() )
+    {
+      if( h1->isPoint() && h2->isPoint() && (h1->min() == h2->min()) )
+        p.kind = SamePoint;
+      else
+        p.kind = MixedPoint;
+    }
+    else
+    {
+      p.kind = Bins;
+      p.bins = h1->bins();
+      for(unsigned b = 0; b < p.bins; b++)
+      {
+        _bins1.push_back(h1->getBinWeight(b));
+        _bins2.push_back(h2->getBinWeight(b));
+      }
+    }
+  }
+
+  _pairs.push_back(p);
+}
+
+
+void CPDrift::run()
+{
+  unsigned n = _pairs.size();
+  _zeroOut.resize(n);
+  _zeroIn.resize(n);
+  _emd.resize(n);
+
+  unsigned threads = _threads;
+  if(threads > n)
+    threads = n;
+
+#ifdef CPDRIFT_THREADS
+  if(threads > 1)
+  {
+    std::vector<pthread_t> tids(threads);
+    std::vector<DriftSlice> slices(threads);
+    std::vector<bool> started(threads, false);
+    unsigned chunk = (n + threads - 1)/threads;
+
+    for(unsigned t = 0; t < threads; ++t)
+    {
+      slices[t].drift = this;
+      slices[t].begin = t*chunk;
+      slices[t].end = ((t+1)*chunk < n) ? (t+1)*chunk : n;
+      started[t] = (pthread_create(&tids[t], NULL, &CPDrift::threadMain,
+                                   &slices[t]) == 0);
+      // fall back to doing the work here if we can't get a thread
+      if(!started[t])
+        computeRange(slices[t].begin, slices[t].end);
+    }
+
+    for(unsigned t = 0; t < threads; ++t)
+      if(started[t])
+        pthread_join(tids[t], NULL);
+    return;
+  }
+#endif
+
+  computeRange(0, n);
+}
+
+
+void* CPDrift::threadMain(void* arg)
+{
+  DriftSlice* s = (DriftSlice*)arg;
+  s->drift->computeRange(s->begin, s->end);
+  return(NULL);
+}
+
+
+// The kernel.  Only reads _pairs/_bins*, and only writes the result
+// slots in [begin,end), so slices can run concurrently.
+void CPDrift::computeRange(unsigned begin, unsigned end)
+{
+  for(unsigned i = begin; i < end; ++i)
+  {
+    const Pair& p = _pairs[i];
+    double overlap = 0;
+    double emd = -1;
+
+    switch(p.kind)
+    {
+    case Mismatch:
+    case Disjoint:
+      _zeroOut[i] = 1.0;
+      _zeroIn[i] = 1.0;
+      _emd[i] = -1;
+      continue;
+
+    case SamePoint:
+      overlap = p.nzw;  // both points carry the same weight
+      if(overlap < FP_FUDGE_EPS)
+        overlap = 0;
+      emd = 0;
+      break;
+
+    case MixedPoint:
+      overlap = 0;      // points don't overlap histograms
+      break;
+
+    case Bins:
+      {
+        const double* a = &_bins1[p.offset];
+        const double* b = &_bins2[p.offset];
+        unsigned n = p.bins;
+
+        // overlap: sum of per-bin minimums, dropping the tiny ones as
+        // CPHistogram::overlap does
+        for(unsigned k = 0; k < n; ++k)
+        {
+          double m = (a[k] < b[k]) ? a[k] : b[k];
+          if(m >= FP_FUDGE_EPS)
+            overlap += m;
+        }
+
+        // earth mover: dirt carried over each bin boundary
+        double dirt = 0;
+        double moved = 0;
+        for(unsigned k = 0; k + 1 < n; ++k)
+        {
+          dirt += a[k] - b[k];
+          moved += fabs(dirt);
+        }
+        emd = (p.nzw > 0) ? moved/p.nzw : 0;
+        break;
+      }
+    }
+
+    double out = (p.nzw > 0) ? overlap/p.nzw : 0;
+    double in = (p.tw > 0) ? (p.zeroMin + overlap)/p.tw : 0;
+    if(out > 1.0) out = 1.0;
+    if(in > 1.0) in = 1.0;
+
+    _zeroOut[i] = 1 - out;
+    _zeroIn[i] = 1 - in;
+    _emd[i] = emd;
+  }
+}
+
+
+void CPDrift::print(llvm::raw_ostream& stream, const std::string& name,
+                    bool printEMD) const
+{
+  // the headers of the old printers
+  if(_pathIDs)
+    stream << "#pathID\t0-out\t0-in";
+  else
+    stream << "#" << name << "Index\t0-out\t0-in";
+  if(printEMD)
+    stream << "\temd";
+  stream << "\n";
+
+  for(unsigned i = 0, E = _ids.size(); i < E; ++i)
+  {
+    stream << _ids[i].first;
+    if(_pathIDs)
+      stream << "-" << _ids[i].second;
+
+    // keep the exact text of the old printer for 100% drift
+    if(_pairs[i].kind == Disjoint)
+      stream << "\t1.0\t1.0";
+    else
+      stream << "\t" << _zeroOut[i] << "\t" << _zeroIn[i];
+
+    if(printEMD)
+    {
+      if(_emd[i] < 0)
+        stream << "\t-";
+      else
+        stream << "\t" << _emd[i];
+    }
+    stream << "\n";
+  }
+}
@@ -8,18 +8,23 @@
 //===----------------------------------------------------------------------===//
 //
 // Takes raw and/or combined profiles from one or more profile file
-// and combines the like-typed profiles (edge/path/call) into a single
-// combined profile of that type.
+// and combines the like-typed profiles (edge/path/call/trip count/value)
+// into a single combined profile of that type.
 //
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Analysis/ProfileInfoTypes.h"
 #include "llvm/Analysis/CombinedProfile.h"
 #include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPStats.h"
 
+#include <cmath>
 #include <vector>
+#include <string.h>
 
 using namespace llvm;
 
@@ -28,11 +33,36 @@ cl::opt<unsigned>
 CPBinCount("bc", cl::init(0), cl::value_desc("number"),
            cl::desc("Number of bins for constructed combined profiles."));
 
+// One instrumented build for both: the edge profile is projected from
+// the raw path profiles (CombinedEdgeProfile::addPathProfile)
+cl::opt<bool>
+CPEdgesFromPaths("edges-from-paths", cl::init(false),
+                 cl::desc("Derive the combined edge profile from raw path "
+                          "profiles; raw edge profiles are skipped"));
+
 // last-resort fallback for bincount
 #define DEFAULT_BINCOUNT 20
 
+// the phase a profile section is read in
+static CPPhase readPhase(ProfilingType type)
+{
+  switch(type)
+  {
+  case ArgumentInfo:
+  case EdgeInfo:
+  case PathInfo:
+  case CallInfo:
+  case TripCountInfo:
+  case ValueInfo:
+    return(CPTimeReadRaw);
+  default:
+    return(CPTimeReadCombined);
+  }
+}
+
 CPFactory::CPFactory(Module& M) : 
-  _callCP(NULL), _edgeCP(NULL), _pathCP(NULL), _M(M) 
+  _callCP(NULL), _edgeCP(NULL), _pathCP(NULL), _tripCP(NULL), _valueCP(NULL),
+  _M(M), _keys(NULL), _indexed(false)
 {
 }
 
@@ -47,6 +77,35 @@ void CPFactory::clear()
   if(_callCP != NULL) delete _callCP;
   if(_edgeCP != NULL) delete _edgeCP;
   if(_pathCP != NULL) delete _pathCP;
+  if(_tripCP != NULL) delete _tripCP;
+  if(_valueCP != NULL) delete _valueCP;
+  if(_keys != NULL) delete _keys;
+  _keys = NULL;
+}
+
+
+const CPFunctionKeys& CPFactory::getFunctionKeys()
+{
+  if(_keys == NULL)
+    _keys = new CPFunctionKeys(_M);
+  return(*_keys);
+}
+
+
+CPFunctionMap* CPFactory::matchFunctions(const CPFunctionKeys& fileKeys)
+{
+  if(fileKeys == getFunctionKeys())
+    return(NULL);
+
+  CPFunctionMap* map = new CPFunctionMap(fileKeys, getFunctionKeys());
+  errs() << "CPFactory: profile is for another build: " << map->matched()
+         << " of " << fileKeys.size() << " functions matched";
+  if(map->renamed() > 0)
+    errs() << " (" << map->renamed() << " renamed)";
+  if(map->changed() > 0)
+    errs() << ", " << map->changed() << " changed";
+  errs() << ", " << getFunctionKeys().size() << " in the module\n";
+  return(map);
 }
 
 // repackage the single file name into a vector
@@ -69,17 +128,37 @@ bool CPFactory::buildProfiles(cl::list<std::string>& filenames)
 
 
 bool CPFactory::buildProfiles(const FilenameVec& filenames)
+{
+  return(buildProfiles(filenames, std::vector<double>()));
+}
+
+
+double CPFactory::decayWeight(double age, double halfLife)
+{
+  if( (halfLife <= 0) || (age <= 0) )
+    return(1.0);
+  return(pow(0.5, age / halfLife));
+}
+
+
+// weights may be empty: every input has weight 1
+bool CPFactory::buildProfiles(const FilenameVec& filenames,
+                              const std::vector<double>& weights)
 {
   bool error = false;
   ProfilingType profType;
   bool rawEdges = false;
   bool rawPaths = false;
   bool rawCalls = false;
+  bool rawTrips = false;
+  bool rawValues = false;
   // only create if needed to avoid needlessly building edgedomtrees, etc.
   CombinedEdgeProfile* cepFromRaw = NULL; // = new CombinedEdgeProfile(_M);
   CombinedPathProfile* cppFromRaw = NULL; // = new CombinedPathProfile(_M);
   CombinedCallProfile* ccpFromRaw = NULL; // = new CombinedCallProfile(_M);
-  CPList cepList, cppList, ccpList;
+  CombinedTripCountProfile* ctpFromRaw = NULL;
+  CombinedValueProfile* cvpFromRaw = NULL;
+  CPList cepList, cppList, ccpList, ctpList, cvpList;
 
   errs() << "--> CPFactory::buildProfiles (" << filenames.size() << ")\n";
 
@@ -87,6 +166,13 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
   if(_edgeCP != NULL) delete _edgeCP;
   if(_pathCP != NULL) delete _pathCP;
   if(_callCP != NULL) delete _callCP;
+  if(_tripCP != NULL) delete _tripCP;
+  if(_valueCP != NULL) delete _valueCP;
+  _edgeCP = NULL;
+  _pathCP = NULL;
+  _callCP = NULL;
+  _tripCP = NULL;
+  _valueCP = NULL;
 
 
   unsigned fnum = 0;
@@ -94,6 +180,10 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
   {
     errs() << "CPFactory::buildProfiles reading " 
            << filenames[fnum].c_str() << "\n";
+    double weight = (fnum < weights.size()) ? weights[fnum] : 1.0;
+    if(weight != 1.0)
+      errs() << "CPFactory::buildProfiles weight " 
+             << format("%.4f", weight) << "\n";
 		FILE* file = fopen(filenames[fnum].c_str(),"rb");
 		if (!file) 
     {
@@ -107,9 +197,14 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
     // Read the type and process the profile data segment.  Raw
     // profiles are collected into single new combined profile
     // (-FromRaw).  Combined profiles are collected in lists (-List)
-    // to be combined at the end.
+    // to be combined at the end.  Those that follow the function keys
+    // of another build are remapped to this one as they are read.
+    CPFunctionKeys fileKeys;
+    CPFunctionMap* remap = NULL;
     while(fread(&profType, sizeof(ProfilingType), 1, file) > 0)
     {
+      TimeRegion timer(CPStats::getTimer(readPhase(profType)));
+      CombinedProfile* combined = NULL;
       errs() << "CPFactory::buildProfile Profile type: " 
              << profilingTypeToString(profType) << "\n";
 			// What to do with this specific profiling type
@@ -119,36 +214,81 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
 				skipArgumentInfo(file);
 				break;
 
+      case CombinedFunctionKeys:
+        error = !fileKeys.deserialize(file);
+        if(remap != NULL) delete remap;
+        remap = error ? NULL : matchFunctions(fileKeys);
+        break;
+
         //
         // Raw Profiles: add them to the -FromRaw combined profile
         //
 			case EdgeInfo:
+        if(CPEdgesFromPaths)
+        {
+          unsigned count;
+          error = (fread(&count, sizeof(unsigned), 1, file) != 1) ||
+            (fseek(file, count * sizeof(unsigned), SEEK_CUR) != 0);
+          break;
+        }
         if(cepFromRaw == NULL) cepFromRaw = new CombinedEdgeProfile(_M);
+        cepFromRaw->setRunWeight(weight);
         error = !cepFromRaw->addProfile(file);
         rawEdges = true;
 				break;
 
 			case PathInfo:
-        if(cppFromRaw == NULL) cppFromRaw = new CombinedPathProfile(_M);
-        error = !cppFromRaw->addProfile(file);
-        rawPaths = true;
-				break;
+        {
+          long start = ftell(file);
+          if(cppFromRaw == NULL) cppFromRaw = new CombinedPathProfile(_M);
+          cppFromRaw->setRunWeight(weight);
+          error = !cppFromRaw->addProfile(file);
+          rawPaths = true;
+          if(error || !CPEdgesFromPaths)
+            break;
+
+          // the same section again, for the edges
+          long end = ftell(file);
+          if(cepFromRaw == NULL) cepFromRaw = new CombinedEdgeProfile(_M);
+          cepFromRaw->setRunWeight(weight);
+          error = (fseek(file, start, SEEK_SET) != 0) ||
+            !cepFromRaw->addPathProfile(file) || (ftell(file) != end);
+          rawEdges = true;
+          break;
+        }
 
 			case CallInfo:
         if(ccpFromRaw == NULL) ccpFromRaw = new CombinedCallProfile(_M);
+        ccpFromRaw->setRunWeight(weight);
         errs() << "ccpFromRaw=" << ccpFromRaw;
         errs() << ", size=" << ccpFromRaw->size() << "\n";
         error = !ccpFromRaw->addProfile(file);
         rawCalls = true;
 				break;
 
+			case TripCountInfo:
+        if(ctpFromRaw == NULL) ctpFromRaw = new CombinedTripCountProfile(_M);
+        ctpFromRaw->setRunWeight(weight);
+        error = !ctpFromRaw->addProfile(file);
+        rawTrips = true;
+				break;
+
+			case ValueInfo:
+        if(cvpFromRaw == NULL) cvpFromRaw = new CombinedValueProfile(_M);
+        cvpFromRaw->setRunWeight(weight);
+        error = !cvpFromRaw->addProfile(file);
+        rawValues = true;
+				break;
+
         //
         // Combined Profiles: add them to the -List to be combined later
         //
 			case CombinedEdgeInfo:
         {
           CombinedEdgeProfile* cep = new CombinedEdgeProfile(_M);
+          if(remap != NULL) cep->setLayout(fileKeys);
           error = !cep->deserialize(file);
+          combined = cep;
           cepList.push_back(cep);
           break;
         }
@@ -156,7 +296,9 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
 			case CombinedPathInfo:
         {
           CombinedPathProfile* cpp = new CombinedPathProfile(_M);
+          if(remap != NULL) cpp->setLayout(fileKeys);
           error = !cpp->deserialize(file);
+          combined = cpp;
           cppList.push_back(cpp);
           break;
         }
@@ -164,20 +306,76 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
 			case CombinedCallInfo:
         {
           CombinedCallProfile* ccp = new CombinedCallProfile(_M);
+          if(remap != NULL) ccp->setLayout(fileKeys);
           error = !ccp->deserialize(file);
+          combined = ccp;
           ccpList.push_back(ccp);
           break;
         }
 
+			case CombinedTripCountInfo:
+        {
+          CombinedTripCountProfile* ctp = new CombinedTripCountProfile(_M);
+          if(remap != NULL) ctp->setLayout(fileKeys);
+          error = !ctp->deserialize(file);
+          combined = ctp;
+          ctpList.push_back(ctp);
+          break;
+        }
+
+			case CombinedValueInfo:
+        {
+          CombinedValueProfile* cvp = new CombinedValueProfile(_M);
+          if(remap != NULL) cvp->setLayout(fileKeys);
+          error = !cvp->deserialize(file);
+          combined = cvp;
+          cvpList.push_back(cvp);
+          break;
+        }
+
+        //
+        // Indexed Combined Profiles: read them whole, add to the -List
+        //
+      case IndexedCombinedInfo:
+        {
+          CombinedProfile* cp = newIndexedCP(file);
+          if( (cp != NULL) && (remap != NULL) ) cp->setLayout(fileKeys);
+          error = (cp == NULL) || !cp->deserializeIndexed(file);
+          if(cp == NULL) break;
+          combined = cp;
+          if(cp->getProfilingType() == CombinedEdgeInfo)
+            cepList.push_back(cp);
+          else if(cp->getProfilingType() == CombinedPathInfo)
+            cppList.push_back(cp);
+          else if(cp->getProfilingType() == CombinedTripCountInfo)
+            ctpList.push_back(cp);
+          else if(cp->getProfilingType() == CombinedValueInfo)
+            cvpList.push_back(cp);
+          else
+            ccpList.push_back(cp);
+          break;
+        }
+
 			default:
         error = true;
 
 			} // switch(profType)
+
+      if( !error && (combined != NULL) && (remap != NULL) )
+        error = !combined->remapFunctions(*remap);
       
+      // decay an older combined profile before it is merged
+      if( !error && (combined != NULL) && (weight != 1.0) )
+        combined->scaleWeight(weight);
+
       // stop if something went wrong
       if(error) break;
     } // while headers
 
+    if(remap != NULL) delete remap;
+    CPStats::count(CPBytesRead, ftell(file));
+    fclose(file);
+
     // stop if something went wrong
     if(error) break;
   } // while files
@@ -193,6 +391,8 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
     if(cepFromRaw != NULL) delete cepFromRaw;
     if(cppFromRaw != NULL) delete cppFromRaw;
     if(ccpFromRaw != NULL) delete ccpFromRaw;
+    if(ctpFromRaw != NULL) delete ctpFromRaw;
+    if(cvpFromRaw != NULL) delete cvpFromRaw;
   }
   else
   {
@@ -240,8 +440,31 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
     }
     //else delete ccpFromRaw;
 
+    if(rawTrips)
+    {
+      unsigned bins = ctpFromRaw->calcBinCount(ctpList, CPBinCount);
+      errs() << "CPFactory::buildProfiles: building trip count histograms "
+             << "with " << bins << " bins\n";
+      ctpFromRaw->buildHistograms(bins);
+      ctpList.push_back(ctpFromRaw);
+      errs() << " CP weight = " << format("%.2f", ctpFromRaw->getTotalWeight())
+             << "\n";
+    }
+
+    if(rawValues)
+    {
+      unsigned bins = cvpFromRaw->calcBinCount(cvpList, CPBinCount);
+      errs() << "CPFactory::buildProfiles: building value histograms "
+             << "with " << bins << " bins\n";
+      cvpFromRaw->buildHistograms(bins);
+      cvpList.push_back(cvpFromRaw);
+      errs() << " CP weight = " << format("%.2f", cvpFromRaw->getTotalWeight())
+             << "\n";
+    }
+
 
     // Combine all the profiles we've read to build the final combined profile
+    TimeRegion timer(CPStats::getTimer(CPTimeMerge));
     if(cepList.size() > 0)
     {
       errs() << "CPFactory::buildProfiles CEPs: " << cepList.size();
@@ -254,6 +477,7 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
       {
         _edgeCP = new CombinedEdgeProfile(_M);
         _edgeCP->buildFromList(cepList, CPBinCount);
+        CPStats::count(CPHistogramsBuilt, _edgeCP->size());
       }
       errs() << " weight: " << format("%.2f", _edgeCP->getTotalWeight()) << "\n";
     }
@@ -270,6 +494,7 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
       {
         _pathCP = new CombinedPathProfile(_M);
         _pathCP->buildFromList(cppList, CPBinCount);
+        CPStats::count(CPHistogramsBuilt, _pathCP->size());
       }
       errs() << " weight: " << format("%.2f", _pathCP->getTotalWeight()) << "\n";
     }
@@ -286,10 +511,46 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
       {
         _callCP = new CombinedCallProfile(_M);
         _callCP->buildFromList(ccpList, CPBinCount);
+        CPStats::count(CPHistogramsBuilt, _callCP->size());
       }
       errs() << " weight: " << format("%.2f", _callCP->getTotalWeight()) << "\n";
     }
 
+    if(ctpList.size() > 0)
+    {
+      errs() << "CPFactory::buildProfiles CTPs: " << ctpList.size();
+      if(ctpList.size() == 1)
+      {
+        _tripCP = (CombinedTripCountProfile*)ctpList.front();
+        ctpList.pop_front();
+      }
+      else
+      {
+        _tripCP = new CombinedTripCountProfile(_M);
+        _tripCP->buildFromList(ctpList, CPBinCount);
+        CPStats::count(CPHistogramsBuilt, _tripCP->size());
+      }
+      errs() << " weight: " << format("%.2f", _tripCP->getTotalWeight()) << "\n";
+    }
+
+    if(cvpList.size() > 0)
+    {
+      errs() << "CPFactory::buildProfiles CVPs: " << cvpList.size();
+      if(cvpList.size() == 1)
+      {
+        _valueCP = (CombinedValueProfile*)cvpList.front();
+        cvpList.pop_front();
+      }
+      else
+      {
+        _valueCP = new CombinedValueProfile(_M);
+        _valueCP->buildFromList(cvpList, CPBinCount);
+        CPStats::count(CPHistogramsBuilt, _valueCP->size());
+      }
+      errs() << " weight: " << format("%.2f", _valueCP->getTotalWeight())
+             << "\n";
+    }
+
   }
 
   // Cleanup
@@ -302,11 +563,16 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
     delete *i;
   for(CPList::iterator i = ccpList.begin(), E = ccpList.end(); i != E; ++i)
     delete *i;
+  for(CPList::iterator i = ctpList.begin(), E = ctpList.end(); i != E; ++i)
+    delete *i;
+  for(CPList::iterator i = cvpList.begin(), E = cvpList.end(); i != E; ++i)
+    delete *i;
 
   errs() << "<-- CPFactory::buildProfiles\n";
 
   // return success if we built at least one CP
-  if( hasEdgeCP() || hasPathCP() || hasCallCP() )
+  if( hasEdgeCP() || hasPathCP() || hasCallCP() || hasTripCountCP()
+      || hasValueCP() )
     return(true);
   else
   {
@@ -318,6 +584,156 @@ bool CPFactory::buildProfiles(const FilenameVec& filenames)
 
 
 
+// Load the profiles in a file.  Indexed combined profiles are mapped,
+// and their histograms read as they are used.  Anything else is read
+// by buildProfiles.
+bool CPFactory::loadProfiles(const std::string& filename)
+{
+  std::string err;
+  MemoryBuffer* buffer = MemoryBuffer::getFile(filename, &err);
+  if(buffer == NULL)
+  {
+    errs() << "CPFactory::loadProfiles Error: cannot open '" << filename 
+           << "': " << err << "\n";
+    return(false);
+  }
+
+  unsigned size = buffer->getBufferSize();
+  unsigned offset = 0;
+  unsigned header[2] = { 0, 0 };
+  if(size >= sizeof(header))
+    memcpy(header, buffer->getBufferStart(), sizeof(header));
+
+  // the keys of another build: the mapped profiles are read whole and
+  // remapped right away
+  CPFunctionKeys fileKeys;
+  CPFunctionMap* remap = NULL;
+  if(header[0] == CombinedFunctionKeys)
+  {
+    const char* data = buffer->getBufferStart() + sizeof(unsigned);
+    if( !fileKeys.deserialize(data, buffer->getBufferEnd()) )
+    {
+      errs() << "CPFactory::loadProfiles Error: bad function keys in '"
+             << filename << "'\n";
+      delete buffer;
+      return(false);
+    }
+    offset = data - buffer->getBufferStart();
+    header[0] = 0;
+    if(offset + sizeof(header) <= size)
+      memcpy(header, data, sizeof(header));
+  }
+
+  _indexed = (header[0] == IndexedCombinedInfo);
+  if(!_indexed)
+  {
+    delete buffer;
+    return(buildProfiles(filename));
+  }
+  if(offset > 0)
+    remap = matchFunctions(fileKeys);
+
+  // the whole file is mapped; histograms are parsed as they are used
+  TimeRegion timer(CPStats::getTimer(CPTimeReadCombined));
+  CPStats::count(CPBytesRead, size);
+
+  // delete any old profiles
+  if(_edgeCP != NULL) delete _edgeCP;
+  if(_pathCP != NULL) delete _pathCP;
+  if(_callCP != NULL) delete _callCP;
+  if(_tripCP != NULL) delete _tripCP;
+  if(_valueCP != NULL) delete _valueCP;
+  _edgeCP = NULL;
+  _pathCP = NULL;
+  _callCP = NULL;
+  _tripCP = NULL;
+  _valueCP = NULL;
+
+  // the file is mapped once; each section's CP holds on to it until
+  // it has read all of its histograms
+  CPMappedFile* mapped = new CPMappedFile(buffer);
+  mapped->retain();
+  bool ok = true;
+  while( ok && (offset + sizeof(header) <= size) )
+  {
+    memcpy(header, buffer->getBufferStart() + offset, sizeof(header));
+    offset += sizeof(header);
+
+    CombinedProfile* cp = NULL;
+    if(header[0] == IndexedCombinedInfo)
+    {
+      if( (header[1] == CombinedEdgeInfo) && (_edgeCP == NULL) )
+        cp = _edgeCP = new CombinedEdgeProfile(_M);
+      else if( (header[1] == CombinedPathInfo) && (_pathCP == NULL) )
+        cp = _pathCP = new CombinedPathProfile(_M);
+      else if( (header[1] == CombinedCallInfo) && (_callCP == NULL) )
+        cp = _callCP = new CombinedCallProfile(_M);
+      else if( (header[1] == CombinedTripCountInfo) && (_tripCP == NULL) )
+        cp = _tripCP = new CombinedTripCountProfile(_M);
+      else if( (header[1] == CombinedValueInfo) && (_valueCP == NULL) )
+        cp = _valueCP = new CombinedValueProfile(_M);
+    }
+
+    if(cp == NULL)
+    {
+      errs() << "CPFactory::loadProfiles Error: '" << filename 
+             << "' can only hold one indexed profile of each type\n";
+      ok = false;
+      break;
+    }
+
+    if(remap != NULL)
+      cp->setLayout(fileKeys);
+    if( !cp->mapIndexed(mapped, offset) )
+    {
+      errs() << "CPFactory::loadProfiles Error: bad indexed profile in '"
+             << filename << "'\n";
+      ok = false;
+      break;
+    }
+    if(remap != NULL)
+      ok = cp->remapFunctions(*remap);
+  }
+
+  mapped->release();
+  if(remap != NULL)
+    delete remap;
+
+  return( ok && (hasEdgeCP() || hasPathCP() || hasCallCP() || hasTripCountCP()
+          || hasValueCP()) );
+}
+
+
+// create an empty CP for the indexed section being read from file
+CombinedProfile* CPFactory::newIndexedCP(FILE* file)
+{
+  ProfilingType ptype;
+  if( fread(&ptype, sizeof(ProfilingType), 1, file) != 1 )
+  {
+    errs() << "CPFactory::newIndexedCP Error: bad header\n";
+    return(NULL);
+  }
+
+  switch(ptype)
+  {
+  case CombinedEdgeInfo:
+    return(new CombinedEdgeProfile(_M));
+  case CombinedPathInfo:
+    return(new CombinedPathProfile(_M));
+  case CombinedCallInfo:
+    return(new CombinedCallProfile(_M));
+  case CombinedTripCountInfo:
+    return(new CombinedTripCountProfile(_M));
+  case CombinedValueInfo:
+    return(new CombinedValueProfile(_M));
+  default:
+    errs() << "CPFactory::newIndexedCP Error: can't index " 
+           << profilingTypeToString(ptype) << "\n";
+    return(NULL);
+  }
+}
+
+
 // skip over a profile block for command line arguments
 bool CPFactory::skipArgumentInfo(FILE* file) 
 {
@@ -338,10 +754,11 @@ bool CPFactory::skipArgumentInfo(FILE* file)
 
 void CPFactory::freeStaticData()
 {
-  errs() << "CPFactory::freeStaticData : freeing static data disabled.\n";
-  //CombinedEdgeProfile::freeStaticData();
-  //CombinedPathProfile::freeStaticData();
-  //CombinedCallProfile::freeStaticData();
+  CombinedEdgeProfile::freeStaticData();
+  CombinedPathProfile::freeStaticData();
+  CombinedCallProfile::freeStaticData();
+  CombinedTripCountProfile::freeStaticData();
+  CombinedValueProfile::freeStaticData();
 }
 
 
@@ -358,6 +775,12 @@ const std::string& CPFactory::profilingTypeToString(ProfilingType p)
   static std::string cpInfoStr      = "Combined Path Profile";
   static std::string callInfoStr    = "Raw Call Profile";
   static std::string ccInfoStr      = "Combined Call Profile";
+  static std::string icInfoStr      = "Indexed Combined Profile";
+  static std::string tripInfoStr    = "Raw Trip Count Profile";
+  static std::string ctInfoStr      = "Combined Trip Count Profile";
+  static std::string valueInfoStr   = "Raw Value Profile";
+  static std::string cvInfoStr      = "Combined Value Profile";
+  static std::string keysInfoStr    = "Combined Function Keys";
   static std::string unknownInfoStr = "(unknowned profile type)";
 
 
@@ -385,6 +808,18 @@ const std::string& CPFactory::profilingTypeToString(ProfilingType p)
     return(callInfoStr);
   case CombinedCallInfo:
     return(ccInfoStr);
+  case IndexedCombinedInfo:
+    return(icInfoStr);
+  case TripCountInfo:
+    return(tripInfoStr);
+  case CombinedTripCountInfo:
+    return(ctInfoStr);
+  case ValueInfo:
+    return(valueInfoStr);
+  case CombinedValueInfo:
+    return(cvInfoStr);
+  case CombinedFunctionKeys:
+    return(keysInfoStr);
   default:
     return(unknownInfoStr);
   }
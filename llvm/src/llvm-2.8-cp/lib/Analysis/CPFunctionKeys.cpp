@@ -0,0 +1,322 @@
+//===- CPFunctionKeys.cpp -------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Stable function identity for combined profiles.  See CPFunctionKeys.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/CPFunctionKeys.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Function.h"
+#include "llvm/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string.h>
+
+using namespace llvm;
+
+// FNV-1a
+#define FNV32_BASIS 2166136261u
+#define FNV32_PRIME 16777619u
+#define FNV64_BASIS 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+
+static unsigned hashWord(unsigned hash, unsigned word)
+{
+  for(unsigned i = 0; i < 4; i++, word >>= 8)
+    hash = (hash ^ (word & 0xff)) * FNV32_PRIME;
+  return(hash);
+}
+
+
+CPFunctionKeys::CPFunctionKeys(Module& M)
+{
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    if(isCPDefinition(*F))
+      _keys.push_back(getKey(*F));
+}
+
+
+uint64_t CPFunctionKeys::hashName(const char* name, unsigned length)
+{
+  uint64_t hash = FNV64_BASIS;
+  for(unsigned i = 0; i < length; i++)
+    hash = (hash ^ (unsigned char)name[i]) * FNV64_PRIME;
+  return(hash);
+}
+
+
+// Each checksum covers what one profile's histogram layout depends on:
+// the successors of each block, in order (edges and paths), which
+// blocks have inlining candidates (calls), which blocks head loops
+// (trip counts), and how many indirect calls each block has (values).
+// Straight-line code can change freely.
+CPFunctionKey CPFunctionKeys::getKey(Function& F)
+{
+  CPFunctionKey key;
+  memset(&key, 0, sizeof(CPFunctionKey));
+
+  uint64_t name = hashName(F.getName().data(), F.getName().size());
+  key.nameHash[0] = (unsigned)name;
+  key.nameHash[1] = (unsigned)(name >> 32);
+
+  CPFunctionBody body(F);
+  if(F.isDeclaration())
+    return(key);
+
+  std::map<BasicBlock*,unsigned> blockNumber;
+  unsigned blocks = 0;
+  for(Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    blockNumber[BB] = blocks++;
+
+  unsigned cfgHash = hashWord(FNV32_BASIS, F.size());
+  unsigned callHash = cfgHash;
+  unsigned loopHash = cfgHash;
+  unsigned siteHash = cfgHash;
+  key.edges = 1;  // the entry edge
+  for(Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+  {
+    TerminatorInst* TI = BB->getTerminator();
+    unsigned succs = TI->getNumSuccessors();
+    cfgHash = hashWord(cfgHash, succs);
+    for(unsigned s = 0; s < succs; s++)
+      cfgHash = hashWord(cfgHash, blockNumber[TI->getSuccessor(s)]);
+    key.edges += succs;
+
+    bool candidate = CombinedCallProfile::hasFDOInliningCandidate(BB);
+    callHash = hashWord(callHash, candidate);
+    if(candidate)
+      key.callBlocks++;
+
+    unsigned sites = 0;
+    for(BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I)
+      if(CombinedValueProfile::isIndirectCall(I))
+        sites++;
+    siteHash = hashWord(siteHash, sites);
+    key.sites += sites;
+  }
+
+  std::vector<BasicBlock*> headers;
+  CombinedTripCountProfile::getLoopHeaders(F, headers);
+  for(unsigned h = 0; h < headers.size(); h++)
+    loopHash = hashWord(loopHash, blockNumber[headers[h]]);
+  key.loops = headers.size();
+
+  key.cfgChecksum = cfgHash;
+  key.callChecksum = callHash;
+  key.loopChecksum = loopHash;
+  key.siteChecksum = siteHash;
+
+  return(key);
+}
+
+
+bool CPFunctionKeys::serialize(FILE* f) const
+{
+  ProfilingType ptype = CombinedFunctionKeys;
+  unsigned count = _keys.size();
+  if( (fwrite(&ptype, sizeof(unsigned), 1, f) != 1) ||
+      (fwrite(&count, sizeof(unsigned), 1, f) != 1) ||
+      ( (count > 0) &&
+        (fwrite(&_keys[0], sizeof(CPFunctionKey), count, f) != count) ) )
+  {
+    errs() << "error: unable to write function keys to file.\n";
+    return(false);
+  }
+  return(true);
+}
+
+
+bool CPFunctionKeys::deserialize(FILE* f)
+{
+  unsigned count;
+  if( fread(&count, sizeof(unsigned), 1, f) != 1 )
+  {
+    errs() << "CPFunctionKeys::deserialize Error: bad header\n";
+    return(false);
+  }
+
+  _keys.resize(count);
+  if( (count > 0) &&
+      (fread(&_keys[0], sizeof(CPFunctionKey), count, f) != count) )
+  {
+    errs() << "CPFunctionKeys::deserialize Error: truncated keys\n";
+    _keys.clear();
+    return(false);
+  }
+  return(true);
+}
+
+
+bool CPFunctionKeys::deserialize(const char*& data, const char* end)
+{
+  unsigned count;
+  if( (unsigned)(end - data) < sizeof(unsigned) )
+  {
+    errs() << "CPFunctionKeys::deserialize Error: bad header\n";
+    return(false);
+  }
+  memcpy(&count, data, sizeof(unsigned));
+
+  if( (unsigned)(end - data - sizeof(unsigned)) / sizeof(CPFunctionKey)
+      < count )
+  {
+    errs() << "CPFunctionKeys::deserialize Error: truncated keys\n";
+    return(false);
+  }
+
+  data += sizeof(unsigned);
+  _keys.resize(count);
+  if(count > 0)
+    memcpy(&_keys[0], data, count * sizeof(CPFunctionKey));
+  data += count * sizeof(CPFunctionKey);
+  return(true);
+}
+
+
+bool CPFunctionKeys::operator==(const CPFunctionKeys& other) const
+{
+  return( (_keys.size() == other._keys.size()) &&
+          ( _keys.empty() ||
+            (memcmp(&_keys[0], &other._keys[0],
+                    _keys.size() * sizeof(CPFunctionKey)) == 0) ) );
+}
+
+
+unsigned CPFunctionKeys::getSlots(const CPFunctionKey& key, CPSlotKind kind)
+{
+  switch(kind)
+  {
+  case CPEdgeSlots: return(key.edges);
+  case CPCallSlots: return(key.callBlocks);
+  case CPLoopSlots: return(key.loops);
+  case CPSiteSlots: return(key.sites);
+  }
+  return(0);
+}
+
+
+unsigned CPFunctionKeys::getChecksum(const CPFunctionKey& key,
+                                     CPSlotKind kind)
+{
+  switch(kind)
+  {
+  case CPEdgeSlots: return(key.cfgChecksum);
+  case CPCallSlots: return(key.callChecksum);
+  case CPLoopSlots: return(key.loopChecksum);
+  case CPSiteSlots: return(key.siteChecksum);
+  }
+  return(0);
+}
+
+
+void CPFunctionKeys::getFirstSlots(CPSlotKind kind,
+                                   std::vector<unsigned>& first) const
+{
+  first.clear();
+  first.push_back(0);
+  for(unsigned i = 0; i < _keys.size(); i++)
+    first.push_back(first.back() + getSlots(_keys[i], kind));
+}
+
+
+// the same histograms of a kind, in the same order
+static bool sameShape(const CPFunctionKey& a, const CPFunctionKey& b,
+                      CPSlotKind kind)
+{
+  return( (CPFunctionKeys::getChecksum(a, kind) ==
+           CPFunctionKeys::getChecksum(b, kind)) &&
+          (CPFunctionKeys::getSlots(a, kind) ==
+           CPFunctionKeys::getSlots(b, kind)) );
+}
+
+// the same histograms of every kind
+static bool sameShape(const CPFunctionKey& a, const CPFunctionKey& b)
+{
+  return( sameShape(a, b, CPEdgeSlots) && sameShape(a, b, CPCallSlots) &&
+          sameShape(a, b, CPLoopSlots) && sameShape(a, b, CPSiteSlots) );
+}
+
+static uint64_t nameOf(const CPFunctionKey& key)
+{
+  return( ((uint64_t)key.nameHash[1] << 32) | key.nameHash[0] );
+}
+
+
+CPFunctionMap::CPFunctionMap(const CPFunctionKeys& from,
+                             const CPFunctionKeys& to) :
+  _from(from), _to(to), _map(from.size(), CP_NO_FUNCTION), _matched(0),
+  _renamed(0), _changed(0)
+{
+  std::map<uint64_t,unsigned> byName;
+  for(unsigned i = 0; i < to.size(); i++)
+    byName[nameOf(to[i])] = i;
+
+  std::vector<bool> taken(to.size(), false);
+  for(unsigned f = 0; f < from.size(); f++)
+  {
+    std::map<uint64_t,unsigned>::iterator N = byName.find(nameOf(from[f]));
+    if(N != byName.end())
+    {
+      _map[f] = N->second;
+      taken[N->second] = true;
+      _matched++;
+    }
+  }
+
+  // A function left over on both sides with a CFG checksum no other
+  // leftover has, and the same histograms, was renamed.  A single
+  // block says too little about a function to go by, so those are only
+  // matched by name.
+  typedef std::map<unsigned,std::vector<unsigned> > ChecksumMap;
+  ChecksumMap fromLeft, toLeft;
+  for(unsigned f = 0; f < from.size(); f++)
+    if(_map[f] == CP_NO_FUNCTION)
+      fromLeft[from[f].cfgChecksum].push_back(f);
+  for(unsigned t = 0; t < to.size(); t++)
+    if(!taken[t])
+      toLeft[to[t].cfgChecksum].push_back(t);
+
+  for(ChecksumMap::iterator C = fromLeft.begin(), E = fromLeft.end();
+      C != E; ++C)
+  {
+    ChecksumMap::iterator T = toLeft.find(C->first);
+    if( (C->second.size() != 1) || (T == toLeft.end()) ||
+        (T->second.size() != 1) || (from[C->second[0]].edges <= 1) ||
+        !sameShape(from[C->second[0]], to[T->second[0]]) )
+      continue;
+
+    _map[C->second[0]] = T->second[0];
+    _matched++;
+    _renamed++;
+  }
+
+  // each profile keeps the histograms of the functions whose layout
+  // for it is unchanged
+  for(unsigned k = CPEdgeSlots; k <= CPSiteSlots; k++)
+    _kindMap[k].resize(from.size(), CP_NO_FUNCTION);
+  for(unsigned f = 0; f < from.size(); f++)
+  {
+    if(_map[f] == CP_NO_FUNCTION)
+      continue;
+
+    bool changed = false;
+    for(unsigned k = CPEdgeSlots; k <= CPSiteSlots; k++)
+    {
+      if(sameShape(from[f], to[_map[f]], (CPSlotKind)k))
+        _kindMap[k][f] = _map[f];
+      else
+        changed = true;
+    }
+    if(changed)
+      _changed++;
+  }
+}
@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <set>
 #include <stdlib.h>
+#include <string.h>
 
 
 using namespace llvm;
@@ -467,6 +468,8 @@ CPHistogram* CPHistogram::cross(const CPHistogramList& others) const
     min *= H._min;
     max *= H._max;
 
+    outvals.clear();  // still holds the previous step after the swap
+
     if( H.isPoint() )
     {
       double w = H._stats.sumOfWeights;
@@ -506,11 +509,169 @@ CPHistogram* CPHistogram::cross(const CPHistogramList& others) const
   for(unsigned i = 0, E = invals.size(); i < E; i++)
     rc->addToList(invals[i]);
   rc->buildFromList(_bincount, tw, min, max);
-  
+
   return(rc);
 }
 
 
+// Like cross(list), but the running product is collapsed back to
+// bincount impulses after each step, bounding the work per step to
+// bincount * (bins used by the next histogram).
+CPHistogram* CPHistogram::crossRebin(const CPHistogramList& others,
+                                     unsigned bincount) const
+{
+  // zero histogram nullifies everything.  Return a zero histogram.
+  if( ! nonZero() )
+    return(new CPHistogram());
+
+  unsigned maxBins = _bincount;
+  CPHistogramList::const_iterator Hist, E;
+  for(Hist = others.begin(), E = others.end(); Hist != E; ++Hist)
+  {
+    if( (*Hist == NULL) || ! (*Hist)->nonZero() )
+      return(new CPHistogram());
+    if( (*Hist)->_bincount > maxBins )
+      maxBins = (*Hist)->_bincount;
+  }
+  if(bincount == 0)
+    bincount = maxBins;
+
+  WeightedValueVec invals;
+  WeightedValueVec outvals;
+
+  getImpulses(invals);
+  double tw = _stats.totalWeight;
+  double min = _min;
+  double max = _max;
+
+  for(Hist = others.begin(); Hist != E; ++Hist)
+  {
+    CPHistogram& H = **Hist;
+
+    tw *= H._stats.totalWeight;
+    min *= H._min;
+    max *= H._max;
+
+    crossImpulses(invals, H, outvals);
+    invals.swap(outvals);
+    collapseImpulses(invals, bincount, min, max);
+  }
+
+  CPHistogram* rc = new CPHistogram();
+  rc->_addList.assign(invals.begin(), invals.end());
+  rc->buildFromList(bincount, tw, min, max);
+
+  return(rc);
+}
+
+
+// Batch form of crossRebin for a single left-hand side, eg, all of
+// the call sites that were inlined by one inlining operation.
+void CPHistogram::crossEach(const CPHistogramList& others,
+                            CPHistogramList& products,
+                            unsigned bincount) const
+{
+  WeightedValueVec vals;
+  WeightedValueVec outvals;
+  if( nonZero() )
+    getImpulses(vals);
+
+  for(CPHistogramList::const_iterator Hist = others.begin(),
+        E = others.end(); Hist != E; ++Hist)
+  {
+    if( (*Hist == NULL) || ! (nonZero() && (*Hist)->nonZero()) )
+    {
+      products.push_back(new CPHistogram());
+      continue;
+    }
+
+    const CPHistogram& H = **Hist;
+    unsigned bins = bincount;
+    if(bins == 0)
+      bins = (_bincount > H._bincount) ? _bincount : H._bincount;
+    double min = _min * H._min;
+    double max = _max * H._max;
+
+    crossImpulses(vals, H, outvals);
+    collapseImpulses(outvals, bins, min, max);
+
+    CPHistogram* rc = new CPHistogram();
+    rc->_addList.assign(outvals.begin(), outvals.end());
+    rc->buildFromList(bins, _stats.totalWeight * H._stats.totalWeight,
+                      min, max);
+    products.push_back(rc);
+  }
+}
+
+
+void CPHistogram::getImpulses(WeightedValueVec& vals) const
+{
+  if( !nonZero() )
+    return;
+
+  if( isPoint() )
+  {
+    vals.push_back(std::make_pair(_min, _stats.sumOfWeights));
+    return;
+  }
+
+  for(unsigned i = 0; i < _bincount; i++)
+  {
+    double w = _bins[i];
+    if(w != 0)
+      vals.push_back(std::make_pair(getBinCenter(i), w));
+  }
+}
+
+
+void CPHistogram::collapseImpulses(WeightedValueVec& vals, unsigned bincount,
+                                   double min, double max)
+{
+  // already small enough, or nothing to collapse into
+  if( (bincount == 0) || (vals.size() <= bincount) || !(max > min) )
+    return;
+
+  double width = (max - min)/bincount;
+  std::vector<double> sumW(bincount, 0.0);
+  std::vector<double> sumVW(bincount, 0.0);
+
+  for(unsigned i = 0, E = vals.size(); i < E; i++)
+  {
+    double v = vals[i].first;
+    double w = vals[i].second;
+    int b = (int)floor((v - min)/width);
+    if(b < 0) b = 0;
+    if((unsigned)b >= bincount) b = bincount-1;
+    sumW[b] += w;
+    sumVW[b] += v*w;
+  }
+
+  vals.clear();
+  for(unsigned b = 0; b < bincount; b++)
+    if(sumW[b] > 0)
+      vals.push_back(std::make_pair(sumVW[b]/sumW[b], sumW[b]));
+}
+
+
+void CPHistogram::crossImpulses(const WeightedValueVec& vals,
+                                const CPHistogram& other,
+                                WeightedValueVec& out)
+{
+  WeightedValueVec ovals;
+  other.getImpulses(ovals);
+
+  out.clear();
+  out.reserve(vals.size() * ovals.size());
+  for(unsigned j = 0, JE = ovals.size(); j < JE; j++)
+  {
+    double v = ovals[j].first;
+    double w = ovals[j].second;
+    for(unsigned i = 0, IE = vals.size(); i < IE; i++)
+      out.push_back(std::make_pair(vals[i].first*v, vals[i].second*w));
+  }
+}
+
+
 
 void CPHistogram::setRange(double min, double max)
 {
@@ -685,16 +846,24 @@ double CPHistogram::stdev(bool inclZeros) const
 }
 
 // find the value corresponding to: P(X < val) == q
-// Ignores 0s
-double CPHistogram::quantile(double q) const
+// Ignores 0s unless inclZeros
+double CPHistogram::quantile(double q, bool inclZeros) const
 {
   if(!nonZero()) return(0);
 
+  if(inclZeros)
+  {
+    // the 0s are the bottom (1 - coverage) of the distribution
+    double zeros = 1.0 - coverage();
+    if(q <= zeros) return(0);
+    q = (q - zeros)/(1.0 - zeros);
+  }
+
   if(isPoint())
   {
     //errs() << "CPHistogram::quantile Error: Points don't have quantiles\n";
     //debug
-    errs() << " q(" << format("%.2f", q) << ") = " << format("%.2f", _min) << " ";
+    //errs() << " q(" << format("%.2f", q) << ") = " << format("%.2f", _min) << " ";
     return(_min);
   }
 
@@ -719,7 +888,7 @@ double CPHistogram::quantile(double q) const
   double val = getBinLowerLimit(i) + getBinWidth()*p;
 
   // debug
-  errs() << " q(" << format("%.2f", q) << ") = " << format("%.2f", _min) << " ";
+  //errs() << " q(" << format("%.2f", q) << ") = " << format("%.2f", val) << " ";
 
   return(val);
 }
@@ -1334,10 +1503,108 @@ void CPHistogram::addToList(double v, double w)
 	_addList.push_back(std::make_pair(v,w));
 }
 
+// Grow the range by doubling until it covers v, and move the weight
+// of each old bin to the new bin holding its center.  With an even
+// bin count, each new bin is exactly two old ones (unless the lower
+// bound would have to go below 0).
+void CPHistogram::fitRange(double v, unsigned bincount)
+{
+  if( (v <= FP_FUDGE_EPS) || !nonZero() )
+    return;
+
+  if(isPoint())
+  {
+    // second distinct value: bin the point and v over their range
+    double point = _min;
+    if(v == point)
+      return;
+    setRange(std::min(point, v), std::max(point, v));
+    setBinCount(bincount);
+    addToBin(whichBin(point), _stats.sumOfWeights);
+    return;
+  }
+
+  if( (v >= _min) && (v <= _max) )
+    return;
+
+  double min = _min;
+  double max = _max;
+  while( (v < min) || (v > max) )
+  {
+    double span = max - min;
+    if(v > max)
+      max += span;
+    else if(min - span > 0)
+      min -= span;
+    else
+      min = v;  // the range stays above 0
+  }
+
+  std::vector<double> old(_bins, _bins + _bincount);
+  double oldMin = _min;
+  double oldWidth = getBinWidth();
+  setRange(min, max);
+  setBinCount(_bincount);
+  for(unsigned b = 0; b < old.size(); b++)
+    if(old[b] > 0)
+      addToBin(whichBin(oldMin + (b + 0.5) * oldWidth), old[b]);
+}
+
+
+void CPHistogram::addValue(double v, double w, unsigned bincount)
+{
+  if(w <= 0)
+    return;
+
+  _stats.totalWeight += w;
+  if(v <= FP_FUDGE_EPS)
+    return;
+
+  if(!nonZero())
+  {
+    // first non-zero value: a point
+    setBinCount(0);
+    setRange(v, v);
+  }
+  else
+    fitRange(v, bincount);
+
+  if(!isPoint())
+    addToBin(whichBin(v), w);
+
+  // weighted running mean and sum of squared deviations
+  double mean = (_stats.sumOfWeights > 0) ?
+    _stats.sumOfValues / _stats.sumOfWeights : 0;
+  _stats.sumOfWeights += w;
+  _stats.sumOfValues += v * w;
+  _stats.sumOfSquares += w * (v - mean) * 
+    (v - _stats.sumOfValues / _stats.sumOfWeights);
+}
+
+
+void CPHistogram::scale(double f)
+{
+  if(_bins != NULL)
+    for(unsigned b = 0; b < _bincount; b++)
+      _bins[b] *= f;
+
+  _stats.sumOfSquares *= f;
+  _stats.sumOfValues *= f;
+  _stats.sumOfWeights *= f;
+  _stats.totalWeight *= f;
+
+  for(WeightedValueList::iterator WV = _addList.begin(), E = _addList.end();
+      WV != E; ++WV)
+    WV->second *= f;
+}
+
+
 // write binary representation to f
 bool CPHistogram::serialize(unsigned ID, FILE* f) const
 {
+  // zeroed so the padding is too: equal profiles give equal files
   CPHistogramHeader entry;
+  memset(&entry, 0, sizeof(entry));
 
   entry.ID = ID;
   entry.sumOfSquares = _stats.sumOfSquares;
@@ -1389,6 +1656,7 @@ bool CPHistogram::serialize(unsigned ID, FILE* f) const
       continue;
     
     CPHistogramBin newBin;
+    memset(&newBin, 0, sizeof(newBin));
     newBin.index  = j;
     newBin.weight = getBinWeight(j);
     
@@ -1415,6 +1683,62 @@ int CPHistogram::deserialize(unsigned bincount, double totalweight, FILE* f)
     return(-1);
   }
 
+  int binsUsed = readHeader(entry, bincount, totalweight);
+  if(binsUsed < 0)
+    return(-1);
+
+  // Get the data for each bin
+  for(int b = 0; b < binsUsed; b++)
+  {
+    CPHistogramBin newBin;
+
+    // Read in the bin
+    if( fread(&newBin, sizeof(CPHistogramBin), 1, f) != 1 )
+    {
+      errs() << "warning: could not read histogram bin entry " << b << "\n";
+      return(-1);
+    }
+    setBinWeight(newBin.index, newBin.weight);
+  }
+  return(entry.ID);
+}
+
+
+// read binary representation from memory (eg, a mapped file)
+int CPHistogram::deserialize(unsigned bincount, double totalweight,
+                             const char*& data, const char* end)
+{
+  CPHistogramHeader entry;
+
+  if( (end - data) < (long)sizeof(CPHistogramHeader) )
+    return(-1);
+  memcpy(&entry, data, sizeof(CPHistogramHeader));
+  data += sizeof(CPHistogramHeader);
+
+  int binsUsed = readHeader(entry, bincount, totalweight);
+  if(binsUsed < 0)
+    return(-1);
+
+  if( (end - data) < (long)(binsUsed * sizeof(CPHistogramBin)) )
+  {
+    errs() << "warning: could not read histogram bin entries\n";
+    return(-1);
+  }
+
+  for(int b = 0; b < binsUsed; b++)
+  {
+    CPHistogramBin newBin;
+    memcpy(&newBin, data, sizeof(CPHistogramBin));
+    data += sizeof(CPHistogramBin);
+    setBinWeight(newBin.index, newBin.weight);
+  }
+  return(entry.ID);
+}
+
+
+int CPHistogram::readHeader(const CPHistogramHeader& entry, unsigned bincount,
+                            double totalweight)
+{
   clear();
 
   _stats.sumOfSquares = entry.sumOfSquares;
@@ -1434,7 +1758,7 @@ int CPHistogram::deserialize(unsigned bincount, double totalweight, FILE* f)
            << entry.ID << "\n";
 
   if(isPoint())  // points have no bins, we're done
-    return(entry.ID);
+    return(0);
 
   // allocate the bins
   setBinCount(bincount);
@@ -1447,20 +1771,7 @@ int CPHistogram::deserialize(unsigned bincount, double totalweight, FILE* f)
     return(-1);
   }
 
-  // Get the data for each bin
-  for(unsigned b = 0; b < entry.binsUsed; b++)
-  {
-    CPHistogramBin newBin;
-
-    // Read in the bin
-    if( fread(&newBin, sizeof(CPHistogramBin), 1, f) != 1 )
-    {
-      errs() << "warning: could not read histogram bin entry " << b << "\n";
-      return(-1);
-    }
-    setBinWeight(newBin.index, newBin.weight);
-  }
-  return(entry.ID);
+  return(entry.binsUsed);
 }
 
 
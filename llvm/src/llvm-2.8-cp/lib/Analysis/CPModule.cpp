@@ -0,0 +1,48 @@
+//===- CPModule.cpp -------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Support for lazily-loaded modules in the CP classes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Function.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+bool llvm::isCPDefinition(const Function& F)
+{
+  return( !F.isDeclaration() || F.isMaterializable() );
+}
+
+
+CPFunctionBody::CPFunctionBody(Function& F) :
+  _F(F), _ok(true), _temporary(false)
+{
+  if( !F.isMaterializable() )
+    return;
+
+  std::string error;
+  if( F.Materialize(&error) )
+  {
+    errs() << "CPFunctionBody Error: cannot read '" << F.getName() 
+           << "': " << error << "\n";
+    _ok = false;
+    return;
+  }
+  _temporary = F.isDematerializable();
+}
+
+
+CPFunctionBody::~CPFunctionBody()
+{
+  if(_temporary)
+    _F.Dematerialize();
+}
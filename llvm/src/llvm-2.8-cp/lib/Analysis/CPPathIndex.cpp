@@ -0,0 +1,180 @@
+//===- CPPathIndex.cpp ----------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Hot path queries over a combined path profile.  See CPPathIndex.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/CPPathIndex.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Analysis/PathNumbering.h"
+#include "llvm/Function.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+// best first; ties go to the higher frequency, then the lower path number
+// so the order doesn't depend on the histogram layout
+static bool betterPath(const CPHotPath& a, const CPHotPath& b)
+{
+  if(a.score != b.score)
+    return(a.score > b.score);
+  if(a.freq != b.freq)
+    return(a.freq > b.freq);
+  return(a.path < b.path);
+}
+
+
+CPPathIndex::CPPathIndex(CombinedPathProfile& cpp, CPPathRank rank,
+                         double q) :
+  _cpp(cpp), _rank(rank), _dag(NULL), _dagFunction(0)
+{
+  PathSet paths;
+  cpp.getPathSet(paths);
+
+  for(PathSet::iterator P = paths.begin(), E = paths.end(); P != E; ++P)
+  {
+    CPHistogram& hist = cpp.getHistogram(*P);
+
+    CPHotPath hot;
+    hot.path = P->second;
+    hot.freq = hist.mean(true);
+    switch(rank)
+    {
+    case CPRankMean:     hot.score = hot.freq; break;
+    case CPRankQuantile: hot.score = hist.quantile(q, true); break;
+    case CPRankCoverage: hot.score = hist.coverage(); break;
+    }
+    _ranked[P->first].push_back(hot);
+  }
+
+  for(RankMap::iterator F = _ranked.begin(), E = _ranked.end(); F != E; ++F)
+  {
+    std::sort(F->second.begin(), F->second.end(), betterPath);
+
+    std::vector<double>& cumulative = _cumulative[F->first];
+    double total = 0;
+    for(unsigned i = 0; i < F->second.size(); i++)
+    {
+      total += F->second[i].freq;
+      cumulative.push_back(total);
+    }
+  }
+}
+
+
+CPPathIndex::~CPPathIndex()
+{
+  // the DAG points into the bodies
+  delete _dag;
+  for(BodyMap::iterator B = _bodies.begin(), E = _bodies.end(); B != E; ++B)
+    delete B->second;
+}
+
+
+const char* CPPathIndex::getRankName(CPPathRank rank)
+{
+  switch(rank)
+  {
+  case CPRankMean:     return("mean");
+  case CPRankQuantile: return("quantile");
+  case CPRankCoverage: return("coverage");
+  }
+  return("unknown");
+}
+
+
+void CPPathIndex::getFunctions(std::vector<FunctionIndex>& functions) const
+{
+  for(RankMap::const_iterator F = _ranked.begin(), E = _ranked.end();
+      F != E; ++F)
+    functions.push_back(F->first);
+}
+
+
+FunctionIndex CPPathIndex::getFunctionIndex(Function* F) const
+{
+  for(RankMap::const_iterator R = _ranked.begin(), E = _ranked.end();
+      R != E; ++R)
+    if(_cpp.getFunction(R->first) == F)
+      return(R->first);
+  return(0);
+}
+
+
+const CPHotPathVec& CPPathIndex::getPaths(FunctionIndex f) const
+{
+  static const CPHotPathVec none;
+  RankMap::const_iterator F = _ranked.find(f);
+  return( (F == _ranked.end()) ? none : F->second );
+}
+
+
+void CPPathIndex::getTopPaths(FunctionIndex f, unsigned k,
+                              CPHotPathVec& paths) const
+{
+  const CPHotPathVec& ranked = getPaths(f);
+  if(k > ranked.size())
+    k = ranked.size();
+  paths.assign(ranked.begin(), ranked.begin() + k);
+}
+
+
+void CPPathIndex::getCoveringPaths(FunctionIndex f, double fraction,
+                                   CPHotPathVec& paths) const
+{
+  paths.clear();
+  FreqMap::const_iterator C = _cumulative.find(f);
+  if( (C == _cumulative.end()) || C->second.empty() )
+    return;
+
+  // the running totals only grow, so the answer is the prefix up to
+  // the first one that reaches the target (give or take the rounding
+  // in the sums)
+  const std::vector<double>& cumulative = C->second;
+  double target = fraction * cumulative.back() * (1.0 - 1.0e-9);
+  unsigned k = std::lower_bound(cumulative.begin(), cumulative.end(),
+                                target) - cumulative.begin();
+  if(k < cumulative.size())
+    k++;
+  getTopPaths(f, k, paths);
+}
+
+
+const PathBlockVector& CPPathIndex::getPathBlocks(FunctionIndex f,
+                                                  PathIndex p)
+{
+  PathID id(f, p);
+  BlockMap::iterator B = _blocks.find(id);
+  if(B != _blocks.end())
+    return(B->second);
+
+  PathBlockVector& blocks = _blocks[id];
+  Function* F = _cpp.getFunction(f);
+  if(F == NULL)
+    return(blocks);
+
+  if(_dagFunction != f)
+  {
+    if(_bodies.count(f) == 0)
+      _bodies[f] = new CPFunctionBody(*F);
+
+    delete _dag;
+    _dag = new BallLarusDag(*F);
+    _dag->init();
+    _dag->calculatePathNumbers();
+    _dagFunction = f;
+  }
+
+  if(p < _dag->getNumberOfPaths())
+    PathProfileInfo::decodePathBlocks(*_dag, p, blocks);
+  return(blocks);
+}
@@ -0,0 +1,456 @@
+//===- CPServer.cpp -------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Long-lived profile server for the CP tools.  See CPServer.h for the
+// command set.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Config/config.h"
+#include "llvm/Analysis/CPServer.h"
+#include "llvm/Analysis/CPConvergence.h"
+#include "llvm/Analysis/CPDrift.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPStats.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/System/Path.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+// longest command line accepted
+#define CPSERVER_LINE_MAX 65536
+
+CPServer::CPServer(Module& M, unsigned driftThreads) :
+  _M(M), _driftThreads(driftThreads), _quit(false), _watch(NULL)
+{
+}
+
+
+CPServer::~CPServer()
+{
+  dropAll();
+  if(_watch != NULL)
+    delete _watch;
+}
+
+
+void CPServer::drop(const std::string& filename)
+{
+  CPCache::iterator i = _cache.find(filename);
+  if(i == _cache.end())
+    return;
+
+  delete i->second.cp;
+  _cache.erase(i);
+}
+
+
+void CPServer::dropAll()
+{
+  for(CPCache::iterator i = _cache.begin(), E = _cache.end(); i != E; ++i)
+    delete i->second.cp;
+  _cache.clear();
+}
+
+
+// return the cached CP for the file, (re)loading it if needed
+CombinedProfile* CPServer::getCP(const std::string& filename,
+                                 std::string& error)
+{
+  sys::PathWithStatus path(filename);
+  const sys::FileStatus* status = path.getFileStatus(true, &error);
+  if(status == NULL)
+    return(NULL);
+
+  CPCache::iterator i = _cache.find(filename);
+  if(i != _cache.end())
+  {
+    if(i->second.modTime == status->getTimestamp())
+      return(i->second.cp);
+    drop(filename);
+  }
+
+  CPFactory fact(_M);
+  if( !fact.buildProfiles(filename) )
+  {
+    error = "failed to read profile '" + filename + "'";
+    return(NULL);
+  }
+
+  int numProfs = fact.hasEdgeCP() + fact.hasPathCP() + fact.hasCallCP()
+    + fact.hasTripCountCP() + fact.hasValueCP();
+  if(numProfs != 1)
+  {
+    error = "'" + filename + "' does not hold exactly one type of profile";
+    return(NULL);
+  }
+
+  CombinedProfile* cp = NULL;
+  if(fact.hasEdgeCP()) cp = fact.takeEdgeCP();
+  if(fact.hasPathCP()) cp = fact.takePathCP();
+  if(fact.hasCallCP()) cp = fact.takeCallCP();
+  if(fact.hasTripCountCP()) cp = fact.takeTripCountCP();
+  if(fact.hasValueCP()) cp = fact.takeValueCP();
+
+  _cache.insert(std::make_pair(filename,
+                               CacheEntry(cp, status->getTimestamp())));
+  return(cp);
+}
+
+
+// merge <out> <in>...
+bool CPServer::merge(const WordVec& words, std::string& error)
+{
+  const std::string& outName = words[1];
+  FilenameVec inputs(words.begin()+2, words.end());
+
+  CPFactory fact(_M);
+  if( !fact.buildProfiles(inputs) )
+  {
+    error = "failed to read profiles";
+    return(false);
+  }
+
+  FILE* file = fopen(outName.c_str(), "wb");
+  if(!file)
+  {
+    error = "cannot open '" + outName + "' for writing";
+    return(false);
+  }
+
+  bool ok = fact.getFunctionKeys().serialize(file);
+
+  // in output order, like llvm-cprof
+  CombinedProfile* cps[5] = { fact.takeEdgeCP(), fact.takePathCP(),
+                              fact.takeCallCP(), fact.takeTripCountCP(),
+                              fact.takeValueCP() };
+  for(unsigned i = 0; i < 5; i++)
+  {
+    if(cps[i] == NULL)
+      continue;
+    // 0 histograms is also what a profile with no weight writes, so
+    // only the stream can tell the two apart
+    if( ok && (cps[i]->serialize(file) == 0) && ferror(file) )
+      ok = false;
+    delete cps[i];
+  }
+
+  CPStats::count(CPBytesWritten, ftell(file));
+  if(fclose(file) != 0)
+    ok = false;
+  if(!ok)
+  {
+    error = "cannot write '" + outName + "'";
+    drop(outName);
+    return(false);
+  }
+
+  // the timestamp may not have moved if we rewrote it quickly
+  drop(outName);
+  return(true);
+}
+
+
+// watch <raw>...
+bool CPServer::watch(const WordVec& words, llvm::raw_ostream& out,
+                     std::string& error)
+{
+  if(_watch == NULL)
+    _watch = new CPConvergence(_M);
+
+  for(unsigned w = 1; w < words.size(); w++)
+  {
+    if(!_watch->addRun(words[w]))
+    {
+      error = "failed to read profile '" + words[w] + "'";
+      return(false);
+    }
+    out << _watch->runs() << "\t" << _watch->lastDrift() << "\n";
+  }
+  return(true);
+}
+
+
+// query <cp> <index> or <cp> <func>-<path>
+bool CPServer::query(CombinedProfile* cp, const std::string& id,
+                     llvm::raw_ostream& out, std::string& error)
+{
+  char* end;
+  const char* str = id.c_str();
+  unsigned first = strtoul(str, &end, 10);
+
+  if(end == str)
+  {
+    error = "bad histogram id '" + id + "'";
+    return(false);
+  }
+
+  if(cp->getProfilingType() == CombinedPathInfo)
+  {
+    const char* pstr = end + 1;
+    if(*end != '-')
+    {
+      error = "path histograms are named <function>-<path>";
+      return(false);
+    }
+    unsigned second = strtoul(pstr, &end, 10);
+    if( (end == pstr) || (*end != '\0') )
+    {
+      error = "bad histogram id '" + id + "'";
+      return(false);
+    }
+
+    CombinedPathProfile* cpp = (CombinedPathProfile*)cp;
+    PathID pid(first, second);
+    if( !cpp->valid(pid) )
+    {
+      error = "no histogram " + id;
+      return(false);
+    }
+    cpp->getHistogram(pid).print(out);
+    return(true);
+  }
+
+  const CPHistogram* h = NULL;
+  if(*end == '\0')
+    h = cp->getHistogramAt(first);
+  if(h == NULL)
+  {
+    error = "no histogram " + id;
+    return(false);
+  }
+  h->print(out);
+  return(true);
+}
+
+
+void CPServer::split(const std::string& line, WordVec& words)
+{
+  const char* space = " \t\r\n";
+  std::string::size_type b = line.find_first_not_of(space);
+  while(b != std::string::npos)
+  {
+    std::string::size_type e = line.find_first_of(space, b);
+    words.push_back(line.substr(b, e - b));
+    b = line.find_first_not_of(space, e);
+  }
+}
+
+
+bool CPServer::execute(const std::string& line, llvm::raw_ostream& out)
+{
+  WordVec words;
+  std::string error;
+  bool ok = false;
+
+  split(line, words);
+
+  // blank lines are not commands
+  if(words.size() == 0)
+    return(true);
+
+  const std::string& cmd = words[0];
+  unsigned args = words.size() - 1;
+
+  if( (cmd == "quit") && (args == 0) )
+  {
+    _quit = true;
+    ok = true;
+  }
+  else if( (cmd == "merge") && (args >= 2) )
+  {
+    ok = merge(words, error);
+  }
+  else if( (cmd == "load") && (args == 1) )
+  {
+    drop(words[1]);
+    ok = (getCP(words[1], error) != NULL);
+  }
+  else if( (cmd == "drop") && (args <= 1) )
+  {
+    if(args == 0)
+      dropAll();
+    else
+      drop(words[1]);
+    ok = true;
+  }
+  else if( ((cmd == "summary") || (cmd == "stats") || (cmd == "print"))
+           && (args == 1) )
+  {
+    CombinedProfile* cp = getCP(words[1], error);
+    if(cp != NULL)
+    {
+      if(cmd == "summary")
+        cp->printSummary(out);
+      else if(cmd == "stats")
+        cp->printHistogramStats(out);
+      else
+        cp->print(out);
+      ok = true;
+    }
+  }
+  else if( (cmd == "query") && (args == 2) )
+  {
+    CombinedProfile* cp = getCP(words[1], error);
+    if(cp != NULL)
+      ok = query(cp, words[2], out, error);
+  }
+  else if( (cmd == "drift") && ((args == 2)
+                                || ((args == 3) && (words[3] == "emd"))) )
+  {
+    CombinedProfile* cp1 = getCP(words[1], error);
+    CombinedProfile* cp2 = (cp1 != NULL) ? getCP(words[2], error) : NULL;
+
+    if( (cp1 != NULL) && (cp2 != NULL) )
+    {
+      if(cp1->getProfilingType() != cp2->getProfilingType())
+        error = "profiles are not of the same type";
+      else
+      {
+        CPDrift drift(_driftThreads);
+        if(cp1->getProfilingType() == CombinedPathInfo)
+          drift.compare(*(CombinedPathProfile*)cp1,
+                        *(CombinedPathProfile*)cp2);
+        else
+          drift.compare(*cp1, *cp2);
+        drift.print(out, cp1->getNameStr(), args == 3);
+        ok = true;
+      }
+    }
+  }
+  else if( (cmd == "watch") && (args >= 1) )
+  {
+    ok = watch(words, out, error);
+  }
+  else if( (cmd == "converged") && (args == 2) )
+  {
+    double tolerance = atof(words[1].c_str());
+    unsigned window = (unsigned)atoi(words[2].c_str());
+    bool yes = (_watch != NULL) && _watch->converged(tolerance, window);
+    out << (yes ? "yes" : "no") << "\n";
+    ok = true;
+  }
+  else if( (cmd == "unwatch") && (args == 0) )
+  {
+    if(_watch != NULL)
+      _watch->clear();
+    ok = true;
+  }
+  else
+    error = "bad command '" + cmd + "'";
+
+  if(ok)
+    out << "ok\n";
+  else
+    out << "error: " << error << "\n";
+  out.flush();
+
+  return(ok);
+}
+
+
+void CPServer::serve(FILE* in, llvm::raw_ostream& out)
+{
+  std::vector<char> buf(CPSERVER_LINE_MAX);
+
+  while( !_quit && (fgets(&buf[0], buf.size(), in) != NULL) )
+    execute(std::string(&buf[0]), out);
+}
+
+
+bool CPServer::serveSocket(const std::string& path)
+{
+#ifdef LLVM_ON_UNIX
+  struct sockaddr_un addr;
+
+  if(path.size() >= sizeof(addr.sun_path))
+  {
+    errs() << "CPServer::serveSocket Error: socket path too long\n";
+    return(false);
+  }
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(sock < 0)
+  {
+    errs() << "CPServer::serveSocket Error: cannot create socket\n";
+    return(false);
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+  unlink(path.c_str());
+
+  if( (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+      || (listen(sock, 8) != 0) )
+  {
+    errs() << "CPServer::serveSocket Error: cannot listen on '"
+           << path << "'\n";
+    close(sock);
+    return(false);
+  }
+
+  // a client that hangs up mid-reply must not take the server down
+  void (*oldPipe)(int) = signal(SIGPIPE, SIG_IGN);
+
+  // one client at a time: the CP classes' static data is not thread-safe
+  bool ok = true;
+  while(!_quit)
+  {
+    int client = accept(sock, NULL, NULL);
+    if(client < 0)
+    {
+      // a signal or a client that gave up before we got to it; anything
+      // else (EBADF, EMFILE, ...) would just fail again, so stop serving
+      if( (errno == EINTR) || (errno == ECONNABORTED) )
+        continue;
+
+      errs() << "CPServer::serveSocket Error: accept failed: "
+             << strerror(errno) << "\n";
+      ok = false;
+      break;
+    }
+
+    FILE* in = fdopen(client, "r");
+    if(in == NULL)
+    {
+      close(client);
+      continue;
+    }
+
+    {
+      raw_fd_ostream out(client, false);
+      serve(in, out);
+      out.flush();
+      // ~raw_fd_ostream treats an unhandled write error as fatal
+      out.clear_error();
+    }
+    fclose(in);  // also closes client
+  }
+
+  signal(SIGPIPE, oldPipe);
+  close(sock);
+  unlink(path.c_str());
+  return(ok);
+#else
+  errs() << "CPServer::serveSocket Error: sockets not supported on this host\n";
+  return(false);
+#endif
+}
@@ -0,0 +1,114 @@
+//===- CPStats.cpp --------------------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Phase timers and counters for the combined profiling code.  See
+// CPStats.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/CPStats.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace llvm;
+
+bool CPStats::Timing = false;
+bool CPStats::Counting = false;
+
+static cl::opt<bool,true>
+EnableTiming("time-cprof", cl::location(CPStats::Timing),
+             cl::desc("Time each combined profiling phase and count "
+                      "histograms, samples and bytes"));
+
+static const char* PhaseNames[CPNumPhases] = {
+  "Reading bitcode",
+  "Building EDTs",
+  "Reading raw profiles",
+  "Reading combined profiles",
+  "Building histograms",
+  "Merging profiles",
+  "Writing profiles"
+};
+
+static const char* CounterNames[CPNumCounters] = {
+  "histograms built",
+  "add-list samples",
+  "bytes read",
+  "bytes written"
+};
+
+namespace {
+  // Created the first time a phase is timed or something is counted,
+  // and printed when llvm_shutdown destroys it.
+  class CPStatsInfo {
+  public:
+    TimerGroup group;  // before the timers: they leave it as they go
+    Timer timers[CPNumPhases];
+    uint64_t counters[CPNumCounters];
+    bool counted;
+
+    CPStatsInfo() : group("Combined Profiling"), counted(false)
+    {
+      for(unsigned i = 0; i < CPNumPhases; i++)
+        timers[i].init(PhaseNames[i], group);
+      for(unsigned i = 0; i < CPNumCounters; i++)
+        counters[i] = 0;
+    }
+
+    ~CPStatsInfo() {print(errs());};
+
+    // the timers that ran, then the counters; both are reset
+    void print(raw_ostream& stream)
+    {
+      group.print(stream);
+      if(!counted)
+        return;
+
+      stream << "===" << std::string(73, '-') << "===\n"
+             << "                   ... Combined Profiling Counters ...\n"
+             << "===" << std::string(73, '-') << "===\n\n";
+      for(unsigned i = 0; i < CPNumCounters; i++)
+      {
+        stream << format("%20llu", (unsigned long long)counters[i])
+               << "  " << CounterNames[i] << "\n";
+        counters[i] = 0;
+      }
+      stream << "\n";
+      stream.flush();
+      counted = false;
+    }
+  };
+}
+
+static ManagedStatic<CPStatsInfo> Info;
+
+
+Timer* CPStats::getPhaseTimer(CPPhase phase)
+{
+  return(&Info->timers[phase]);
+}
+
+
+void CPStats::addCount(CPCounter counter, uint64_t n)
+{
+  Info->counters[counter] += n;
+  Info->counted = true;
+}
+
+
+void CPStats::print(raw_ostream& stream)
+{
+  if(Info.isConstructed())
+    Info->print(stream);
+}
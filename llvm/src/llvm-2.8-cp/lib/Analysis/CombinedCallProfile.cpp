@@ -16,11 +16,14 @@
 #include "llvm/Module.h"
 #include "llvm/IntrinsicInst.h"
 //#include "llvm/Support/Format.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/CallSite.h"
 
 #include "llvm/Analysis/CombinedProfile.h"
 #include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Analysis/CPStats.h"
 
 
 using namespace llvm;
@@ -58,7 +61,7 @@ CombinedCallProfile::CombinedCallProfile(Module& M)
     // count real functions
     for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F) 
     {
-      if (!F->isDeclaration())
+      if (isCPDefinition(*F))
         numFuncs++;
     }
     _funcRef.resize(numFuncs, 0);
@@ -69,9 +72,12 @@ CombinedCallProfile::CombinedCallProfile(Module& M)
     
     for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F) 
     {
-      if (F->isDeclaration()) continue;
+      if (!isCPDefinition(*F)) continue;
       
       _funcRef[fnum] = F;
+      // BBs of a lazily-read body go away again: don't map them
+      CPFunctionBody body(*F);
+      bool mapBlocks = !body.temporary();
       //errs() << "    F " << fnum << ": " << _funcRef[fnum]->getName().str() 
       //       << "   (" << _funcRef[fnum]->size() << ")\n";
       //
@@ -82,7 +88,7 @@ CombinedCallProfile::CombinedCallProfile(Module& M)
       if(hasFDOInliningCandidate(BB))
       {
         //errs() << ">";
-        _profmap[BB] = _histCnt;
+        if(mapBlocks) _profmap[BB] = _histCnt;
         _funcIndex.push_back(fnum);
         _entryCalls.push_back(_histCnt);
         _histCnt++;
@@ -100,7 +106,8 @@ CombinedCallProfile::CombinedCallProfile(Module& M)
         if(hasFDOInliningCandidate(BB))
         {
           //errs() << "$";
-          _profmap[BB] = _histCnt++;
+          if(mapBlocks) _profmap[BB] = _histCnt;
+          _histCnt++;
           _funcIndex.push_back(fnum);
         }
         else
@@ -135,8 +142,11 @@ bool CombinedCallProfile::isEntry(BasicBlock* BB)
    
 unsigned CombinedCallProfile::serialize(FILE* f)
 {
+  TimeRegion timer(CPStats::getTimer(CPTimeWrite));
 	unsigned callCount = 0;
 
+  materializeAll();
+
   //errs() << "--> CCP::serialize\n";
 
 	// Calculate the number of histograms which have non-zero data
@@ -194,7 +204,7 @@ bool CombinedCallProfile::deserialize(FILE* f)
     CPHistogram* newHist = new CPHistogram();
     int index = newHist->deserialize(_bincount, _weight, f);
     
-    if(index < 0) {
+    if( (index < 0) || ((unsigned)index >= _histograms.size()) ) {
       errs() << "CombinedCallProfile: error: unable to read histogram " 
              << h << " of " << callCount << "\n";
       delete newHist;
@@ -216,13 +226,14 @@ bool CombinedCallProfile::deserialize(FILE* f)
 }
 
 
-// Reads in a raw profile from the file and adds the
-// hierarchically-normalized call-block frequencies to the appropriate
-// histogram's add list.
-bool CombinedCallProfile::addProfile(FILE* file)
+// Reads in a raw profile from the file and computes the
+// hierarchically-normalized frequency of every call block: its count
+// over the entry count of its function (1 for entry blocks, 0 if
+// either count is 0).  Only reads the static maps, so any number of
+// threads can share one CCP for this.
+bool CombinedCallProfile::readNormalized(FILE* file,
+                                         std::vector<double>& freqs) const
 {
-  //errs() << "--> CCP::addProfile (" << getTotalWeight() << ")\n";
-  
   // get the number of profiled blocks in this profile (entry blocks +
   // blocks with calls)
   unsigned callCount;
@@ -243,66 +254,69 @@ bool CombinedCallProfile::addProfile(FILE* file)
   }
 
   // read the counters
-  unsigned* callBuffer = new unsigned[callCount];
-  if( fread(callBuffer, sizeof(unsigned), callCount, file)
-      != callCount) {
-    delete [] callBuffer;
+  UnsignedVec callBuffer(callCount);
+  if( (callCount > 0) &&
+      (fread(&callBuffer[0], sizeof(unsigned), callCount, file)
+       != callCount) ) {
     errs() << "  warning: call profiling info header/data mismatch\n";
     return(false);
   }
 
-  addWeight(1.0);
-
-  // allocate any missing histograms
-  for(unsigned i = 0; i < _histograms.size(); i++)
-  {
-    if( _histograms[i] == NULL ) 
-      _histograms[i] = new CPHistogram();
-  }
-
-  unsigned i = 0;   // index into callBuffer
-
-  // function entry frequencies are first
-  //errs() << "  Reading " << _funcFreq.size() << " function counters\n";
-  for(unsigned f = 0, E = _funcFreq.size(); f != E; ++f, ++i)
-  {
-    //errs() << "     i=" << i << " ";
-    //errs() << _funcRef[f]->getName().str() << ": ";
-    //errs() << callBuffer[i] << "\n";
-    unsigned count = callBuffer[i];
-    if(count == 0xffffffff)
+  // function entry frequencies are first...
+  unsigned funcCount = _funcFreq.size();
+  for(unsigned f = 0; f < funcCount; ++f)
+    if(callBuffer[f] == 0xffffffff)
       errs() << "CombinedCallProfile::addProfile Warning: saturated function entry count (" << f << ")\n";
-    _funcFreq[f] = count;
-  }
 
   // ... followed by frequencies for block with calls
-  //errs() << "  Reading " << _histograms.size() << " block counters\n";
+  freqs.assign(_histograms.size(), 0);
+  unsigned i = funcCount;   // index into callBuffer
   unsigned ec = 0;  // index in _entryCalls
   for(unsigned h = 0, E = _histograms.size(); h < E; ++h, ++i)
   {
     if(h == _entryCalls[ec])  // entry blocks always have HN-freq=1
     {
-      //errs() << "    h["<<h<<"] = 1 (entry " << ec << ")\n";
       // this counter doesn't actually exist, so increment h!
-      _histograms[h++]->addToList(1.0);  
+      freqs[h++] = 1.0;
       ec++;
     }
 
-    //errs() << "    h["<<h<<"] = ";
-    unsigned funcFreq = _funcFreq[_funcIndex[h]];
+    unsigned funcFreq = callBuffer[_funcIndex[h]];
     unsigned count = callBuffer[i];
     if(count == 0xffffffff)
       errs() << "CombinedCallProfile::addProfile Warning: saturated call count (" << h << ")\n";
     if( (funcFreq > 0) && (count > 0) )
-    {
-      double normFreq = (double)count / (double) funcFreq;
-      //errs() << callBuffer[i] << "/" << funcFreq << " = " 
-      //       << normFreq << "\n";
-      _histograms[h]->addToList(normFreq);
-    }
+      freqs[h] = (double)count / (double) funcFreq;
+  }
+
+  return(true);
+}
+
+
+// Reads in a raw profile from the file and adds the
+// hierarchically-normalized call-block frequencies to the appropriate
+// histogram's add list.
+bool CombinedCallProfile::addProfile(FILE* file)
+{
+  //errs() << "--> CCP::addProfile (" << getTotalWeight() << ")\n";
+
+  std::vector<double> freqs;
+  if(!readNormalized(file, freqs))
+    return(false);
+
+  addWeight(_runWeight);
+
+  // allocate any missing histograms (in place, only the ones we add to)
+  for(unsigned i = 0; (i < _histograms.size()) && !_inPlace; i++)
+  {
+    if( _histograms[i] == NULL ) 
+      _histograms[i] = new CPHistogram();
   }
 
-  delete [] callBuffer;
+  for(unsigned h = 0, E = _histograms.size(); h < E; ++h)
+    if(freqs[h] > 0)
+      addRunValue((*this)[h], freqs[h], _runWeight);
+
   //errs() << "<-- CCP::addProfile (" << getTotalWeight() << ")\n";
   return(true);
 }
@@ -399,11 +413,32 @@ CPHistogram& CombinedCallProfile::operator[](const CallIndex index)
   //  index = _histograms.size()-1;
   //}
 
-  if( _histograms[index] == NULL )
+  if( (_histograms[index] == NULL) && (materialize(index) == NULL) )
     _histograms[index] = new CPHistogram();
 	return *_histograms[index];
 }
 
+
+// same histograms as serialize
+void CombinedCallProfile::getIndexOrder(std::vector<CPIndexEntry>& order) const
+{
+  for(unsigned i = 0; i < _histograms.size(); i++)
+  {
+    if( (_histograms[i] == NULL) || !_histograms[i]->nonZero() )
+      continue;
+    CPIndexEntry e = { 0, i, i };
+    order.push_back(e);
+  }
+}
+
+
+unsigned CombinedCallProfile::addIndexedSlot(unsigned fnNumber, unsigned ID)
+{
+  if( (fnNumber != 0) || (ID >= _histograms.size()) )
+    return(CP_NOT_INDEXED);
+  return(ID);
+}
+
 /*
 CPHistogram& CombinedCallProfile::operator[](const CallSite call)
 {
@@ -459,7 +494,7 @@ bool CombinedCallProfile::isFDOInliningCandidate(Instruction* I)
   if(callee == cs.getCaller()) return(false);
   
   // Can't inline without the definition (assumes whole-program analysis)
-  if(callee->isDeclaration()) return(false);
+  if(!isCPDefinition(*callee)) return(false);
   
   // We're out of excuses
   return(true);
@@ -14,9 +14,14 @@
 #include "llvm/Analysis/ProfileInfoTypes.h"
 #include "llvm/Analysis/CombinedProfile.h"
 #include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Analysis/CPStats.h"
 #include "llvm/Analysis/EdgeDominatorTree.h"
+#include "llvm/Analysis/PathNumbering.h"
+#include "llvm/Module.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <cmath>
@@ -33,10 +38,13 @@ using namespace llvm;
 EdgeDominatorTree* CombinedEdgeProfile::_edt = NULL;
 
 
-CombinedEdgeProfile::CombinedEdgeProfile(Module& module) 
+CombinedEdgeProfile::CombinedEdgeProfile(Module& module) : _module(&module)
 {
   if(_edt == NULL)
+  {
+    TimeRegion timer(CPStats::getTimer(CPTimeEDT));
     _edt = new EdgeDominatorTree(module);
+  }
   _histograms.resize(_edt->getEdgeCount());
 }
 
@@ -44,55 +52,62 @@ void CombinedEdgeProfile::freeStaticData()
 {
   if(_edt != NULL)
     delete _edt;
+  _edt = NULL;
 }
 
 
-// Read in a standard edge profile and add the
-// hierarchically-normalized frequencies to the add lists of the
-// corresponding histograms.  Requires the number of bins to use
-// (binCount).
-bool CombinedEdgeProfile::addProfile(FILE* file)
+// read the counters of a raw edge profile
+static bool readEdgeCounts(FILE* file, std::vector<unsigned>& counts)
 {
-  
-  if(_edt == NULL)
-  {
-    errs() << "addEdgeProfile: error: EDT not set!\n";
-    return(false);
-  }
-
-  //errs() << "--> addEdgeProfile\n";
-  
   // get the number of edges in this profile
   unsigned edgeCount;
   if( fread(&edgeCount, sizeof(edgeCount), 1, file) != 1 ) {
     errs() << "  error: edge profiling info has no header\n";
     return(false);
   }
-  if(_histograms.size() != edgeCount) 
-  {
-    if(_histograms.size() != 0)
-      errs() << "CEP::addProfile: warning: edge count has changed from " << _histograms.size() << " to " << edgeCount << "\n";
-    _histograms.resize(edgeCount);
-  }
-  //errs() << "CEP::addProfile: " << edgeCount << " edges\n";
 
-  // TODO: is edge count reasonable for this program?
-  // Also ... do all of the edge profiles have the proper edge count?
-  // Compare it to the dominator tree, since that information will be there
-  
-  unsigned* edgeBuffer = new unsigned[edgeCount];
-  if( fread(edgeBuffer, sizeof(unsigned), edgeCount, file)
-      != edgeCount) {
-    delete [] edgeBuffer;
+  counts.resize(edgeCount);
+  if( (edgeCount > 0) &&
+      (fread(&counts[0], sizeof(unsigned), edgeCount, file) != edgeCount) ) {
     errs() << "  warning: edge profiling info header/data mismatch\n";
     return(false);
   }
+  return(true);
+}
+
 
-  addWeight(1.0);
+// Read in a standard edge profile and compute the
+// hierarchically-normalized frequency of every edge: its count over
+// the count of its dominating edge.  Only reads _edt (through its const
+// lookups), so any number of threads can share one CEP for this.
+bool CombinedEdgeProfile::readNormalized(FILE* file,
+                                         std::vector<double>& freqs) const
+{
+  std::vector<unsigned> edgeBuffer;
+  return( readEdgeCounts(file, edgeBuffer) && normalize(edgeBuffer, freqs) );
+}
+
+
+bool CombinedEdgeProfile::normalize(const std::vector<unsigned>& edgeBuffer,
+                                    std::vector<double>& freqs) const
+{
+  if(_edt == NULL)
+  {
+    errs() << "addEdgeProfile: error: EDT not set!\n";
+    return(false);
+  }
+
+  // a profile of another program would index past the dominator tree
+  unsigned edgeCount = edgeBuffer.size();
+  if(edgeCount != _edt->getEdgeCount())
+  {
+    errs() << "addEdgeProfile: error: " << edgeCount << " edges, but "
+           << _edt->getEdgeCount() << " in the module\n";
+    return(false);
+  }
 
+  freqs.assign(edgeCount, 0);
   for( unsigned i = 0; i < edgeCount; i++ ) {
-    // Add a new histogram entry
-    double normFreq = 0;
     unsigned execCnt = edgeBuffer[i];
     unsigned domID = _edt->getDominatorIndex(i);
     unsigned domCnt = edgeBuffer[domID];
@@ -102,34 +117,274 @@ bool CombinedEdgeProfile::addProfile(FILE* file)
     {
       // no dominator or self-dominator: must be a root node
       // note: root normalizes to 1, even if execCnt = 0
-      normFreq = 1;
+      freqs[i] = 1;
     }
-    else
+    else if(domCnt != 0)  // 0 should only happen if execCnt is also 0
     {
-      if(domCnt == 0)  // should only happen if execCnt is also 0
+      freqs[i] = double(execCnt) / double(domCnt);
+    }
+  }
+
+  return(true);
+}
+
+
+// Read in a standard edge profile and add the
+// hierarchically-normalized frequencies to the add lists of the
+// corresponding histograms.
+bool CombinedEdgeProfile::addProfile(FILE* file)
+{
+  std::vector<unsigned> counts;
+  return( readEdgeCounts(file, counts) && addCounts(counts) );
+}
+
+
+bool CombinedEdgeProfile::addCounts(const std::vector<unsigned>& counts)
+{
+  //errs() << "--> addEdgeProfile\n";
+
+  std::vector<double> freqs;
+  if(!normalize(counts, freqs))
+    return(false);
+
+  unsigned edgeCount = freqs.size();
+  if(_histograms.size() != edgeCount) 
+  {
+    if(_histograms.size() != 0)
+      errs() << "CEP::addProfile: warning: edge count has changed from " << _histograms.size() << " to " << edgeCount << "\n";
+    _histograms.resize(edgeCount);
+  }
+  //errs() << "CEP::addProfile: " << edgeCount << " edges\n";
+
+  addWeight(_runWeight);
+
+  // use operator[] so that we check if the histogram is allocated;
+  // in place, edges the run didn't take are left alone
+  for( unsigned i = 0; i < edgeCount; i++ )
+    if( !_inPlace || (freqs[i] > 0) )
+      addRunValue(*operator[](i), freqs[i], _runWeight);
+
+  //errs() << "<-- addEdgeProfile\n";
+  return(true);
+}
+
+
+bool CombinedEdgeProfile::addPathProfile(FILE* file)
+{
+  std::vector<unsigned> counts;
+  return( readPathCounts(file, counts) && addCounts(counts) );
+}
+
+
+bool CombinedEdgeProfile::readPathCounts(FILE* f,
+                                         std::vector<unsigned>& counts)
+{
+  if(_edt == NULL)
+  {
+    errs() << "CEP::readPathCounts: error: EDT not set!\n";
+    return(false);
+  }
+
+  // edges are numbered like the EDT's: an entry edge, then the
+  // successors of each block in order
+  if(_pathFunctions.empty())
+  {
+    unsigned edges = 0;
+    for(Module::iterator F = _module->begin(), E = _module->end();
+        F != E; ++F)
+    {
+      if(!isCPDefinition(*F))
+        continue;
+
+      _pathFunctions.push_back(F);
+      _firstEdge.push_back(edges);
+      CPFunctionBody body(*F);
+      if(F->isDeclaration())
+        continue;
+
+      edges++;
+      for(Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB)
+        edges += BB->getTerminator()->getNumSuccessors();
+    }
+    _firstEdge.push_back(edges);
+  }
+
+  unsigned functionCount;
+  if( fread(&functionCount, sizeof(unsigned), 1, f) != 1 )
+  {
+    errs() << "  error: path profiling info has no header\n";
+    return(false);
+  }
+
+  counts.assign(_edt->getEdgeCount(), 0);
+  if(_firstEdge.back() != counts.size())
+  {
+    errs() << "CEP::readPathCounts: error: " << _firstEdge.back() 
+           << " edges in the module, but " << counts.size() << " in the EDT\n";
+    return(false);
+  }
+
+  // one function's paths at a time
+  std::vector<PathTableEntry> paths;
+  for(unsigned i = 0; i < functionCount; ++i)
+  {
+    PathHeader header;
+    if( fread(&header, sizeof(PathHeader), 1, f) != 1 )
+    {
+      errs() << "  error: bad path profiling file syntax\n";
+      return(false);
+    }
+
+    paths.resize(header.numEntries);
+    if( (header.numEntries > 0) &&
+        (fread(&paths[0], sizeof(PathTableEntry), header.numEntries, f)
+         != header.numEntries) )
+    {
+      errs() << "  error: bad path profiling file syntax\n";
+      return(false);
+    }
+
+    if( (header.fnNumber == 0) || (header.fnNumber > _pathFunctions.size()) )
+    {
+      errs() << "CEP::readPathCounts: error: no function " 
+             << header.fnNumber << "\n";
+      return(false);
+    }
+
+    if(header.numEntries > 0)
+      addFunctionPaths(*_pathFunctions[header.fnNumber-1], &paths[0],
+                       header.numEntries,
+                       &counts[_firstEdge[header.fnNumber-1]]);
+  }
+
+  return(true);
+}
+
+
+// the DAG edge a path number takes out of node (as PathProfileInfo)
+static BallLarusEdge* nextPathEdge(BallLarusNode* node, unsigned pathNumber)
+{
+  BallLarusEdge* best = 0;
+  for(BLEdgeIterator next = node->succBegin(), end = node->succEnd();
+      next != end; next++)
+  {
+    if( ((*next)->getType() != BallLarusEdge::BACKEDGE) &&
+        ((*next)->getType() != BallLarusEdge::SPLITEDGE) &&
+        ((*next)->getWeight() <= pathNumber) &&
+        (!best || (best->getWeight() < (*next)->getWeight())) )
+      best = *next;
+  }
+  return(best);
+}
+
+
+// Decode each path on F's DAG, adding its count to counts[] (F's own
+// edges, entry edge first).  The real edges of a node are its CFG
+// successors in order, so each is numbered the first time a path
+// leaves the node, and every later path just looks it up.
+void CombinedEdgeProfile::addFunctionPaths(Function& F,
+                                           const PathTableEntry* paths,
+                                           unsigned pathCount,
+                                           unsigned* counts)
+{
+  CPFunctionBody body(F);
+  if(F.isDeclaration())
+    return;
+
+  BallLarusDag dag(F);
+  dag.init();
+  dag.calculatePathNumbers();
+
+  std::map<BasicBlock*,unsigned> firstOut;
+  unsigned edges = 1;
+  for(Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+  {
+    firstOut[BB] = edges;
+    edges += BB->getTerminator()->getNumSuccessors();
+  }
+
+  std::map<BallLarusEdge*,unsigned> edgeIndex;
+  for(unsigned p = 0; p < pathCount; p++)
+  {
+    unsigned count = paths[p].pathCounter;
+    if(count == 0)
+      continue;
+
+    unsigned number = paths[p].pathNumber;
+    BallLarusNode* node = dag.getRoot();
+    bool first = true;
+    while(node != dag.getExit())
+    {
+      BallLarusEdge* next = nextPathEdge(node, number);
+      if(next == NULL)
       {
-        normFreq = 0;
+        errs() << "CEP::readPathCounts: warning: bad path number "
+               << paths[p].pathNumber << " in " << F.getName() << "\n";
+        break;
       }
-      else
+      number -= next->getWeight();
+
+      // the CFG edge this DAG edge stands for, if it's counted here:
+      // a back edge ends one path and a split edge starts the next
+      BallLarusEdge* real = NULL;
+      switch(next->getType())
+      {
+      case BallLarusEdge::NORMAL:
+        if(next->getTarget() != dag.getExit())
+          real = next;
+        if(first)
+          counts[0] += count;
+        break;
+      case BallLarusEdge::BACKEDGE_PHONY:
+        if(next->getTarget() == dag.getExit())
+          real = next->getRealEdge();
+        break;
+      case BallLarusEdge::SPLITEDGE_PHONY:
+        if(next->getSource() == dag.getRoot())
+          real = next->getRealEdge();
+        break;
+      default:
+        break;
+      }
+      first = false;
+
+      if(real != NULL)
       {
-        normFreq = double(execCnt) / double(domCnt);
+        std::map<BallLarusEdge*,unsigned>::iterator I = edgeIndex.find(real);
+        if(I == edgeIndex.end())
+        {
+          BallLarusNode* source = real->getSource();
+          unsigned e = firstOut[source->getBlock()];
+          for(BLEdgeIterator S = source->succBegin(), SE = source->succEnd();
+              S != SE; ++S)
+          {
+            BallLarusEdge::EdgeType t = (*S)->getType();
+            if( ( (t == BallLarusEdge::NORMAL) ||
+                  (t == BallLarusEdge::BACKEDGE) ||
+                  (t == BallLarusEdge::SPLITEDGE) ) &&
+                ((*S)->getTarget() != dag.getExit()) )
+              edgeIndex[*S] = e++;
+          }
+          I = edgeIndex.find(real);
+        }
+        if(I != edgeIndex.end())
+          counts[I->second] += count;
       }
+
+      node = next->getTarget();
     }
-    
-    // use operator[] so that we check if the histogram is allocated
-    operator[](i)->addToList(normFreq);
   }
-
-  delete [] edgeBuffer;
-  //errs() << "<-- addEdgeProfile\n";
-  return(true);
 }
 
 
 // Write CEP to file - store only those histograms with data
 unsigned CombinedEdgeProfile::serialize(FILE* f)
 {
+  TimeRegion timer(CPStats::getTimer(CPTimeWrite));
 	unsigned edgeCount = 0;
+
+  materializeAll();
+
 	// Calculate the number of histograms which have non-zero data
 	for( unsigned i = 0; i < _histograms.size(); i++ )
 		if( _histograms[i]->nonZeroWeight() > FP_FUDGE_EPS )
@@ -186,7 +441,7 @@ bool CombinedEdgeProfile::deserialize(FILE* f) {
     CPHistogram* newHist = new CPHistogram();
     int index = newHist->deserialize(_bincount, _weight, f);
     
-    if(index < 0) {
+    if( (index < 0) || ((unsigned)index >= _histograms.size()) ) {
       errs() << "error: unable to read histogram\n";
       delete newHist;
       return false;
@@ -286,7 +541,29 @@ bool CombinedEdgeProfile::buildFromList(CPList& list, unsigned binCount)
 
 
 CPHistogram* CombinedEdgeProfile::operator[](const int index) {
-  if( _histograms[index] == NULL )
+  if( (_histograms[index] == NULL) && (materialize(index) == NULL) )
     _histograms[index] = new CPHistogram();
 	return _histograms[index];
 }
+
+
+// same histograms as serialize
+void CombinedEdgeProfile::getIndexOrder(std::vector<CPIndexEntry>& order) const
+{
+  for(unsigned i = 0; i < _histograms.size(); i++)
+  {
+    if( (_histograms[i] == NULL) 
+        || (_histograms[i]->nonZeroWeight() < FP_FUDGE_EPS) )
+      continue;
+    CPIndexEntry e = { 0, i, i };
+    order.push_back(e);
+  }
+}
+
+
+unsigned CombinedEdgeProfile::addIndexedSlot(unsigned fnNumber, unsigned ID)
+{
+  if( (fnNumber != 0) || (ID >= _histograms.size()) )
+    return(CP_NOT_INDEXED);
+  return(ID);
+}
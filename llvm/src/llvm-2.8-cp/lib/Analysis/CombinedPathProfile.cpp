@@ -14,10 +14,14 @@
 #include "llvm/Analysis/ProfileInfoTypes.h"
 #include "llvm/Analysis/CombinedProfile.h"
 #include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Analysis/CPStats.h"
+#include "llvm/Analysis/CPDrift.h"
 #include "llvm/Analysis/PathNumbering.h"
 #include "llvm/Module.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <cmath>
@@ -38,12 +42,16 @@ CombinedPathProfile::CombinedPathProfile(Module& module)
 {
   for( Module::iterator F = module.begin(), E = module.end();
        F != E; ++F )
-    if( !F->isDeclaration() )
+    if( isCPDefinition(*F) )
       _functionRef.push_back(F);
+  _functionCount = _functionRef.size();
 }
 
 
 unsigned CombinedPathProfile::serialize(FILE* f) {
+  TimeRegion timer(CPStats::getTimer(CPTimeWrite));
+  materializeAll();
+
 	// Write the CPP header
   ProfilingType ptype = CombinedPathInfo;
   unsigned psize = _functions.size();
@@ -152,7 +160,7 @@ bool CombinedPathProfile::addProfile(FILE* f)
 
   //errs() << "  " << functionCount << " path function(s) identified.\n";
 
-  addWeight(1.0);
+  addWeight(_runWeight);
 
   // Iterate through each function
   for(unsigned i = 0; i < functionCount; ++i) 
@@ -168,6 +176,7 @@ bool CombinedPathProfile::addProfile(FILE* f)
 
     // Build a DAG for the function
     //errs() << "    build dag\n";
+    CPFunctionBody body(*_functionRef[funcNum-1]);
     BallLarusDag dag(*_functionRef[funcNum-1]);
     //errs() << "    init dag\n";
     dag.init();
@@ -213,7 +222,7 @@ bool CombinedPathProfile::addProfile(FILE* f)
       {
         double pathFreq = double(P->pathCounter)/totalNumberExecuted;
         CPHistogram& hist = getHistogram(funcNum, P->pathNumber);
-        hist.addToList(pathFreq);
+        addRunValue(hist, pathFreq, _runWeight);
       }
     }
   }
@@ -267,7 +276,8 @@ bool CombinedPathProfile::buildFromList(CPList& list, unsigned binCount)
 
 	// Iterate through all the potential functions in the program and
 	// collect all the histograms for each path from all CPs in the list
-	for(unsigned funcID = 0, S = _functionRef.size(); funcID < S; ++funcID) 
+	// (functions are numbered from 1, as in the raw path profile)
+	for(unsigned funcID = 1, S = _functionRef.size(); funcID <= S; ++funcID) 
   {
 		// Function path combined profiling histogram map
     // pathNumber --> CPHistogramList
@@ -388,6 +398,14 @@ unsigned CombinedPathProfile::getFunctionCount() const {
 }
 
 
+Function* CombinedPathProfile::getFunction(FunctionIndex f) const
+{
+  if( (f == 0) || (f > _functionRef.size()) )
+    return(NULL);
+  return(_functionRef[f-1]);
+}
+
+
 // check if a PathID is valid, ie, the function and path already exist
 // in the _functions map.
 bool CombinedPathProfile::valid(const PathID& path) const
@@ -405,18 +423,25 @@ bool CombinedPathProfile::valid(const PathID& path) const
 CPHistogram& CombinedPathProfile::getHistogram(const FunctionIndex funcIndex, 
                                                const PathIndex pathIndex)
 {
+  // a path not seen before gets a new slot, never one already in use
+  // (slot 0 is a real histogram in a profile that was read in)
   CPPHistogramMap& funcPaths = _functions[funcIndex];
-  unsigned histIndex = funcPaths[pathIndex];
-  if(histIndex+1 > _histograms.size())
-    _histograms.resize(histIndex+1);
-  CPHistogram* hist = _histograms[funcPaths[pathIndex]];
-  if(hist == NULL)
+  CPPHistogramMap::iterator P = funcPaths.find(pathIndex);
+  if(P == funcPaths.end())
   {
-    unsigned histIndex = _histograms.size();
-    hist = new CPHistogram();
+    CPHistogram* hist = new CPHistogram();
+    funcPaths[pathIndex] = _histograms.size();
     _histograms.push_back(hist);
-    funcPaths[pathIndex] = histIndex;
+    return(*hist);
   }
+
+  if(P->second >= _histograms.size())
+    _histograms.resize(P->second + 1);
+  CPHistogram* hist = _histograms[P->second];
+  if(hist == NULL)
+    hist = materialize(P->second);
+  if(hist == NULL)
+    hist = _histograms[P->second] = new CPHistogram();
   return(*hist);
 }
 
@@ -432,6 +457,67 @@ CPHistogram& CombinedPathProfile::operator[](const PathID& path)
   return(getHistogram(path));
 }
 
+// same histograms as serialize, ID'd by <function,path>
+void CombinedPathProfile::getIndexOrder(std::vector<CPIndexEntry>& order) const
+{
+	for( CPPFunctionMap::const_iterator F = _functions.begin(), 
+         E = _functions.end(); F != E; ++F ) 
+  {
+		for( CPPHistogramMap::const_iterator H = F->second.begin(), 
+           HE = F->second.end(); H != HE; ++H ) 
+    {
+      CPIndexEntry e = { F->first, H->first, H->second };
+      order.push_back(e);
+    }
+  }
+}
+
+
+unsigned CombinedPathProfile::addIndexedSlot(unsigned fnNumber, unsigned ID)
+{
+  if( (fnNumber == 0) || (fnNumber > _functionCount) )
+    return(CP_NOT_INDEXED);
+
+  unsigned slot = _histograms.size();
+  _histograms.push_back(NULL);
+  _functions[fnNumber][ID] = slot;
+  return(slot);
+}
+
+
+// Path numbers only depend on the CFG, so a matched function keeps
+// its paths; only its number changes.
+bool CombinedPathProfile::remapFunctions(const CPFunctionMap& map)
+{
+  materializeAll();
+
+  CPPFunctionMap functions;
+  CPHistVec histograms;
+  for(CPPFunctionMap::iterator F = _functions.begin(), E = _functions.end();
+      F != E; ++F)
+  {
+    unsigned to = ( (F->first > 0) && (F->first <= map.from().size()) )
+      ? map(F->first - 1, CPEdgeSlots) : CP_NO_FUNCTION;
+    for(CPPHistogramMap::iterator H = F->second.begin(),
+          HE = F->second.end(); H != HE; ++H)
+    {
+      if(to == CP_NO_FUNCTION)
+      {
+        delete _histograms[H->second];
+        continue;
+      }
+      functions[to + 1][H->first] = histograms.size();
+      histograms.push_back(_histograms[H->second]);
+    }
+  }
+
+  _functions.swap(functions);
+  _histograms.swap(histograms);
+  _functionCount = _functionRef.size();
+  return(true);
+}
+
+
 void CombinedPathProfile::getPathSet(PathSet& paths) const
 {
   // Iterate through each function
@@ -454,32 +540,8 @@ void CombinedPathProfile::getPathSet(PathSet& paths) const
 void CombinedPathProfile::printDrift(CombinedPathProfile& other, 
                                      llvm::raw_ostream& stream)
 {
-  PathSet ps;
-
-  getPathSet(ps);
-  other.getPathSet(ps);
-
-  stream << "#pathID\t0-out\t0-in\n";
-  for(PathSet::iterator p=ps.begin(), E=ps.end(); p != E; ++p)
-  {
-    if(!valid(*p) || !other.valid(*p))
-    {
-      // if path only exists in one profile, then 0% overlap
-      errs() << "warning: path exists in only 1 profile: " 
-             << p->first << "-" << p->second << "\n";
-      continue;
-    }
-
-    CPHistogram& h1 = getHistogram(*p);
-    CPHistogram& h2 = other.getHistogram(*p);
-
-    if( h1.isPoint() && h2.isPoint() )
-      continue;
-
-    stream << p->first << "-" << p->second << "\t" 
-           << 1-h1.overlap(h2, false) << "\t" 
-           << 1-h1.overlap(h2, true) << "\n";
-  }
-
+  CPDrift drift;
+  drift.compare(*this, other);
+  drift.print(stream, getNameStr());
 }
 
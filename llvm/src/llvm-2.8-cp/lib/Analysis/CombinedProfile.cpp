@@ -15,10 +15,16 @@
 
 #include "llvm/Analysis/ProfileInfoTypes.h"
 #include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPDrift.h"
+#include "llvm/Analysis/CPStats.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <string.h>
+
 using namespace llvm;
 
 
@@ -26,7 +32,9 @@ using namespace llvm;
 // Combined profile implementation
 // ----------------------------------------------------------------------------
 
-CombinedProfile::CombinedProfile() : _weight(0) {
+CombinedProfile::CombinedProfile() : _weight(0), _runWeight(1.0),
+                                     _inPlace(false), _lazyFile(NULL),
+                                     _lazyData(NULL), _lazyEnd(NULL) {
 }
 
 CombinedProfile::~CombinedProfile()
@@ -35,6 +43,285 @@ CombinedProfile::~CombinedProfile()
   for(unsigned i = 0, E = _histograms.size(); i != E; ++i)
     if(_histograms[i] != NULL)
       delete (_histograms[i]);
+  if(_lazyFile != NULL)
+    _lazyFile->release();
+}
+
+
+CPMappedFile::~CPMappedFile()
+{
+  delete _buffer;
+}
+
+
+// Indexed section, after the IndexedCombinedInfo and type words:
+//   double weight, unsigned count, unsigned bincount,
+//   CPIndexEntry[count], unsigned dataBytes, histograms (dataBytes)
+// Offsets are only known once the histograms are written, so the
+// index is written twice.
+unsigned CombinedProfile::serializeIndexed(FILE* f)
+{
+  TimeRegion timer(CPStats::getTimer(CPTimeWrite));
+  std::vector<CPIndexEntry> order;
+
+  materializeAll();
+  getIndexOrder(order);
+
+  ProfilingType itype = IndexedCombinedInfo;
+  ProfilingType ptype = getProfilingType();
+  unsigned count = order.size();
+  unsigned dataBytes = 0;
+
+  if( (fwrite(&itype, sizeof(unsigned), 1, f) != 1) ||
+      (fwrite(&ptype, sizeof(unsigned), 1, f) != 1) ||
+      (fwrite(&_weight, sizeof(double), 1, f) != 1) ||
+      (fwrite(&count, sizeof(unsigned), 1, f) != 1) ||
+      (fwrite(&_bincount, sizeof(unsigned), 1, f) != 1) ) 
+  {
+    errs() << "CombinedProfile::serializeIndexed Error: cannot write header\n";
+    return(0);
+  }
+
+  long indexPos = ftell(f);
+  if( (indexPos < 0) ||
+      ((count > 0) && (fwrite(&order[0], sizeof(CPIndexEntry), count, f) 
+                       != count)) ||
+      (fwrite(&dataBytes, sizeof(unsigned), 1, f) != 1) )
+  {
+    errs() << "CombinedProfile::serializeIndexed Error: cannot write index\n";
+    return(0);
+  }
+
+  long dataPos = ftell(f);
+  for(unsigned i = 0; i < count; ++i)
+  {
+    CPHistogram* h = _histograms[order[i].offset];
+    order[i].offset = ftell(f) - dataPos;
+    if( !h->serialize(order[i].ID, f) )
+    {
+      errs() << "CombinedProfile::serializeIndexed Error: cannot write "
+             << "histogram " << order[i].ID << "\n";
+      return(0);
+    }
+  }
+
+  long endPos = ftell(f);
+  dataBytes = endPos - dataPos;
+
+  // now fill in the real offsets
+  if( (fseek(f, indexPos, SEEK_SET) != 0) ||
+      ((count > 0) && (fwrite(&order[0], sizeof(CPIndexEntry), count, f) 
+                       != count)) ||
+      (fwrite(&dataBytes, sizeof(unsigned), 1, f) != 1) ||
+      (fseek(f, endPos, SEEK_SET) != 0) )
+  {
+    errs() << "CombinedProfile::serializeIndexed Error: cannot rewrite index\n";
+    return(0);
+  }
+
+  return(count);
+}
+
+
+// read a whole indexed section from a stream
+bool CombinedProfile::deserializeIndexed(FILE* f)
+{
+  unsigned count;
+  unsigned bincount;
+  unsigned dataBytes;
+  double weight;
+
+  // pull the whole section into memory, then parse it like a map
+  if( !fread(&weight, sizeof(double), 1, f) ||
+      !fread(&count, sizeof(unsigned), 1, f) ||
+      !fread(&bincount, sizeof(unsigned), 1, f) )
+  {
+    errs() << "CombinedProfile::deserializeIndexed Error: bad header\n";
+    return(false);
+  }
+
+  unsigned headBytes = sizeof(double) + 2*sizeof(unsigned);
+  unsigned indexBytes = count * sizeof(CPIndexEntry);
+  std::vector<char> buf(headBytes + indexBytes + sizeof(unsigned));
+  char* p = &buf[0];
+  memcpy(p, &weight, sizeof(double));
+  memcpy(p + sizeof(double), &count, sizeof(unsigned));
+  memcpy(p + sizeof(double) + sizeof(unsigned), &bincount, sizeof(unsigned));
+
+  if( fread(&buf[headBytes], 1, indexBytes + sizeof(unsigned), f) 
+      != indexBytes + sizeof(unsigned) )
+  {
+    errs() << "CombinedProfile::deserializeIndexed Error: bad index\n";
+    return(false);
+  }
+  memcpy(&dataBytes, &buf[headBytes + indexBytes], sizeof(unsigned));
+
+  unsigned sectionBytes = buf.size();
+  buf.resize(sectionBytes + dataBytes);
+  if( (dataBytes > 0) &&
+      (fread(&buf[sectionBytes], 1, dataBytes, f) != dataBytes) )
+  {
+    errs() << "CombinedProfile::deserializeIndexed Error: truncated data\n";
+    return(false);
+  }
+
+  const char* data = &buf[0];
+  return(readIndexed(data, data + buf.size(), false));
+}
+
+
+bool CombinedProfile::mapIndexed(CPMappedFile* file, unsigned& offset)
+{
+  file->retain();
+  if(_lazyFile != NULL)
+    _lazyFile->release();
+  _lazyFile = file;
+
+  const MemoryBuffer& buffer = file->getBuffer();
+  const char* data = buffer.getBufferStart() + offset;
+  if( !readIndexed(data, buffer.getBufferEnd(), true) )
+    return(false);
+
+  offset = data - buffer.getBufferStart();
+  return(true);
+}
+
+
+// parse an indexed section; histograms are read now, or when first
+// accessed if lazy
+bool CombinedProfile::readIndexed(const char*& data, const char* end, 
+                                  bool lazy)
+{
+  unsigned count;
+  unsigned dataBytes;
+  unsigned headBytes = sizeof(double) + 2*sizeof(unsigned);
+
+  if( (unsigned)(end - data) < headBytes )
+  {
+    errs() << "CombinedProfile::readIndexed Error: bad header\n";
+    return(false);
+  }
+  memcpy(&_weight, data, sizeof(double));
+  memcpy(&count, data + sizeof(double), sizeof(unsigned));
+  memcpy(&_bincount, data + sizeof(double) + sizeof(unsigned), 
+         sizeof(unsigned));
+  data += headBytes;
+
+  const char* index = data;
+  unsigned indexBytes = count * sizeof(CPIndexEntry);
+  if( (unsigned)(end - data) < indexBytes + sizeof(unsigned) )
+  {
+    errs() << "CombinedProfile::readIndexed Error: bad index\n";
+    return(false);
+  }
+  data += indexBytes;
+  memcpy(&dataBytes, data, sizeof(unsigned));
+  data += sizeof(unsigned);
+
+  const char* hdata = data;
+  if( (unsigned)(end - data) < dataBytes )
+  {
+    errs() << "CombinedProfile::readIndexed Error: truncated data\n";
+    return(false);
+  }
+  data += dataBytes;
+  const char* hend = data;
+
+  if(lazy)
+  {
+    _lazyData = hdata;
+    _lazyEnd = hend;
+  }
+
+  for(unsigned i = 0; i < count; ++i)
+  {
+    CPIndexEntry entry;
+    memcpy(&entry, index + i*sizeof(CPIndexEntry), sizeof(CPIndexEntry));
+
+    unsigned slot = addIndexedSlot(entry.fnNumber, entry.ID);
+    if( (slot == CP_NOT_INDEXED) || (entry.offset >= dataBytes) )
+    {
+      errs() << "CombinedProfile::readIndexed Error: bad index entry " 
+             << entry.fnNumber << "-" << entry.ID << "\n";
+      return(false);
+    }
+
+    if(lazy)
+    {
+      if(_lazyOffsets.size() < _histograms.size())
+        _lazyOffsets.resize(_histograms.size(), CP_NOT_INDEXED);
+      _lazyOffsets[slot] = entry.offset;
+      continue;
+    }
+
+    const char* h = hdata + entry.offset;
+    CPHistogram* hist = new CPHistogram();
+    if( hist->deserialize(_bincount, _weight, h, hend) < 0 )
+    {
+      errs() << "CombinedProfile::readIndexed Error: unable to read "
+             << "histogram " << entry.fnNumber << "-" << entry.ID << "\n";
+      delete hist;
+      return(false);
+    }
+    if(_histograms[slot] != NULL)
+      delete _histograms[slot];
+    _histograms[slot] = hist;
+  }
+
+  // allocate any missing histograms
+  if(!lazy)
+    for(unsigned i = 0; i < _histograms.size(); i++)
+      if( _histograms[i] == NULL ) 
+        _histograms[i] = new CPHistogram();
+
+  return(true);
+}
+
+
+CPHistogram* CombinedProfile::materialize(unsigned i)
+{
+  if( (_lazyData == NULL) || (i >= _lazyOffsets.size()) 
+      || (_lazyOffsets[i] == CP_NOT_INDEXED) )
+    return(NULL);
+
+  const char* data = _lazyData + _lazyOffsets[i];
+  _lazyOffsets[i] = CP_NOT_INDEXED;
+
+  CPHistogram* hist = new CPHistogram();
+  if( hist->deserialize(_bincount, _weight, data, _lazyEnd) < 0 )
+  {
+    errs() << "CombinedProfile::materialize Error: unable to read "
+           << "histogram " << i << "\n";
+    hist->clear();
+  }
+
+  _histograms[i] = hist;
+  return(hist);
+}
+
+
+const CPHistogram* CombinedProfile::getHistogramAt(unsigned i) const
+{
+  if(i >= _histograms.size())
+    return(NULL);
+  // reading a mapped histogram doesn't change what the profile holds
+  if(_histograms[i] == NULL)
+    return(const_cast<CombinedProfile*>(this)->materialize(i));
+  return(_histograms[i]);
+}
+
+
+void CombinedProfile::materializeAll()
+{
+  for(unsigned i = 0; i < _histograms.size(); i++)
+    if( (_histograms[i] == NULL) && (materialize(i) == NULL) )
+      _histograms[i] = new CPHistogram();
+
+  if(_lazyFile != NULL)
+    _lazyFile->release();
+  _lazyFile = NULL;
+  _lazyData = _lazyEnd = NULL;
+  _lazyOffsets.clear();
 }
 
 unsigned CombinedProfile::getBinCount() const {
@@ -51,15 +338,108 @@ void CombinedProfile::addWeight(double w) {
 }
 
 
+// Histograms still in a mapped file are read first; slots with no
+// histogram stay empty.  The share of 0s is unchanged.
+void CombinedProfile::scaleWeight(double f)
+{
+  for(unsigned i = 0, E = _histograms.size(); i != E; ++i)
+  {
+    CPHistogram* h = _histograms[i];
+    if(h == NULL)
+      h = materialize(i);  // at the old weight
+    if(h != NULL)
+      h->scale(f);
+  }
+  _weight *= f;
+}
+
+
+void CombinedProfile::setSlotLayout(const CPFunctionKeys& keys,
+                                    CPSlotKind kind)
+{
+  std::vector<unsigned> first;
+  keys.getFirstSlots(kind, first);
+
+  for(unsigned i = 0; i < _histograms.size(); i++)
+    if(_histograms[i] != NULL)
+      delete _histograms[i];
+  _histograms.clear();
+  _histograms.resize(first.back(), NULL);
+}
+
+
+bool CombinedProfile::remapSlots(const CPFunctionMap& map, CPSlotKind kind)
+{
+  std::vector<unsigned> oldFirst, newFirst;
+  map.from().getFirstSlots(kind, oldFirst);
+  map.to().getFirstSlots(kind, newFirst);
+  if(oldFirst.back() != _histograms.size())
+  {
+    errs() << "CombinedProfile::remapSlots Error: " << _histograms.size()
+           << " " << getNameStr() << " histograms for keys with "
+           << oldFirst.back() << "\n";
+    return(false);
+  }
+
+  materializeAll();
+  CPHistVec moved(newFirst.back(), NULL);
+  for(unsigned f = 0; f < map.from().size(); f++)
+  {
+    unsigned to = map(f, kind);
+    for(unsigned i = oldFirst[f]; i < oldFirst[f+1]; i++)
+    {
+      if(to != CP_NO_FUNCTION)
+        moved[newFirst[to] + i - oldFirst[f]] = _histograms[i];
+      else
+        delete _histograms[i];
+    }
+  }
+
+  // new and changed functions were never seen running
+  for(unsigned i = 0; i < moved.size(); i++)
+    if(moved[i] == NULL)
+      moved[i] = new CPHistogram();
+  _histograms.swap(moved);
+  return(true);
+}
+
+
+bool CombinedProfile::updateProfile(FILE* file)
+{
+  _inPlace = true;
+  bool ok = addProfile(file);
+  _inPlace = false;
+  return(ok);
+}
+
+
+void CombinedProfile::addRunValue(CPHistogram& h, double v, double w)
+{
+  if(!_inPlace)
+  {
+    h.addToList(v, w);
+    CPStats::count(CPSamplesAdded);
+  }
+  else if(v > FP_FUDGE_EPS)
+    h.addValue(v, w, _bincount);
+}
+
+
 void CombinedProfile::buildHistograms(unsigned binCount)
 {
 	_bincount = binCount;
 
+  TimeRegion timer(CPStats::getTimer(CPTimeBuild));
+  unsigned built = 0;
   for(unsigned i = 0, E = _histograms.size(); i != E; ++i)
   {
     if(_histograms[i] != NULL)
+    {
       _histograms[i]->buildFromList(_bincount, _weight);
+      built++;
+    }
   }
+  CPStats::count(CPHistogramsBuilt, built);
 }
 
 
@@ -67,6 +447,8 @@ void CombinedProfile::print(llvm::raw_ostream& stream)
 {
   int binsUsed = 0;
 
+  materializeAll();
+
   stream << "Profile Type: " << getNameStr() << "\n";
 	stream << "Total Weight: " << _weight << "\n";
 	stream << "Bin Count:    " << _bincount << "\n";
@@ -83,6 +465,7 @@ void CombinedProfile::print(llvm::raw_ostream& stream)
 
 void CombinedProfile::printHistogramInfo(llvm::raw_ostream& stream)
 {
+  materializeAll();
 
   if(_histograms.size() == 0)
     errs() << "Warning: no histograms\n";
@@ -108,6 +491,8 @@ void CombinedProfile::printHistogramInfo(llvm::raw_ostream& stream)
 
 void CombinedProfile::printHistogramStats(llvm::raw_ostream& stream)
 {
+  materializeAll();
+
   if(_histograms.size() == 0)
     errs() << "Warning: no histograms\n";
 
@@ -138,6 +523,8 @@ void CombinedProfile::printSummary(llvm::raw_ostream& stream)
   int histcov1 = 0;   // histogram, 100% coverage
   int hist = 0;       // histogram, <100% coverage
 
+  materializeAll();
+
   if(_histograms.size() == 0)
     errs() << "Warning: no histograms\n";
 
@@ -199,50 +586,9 @@ void CombinedProfile::printSummary(llvm::raw_ostream& stream)
 void CombinedProfile::printDrift(const CombinedProfile& other, 
                                  llvm::raw_ostream& stream) const
 {
-
-  // build union of non-zero histograms
-  IndexSet I;
-
-  for(unsigned i = 0, E = size(); i < E; ++i)
-    if( (_histograms[i] != NULL) && _histograms[i]->nonZero() )
-      I.insert(i);
-
-  for(unsigned i = 0, E = other.size(); i < E; ++i)
-    if( (other._histograms[i] != NULL) && other._histograms[i]->nonZero() )
-      I.insert(i);
-
-  if(I.size() == 0)
-    errs() << "Warning: no histograms\n";
-
-  // Compute and print drift
-  stream << "#" << getNameStr() << "Index\t0-out\t0-in\n";
-  for(IndexSet::iterator i = I.begin(), E = I.end(); i != E; ++i)
-  {
-    // check for 0-overlap (100% drift) cases
-    if( (*i > size()) || (*i > other.size()) 
-        || (_histograms[*i] == NULL) || (other._histograms[*i] == NULL) 
-        || !_histograms[*i]->nonZero() || !other._histograms[*i]->nonZero() )
-    {
-      errs() << "Warning: histogram " << *i << " only exists in one profile!\n";
-      stream << *i << "\t1.0\t1.0\n"; 
-      continue;
-    }
-
-    CPHistogram* h1 = _histograms[*i];
-    CPHistogram* h2 = other._histograms[*i];
-
-    if( h1->isPoint() && h2->isPoint() && (h1->min() != h2->min()))
-    {
-      errs() << "Warning: histogram " << *i << " has different point values\n";
-      stream << *i << "\t1.0\t1.0\n";
-      continue;
-    }
-
-    // finally, no exceptional situations!
-    stream << *i << "\t" << 1-h1->overlap(*h2, false) << "\t" 
-           << 1-h1->overlap(*h2, true) << "\n";
-    
-  }
+  CPDrift drift;
+  drift.compare(*this, other);
+  drift.print(stream, getNameStr());
 }
 
 
@@ -0,0 +1,178 @@
+//===- CombinedProfileInfo.cpp --------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A ProfileInfo implementation backed by a combined edge profile.  Each
+// edge histogram holds the edge's count divided by the count of its
+// dominating edge, so one statistic is taken from every histogram and
+// the weights are rebuilt top-down through the edge dominator tree
+// (see CPBlockWeights):
+//
+//   weight(e) = stat(e) * weight(dom(e))
+//
+// Combined edge profiles normalize every function entry to 1, so the
+// resulting weights are per invocation of the function, scaled by
+// -cp-entry-weight.  Weights are comparable within a function, not
+// across functions.
+//
+//===----------------------------------------------------------------------===//
+#define DEBUG_TYPE "cp-profile-loader"
+#include "llvm/BasicBlock.h"
+#include "llvm/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CPBlockWeights.h"
+#include "llvm/Analysis/Passes.h"
+#include "llvm/Analysis/ProfileInfo.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/Statistic.h"
+using namespace llvm;
+
+STATISTIC(NumCPEdgesRead, "The # of edges read from the combined profile.");
+
+namespace {
+  enum CPStatistic { cpMean, cpMedian, cpQuantile, cpMinCoverage };
+}
+
+static cl::opt<std::string>
+CPProfileFilename("cp-profile-file", cl::init("edge.cp"),
+                  cl::value_desc("filename"),
+                  cl::desc("Combined edge profile loaded by "
+                           "-cp-profile-loader"));
+
+static cl::opt<CPStatistic>
+CPStatisticOpt("cp-statistic", cl::init(cpMean),
+               cl::desc("Statistic taken from each edge histogram"),
+               cl::values(
+                 clEnumValN(cpMean, "mean", "mean over all runs"),
+                 clEnumValN(cpMedian, "median", "median over all runs"),
+                 clEnumValN(cpQuantile, "quantile",
+                            "-cp-quantile over all runs"),
+                 clEnumValN(cpMinCoverage, "mincov",
+                            "smallest non-zero value times coverage"),
+                 clEnumValEnd));
+
+static cl::opt<double>
+CPQuantile("cp-quantile", cl::init(0.5),
+           cl::desc("Quantile used by -cp-statistic=quantile"));
+
+static cl::opt<double>
+CPEntryWeight("cp-entry-weight", cl::init(1.0),
+              cl::desc("Weight given to the entry of every function by "
+                       "-cp-profile-loader"));
+
+namespace {
+  class CombinedProfileInfo : public ModulePass, public ProfileInfo {
+    std::string Filename;
+  public:
+    static char ID; // Class identification, replacement for typeinfo
+    explicit CombinedProfileInfo(const std::string &filename = "")
+      : ModulePass(ID), Filename(filename) {
+      if (filename.empty()) Filename = CPProfileFilename;
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.setPreservesAll();
+    }
+
+    virtual const char *getPassName() const {
+      return "Combined profile information loader";
+    }
+
+    /// getAdjustedAnalysisPointer - This method is used when a pass implements
+    /// an analysis interface through multiple inheritance.  If needed, it
+    /// should override this to adjust the this pointer as needed for the
+    /// specified pass info.
+    virtual void *getAdjustedAnalysisPointer(AnalysisID PI) {
+      if (PI == &ProfileInfo::ID)
+        return (ProfileInfo*)this;
+      return this;
+    }
+
+    /// run - Load the combined profile and compute edge weights.
+    virtual bool runOnModule(Module &M);
+
+  private:
+    void readFunction(Function& F, const CPBlockWeights& weights);
+  };
+}  // End of anonymous namespace
+
+char CombinedProfileInfo::ID = 0;
+INITIALIZE_AG_PASS(CombinedProfileInfo, ProfileInfo, "cp-profile-loader",
+                   "Load profile information from a combined edge profile",
+                   false, true, false);
+
+ModulePass *llvm::createCombinedProfileInfoPass() {
+  return new CombinedProfileInfo();
+}
+
+Pass *llvm::createCombinedProfileInfoPass(const std::string &Filename) {
+  return new CombinedProfileInfo(Filename);
+}
+
+
+void CombinedProfileInfo::readFunction(Function& F,
+                                       const CPBlockWeights& weights)
+{
+  EdgeWeights& ew = EdgeInformation[&F];
+  BasicBlock* entry = &F.getEntryBlock();
+  ew[getEdge(0, entry)] = CPEntryWeight * weights.edgeWeight(0, entry);
+  NumCPEdgesRead++;
+
+  // parallel edges (eg, switch cases to the same block) share an Edge,
+  // and CPBlockWeights has already added them up
+  for(Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    for(succ_iterator S = succ_begin(BB), SE = succ_end(BB); S != SE; ++S)
+    {
+      ew[getEdge(BB, *S)] = CPEntryWeight * weights.edgeWeight(BB, *S);
+      NumCPEdgesRead++;
+    }
+  FunctionInformation[&F] = CPEntryWeight;
+}
+
+
+bool CombinedProfileInfo::runOnModule(Module &M) {
+  EdgeInformation.clear();
+  BlockInformation.clear();
+  FunctionInformation.clear();
+
+  CPBlockWeights::Statistic stat = CPBlockWeights::Mean;
+  double q = CPQuantile;
+  switch(CPStatisticOpt)
+  {
+  case cpMean:
+    stat = CPBlockWeights::Mean;
+    break;
+  case cpMinCoverage:
+    stat = CPBlockWeights::MinCoverage;
+    break;
+  case cpMedian:
+    q = 0.5;
+    // fall through
+  case cpQuantile:
+    stat = CPBlockWeights::Quantile;
+    break;
+  }
+
+  // Median and quantiles are over all runs, so they are 0 when q falls
+  // in the runs that never took the edge.
+  CPBlockWeights weights;
+  if( !weights.load(M, Filename, stat, q) )
+    return(false);
+
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if(F->isDeclaration())
+      continue;
+    DEBUG(dbgs() << "Working on " << F->getNameStr() << "\n");
+    readFunction(*F, weights);
+  }
+  return(false);
+}
@@ -0,0 +1,328 @@
+//===- CombinedTripCountProfile.cpp ---------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Combined loop trip count profiles.  A raw profile holds a small
+// bucketed histogram of trip counts for every loop (ProfileInfoTypes.h);
+// each run adds the fraction of the loop's invocations in each bucket to
+// the loop's histogram, so the combined histogram is the distribution of
+// trip counts over all invocations, with every run weighted equally.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "cp-tripcount"
+
+#include "llvm/Analysis/ProfileInfoTypes.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Analysis/CPStats.h"
+#include "llvm/Analysis/Dominators.h"
+#include "llvm/Module.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// ----------------------------------------------------------------------------
+// Combined trip count profile implementation
+// ----------------------------------------------------------------------------
+
+CombinedTripCountProfile::CombinedTripCountProfile(Module& M)
+{
+  _firstLoop.push_back(0);
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if(!isCPDefinition(*F))
+      continue;
+
+    CPFunctionBody body(*F);
+    std::vector<BasicBlock*> headers;
+    getLoopHeaders(*F, headers);
+    _firstLoop.push_back(_firstLoop.back() + headers.size());
+  }
+
+  _histograms.resize(_firstLoop.back(), NULL);
+}
+
+
+// A reachable block is a loop header if it dominates one of its
+// reachable predecessors, as in LoopInfo.
+void CombinedTripCountProfile::getLoopHeaders(Function& F,
+                                              std::vector<BasicBlock*>& headers)
+{
+  if(F.isDeclaration())
+    return;
+
+  DominatorTreeBase<BasicBlock> DT(false);
+  DT.recalculate(F);
+
+  for(Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+  {
+    if(!DT.isReachableFromEntry(BB))
+      continue;
+
+    for(pred_iterator P = pred_begin(BB), PE = pred_end(BB); P != PE; ++P)
+    {
+      if( DT.isReachableFromEntry(*P) && DT.dominates(BB, *P) )
+      {
+        headers.push_back(BB);
+        break;
+      }
+    }
+  }
+}
+
+
+double CombinedTripCountProfile::bucketValue(unsigned bucket)
+{
+  if(bucket < TRIPCOUNT_EXACT)
+    return(bucket);
+
+  // middle of the bucket's range
+  unsigned shift = bucket - TRIPCOUNT_EXACT;
+  double low = (double)TRIPCOUNT_EXACT * (double)(1u << shift);
+  return(low * 1.5);
+}
+
+
+unsigned CombinedTripCountProfile::serialize(FILE* f)
+{
+  TimeRegion timer(CPStats::getTimer(CPTimeWrite));
+	unsigned loopCount = 0;
+
+  materializeAll();
+
+	for( unsigned i = 0; i < _histograms.size(); i++ )
+		if( (_histograms[i] != NULL) && _histograms[i]->nonZero() )
+			loopCount++;
+
+  ProfilingType ptype = CombinedTripCountInfo;
+	if( (fwrite(&ptype, sizeof(unsigned), 1, f) != 1) ||
+      (fwrite(&_weight, sizeof(double), 1, f) != 1) ||
+      (fwrite(&loopCount, sizeof(unsigned), 1, f) != 1) ||
+      (fwrite(&_bincount, sizeof(unsigned), 1, f) != 1) )
+  {
+		errs() << "error: unable to write CPTripCount header to file.\n";
+		return(0);
+	}
+
+  unsigned written = 0;
+	for( unsigned i = 0; i < _histograms.size(); i++ )
+  {
+		if( (_histograms[i] == NULL) || !_histograms[i]->nonZero() )
+			continue;
+
+    if( !_histograms[i]->serialize(i, f) )
+    {
+      errs() << "error: unable to write histogram " << i << " to file.\n";
+      return(0);
+    }
+    written++;
+	}
+
+  return(written);
+}
+
+
+bool CombinedTripCountProfile::deserialize(FILE* f)
+{
+	unsigned loopCount;
+
+	if( !fread(&_weight, sizeof(double), 1, f) ||
+		  !fread(&loopCount, sizeof(unsigned), 1, f) ||
+		  !fread(&_bincount, sizeof(unsigned), 1, f) ) {
+		errs() << "warning: combined trip count profiling data corrupt.\n";
+		return false;
+	}
+
+  for(unsigned h = 0; h < loopCount; h++)
+  {
+    CPHistogram* newHist = new CPHistogram();
+    int index = newHist->deserialize(_bincount, _weight, f);
+
+    if( (index < 0) || ((unsigned)index >= _histograms.size()) )
+    {
+      errs() << "CombinedTripCountProfile: error: unable to read histogram "
+             << h << " of " << loopCount << "\n";
+      delete newHist;
+      return false;
+    }
+
+    if(_histograms[index] != NULL)
+      delete _histograms[index];
+    _histograms[index] = newHist;
+	}
+
+  // allocate any missing histograms
+  for(unsigned i = 0; i < _histograms.size(); i++)
+  {
+    if( _histograms[i] == NULL )
+      _histograms[i] = new CPHistogram();
+  }
+
+	return true;
+}
+
+
+// Reads in a raw profile from the file and adds the share of each
+// loop's invocations in each bucket to that loop's add list.
+bool CombinedTripCountProfile::addProfile(FILE* file)
+{
+  unsigned counterCount;
+  if( fread(&counterCount, sizeof(unsigned), 1, file) != 1 )
+  {
+    errs() << "  error: trip count profiling info has no header\n";
+    return(false);
+  }
+
+  unsigned expectedCnt = _histograms.size() * TRIPCOUNT_BUCKETS;
+  if(counterCount != expectedCnt)
+  {
+    errs() << "addProfile: Error: " << counterCount << " profile entries, but "
+           << expectedCnt << " needed (" << _histograms.size()
+           << " loops)\n";
+    return(false);
+  }
+
+  std::vector<unsigned> counters(counterCount);
+  if( (counterCount > 0) &&
+      (fread(&counters[0], sizeof(unsigned), counterCount, file)
+       != counterCount) )
+  {
+    errs() << "  warning: trip count profiling info header/data mismatch\n";
+    return(false);
+  }
+
+  addWeight(_runWeight);
+
+  for(unsigned i = 0; i < _histograms.size(); i++)
+  {
+    // in place, only the loops the run reached are allocated (or read)
+    if( !_inPlace && (_histograms[i] == NULL) )
+      _histograms[i] = new CPHistogram();
+
+    const unsigned* buckets = &counters[i*TRIPCOUNT_BUCKETS];
+    double invocations = 0;
+    for(unsigned b = 0; b < TRIPCOUNT_BUCKETS; b++)
+    {
+      if(buckets[b] == 0xffffffff)
+        errs() << "CombinedTripCountProfile::addProfile Warning: saturated "
+               << "trip count bucket (" << i << ", " << b << ")\n";
+      invocations += buckets[b];
+    }
+
+    if(invocations == 0)
+      continue;
+
+    CPHistogram& hist = (*this)[i];
+    for(unsigned b = 0; b < TRIPCOUNT_BUCKETS; b++)
+      if(buckets[b] > 0)
+        addRunValue(hist, bucketValue(b),
+                    _runWeight * buckets[b] / invocations);
+  }
+
+  return(true);
+}
+
+
+// Even though list is a generic CPList, it should only contain CTPs
+bool CombinedTripCountProfile::buildFromList(CPList& list, unsigned binCount)
+{
+  ProfilingType myType = getProfilingType();
+
+  if(binCount == 0)
+    _bincount = calcBinCount(list);
+  else
+    _bincount = binCount;
+
+  _weight = 0;
+
+	if(list.size() == 0)
+		return true;
+
+  // delete current contents (if any)
+  for(unsigned i = 0; i < _histograms.size(); i++)
+    if(_histograms[i] != NULL)
+    {
+      delete _histograms[i];
+      _histograms[i] = NULL;
+    }
+
+	for(CPList::iterator CP = list.begin(), E = list.end(); CP != E; ++CP)
+  {
+    if((*CP)->getProfilingType() != myType)
+    {
+      errs() << "CTP::buildFromList Warning: CP in list is not a CTP\n";
+      continue;
+    }
+
+    CombinedTripCountProfile* cp = (CombinedTripCountProfile*)(*CP);
+		addWeight(cp->_weight);
+    if(cp->size() != size())
+    {
+      errs() << "CTP::buildFromList Error: loop count mismatch! "
+             << cp->size() << " vs " << size() << "\n";
+      return(false);
+    }
+  }
+
+	// Merge each set of histograms
+	for( unsigned i = 0; i < _histograms.size(); i++ )
+  {
+		CPHistogramList cphl;
+
+		for(CPList::iterator CP = list.begin(), E = list.end();	CP != E; ++CP)
+    {
+      if((*CP)->getProfilingType() != myType)
+        continue;
+
+      CombinedTripCountProfile* cp = (CombinedTripCountProfile*)(*CP);
+      CPHistogram& hist = (*cp)[i];
+			if( hist.nonZeroWeight() != 0 )
+				cphl.push_back(&hist);
+    }
+
+		_histograms[i] = new CPHistogram(_bincount, _weight, cphl);
+	}
+
+	return true;
+}
+
+
+CPHistogram& CombinedTripCountProfile::operator[](const unsigned index)
+{
+  if( (_histograms[index] == NULL) && (materialize(index) == NULL) )
+    _histograms[index] = new CPHistogram();
+	return *_histograms[index];
+}
+
+
+// same histograms as serialize
+void CombinedTripCountProfile::getIndexOrder(
+  std::vector<CPIndexEntry>& order) const
+{
+  for(unsigned i = 0; i < _histograms.size(); i++)
+  {
+    if( (_histograms[i] == NULL) || !_histograms[i]->nonZero() )
+      continue;
+    CPIndexEntry e = { 0, i, i };
+    order.push_back(e);
+  }
+}
+
+
+unsigned CombinedTripCountProfile::addIndexedSlot(unsigned fnNumber,
+                                                  unsigned ID)
+{
+  if( (fnNumber != 0) || (ID >= _histograms.size()) )
+    return(CP_NOT_INDEXED);
+  return(ID);
+}
@@ -0,0 +1,398 @@
+//===- CombinedValueProfile.cpp -------------------------------*- C++ -*---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Combined indirect call target profiles.  A raw profile holds the most
+// frequent targets of every indirect call site (ProfileInfoTypes.h);
+// each run adds each target's share of the site's calls to the
+// histogram for that <site,target>, so a target that dominates the site
+// for every input has its weight near 1 in every run.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "cp-value"
+
+#include "llvm/Analysis/ProfileInfoTypes.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Analysis/CPStats.h"
+#include "llvm/InlineAsm.h"
+#include "llvm/IntrinsicInst.h"
+#include "llvm/Module.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// ----------------------------------------------------------------------------
+// Combined value profile implementation
+// ----------------------------------------------------------------------------
+
+CombinedValueProfile::CombinedValueProfile(Module& M) : _siteCount(0)
+{
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if(!isCPDefinition(*F))
+      continue;
+
+    _functionRef.push_back(F);
+    CPFunctionBody body(*F);
+    std::vector<Instruction*> calls;
+    getIndirectCalls(*F, calls);
+    _siteCount += calls.size();
+  }
+}
+
+
+// Calls through a pointer; calls to (a cast of) a function or to inline
+// asm have only one possible target.
+bool CombinedValueProfile::isIndirectCall(Instruction* I)
+{
+  CallSite cs(cast<Value>(I));
+  if(!cs || isa<IntrinsicInst>(I))
+    return(false);
+
+  Value* callee = cs.getCalledValue()->stripPointerCasts();
+  return( !isa<Function>(callee) && !isa<InlineAsm>(callee) );
+}
+
+
+void CombinedValueProfile::getIndirectCalls(Function& F,
+                                            std::vector<Instruction*>& calls)
+{
+  for(Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    for(BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I)
+      if(isIndirectCall(I))
+        calls.push_back(I);
+}
+
+
+unsigned CombinedValueProfile::serialize(FILE* f)
+{
+  TimeRegion timer(CPStats::getTimer(CPTimeWrite));
+  materializeAll();
+
+  ProfilingType ptype = CombinedValueInfo;
+  unsigned siteCount = _sites.size();
+	if( (fwrite(&ptype, sizeof(unsigned), 1, f) != 1) ||
+      (fwrite(&_weight, sizeof(double), 1, f) != 1) ||
+      (fwrite(&siteCount, sizeof(unsigned), 1, f) != 1) ||
+      (fwrite(&_bincount, sizeof(unsigned), 1, f) != 1) )
+  {
+		errs() << "error: unable to write CPValue header to file.\n";
+		return(0);
+	}
+
+  unsigned written = 0;
+	for(CVPSiteMap::iterator S = _sites.begin(), E = _sites.end(); S != E; ++S)
+  {
+    // same layout as the path profile: a header per site
+		PathHeader sh = { S->first, S->second.size() };
+		if( fwrite(&sh, sizeof(PathHeader), 1, f) != 1 )
+    {
+			errs() << "error: unable to write CPValue site header to file.\n";
+			return(0);
+		}
+
+		for(CVPTargetMap::iterator T = S->second.begin(), TE = S->second.end();
+        T != TE; ++T)
+    {
+      if( !_histograms[T->second]->serialize(T->first, f) )
+      {
+        errs() << "error: CVP::serialize failed to serialize histogram: s:"
+               << S->first << ", t:" << T->first << "\n";
+        return(0);
+      }
+      written++;
+		}
+	}
+  return(written);
+}
+
+
+bool CombinedValueProfile::deserialize(FILE* f)
+{
+	unsigned siteCount;
+
+	if( !fread(&_weight, sizeof(double), 1, f) ||
+		  !fread(&siteCount, sizeof(unsigned), 1, f) ||
+		  !fread(&_bincount, sizeof(unsigned), 1, f) ) {
+		errs() << "warning: combined value profiling data corrupt.\n";
+		return false;
+	}
+
+	while( siteCount-- ) {
+		PathHeader sh;
+		if( fread(&sh, sizeof(PathHeader), 1, f) != 1 ) {
+			errs() << "CVP::deserialize Error: failed to read site header\n";
+			return false;
+		}
+
+		while( sh.numEntries-- )
+    {
+      CPHistogram* hist = new CPHistogram();
+      int target = hist->deserialize(_bincount, _weight, f);
+      if( (target < 0) || (sh.fnNumber >= _siteCount) )
+      {
+        errs() << "CVP::deserialize Error: failed to read histogram\n";
+        delete hist;
+        return(false);
+      }
+
+      _sites[sh.fnNumber][target] = _histograms.size();
+      _histograms.push_back(hist);
+		}
+	}
+
+	return true;
+}
+
+
+// Reads in a raw profile from the file and adds the share of each
+// site's calls that went to each target to the <site,target> add list.
+bool CombinedValueProfile::addProfile(FILE* file)
+{
+  unsigned counterCount;
+  if( fread(&counterCount, sizeof(unsigned), 1, file) != 1 )
+  {
+    errs() << "  error: value profiling info has no header\n";
+    return(false);
+  }
+
+  unsigned expectedCnt = _siteCount * VALUE_SITE_COUNTERS;
+  if(counterCount != expectedCnt)
+  {
+    errs() << "addProfile: Error: " << counterCount << " profile entries, but "
+           << expectedCnt << " needed (" << _siteCount
+           << " indirect call sites)\n";
+    return(false);
+  }
+
+  std::vector<unsigned> counters(counterCount);
+  if( (counterCount > 0) &&
+      (fread(&counters[0], sizeof(unsigned), counterCount, file)
+       != counterCount) )
+  {
+    errs() << "  warning: value profiling info header/data mismatch\n";
+    return(false);
+  }
+
+  addWeight(_runWeight);
+
+  for(SiteIndex s = 0; s < _siteCount; s++)
+  {
+    const unsigned* site = &counters[s*VALUE_SITE_COUNTERS];
+    double calls = site[2*VALUE_TARGETS];
+    for(unsigned t = 0; t < VALUE_TARGETS; t++)
+      calls += site[2*t+1];
+
+    if(calls == 0)
+      continue;
+
+    addRunValue(getHistogram(s, CVP_ALL_TARGETS), calls, _runWeight);
+    for(unsigned t = 0; t < VALUE_TARGETS; t++)
+    {
+      TargetIndex target = site[2*t];
+      if( (target == 0) || (site[2*t+1] == 0) )
+        continue;
+      if(target > _functionRef.size())
+      {
+        errs() << "CombinedValueProfile::addProfile Warning: bad target "
+               << target << " at site " << s << "\n";
+        continue;
+      }
+      if(site[2*t+1] == 0xffffffff)
+        errs() << "CombinedValueProfile::addProfile Warning: saturated "
+               << "target count (" << s << ", " << target << ")\n";
+      addRunValue(getHistogram(s, target), site[2*t+1] / calls,
+                  _runWeight);
+    }
+  }
+
+  return(true);
+}
+
+
+// Even though list is a generic CPList, it should only contain CVPs
+bool CombinedValueProfile::buildFromList(CPList& list, unsigned binCount)
+{
+	if(list.size() == 0)
+		return true;
+
+  ProfilingType myType = getProfilingType();
+
+  if(binCount == 0)
+    _bincount = calcBinCount(list);
+  else
+    _bincount = binCount;
+
+	for(CPList::iterator CP = list.begin(), E = list.end(); CP != E; ++CP)
+  {
+    if((*CP)->getProfilingType() != myType)
+    {
+      errs() << "CVP::buildFromList Warning: CP in list is not a CVP\n";
+      continue;
+    }
+		_weight += ((CombinedValueProfile*)(*CP))->_weight;
+  }
+
+  // collect the histograms of each <site,target> from every profile
+  std::map<SiteIndex, std::map<TargetIndex,CPHistogramList> > lists;
+	for(CPList::iterator CP = list.begin(), E = list.end(); CP != E; ++CP)
+  {
+    if((*CP)->getProfilingType() != myType)
+      continue;
+
+    CombinedValueProfile* cp = (CombinedValueProfile*)(*CP);
+    for(CVPSiteMap::iterator S = cp->_sites.begin(), SE = cp->_sites.end();
+        S != SE; ++S)
+      for(CVPTargetMap::iterator T = S->second.begin(),
+            TE = S->second.end(); T != TE; ++T)
+        lists[S->first][T->first].push_back(
+          &cp->getHistogram(S->first, T->first));
+  }
+
+  for(std::map<SiteIndex, std::map<TargetIndex,CPHistogramList> >::iterator
+        S = lists.begin(), E = lists.end(); S != E; ++S)
+    for(std::map<TargetIndex,CPHistogramList>::iterator
+          T = S->second.begin(), TE = S->second.end(); T != TE; ++T)
+    {
+      _sites[S->first][T->first] = _histograms.size();
+      _histograms.push_back(new CPHistogram(_bincount, _weight, T->second));
+    }
+
+	return true;
+}
+
+
+void CombinedValueProfile::getTargets(SiteIndex site,
+                                      std::vector<TargetIndex>& targets) const
+{
+  CVPSiteMap::const_iterator S = _sites.find(site);
+  if(S == _sites.end())
+    return;
+
+  for(CVPTargetMap::const_iterator T = S->second.begin(),
+        TE = S->second.end(); T != TE; ++T)
+    if(T->first != CVP_ALL_TARGETS)
+      targets.push_back(T->first);
+}
+
+
+bool CombinedValueProfile::valid(SiteIndex site, TargetIndex target) const
+{
+  CVPSiteMap::const_iterator S = _sites.find(site);
+  return( (S != _sites.end()) && (S->second.count(target) > 0) );
+}
+
+
+// allocates an empty histogram for a <site,target> not seen before
+CPHistogram& CombinedValueProfile::getHistogram(SiteIndex site,
+                                                TargetIndex target)
+{
+  CVPTargetMap& targets = _sites[site];
+  CVPTargetMap::iterator T = targets.find(target);
+  if(T == targets.end())
+  {
+    T = targets.insert(std::make_pair(target, _histograms.size())).first;
+    _histograms.push_back(NULL);
+  }
+
+  if( (_histograms[T->second] == NULL) && (materialize(T->second) == NULL) )
+    _histograms[T->second] = new CPHistogram();
+  return(*_histograms[T->second]);
+}
+
+
+// same histograms as serialize, ID'd by <site+1,target>
+void CombinedValueProfile::getIndexOrder(std::vector<CPIndexEntry>& order) const
+{
+	for(CVPSiteMap::const_iterator S = _sites.begin(), E = _sites.end();
+      S != E; ++S)
+		for(CVPTargetMap::const_iterator T = S->second.begin(),
+          TE = S->second.end(); T != TE; ++T)
+    {
+      CPIndexEntry e = { S->first + 1, T->first, T->second };
+      order.push_back(e);
+    }
+}
+
+
+unsigned CombinedValueProfile::addIndexedSlot(unsigned fnNumber, unsigned ID)
+{
+  if( (fnNumber == 0) || (fnNumber > _siteCount) )
+    return(CP_NOT_INDEXED);
+
+  unsigned slot = _histograms.size();
+  _histograms.push_back(NULL);
+  _sites[fnNumber-1][ID] = slot;
+  return(slot);
+}
+
+
+void CombinedValueProfile::setLayout(const CPFunctionKeys& keys)
+{
+  std::vector<unsigned> first;
+  keys.getFirstSlots(CPSiteSlots, first);
+  _siteCount = first.back();
+}
+
+
+// Sites move with their function while its indirect calls stay put.
+// Targets are renumbered by name, whatever became of their bodies; a
+// target that went away takes its histogram with it.
+bool CombinedValueProfile::remapFunctions(const CPFunctionMap& map)
+{
+  std::vector<unsigned> oldFirst, newFirst;
+  map.from().getFirstSlots(CPSiteSlots, oldFirst);
+  map.to().getFirstSlots(CPSiteSlots, newFirst);
+  materializeAll();
+
+  CVPSiteMap sites;
+  CPHistVec histograms;
+  unsigned f = 0;
+  for(CVPSiteMap::iterator S = _sites.begin(), E = _sites.end(); S != E; ++S)
+  {
+    // sites are in order: find the function of this one
+    while( (f < map.from().size()) && (oldFirst[f+1] <= S->first) )
+      f++;
+    unsigned to = (f < map.from().size()) ? map(f, CPSiteSlots)
+      : CP_NO_FUNCTION;
+
+    for(CVPTargetMap::iterator T = S->second.begin(), TE = S->second.end();
+        T != TE; ++T)
+    {
+      TargetIndex target = T->first;
+      bool gone = (to == CP_NO_FUNCTION);
+      if( !gone && (target != CVP_ALL_TARGETS) )
+      {
+        unsigned t = (target <= map.from().size()) ? map[target-1]
+          : CP_NO_FUNCTION;
+        gone = (t == CP_NO_FUNCTION);
+        target = t + 1;
+      }
+
+      if(gone)
+      {
+        delete _histograms[T->second];
+        continue;
+      }
+      sites[newFirst[to] + S->first - oldFirst[f]][target] =
+        histograms.size();
+      histograms.push_back(_histograms[T->second]);
+    }
+  }
+
+  _sites.swap(sites);
+  _histograms.swap(histograms);
+  _siteCount = newFirst.back();
+  return(true);
+}
@@ -14,6 +14,7 @@
 #include "llvm/Pass.h"
 #include "llvm/Instructions.h"
 #include "llvm/Analysis/EdgeDominatorTree.h"
+#include "llvm/Analysis/CPModule.h"
 #include "llvm/Analysis/Passes.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/CommandLine.h"
@@ -45,6 +46,8 @@ EdgeDominatorTree::EdgeDominatorTree(Module &M)
   unsigned totalEdges = 0;
 	for( Module::iterator F = M.begin(), E = M.end(); F != E; F++ ) 
   {
+    // a lazy body is dropped again at the end of this iteration
+    CPFunctionBody body(*F);
     CFGEdgeDomTree funcEDT(*F, edgeCounter);
 
     // claim EdgeNode*s from funcEDT: now it's our job to free them
@@ -55,6 +58,15 @@ EdgeDominatorTree::EdgeDominatorTree(Module &M)
       totalEdges += localEdges->size();
       //printDominance(errs(), *localEdges);
       edgeCounter += localEdges->size();
+      // Only the indexes and dominance are kept.  The blocks may be
+      // freed with a temporary body, or by later passes, so don't
+      // leave pointers to them around.
+      for(EdgeNodeMapIterator i = localEdges->begin(),
+            iE = localEdges->end(); i != iE; ++i)
+      {
+        i->second->source = NULL;
+        i->second->target = NULL;
+      }
       // this is inserting *pointers* to the EdgeNodes allocated by funcEDT
       _edges.insert(localEdges->begin(), localEdges->end());
     }
@@ -70,12 +82,16 @@ EdgeDominatorTree::~EdgeDominatorTree() {
 }
 
 
-EdgeIndex EdgeDominatorTree::getDominatorIndex(EdgeIndex e) {
-  return(_edges[e]->domIndex);
+// find, not operator[]: this must not change _edges, which readers on
+// other threads share
+EdgeIndex EdgeDominatorTree::getDominatorIndex(EdgeIndex e) const {
+  EdgeNodeMap::const_iterator i = _edges.find(e);
+  assert(i != _edges.end() && "edge not in the dominator tree");
+  return(i->second->domIndex);
 }
 
 
-unsigned EdgeDominatorTree::getEdgeCount() {
+unsigned EdgeDominatorTree::getEdgeCount() const {
 	return _edges.size();
 }
 
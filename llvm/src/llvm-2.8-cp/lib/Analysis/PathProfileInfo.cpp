@@ -18,6 +18,8 @@
 #include "llvm/Analysis/Passes.h"
 #include "llvm/Analysis/ProfileInfoTypes.h"
 #include "llvm/Analysis/PathProfileInfo.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPPathIndex.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
@@ -32,10 +34,27 @@ PathProfileInfoFilename("path-profile-loader-file", cl::init("llvmprof.out"),
                         cl::value_desc("filename"),
                         cl::desc("Path profile file loaded by -path-profile-loader"));
 
+// how the paths of a combined path profile are ranked
+static cl::opt<CPPathRank>
+PathProfileRank("path-profile-rank", cl::init(CPRankMean),
+                cl::desc("Rank the paths of a combined path profile by"),
+                cl::values(
+                  clEnumValN(CPRankMean, "mean",
+                             "mean executions per call"),
+                  clEnumValN(CPRankQuantile, "quantile",
+                             "-path-profile-quantile of executions per call"),
+                  clEnumValN(CPRankCoverage, "coverage",
+                             "fraction of runs executed in"),
+                  clEnumValEnd));
+
+static cl::opt<double>
+PathProfileQuantile("path-profile-quantile", cl::init(0.5),
+                    cl::desc("Quantile for -path-profile-rank=quantile"));
+
 namespace {
   class PathProfileLoaderPass : public ModulePass, public PathProfileInfo {
   public:
-    PathProfileLoaderPass() : ModulePass(ID) { }
+    PathProfileLoaderPass() : ModulePass(ID), _combined(0) { }
     ~PathProfileLoaderPass();
 
     // this pass doesn't change anything (only loads information)
@@ -71,6 +90,9 @@ namespace {
     // process path number information from the input file
     void handlePathInfo();
 
+    // read a combined path profile and index it
+    bool loadCombined(Module &M);
+
     // array of references to the functions in the module
     std::vector<Function*> _functions;
 
@@ -79,6 +101,9 @@ namespace {
 
     // path profile file name
     std::string _filename;
+
+    // combined path profile behind _pathIndex
+    CombinedPathProfile* _combined;
   };
 }
 
@@ -194,27 +219,8 @@ PathEdgeVector* Path::getPathEdges() const {
 }
 
 PathBlockVector* Path::getPathBlocks() const {
-  BallLarusNode* currentNode = _ppi->_currentDag->getRoot ();
-  unsigned int increment = _number;
   PathBlockVector* pbv = new PathBlockVector;
-
-  while (currentNode != _ppi->_currentDag->getExit()) {
-    BallLarusEdge* next = getNextEdge(currentNode, increment);
-    increment -= next->getWeight();
-
-    // add block to the block list if it is a real edge
-    if( next->getType() == BallLarusEdge::NORMAL)
-      pbv->push_back (currentNode->getBlock());
-    // make the back edge the last edge since we are at the end
-    else if( next->getTarget() == _ppi->_currentDag->getExit() ) {
-      pbv->push_back (currentNode->getBlock());
-      pbv->push_back (next->getRealEdge()->getTarget()->getBlock());
-    }
-
-    // set the new node
-    currentNode = next->getTarget();
-  }
-
+  PathProfileInfo::decodePathBlocks(*_ppi->_currentDag, _number, *pbv);
   return pbv;
 }
 
@@ -236,12 +242,15 @@ BasicBlock* Path::getFirstBlockInPath() const {
 // Pass identification
 char llvm::PathProfileInfo::ID = 0;
 
-PathProfileInfo::PathProfileInfo () : _currentDag(0) , _currentFunction(0) {
+PathProfileInfo::PathProfileInfo () : _pathIndex(0), _currentDag(0) ,
+  _currentFunction(0) {
 }
 
 PathProfileInfo::~PathProfileInfo() {
 	if (_currentDag)
     delete _currentDag;
+  if (_pathIndex)
+    delete _pathIndex;
 }
 
 // set the function for which paths are currently begin processed
@@ -293,6 +302,35 @@ unsigned int PathProfileInfo::pathsRun() {
 		return _currentFunction ? _functionPaths[_currentFunction].size() : 0;
 }
 
+// walk the path from the root, adding the source of each real edge
+void PathProfileInfo::decodePathBlocks(BallLarusDag& dag, unsigned int number,
+                                       PathBlockVector& blocks) {
+  BallLarusNode* currentNode = dag.getRoot ();
+  unsigned int increment = number;
+
+  while (currentNode != dag.getExit()) {
+    BallLarusEdge* next = getNextEdge(currentNode, increment);
+    increment -= next->getWeight();
+
+    // add block to the block list if it is a real edge
+    if( next->getType() == BallLarusEdge::NORMAL)
+      blocks.push_back (currentNode->getBlock());
+    // make the back edge the last edge since we are at the end
+    else if( next->getTarget() == dag.getExit() ) {
+      blocks.push_back (currentNode->getBlock());
+      blocks.push_back (next->getRealEdge()->getTarget()->getBlock());
+    }
+
+    // set the new node
+    currentNode = next->getTarget();
+  }
+}
+
+// return the hot path index of a combined profile
+CPPathIndex* PathProfileInfo::getPathIndex() const {
+  return _pathIndex;
+}
+
 // ----------------------------------------------------------------------------
 // PathLoader implementation
 //
@@ -304,6 +342,13 @@ PathProfileLoaderPass::~PathProfileLoaderPass() {
     for( PathIterator pathNext = funcNext->second.begin(),
         pathEnd = funcNext->second.end(); pathNext != pathEnd; pathNext++)
       delete pathNext->second;
+
+  // the index refers to the profile
+  if (_pathIndex)
+    delete _pathIndex;
+  _pathIndex = 0;
+  if (_combined)
+    delete _combined;
 }
 
 // entry point of the pass; this loads and parses a file
@@ -319,6 +364,15 @@ bool PathProfileLoaderPass::runOnModule(Module &M) {
 
   ProfilingType profType;
 
+  // a combined profile is read whole by the CP classes
+  if( fread(&profType, sizeof(ProfilingType), 1, _file) == 1 &&
+      (profType == CombinedFunctionKeys || profType == CombinedPathInfo ||
+       profType == IndexedCombinedInfo) ) {
+    fclose (_file);
+    return loadCombined(M);
+  }
+  rewind (_file);
+
   while( fread(&profType, sizeof(ProfilingType), 1, _file) ) {
     switch (profType) {
     case ArgumentInfo:
@@ -339,6 +393,23 @@ bool PathProfileLoaderPass::runOnModule(Module &M) {
   return true;
 }
 
+// read a combined path profile and index its paths
+bool PathProfileLoaderPass::loadCombined(Module &M) {
+  CPFactory factory(M);
+  if( !factory.loadProfiles(_filename) )
+    return false;
+
+  if( !factory.hasPathCP() ) {
+    errs () << "error: '" << _filename << "' has no combined path profile\n";
+    return false;
+  }
+
+  _combined = factory.takePathCP();
+  _pathIndex = new CPPathIndex(*_combined, PathProfileRank,
+                               PathProfileQuantile);
+  return true;
+}
+
 // create a reference table for functions defined in the path profile file
 void PathProfileLoaderPass::buildFunctionRefs (Module &M) {
   _functions.push_back(0); // make the 0 index a null pointer
@@ -17,6 +17,7 @@
 #include "llvm/CodeGen/MachineLoopInfo.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/SlotIndexes.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetInstrInfo.h"
@@ -24,6 +25,16 @@
 #include "llvm/Target/TargetRegisterInfo.h"
 using namespace llvm;
 
+static cl::opt<std::string>
+SpillWeightCProf("spill-weight-cprof", cl::init(""), cl::value_desc("filename"),
+                 cl::desc("Weight spills by block frequencies from a combined "
+                          "edge profile instead of loop depth"));
+
+static cl::opt<double>
+SpillWeightQuantile("spill-weight-quantile", cl::init(-1.0),
+                    cl::desc("Take block frequencies at this quantile over "
+                             "all runs instead of the mean (0 to 1)"));
+
 char CalculateSpillWeights::ID = 0;
 INITIALIZE_PASS(CalculateSpillWeights, "calcspillweights",
                 "Calculate spill weights", false, false);
@@ -35,6 +46,20 @@ void CalculateSpillWeights::getAnalysisUsage(AnalysisUsage &au) const {
   MachineFunctionPass::getAnalysisUsage(au);
 }
 
+/// doInitialization - Load the profile before codegen changes the IR, so the
+/// edges are numbered the same way as when the program was profiled.
+bool CalculateSpillWeights::doInitialization(Module &m) {
+  haveProfile_ = !SpillWeightCProf.empty() &&
+    profile_.load(m, SpillWeightCProf, SpillWeightQuantile);
+  return false;
+}
+
+bool CalculateSpillWeights::doFinalization(Module &m) {
+  profile_.clear();
+  haveProfile_ = false;
+  return false;
+}
+
 bool CalculateSpillWeights::runOnMachineFunction(MachineFunction &fn) {
 
   DEBUG(dbgs() << "********** Compute Spill Weights **********\n"
@@ -42,7 +67,8 @@ bool CalculateSpillWeights::runOnMachineFunction(MachineFunction &fn) {
                << fn.getFunction()->getName() << '\n');
 
   LiveIntervals &lis = getAnalysis<LiveIntervals>();
-  VirtRegAuxInfo vrai(fn, lis, getAnalysis<MachineLoopInfo>());
+  VirtRegAuxInfo vrai(fn, lis, getAnalysis<MachineLoopInfo>(),
+                      haveProfile_ ? &profile_ : 0);
   for (LiveIntervals::iterator I = lis.begin(), E = lis.end(); I != E; ++I) {
     LiveInterval &li = *I->second;
     if (TargetRegisterInfo::isVirtualRegister(li.reg))
@@ -88,7 +114,9 @@ void VirtRegAuxInfo::CalculateWeightAndHint(LiveInterval &li) {
   MachineBasicBlock *mbb = 0;
   MachineLoop *loop = 0;
   unsigned loopDepth = 0;
+  double freq = 0;
   bool isExiting = false;
+  bool useProfile = profile_ && profile_->profiled(mf_.getFunction());
   float totalWeight = 0;
   SmallPtrSet<MachineInstr*, 8> visited;
 
@@ -112,12 +140,16 @@ void VirtRegAuxInfo::CalculateWeightAndHint(LiveInterval &li) {
       loop = loops_.getLoopFor(mbb);
       loopDepth = loop ? loop->getLoopDepth() : 0;
       isExiting = loop ? loop->isLoopExiting(mbb) : false;
+      if (useProfile)
+        freq = profile_->getBlockWeight(mbb);
     }
 
-    // Calculate instr weight.
+    // Calculate instr weight.  Measured block frequencies are per function
+    // entry, the same scale as the loop-depth estimate.
     bool reads, writes;
     tie(reads, writes) = mi->readsWritesVirtualRegister(li.reg);
-    float weight = LiveIntervals::getSpillWeight(writes, reads, loopDepth);
+    float weight = useProfile ? (float)((writes + reads) * freq)
+      : LiveIntervals::getSpillWeight(writes, reads, loopDepth);
 
     // Give extra weight to what looks like a loop induction variable update.
     if (writes && isExiting && lis_.isLiveOutOfMBB(li, mbb))
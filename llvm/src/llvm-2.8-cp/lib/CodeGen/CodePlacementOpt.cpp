@@ -10,34 +10,74 @@
 // This file implements the pass that optimize code placement and align loop
 // headers to target specific alignment boundary.
 //
+// With -code-place-cprof, blocks are instead laid out by bottom-up chaining
+// (Pettis and Hansen, "Profile Guided Code Positioning", PLDI '90), with edge
+// weights taken from a combined edge profile of the IR and projected onto the
+// machine CFG.  -code-place-quantile weighs each edge at a quantile over the
+// training runs rather than the mean, so the layout maximizes fall-through for
+// that fraction of inputs instead of for the average one.
+//
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "code-placement"
+#include "llvm/CodeGen/MachineCPWeights.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/Passes.h"
 #include "llvm/Target/TargetInstrInfo.h"
 #include "llvm/Target/TargetLowering.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/ADT/Statistic.h"
+#include <algorithm>
 using namespace llvm;
 
 STATISTIC(NumLoopsAligned,  "Number of loops aligned");
 STATISTIC(NumIntraElim,     "Number of intra loop branches eliminated");
 STATISTIC(NumIntraMoved,    "Number of intra loop branches moved");
+STATISTIC(NumChainedFuncs,  "Number of functions laid out from a profile");
+STATISTIC(NumChainedEdges,  "Number of profiled edges made fall-through");
+
+static cl::opt<std::string>
+CodePlaceCProf("code-place-cprof", cl::init(""), cl::value_desc("filename"),
+               cl::desc("Lay out blocks by chaining, with edge weights from "
+                        "a combined edge profile"));
+
+static cl::opt<double>
+CodePlaceQuantile("code-place-quantile", cl::init(-1.0),
+                  cl::desc("Weigh profiled edges at this quantile over all "
+                           "runs instead of the mean (0 to 1)"));
 
 namespace {
+  /// MBBEdge - A profiled machine CFG edge, heaviest first.
+  struct MBBEdge {
+    MachineBasicBlock *Src, *Dst;
+    double Weight;
+    bool operator<(const MBBEdge &RHS) const {
+      if (Weight != RHS.Weight) return Weight > RHS.Weight;
+      if (Src->getNumber() != RHS.Src->getNumber())
+        return Src->getNumber() < RHS.Src->getNumber();
+      return Dst->getNumber() < RHS.Dst->getNumber();
+    }
+  };
+
   class CodePlacementOpt : public MachineFunctionPass {
     const MachineLoopInfo *MLI;
     const TargetInstrInfo *TII;
     const TargetLowering  *TLI;
 
+    /// Profile weights of the IR, per function entry.
+    MachineCPWeights Profile;
+
   public:
     static char ID;
     CodePlacementOpt() : MachineFunctionPass(ID) {}
 
+    virtual bool doInitialization(Module &M);
+    virtual bool doFinalization(Module &M);
     virtual bool runOnMachineFunction(MachineFunction &MF);
     virtual const char *getPassName() const {
       return "Code Placement Optimizater";
@@ -64,6 +104,8 @@ namespace {
     bool OptimizeIntraLoopEdges(MachineFunction &MF);
     bool AlignLoops(MachineFunction &MF);
     bool AlignLoop(MachineFunction &MF, MachineLoop *L, unsigned Align);
+
+    bool ChainBlocks(MachineFunction &MF);
   };
 
   char CodePlacementOpt::ID = 0;
@@ -409,14 +451,140 @@ bool CodePlacementOpt::AlignLoop(MachineFunction &MF, MachineLoop *L,
   return Changed;
 }
 
+/// doInitialization - Load the combined edge profile, if there is one.  This
+/// runs before any codegen pass changes the IR, so the edges are numbered the
+/// same way as when the program was profiled.
+bool CodePlacementOpt::doInitialization(Module &M) {
+  if (!CodePlaceCProf.empty())
+    Profile.load(M, CodePlaceCProf, CodePlaceQuantile);
+  return false;
+}
+
+bool CodePlacementOpt::doFinalization(Module &M) {
+  Profile.clear();
+  return false;
+}
+
+/// ChainBlocks - Profile-driven layout.  Heaviest edge first, join the chain
+/// ending in its source to the chain starting at its target; then emit the
+/// entry chain followed by the rest, hottest first.  Blocks whose terminator
+/// can't be rewritten keep their layout successor.
+bool CodePlacementOpt::ChainBlocks(MachineFunction &MF) {
+  MF.RenumberBlocks();
+  unsigned NumBlocks = MF.getNumBlockIDs();
+  std::vector<MachineBasicBlock*> Blocks(NumBlocks);
+  std::vector<unsigned> ChainOf(NumBlocks);
+  std::vector<std::vector<MachineBasicBlock*> > Chains(NumBlocks);
+  std::vector<bool> Analyzable(NumBlocks);
+  std::vector<double> Heat(NumBlocks, 0.0);
+
+  for (MachineFunction::iterator I = MF.begin(), E = MF.end(); I != E; ++I) {
+    unsigned N = I->getNumber();
+    Blocks[N] = I;
+    ChainOf[N] = N;
+    Chains[N].push_back(I);
+    Analyzable[N] = HasAnalyzableTerminator(I);
+  }
+
+  // Keep the fall-through of blocks we can't update.
+  for (unsigned N = 0; N + 1 < NumBlocks; ++N) {
+    if (Analyzable[N])
+      continue;
+    unsigned A = ChainOf[N], B = ChainOf[N + 1];
+    for (unsigned i = 0, e = Chains[B].size(); i != e; ++i)
+      ChainOf[Chains[B][i]->getNumber()] = A;
+    Chains[A].insert(Chains[A].end(), Chains[B].begin(), Chains[B].end());
+    Chains[B].clear();
+  }
+
+  std::vector<MBBEdge> Edges;
+  for (unsigned N = 0; N != NumBlocks; ++N) {
+    MachineBasicBlock *MBB = Blocks[N];
+    for (MachineBasicBlock::succ_iterator SI = MBB->succ_begin(),
+         SE = MBB->succ_end(); SI != SE; ++SI) {
+      MBBEdge Edge = { MBB, *SI, Profile.getEdgeWeight(MBB, *SI) };
+      if (Edge.Weight > 0 && *SI != MBB) {
+        Edges.push_back(Edge);
+        Heat[N] = std::max(Heat[N], Edge.Weight);
+        Heat[(*SI)->getNumber()] = std::max(Heat[(*SI)->getNumber()],
+                                            Edge.Weight);
+      }
+    }
+  }
+  std::sort(Edges.begin(), Edges.end());
+
+  for (unsigned i = 0, e = Edges.size(); i != e; ++i) {
+    unsigned Src = Edges[i].Src->getNumber(), Dst = Edges[i].Dst->getNumber();
+    unsigned A = ChainOf[Src], B = ChainOf[Dst];
+    if (A == B || Dst == 0 || Chains[A].back() != Edges[i].Src ||
+        Chains[B].front() != Edges[i].Dst || !Analyzable[Src])
+      continue;
+    for (unsigned j = 0, je = Chains[B].size(); j != je; ++j)
+      ChainOf[Chains[B][j]->getNumber()] = A;
+    Chains[A].insert(Chains[A].end(), Chains[B].begin(), Chains[B].end());
+    Chains[B].clear();
+    ++NumChainedEdges;
+  }
+
+  // Order the chains: the entry chain, then by their hottest block; cold
+  // chains keep their original order.
+  std::vector<std::pair<double, unsigned> > Order;
+  for (unsigned C = 1; C != NumBlocks; ++C) {
+    if (Chains[C].empty())
+      continue;
+    double H = 0;
+    for (unsigned j = 0, je = Chains[C].size(); j != je; ++j)
+      H = std::max(H, Heat[Chains[C][j]->getNumber()]);
+    Order.push_back(std::make_pair(-H, C));
+  }
+  std::sort(Order.begin(), Order.end());
+
+  std::vector<MachineBasicBlock*> Layout(Chains[0]);
+  for (unsigned i = 0, e = Order.size(); i != e; ++i)
+    Layout.insert(Layout.end(), Chains[Order[i].second].begin(),
+                  Chains[Order[i].second].end());
+
+  bool Changed = false;
+  for (unsigned i = 0; i != NumBlocks; ++i)
+    if (Layout[i]->getNumber() != (int)i)
+      Changed = true;
+  if (!Changed)
+    return false;
+
+  DEBUG(dbgs() << "CGP: Profile layout of " << MF.getFunction()->getName()
+               << ":");
+  for (unsigned i = 0; i != NumBlocks; ++i) {
+    DEBUG(dbgs() << " BB#" << Layout[i]->getNumber());
+    MF.splice(MF.end(), Layout[i]);
+  }
+  DEBUG(dbgs() << "\n");
+
+  for (MachineFunction::iterator I = MF.begin(), E = MF.end(); I != E; ++I)
+    if (Analyzable[I->getNumber()])
+      I->updateTerminator();
+
+  MF.RenumberBlocks();
+  ++NumChainedFuncs;
+  return true;
+}
+
 bool CodePlacementOpt::runOnMachineFunction(MachineFunction &MF) {
   MLI = &getAnalysis<MachineLoopInfo>();
-  if (MLI->empty())
-    return false;  // No loops.
-
   TLI = MF.getTarget().getTargetLowering();
   TII = MF.getTarget().getInstrInfo();
 
+  // Lay out profiled functions from the profile, instead of adjusting loops.
+  if (Profile.profiled(MF.getFunction()) &&
+      TLI->shouldOptimizeCodePlacement()) {
+    bool Changed = ChainBlocks(MF);
+    if (!MLI->empty())
+      Changed |= AlignLoops(MF);
+    return Changed;
+  }
+
+  if (MLI->empty())
+    return false;  // No loops.
+
   bool Changed = OptimizeIntraLoopEdges(MF);
 
   Changed |= AlignLoops(MF);
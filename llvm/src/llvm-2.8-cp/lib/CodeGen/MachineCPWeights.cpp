@@ -0,0 +1,54 @@
+//===-- MachineCPWeights.cpp - Profile weights of MBBs --------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file projects combined edge profile weights onto MachineBasicBlocks.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/CodeGen/MachineCPWeights.h"
+#include "llvm/CodeGen/MachineBasicBlock.h"
+using namespace llvm;
+
+const BasicBlock *MachineCPWeights::getIRBlock(const MachineBasicBlock *MBB,
+                                               bool Forward) {
+  for (unsigned Steps = 0; MBB && Steps != 8; ++Steps) {
+    if (const BasicBlock *BB = MBB->getBasicBlock())
+      return BB;
+    if (Forward)
+      MBB = MBB->succ_size() == 1 ? *MBB->succ_begin() : 0;
+    else
+      MBB = MBB->pred_size() == 1 ? *MBB->pred_begin() : 0;
+  }
+  return 0;
+}
+
+double MachineCPWeights::getEdgeWeight(const MachineBasicBlock *Src,
+                                       const MachineBasicBlock *Dst) const {
+  const BasicBlock *SrcBB = getIRBlock(Src, false);
+  const BasicBlock *DstBB = getIRBlock(Dst, true);
+  if (!SrcBB || !DstBB)
+    return 0;
+  if (SrcBB == DstBB)
+    return blockWeight(SrcBB);
+  return edgeWeight(SrcBB, DstBB);
+}
+
+double MachineCPWeights::getBlockWeight(const MachineBasicBlock *MBB) const {
+  if (const BasicBlock *BB = MBB->getBasicBlock())
+    return blockWeight(BB);
+
+  // A block on a split edge runs as often as the edge.
+  if (MBB->pred_size() == 1 && MBB->succ_size() == 1)
+    return getEdgeWeight(*MBB->pred_begin(), *MBB->succ_begin());
+  if (const BasicBlock *BB = getIRBlock(MBB, true))
+    return blockWeight(BB);
+  if (const BasicBlock *BB = getIRBlock(MBB, false))
+    return blockWeight(BB);
+  return 0;
+}
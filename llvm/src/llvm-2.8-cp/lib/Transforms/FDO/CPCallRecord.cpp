@@ -67,12 +67,15 @@ CPCallRecord::CPCallRecord(const CPCallRecord& rhs) :
 CPCallRecord::CPCallRecord(const CPCallRecord& callRec, // for inlined call
                            const CPCallRecord& oldRec,  // for original callsite
                            Function* inlinedFunc, // original caller
-                           const CallSite newCall) :    // new callsite
+                           const CallSite newCall,      // new callsite
+                           CPHistogram* product) :      // precomputed cross
   cs(newCall), ignored(false)
 {
   ID = CurrID++;
-  if( (callRec.cphist != NULL) && (oldRec.cphist != NULL) )
-    cphist = callRec.cphist->cross(*(oldRec.cphist));
+  if(product != NULL)
+    cphist = product;
+  else if( (callRec.cphist != NULL) && (oldRec.cphist != NULL) )
+    cphist = callRec.cphist->crossRebin(CPHistogramList(1, oldRec.cphist));
   else
   {
     errs() << "CPCallRecord::CPCallRecord (inlined) Error: NULL histogram\n";
@@ -20,3 +20,15 @@ using namespace llvm;
 void LLVMAddFDOInlinerPass(LLVMPassManagerRef PM) {
   unwrap(PM)->add(createFDOInlinerPass());
 }
+
+void LLVMAddFDOSplitterPass(LLVMPassManagerRef PM) {
+  unwrap(PM)->add(createFDOSplitterPass());
+}
+
+void LLVMAddFDOFunctionOrderPass(LLVMPassManagerRef PM) {
+  unwrap(PM)->add(createFDOFunctionOrderPass());
+}
+
+void LLVMAddFDOSuperblockPass(LLVMPassManagerRef PM) {
+  unwrap(PM)->add(createFDOSuperblockPass());
+}
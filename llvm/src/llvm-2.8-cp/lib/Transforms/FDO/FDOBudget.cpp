@@ -0,0 +1,61 @@
+//===- FDOBudget.cpp - Code-growth budget for FDO transforms --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Split out of FDOInliner::computeBudget.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/FDO/FDOBudget.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace llvm;
+
+int llvm::computeFDOBudget(int size, unsigned setting)
+{
+  int b = setting;
+
+  if(setting == 0)
+  {
+    b = std::numeric_limits<int>::max();
+  }
+  else if(setting == 1)
+  {
+    const double minPct = 0.05;      // y-shift on sqrt(size)
+    const double maxPct = 10.0;      // upper-bound
+    double growthFactor;
+
+    // Sizes:
+    //   gzip (real):    6748
+    //   bzip (real):   11251
+    //   gobmk (spec):  91778
+    //   gcc (spec):   407976
+    
+    // Formula is only defined between these sizes, and is calibrated
+    // to hit (maxPct+minPct) at minSize, and minPct at maxSize
+    const double maxSize = 425000;
+    const double minSize = 5000;
+    const double scale = maxPct / (1/sqrt(minSize) - 1/sqrt(maxSize));
+
+    if(size >= maxSize)
+      growthFactor = minPct;
+    else if(size <= minSize)
+      growthFactor = maxPct;
+    else
+      growthFactor = scale * ( 1/sqrt(size) - 1/sqrt(maxSize) ) + minPct;
+
+    // These checks should be unnecessary now...
+    if(growthFactor < minPct) growthFactor = minPct;
+    if(growthFactor > maxPct) growthFactor = maxPct;
+    b = (int)floor(growthFactor*size);
+  }
+
+  return(b);
+}
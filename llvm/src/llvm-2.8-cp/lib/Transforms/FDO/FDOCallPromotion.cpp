@@ -0,0 +1,290 @@
+//===- FDOCallPromotion.cpp - Feedback-Directed Indirect Call Promotion ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Speculatively devirtualize indirect calls whose target is dominant
+// across the whole training distribution: the call is guarded by a
+// comparison of the called pointer with the target, and the direct call
+// on the fast path becomes an ordinary FDO inlining candidate.
+//
+// Target shares come from a combined value profile.  A target is
+// dominant if, at -FDCP-quantile over the runs that reached the site,
+// it receives at least -FDCP-threshold of the site's calls; up to
+// -FDCP-max-targets targets are promoted per site, most dominant first.
+// Calls whose argument or return types differ from the target's only
+// in pointer types (eg, the 'this' pointer of a virtual method) are
+// promoted with casts.  Invokes are left alone.
+//
+// Combined value profiles identify sites by their position in the
+// module, so this must run before any pass that adds or removes
+// indirect calls.  The direct calls get their own counters when the
+// promoted program is call profiled for FDOInliner.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "FDOCallPromotion"
+#include "llvm/BasicBlock.h"
+#include "llvm/Constants.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Transforms/FDO.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumPromotedSites, "Number of indirect call sites promoted");
+STATISTIC(NumPromotedTargets, "Number of direct calls inserted");
+
+static cl::opt<std::string>
+CPValueFile("FDCP-cprof", cl::init("value.cp"),
+            cl::desc("FDO call promotion combined value-profile file name"));
+
+static cl::opt<double>
+FDCPQuantile("FDCP-quantile", cl::init(0.25),
+             cl::desc("FDO call promotion quantile (over the runs that "
+                      "reach a site) at which a target must be dominant"));
+
+static cl::opt<double>
+FDCPThreshold("FDCP-threshold", cl::init(0.4),
+              cl::desc("FDO call promotion: fraction of a site's calls "
+                       "above which a target is dominant"));
+
+static cl::opt<unsigned>
+FDCPMaxTargets("FDCP-max-targets", cl::init(2),
+               cl::desc("FDO call promotion: most targets promoted at "
+                        "one site"));
+
+namespace {
+  // a target and its share of the site's calls at FDCPQuantile
+  typedef std::pair<double,Function*> TargetShare;
+
+  class FDOCallPromotion : public ModulePass {
+  public:
+    static char ID; // Pass identification, replacement for typeid
+    FDOCallPromotion() : ModulePass(ID) {}
+
+    virtual bool runOnModule(Module& M);
+
+  private:
+    void findTargets(CombinedValueProfile& cvp, SiteIndex site,
+                     std::vector<TargetShare>& targets);
+    static bool canCallDirectly(CallInst* CI, Function* F);
+    static void promote(CallInst* CI, Function* F);
+  };
+}
+
+char FDOCallPromotion::ID = 0;
+INITIALIZE_PASS(FDOCallPromotion, "FDOCallPromotion",
+                "FDO Indirect Call Promotion Pass", false, false);
+
+ModulePass* llvm::createFDOCallPromotionPass()
+{
+  return new FDOCallPromotion();
+}
+
+
+// The dominant targets of site, most dominant first.  Runs that reach
+// the site without calling a target count as zeros for that target.
+void FDOCallPromotion::findTargets(CombinedValueProfile& cvp, SiteIndex site,
+                                   std::vector<TargetShare>& targets)
+{
+  if(!cvp.valid(site, CVP_ALL_TARGETS))
+    return;
+  double siteRuns = cvp.getHistogram(site, CVP_ALL_TARGETS).nonZeroWeight();
+  if(siteRuns == 0)
+    return;
+
+  std::vector<TargetIndex> seen;
+  cvp.getTargets(site, seen);
+  for(unsigned i = 0; i < seen.size(); i++)
+  {
+    CPHistogram& h = cvp.getHistogram(site, seen[i]);
+    double coverage = std::min(1.0, h.nonZeroWeight() / siteRuns);
+    double zeros = 1.0 - coverage;
+    if( (coverage == 0) || (FDCPQuantile < zeros) )
+      continue;
+
+    double share = h.quantile((FDCPQuantile - zeros) / coverage);
+    if(share >= FDCPThreshold)
+      targets.push_back(TargetShare(share, cvp.getTarget(seen[i])));
+  }
+
+  std::sort(targets.rbegin(), targets.rend());
+  if(targets.size() > FDCPMaxTargets)
+    targets.resize(FDCPMaxTargets);
+}
+
+
+// F can replace the called value if the call's types differ from F's
+// only in pointer types.
+bool FDOCallPromotion::canCallDirectly(CallInst* CI, Function* F)
+{
+  if( (F == NULL) || F->isVarArg() ||
+      (F->getFunctionType()->getNumParams() != CI->getNumArgOperands()) )
+    return(false);
+
+  const FunctionType* FTy = F->getFunctionType();
+  const Type* RetTy = FTy->getReturnType();
+  if( (RetTy != CI->getType()) &&
+      !(RetTy->isPointerTy() && CI->getType()->isPointerTy()) )
+    return(false);
+
+  for(unsigned i = 0; i < FTy->getNumParams(); i++)
+  {
+    const Type* ArgTy = CI->getArgOperand(i)->getType();
+    const Type* ParamTy = FTy->getParamType(i);
+    if( (ArgTy != ParamTy) &&
+        !(ArgTy->isPointerTy() && ParamTy->isPointerTy()) )
+      return(false);
+  }
+  return(true);
+}
+
+
+// Split CI's block around it and call F directly when the called value
+// is F:
+//   BB:           %t = icmp eq %callee, F; br %t, icp.direct, icp.indirect
+//   icp.direct:   F(...); br icp.merge
+//   icp.indirect: %callee(...); br icp.merge
+//   icp.merge:    phi of the results; rest of BB
+// CI stays in icp.indirect, so further targets can be promoted there.
+void FDOCallPromotion::promote(CallInst* CI, Function* F)
+{
+  BasicBlock* BB = CI->getParent();
+  Function* Caller = BB->getParent();
+  LLVMContext& Context = CI->getContext();
+
+  BasicBlock* Indirect = BB->splitBasicBlock(CI, "icp.indirect");
+  BasicBlock::iterator next = CI;
+  ++next;
+  BasicBlock* Merge = Indirect->splitBasicBlock(next, "icp.merge");
+  BasicBlock* Direct = BasicBlock::Create(Context, "icp.direct", Caller,
+                                          Indirect);
+
+  // the guard replaces the branch left by splitBasicBlock
+  Value* Callee = CI->getCalledValue();
+  Value* Target = F;
+  if(F->getType() != Callee->getType())
+    Target = ConstantExpr::getBitCast(F, Callee->getType());
+  TerminatorInst* oldTerm = BB->getTerminator();
+  Value* isTarget = new ICmpInst(oldTerm, ICmpInst::ICMP_EQ, Callee, Target,
+                                 "icp.guard");
+  BranchInst::Create(Direct, Indirect, isTarget, oldTerm);
+  oldTerm->eraseFromParent();
+
+  // the direct call, with pointer arguments cast to F's types
+  const FunctionType* FTy = F->getFunctionType();
+  BranchInst* toMerge = BranchInst::Create(Merge, Direct);
+  std::vector<Value*> args;
+  for(unsigned i = 0; i < CI->getNumArgOperands(); i++)
+  {
+    Value* arg = CI->getArgOperand(i);
+    if(arg->getType() != FTy->getParamType(i))
+      arg = new BitCastInst(arg, FTy->getParamType(i), "icp.arg", toMerge);
+    args.push_back(arg);
+  }
+  CallInst* direct = CallInst::Create(F, args.begin(), args.end(), "",
+                                      toMerge);
+  direct->setCallingConv(CI->getCallingConv());
+  direct->setAttributes(CI->getAttributes());
+  if(CI->isTailCall())
+    direct->setTailCall();
+
+  if(CI->getType()->isVoidTy() || CI->use_empty())
+    return;
+
+  direct->setName(CI->getName() + ".direct");
+  Value* result = direct;
+  if(result->getType() != CI->getType())
+    result = new BitCastInst(result, CI->getType(), "icp.ret", toMerge);
+
+  PHINode* phi = PHINode::Create(CI->getType(), "icp.result", Merge->begin());
+  CI->replaceAllUsesWith(phi);
+  phi->addIncoming(result, Direct);
+  phi->addIncoming(CI, Indirect);
+}
+
+
+bool FDOCallPromotion::runOnModule(Module& M)
+{
+  CPFactory fact(M);
+  if( !fact.loadProfiles(CPValueFile) || !fact.hasValueCP() )
+  {
+    errs() << "FDOCallPromotion::runOnModule Error: no combined value "
+           << "profile in '" << CPValueFile << "'\n";
+    return(false);
+  }
+  CombinedValueProfile* cvp = fact.takeValueCP();
+
+  // Number the sites before changing anything
+  std::vector<Instruction*> sites;
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    if(isCPDefinition(*F))
+      CombinedValueProfile::getIndirectCalls(*F, sites);
+
+  if(sites.size() != cvp->getSiteCount())
+  {
+    errs() << "FDOCallPromotion::runOnModule Error: combined profile is "
+           << "inconsistent with the current program\n";
+    delete cvp;
+    CPFactory::freeStaticData();
+    return(false);
+  }
+
+  std::vector<std::vector<TargetShare> > promotions(sites.size());
+  for(SiteIndex s = 0; s < sites.size(); s++)
+    if(isa<CallInst>(sites[s]))
+      findTargets(*cvp, s, promotions[s]);
+
+  delete cvp;
+  CPFactory::freeStaticData();
+
+  bool changed = false;
+  for(SiteIndex s = 0; s < sites.size(); s++)
+  {
+    CallInst* CI = dyn_cast<CallInst>(sites[s]);
+    if(CI == NULL)
+      continue;
+
+    bool promoted = false;
+    for(unsigned t = 0; t < promotions[s].size(); t++)
+    {
+      Function* F = promotions[s][t].second;
+      if(!canCallDirectly(CI, F))
+        continue;
+
+      DEBUG(dbgs() << "FDOCallPromotion: site " << s << " in "
+                   << CI->getParent()->getParent()->getName() << " --> "
+                   << F->getName() << " (" << promotions[s][t].first
+                   << ")\n");
+      promote(CI, F);
+      NumPromotedTargets++;
+      promoted = true;
+    }
+
+    if(promoted)
+    {
+      NumPromotedSites++;
+      changed = true;
+    }
+  }
+
+  return(changed);
+}
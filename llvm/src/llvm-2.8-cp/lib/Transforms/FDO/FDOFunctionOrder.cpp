@@ -0,0 +1,334 @@
+//===- FDOFunctionOrder.cpp - Feedback-Directed Function Ordering ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Reorder the functions of a module so that functions that call each
+// other frequently are emitted next to each other, hottest first
+// (Pettis and Hansen, "Profile Guided Code Positioning", PLDI '90).
+//
+// Call-edge weights come from a combined call profile.  Its histograms
+// hold call-block frequencies per caller entry, so entry frequencies are
+// propagated top-down over the call graph from main (entry 1), taking
+// -FDOrder-quantile (over all runs) of each histogram.  Calls within a
+// recursive cycle do not add to entry frequencies.
+//
+// Combined profiles identify functions by their position in the module,
+// so this must run after every pass that reads one.  Optionally, the
+// order is also written as a symbol ordering file for the linker.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "FDOOrder"
+#include "llvm/Function.h"
+#include "llvm/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Transforms/FDO.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumHotFunctions, "Number of functions ordered by call profile");
+
+static cl::opt<std::string>
+CPOrderFile("FDOrder-cprof", cl::init("call.cp"),
+            cl::desc("FDO function ordering combined call-profile file name"));
+
+static cl::opt<double>
+FDOrderQuantile("FDOrder-quantile", cl::init(0.5),
+                cl::desc("FDO function ordering quantile (over all runs) "
+                         "of call frequencies"));
+
+static cl::opt<std::string>
+FDOrderSymbolFile("FDOrder-file", cl::init(""), cl::value_desc("filename"),
+                  cl::desc("Write the function order to a linker symbol "
+                           "ordering file"));
+
+namespace {
+  typedef std::vector<Function*> Chain;
+
+  // an undirected call-graph edge between function numbers
+  struct OrderEdge {
+    unsigned f1;
+    unsigned f2;
+    double weight;
+    bool operator<(const OrderEdge& rhs) const
+    {
+      if(weight != rhs.weight) return(weight > rhs.weight);
+      if(f1 != rhs.f1) return(f1 < rhs.f1);
+      return(f2 < rhs.f2);
+    }
+  };
+
+  class FDOFunctionOrder : public ModulePass {
+  public:
+    static char ID; // Pass identification, replacement for typeid
+    FDOFunctionOrder() : ModulePass(ID) {}
+
+    virtual bool runOnModule(Module& M);
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<CallGraph>();
+    }
+
+  private:
+    std::vector<Function*> _funcs;          // definitions, in module order
+    std::map<Function*,unsigned> _funcNum;  // function --> index in _funcs
+    std::vector<double> _freq;              // entry frequency estimates
+    std::map<std::pair<unsigned,unsigned>,double> _weights;
+
+    void computeWeights(Module& M, CombinedCallProfile& ccp);
+    void buildChains(std::vector<Chain>& chains);
+    bool writeOrderFile(const std::vector<Chain>& chains);
+  };
+
+  // hottest chains first; ties keep module order
+  struct ChainOrder {
+    ChainOrder(const std::vector<double>& h, const std::vector<unsigned>& f)
+      : heat(h), first(f) {}
+    const std::vector<double>& heat;
+    const std::vector<unsigned>& first;
+    bool operator()(unsigned a, unsigned b) const
+    {
+      if(heat[a] != heat[b]) return(heat[a] > heat[b]);
+      return(first[a] < first[b]);
+    }
+  };
+}
+
+char FDOFunctionOrder::ID = 0;
+INITIALIZE_PASS(FDOFunctionOrder, "FDOOrder", "FDO Function Ordering Pass",
+                false, false);
+
+ModulePass* llvm::createFDOFunctionOrderPass()
+{
+  return new FDOFunctionOrder();
+}
+
+
+// Propagate entry frequencies top-down (reverse of scc_iterator's
+// order) and accumulate call-edge weights on the way.
+void FDOFunctionOrder::computeWeights(Module& M, CombinedCallProfile& ccp)
+{
+  CallGraph& CG = getAnalysis<CallGraph>();
+
+  std::vector<std::vector<CallGraphNode*> > sccs;
+  for(scc_iterator<CallGraph*> I = scc_begin(&CG), E = scc_end(&CG);
+      I != E; ++I)
+    sccs.push_back(*I);
+
+  // roots: main if we have it, else everything callable from outside
+  Function* main = M.getFunction("main");
+  bool haveMain = (main != NULL) && (_funcNum.count(main) != 0);
+  for(unsigned f = 0; f < _funcs.size(); f++)
+    if( haveMain ? (_funcs[f] == main) : !_funcs[f]->hasLocalLinkage() )
+      _freq[f] = 1.0;
+
+  for(unsigned s = sccs.size(); s-- > 0; )
+  {
+    std::vector<CallGraphNode*>& scc = sccs[s];
+
+    for(unsigned n = 0; n < scc.size(); n++)
+    {
+      Function* F = scc[n]->getFunction();
+      if( (F == NULL) || (_funcNum.count(F) == 0) )
+        continue;
+      unsigned caller = _funcNum[F];
+
+      for(Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB)
+      {
+        if(!ccp.hasFDOInliningCandidate(BB))
+          continue;
+
+        double blockFreq = _freq[caller]
+          * ccp[BB].quantile(FDOrderQuantile, true);
+        if(blockFreq == 0)
+          continue;
+
+        for(BasicBlock::iterator I = BB->begin(), IE = BB->end();
+            I != IE; ++I)
+        {
+          if(!ccp.isFDOInliningCandidate(I))
+            continue;
+
+          Function* G = CallSite(I).getCalledFunction();
+          unsigned callee = _funcNum[G];
+
+          std::pair<unsigned,unsigned> key = (caller < callee)
+            ? std::make_pair(caller, callee) : std::make_pair(callee, caller);
+          _weights[key] += blockFreq;
+
+          // calls within the cycle would feed back into F
+          bool sameSCC = false;
+          for(unsigned m = 0; m < scc.size(); m++)
+            if(scc[m]->getFunction() == G)
+              sameSCC = true;
+          if(!sameSCC)
+            _freq[callee] += blockFreq;
+        }
+      }
+    }
+  }
+}
+
+
+// Pettis-Hansen: merge the chains of the two ends of each edge, heaviest
+// edge first, oriented so the two functions end up as close as possible.
+void FDOFunctionOrder::buildChains(std::vector<Chain>& chains)
+{
+  std::vector<unsigned> chainOf(_funcs.size());
+  chains.resize(_funcs.size());
+  for(unsigned f = 0; f < _funcs.size(); f++)
+  {
+    chains[f].push_back(_funcs[f]);
+    chainOf[f] = f;
+  }
+
+  std::vector<OrderEdge> edges;
+  for(std::map<std::pair<unsigned,unsigned>,double>::iterator
+        i = _weights.begin(), E = _weights.end(); i != E; ++i)
+  {
+    OrderEdge e = { i->first.first, i->first.second, i->second };
+    edges.push_back(e);
+  }
+  std::sort(edges.begin(), edges.end());
+
+  for(unsigned i = 0; i < edges.size(); i++)
+  {
+    unsigned a = chainOf[edges[i].f1];
+    unsigned b = chainOf[edges[i].f2];
+    if(a == b)
+      continue;
+
+    Chain& ca = chains[a];
+    Chain& cb = chains[b];
+    unsigned posA = std::find(ca.begin(), ca.end(), _funcs[edges[i].f1])
+      - ca.begin();
+    unsigned posB = std::find(cb.begin(), cb.end(), _funcs[edges[i].f2])
+      - cb.begin();
+
+    // put f1 at the tail of a and f2 at the head of b
+    if(posA < ca.size() - 1 - posA)
+      std::reverse(ca.begin(), ca.end());
+    if(posB > cb.size() - 1 - posB)
+      std::reverse(cb.begin(), cb.end());
+
+    for(unsigned j = 0; j < cb.size(); j++)
+      chainOf[_funcNum[cb[j]]] = a;
+    ca.insert(ca.end(), cb.begin(), cb.end());
+    cb.clear();
+  }
+
+  // sort the surviving chains
+  std::vector<double> heat(chains.size(), 0);
+  std::vector<unsigned> first(chains.size(), 0);
+  std::vector<unsigned> order;
+  for(unsigned c = 0; c < chains.size(); c++)
+  {
+    if(chains[c].empty())
+      continue;
+    first[c] = _funcs.size();
+    for(unsigned j = 0; j < chains[c].size(); j++)
+    {
+      unsigned f = _funcNum[chains[c][j]];
+      heat[c] += _freq[f];
+      if(f < first[c])
+        first[c] = f;
+    }
+    order.push_back(c);
+  }
+  std::sort(order.begin(), order.end(), ChainOrder(heat, first));
+
+  std::vector<Chain> sorted;
+  for(unsigned i = 0; i < order.size(); i++)
+  {
+    if(heat[order[i]] > 0)
+      NumHotFunctions += chains[order[i]].size();
+    sorted.push_back(chains[order[i]]);
+  }
+  chains.swap(sorted);
+}
+
+
+// one symbol per line, for the functions that ran
+bool FDOFunctionOrder::writeOrderFile(const std::vector<Chain>& chains)
+{
+  std::string error;
+  raw_fd_ostream out(FDOrderSymbolFile.c_str(), error);
+  if(!error.empty())
+  {
+    errs() << "FDOFunctionOrder::writeOrderFile Error: " << error << "\n";
+    return(false);
+  }
+
+  for(unsigned c = 0; c < chains.size(); c++)
+    for(unsigned j = 0; j < chains[c].size(); j++)
+      if(_freq[_funcNum[chains[c][j]]] > 0)
+        out << chains[c][j]->getName() << "\n";
+  return(true);
+}
+
+
+bool FDOFunctionOrder::runOnModule(Module& M)
+{
+  _funcs.clear();
+  _funcNum.clear();
+  _weights.clear();
+
+  CPFactory fact(M);
+  if( !fact.loadProfiles(CPOrderFile) || !fact.hasCallCP() )
+  {
+    errs() << "FDOFunctionOrder::runOnModule Error: no combined call profile "
+           << "in '" << CPOrderFile << "'\n";
+    return(false);
+  }
+  CombinedCallProfile* ccp = fact.takeCallCP();
+
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if(F->isDeclaration())
+      continue;
+    _funcNum[F] = _funcs.size();
+    _funcs.push_back(F);
+  }
+  _freq.assign(_funcs.size(), 0);
+
+  computeWeights(M, *ccp);
+  delete ccp;
+  CPFactory::freeStaticData();
+
+  std::vector<Chain> chains;
+  buildChains(chains);
+
+  // move the definitions to the end of the list, in order
+  Module::FunctionListType& FL = M.getFunctionList();
+  for(unsigned c = 0; c < chains.size(); c++)
+    for(unsigned j = 0; j < chains[c].size(); j++)
+    {
+      DEBUG(dbgs() << "FDOOrder: " << chains[c][j]->getName() << " ("
+                   << _freq[_funcNum[chains[c][j]]] << ")\n");
+      FL.splice(FL.end(), FL, chains[c][j]);
+    }
+
+  if(!FDOrderSymbolFile.empty())
+    writeOrderFile(chains);
+
+  return(true);
+}
@@ -8,6 +8,12 @@
 //
 // A Feedback-Directed Inliner.
 //
+// With -FDI-partial, a callee too big for the remaining budget is
+// partially inlined: blocks that execute less than -FDI-partial-threshold
+// times per entry at -FDI-partial-quantile over all runs (from the
+// combined edge profile -FDI-edge-cprof) are outlined from a clone of
+// the callee, and the clone is inlined if it fits.
+//
 //
 //  TODO:
 //    - tune scaling on budget function
@@ -15,9 +21,12 @@
 
 #define DEBUG_TYPE "FDOInliner"
 #include "llvm/Pass.h"
+#include "llvm/Attributes.h"
 #include "llvm/Function.h"
 #include "llvm/IntrinsicInst.h"
 #include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/CPBlockWeights.h"
+#include "llvm/Analysis/Dominators.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
@@ -25,11 +34,13 @@
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/FunctionUtils.h"
 #include "llvm/Transforms/FDO.h"
 #include "llvm/Analysis/CombinedProfile.h"
 #include "llvm/Analysis/CPHistogram.h"
 #include "llvm/Analysis/CPFactory.h"
 
+#include "llvm/Transforms/FDO/FDOBudget.h"
 #include "llvm/Transforms/FDO/FDOInlinerPass.h"
 #include "llvm/Transforms/FDO/TStream.h"
 
@@ -65,6 +76,30 @@ static cl::opt<unsigned>
 FDIVerbose("FDI-verbose", cl::init(vl::info), 
           cl::desc("FDO Inlining verbosity level"));
 
+static cl::opt<bool>
+FDIPartial("FDI-partial", cl::init(false),
+           cl::desc("FDO Inlining: inline the hot part of callees too "
+                    "big for the budget"));
+
+static cl::opt<std::string> 
+CPEdgeFile("FDI-edge-cprof", cl::init("edge.cp"), 
+           cl::desc("FDO partial inlining combined edge-profile file name"));
+
+static cl::opt<double>
+FDIPartialQuantile("FDI-partial-quantile", cl::init(0.9),
+                   cl::desc("FDO partial inlining quantile (over all runs) "
+                            "at which a block must be cold"));
+
+static cl::opt<double>
+FDIPartialThreshold("FDI-partial-threshold", cl::init(0.05),
+                    cl::desc("FDO partial inlining: executions per callee "
+                             "entry below which a block is cold"));
+
+static cl::opt<unsigned>
+FDIPartialMinSize("FDI-partial-min-size", cl::init(8),
+                  cl::desc("FDO partial inlining minimum outlined region "
+                           "size (IR instructions)"));
+
 
 char FDOInliner::ID = 0;
 INITIALIZE_PASS(FDOInliner, "FDOInliner", "FDO Inliner Pass", false, false);
@@ -172,8 +207,10 @@ unsigned FDOInliner::initialize(Module& M, CallGraph& CG, const TargetData* TD)
   debug(vl::trace) << "--> FDOInliner::initialize\n";
 
  // Load Call Profiling info
+  // an indexed profile is mapped: we only read histograms for call
+  // sites we find
   CPFactory* fact = new CPFactory(M);
-  fact->buildProfiles(CPCallFile);
+  fact->loadProfiles(CPCallFile);
 
   if( !fact->hasCallCP() )
   {
@@ -270,6 +307,10 @@ unsigned FDOInliner::initialize(Module& M, CallGraph& CG, const TargetData* TD)
 
   delete callCP;
 
+  // the edge profile is numbered for the unmodified program
+  if(FDIPartial && !findColdBlocks(M))
+    debug(vl::warn) << "FDOInliner: partial inlining disabled\n";
+
   // now that we have all the info, evaluate the candidates
   debug(vl::info) << "    Re-evaluate mvals\n";
   for(CallList::iterator i = _candidates.begin(), E = _candidates.end();
@@ -330,6 +371,7 @@ bool FDOInliner::runOnModule(Module &M)
   unsigned missingRecord = 0;
   unsigned tooDeep = 0;
   unsigned tooBig = 0;
+  unsigned partialCount = 0;
   unsigned newCand = 0;
   unsigned newIgnore = 0;
   unsigned newNotCand = 0;
@@ -369,12 +411,25 @@ bool FDOInliner::runOnModule(Module &M)
     // candidate is too large? (and more than one caller)
     //if((int)(*_funcAttr)[callee].size > budget) 
     int iSize = crec.inlineSize();
+    Function* hotClone = NULL;
     if(iSize > budget)
     {
-      tooBig++;
-      debug(vl::info) << "    too big (" << iSize << "/" << budget << ")\n";
-      ignoreCandidate(candIter);
-      continue;
+      // maybe the hot part of the callee still fits
+      int pSize = iSize;
+      if(FDIPartial && ((hotClone = getHotClone(callee, CG)) != NULL))
+        pSize -= (int)(*_funcAttr)[callee].size
+          - (int)(*_funcAttr)[hotClone].size;
+
+      if( (hotClone == NULL) || (pSize > budget) )
+      {
+        tooBig++;
+        debug(vl::info) << "    too big (" << iSize << "/" << budget << ")\n";
+        ignoreCandidate(candIter);
+        continue;
+      }
+
+      debug(vl::info) << "    partial (" << pSize << "/" << budget << ")\n";
+      iSize = pSize;
     }
 
     didTry = true;
@@ -417,8 +472,18 @@ bool FDOInliner::runOnModule(Module &M)
     // try to inline
     debug(vl::trace) << "    Trying to inline: \n";
     InlineFunctionInfo& ifi = _funcInfo[caller];
+    bool callerCold = (_coldBlocks.count(BB) != 0);
+    BlockSet oldBlocks;
+    if(callerCold)
+      for(Function::iterator B = caller->begin(), E = caller->end(); 
+          B != E; ++B)
+        oldBlocks.insert(B);
+    if(hotClone != NULL)
+      tmpRec.cs.setCalledFunction(hotClone);
     if(!inlineIfPossible(tmpRec.cs, ifi, _allocas[caller]))
     {
+      if(hotClone != NULL)
+        tmpRec.cs.setCalledFunction(callee);
       inlineFail++;
       debug(vl::info) << "fail\n";
       ignore(tmpRec.cs);  // re-insert because of the initial remove
@@ -431,7 +496,17 @@ bool FDOInliner::runOnModule(Module &M)
 
     // Inlining successful!
     inlineCount++;
+    if(hotClone != NULL)
+      partialCount++;
     (*_funcAttr)[caller].inlineCount += (*_funcAttr)[callee].inlineCount + 1;
+
+    // code inlined into a cold block is cold; the caller's clone is stale
+    if(callerCold)
+      for(Function::iterator B = caller->begin(), E = caller->end(); 
+          B != E; ++B)
+        if(!oldBlocks.count(B))
+          _coldBlocks[&*B] = true;
+    _hotClones.erase(caller);
     
     // print the call record
     debug(vl::log) << "  ";
@@ -467,6 +542,9 @@ bool FDOInliner::runOnModule(Module &M)
       }
       */
       
+      std::vector<std::pair<CallSite,CPCallRecord*> > newCalls;
+      CPHistogramList origHists;
+
       for(unsigned i = 0; i != numInlinedCalls; ++i)
       {
         CallSite newCS = CallSite(ifi.InlinedCalls[i]);
@@ -492,6 +570,22 @@ bool FDOInliner::runOnModule(Module &M)
         // it's not intrinsit or icall, so record the new caller
         _callers[newCS.getCalledFunction()].insert(newCS);
 
+        // calls inlined from a hot clone stand for calls in the callee;
+        // the others call the outlined cold code
+        if(hotClone != NULL)
+        {
+          OriginMap::iterator origin = 
+            _cloneOrigins.find(oldCS.getInstruction());
+          if(origin == _cloneOrigins.end())
+          {
+            newIgnore++;
+            debug(vl::info) << "(outlined)\n";
+            ignore(newCS);
+            continue;
+          }
+          oldCS = CallSite(origin->second);
+        }
+
         // check for icall->direct call resolution
         // ignore because we don't have a CP for it
         if( (oldCS.getCalledFunction() == NULL) 
@@ -527,14 +621,30 @@ bool FDOInliner::runOnModule(Module &M)
           continue;
         }
 
-        // Otherwise, we have a valid new inlining candidate
+        // Otherwise, we have a valid new inlining candidate.  Its
+        // histogram is computed below, together with the others
+        // from this inlining operation.
         newCand++;
-        CPCallRecord rec = CPCallRecord(tmpRec, *(recIter->second), 
-                                        callee, newCS);
-        debug(vl::info) << " " << rec.historyString.size() << "  mval=" 
+        debug(vl::info) << " (new)\n";
+        newCalls.push_back(std::make_pair(newCS, recIter->second));
+        origHists.push_back(recIter->second->cphist);
+      } // for inlined calls
+
+      // estimate the profiles of all the new candidates in one pass
+      CPHistogramList products;
+      if(!error)
+        tmpRec.cphist->crossEach(origHists, products);
+
+      CPHistogramList::iterator P = products.begin();
+      for(unsigned i = 0, E = products.size(); i != E; ++i, ++P)
+      {
+        CPCallRecord rec = CPCallRecord(tmpRec, *(newCalls[i].second),
+                                        callee, newCalls[i].first, *P);
+        debug(vl::info) << "      new candidate " 
+                        << rec.historyString.size() << "  mval=" 
                         << rec.mval << "\n";
         insert(rec);
-      } // for inlined calls
+      }
     } // if inlined calls
     
     // now that all the inlined calls have been processed, check if
@@ -565,6 +675,10 @@ bool FDOInliner::runOnModule(Module &M)
     
   } // inlining loop
 
+  // the hot clones have all been inlined (or not used)
+  unsigned clonesRemoved = removeHotClones(CG);
+  debug(vl::info) << clonesRemoved << " hot clones removed\n";
+
   // If something went wrong, bail now.
   if(error)
   {
@@ -584,6 +698,7 @@ bool FDOInliner::runOnModule(Module &M)
     if(c->mval <= 0) zeroCand++;
   
   count() << "  Calls inlined:   " << inlineCount << "\n"
+          << "  Partially:       " << partialCount << "\n"
           << "  Failures:        " << inlineFail << "\n"
           << "  Initial cands.:  " << numCandidates << "\n"
           << "  New Candidates:  " << newCand << "\n"
@@ -1032,42 +1147,7 @@ int FDOInliner::computeBudget(int size)
 {
   debug(vl::detail) << "--> FDOInliner::computeBudget\n";
 
-  int b = FDIBudget;
-
-  if(FDIBudget == 0)
-  {
-    b = std::numeric_limits<int>::max();
-  }
-  else if(FDIBudget == 1)
-  {
-    const double minPct = 0.05;      // y-shift on sqrt(size)
-    const double maxPct = 10.0;      // upper-bound
-    double growthFactor;
-
-    // Sizes:
-    //   gzip (real):    6748
-    //   bzip (real):   11251
-    //   gobmk (spec):  91778
-    //   gcc (spec):   407976
-    
-    // Formula is only defined between these sizes, and is calibrated
-    // to hit (maxPct+minPct) at minSize, and minPct at maxSize
-    const double maxSize = 425000;
-    const double minSize = 5000;
-    const double scale = maxPct / (1/sqrt(minSize) - 1/sqrt(maxSize));
-
-    if(size >= maxSize)
-      growthFactor = minPct;
-    else if(size <= minSize)
-      growthFactor = maxPct;
-    else
-      growthFactor = scale * ( 1/sqrt(size) - 1/sqrt(maxSize) ) + minPct;
-
-    // These checks should be unnecessary now...
-    if(growthFactor < minPct) growthFactor = minPct;
-    if(growthFactor > maxPct) growthFactor = maxPct;
-    b = (int)floor(growthFactor*size);
-  }
+  int b = computeFDOBudget(size, FDIBudget);
 
   debug(vl::info) << "** Inlining Budget: " << size
                   << " +" << format("%2.1f", 100.0*b/size) << "% = " 
@@ -1224,6 +1304,188 @@ bool FDOInliner::updateCallers(Function* caller)
 }
 
 
+//===================================================================//
+//                                                                   //
+//      PARTIAL INLINING                                             //
+//                                                                   //
+//===================================================================//
+
+
+// Find the cold blocks of every function.  Must be done before
+// anything is inlined: the weights are numbered for the program as
+// profiled.
+bool FDOInliner::findColdBlocks(Module& M)
+{
+  debug(vl::trace) << "--> FDOInliner::findColdBlocks\n";
+
+  CPBlockWeights weights;
+  if( !weights.load(M, CPEdgeFile, FDIPartialQuantile) )
+  {
+    debug(vl::error) << "FDOInliner: no usable edge profile in file '" 
+                     << CPEdgeFile << "'\n";
+    return(false);
+  }
+
+  unsigned coldCount = 0;
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if(F->isDeclaration())
+      continue;
+    for(Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB)
+      if( (&*BB != &F->getEntryBlock()) 
+          && (weights.blockWeight(BB) < FDIPartialThreshold) )
+      {
+        _coldBlocks[&*BB] = true;
+        coldCount++;
+      }
+  }
+
+  debug(vl::info) << "    " << coldCount << " cold blocks\n";
+  debug(vl::trace) << "<-- FDOInliner::findColdBlocks\n";
+
+  return(true);
+}
+
+
+// The callee with its cold regions outlined, built on first use.
+// Returns NULL if the callee has no cold region worth outlining.
+Function* FDOInliner::getHotClone(Function* callee, CallGraph& CG)
+{
+  CloneMap::iterator known = _hotClones.find(callee);
+  if(known != _hotClones.end())
+    return(known->second);
+
+  if(callee->isVarArg())
+    return(NULL);
+  BlockSet cold;
+  for(Function::iterator BB = callee->begin(), E = callee->end(); BB != E; ++BB)
+    if(_coldBlocks.count(BB))
+      cold.insert(BB);
+  if(cold.empty())
+    return(NULL);
+
+  debug(vl::trace) << "--> FDOInliner::getHotClone\n";
+
+  ValueMap<const Value*, Value*> VMap;
+  Function* clone = CloneFunction(callee, VMap, /*ModuleLevelChanges=*/false);
+  clone->setLinkage(GlobalValue::InternalLinkage);
+  callee->getParent()->getFunctionList().push_back(clone);
+  clone->setName(callee->getName() + ".hot");
+
+  BlockSet cloneCold;
+  for(BlockSet::iterator b = cold.begin(), E = cold.end(); b != E; ++b)
+    cloneCold.insert(cast<BasicBlock>(VMap[*b]));
+
+  // The CodeExtractor needs a dominator tree.
+  DominatorTree DT;
+  DT.runOnFunction(*clone);
+
+  std::vector<std::vector<BasicBlock*> > regions;
+  findColdSubtrees(DT, cloneCold, regions);
+
+  std::vector<Function*> outlined;
+  for(unsigned r = 0; r < regions.size(); r++)
+  {
+    unsigned size = 0;
+    for(unsigned b = 0; b < regions[r].size(); b++)
+      size += regions[r][b]->size();
+    if(size < FDIPartialMinSize)
+      continue;
+
+    Function* coldF = ExtractCodeRegion(DT, regions[r]);
+    if(coldF == NULL)
+      continue;
+    coldF->addFnAttr(Attribute::NoInline);
+    outlined.push_back(coldF);
+  }
+
+  if(outlined.empty())
+  {
+    debug(vl::verbose) << "    nothing to outline in " 
+                       << callee->getName().str() << "\n";
+    clone->eraseFromParent();
+    _hotClones[callee] = NULL;
+    return(NULL);
+  }
+
+  // remember which callee call each hot call stands for
+  for(Function::iterator BB = callee->begin(), E = callee->end(); BB != E; ++BB)
+    for(BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I)
+    {
+      if(!isFDOInliningCandidate(I))
+        continue;
+      Instruction* copy = dyn_cast_or_null<Instruction>(VMap[I]);
+      if( (copy != NULL) && (copy->getParent()->getParent() == clone) )
+        _cloneOrigins[copy] = I;
+    }
+
+  // inlining the clone needs its calls in the call graph
+  addToCallGraph(clone, CG);
+  CPCallRecord::recalcFunctionAttr(clone);
+  for(unsigned i = 0; i < outlined.size(); i++)
+  {
+    addToCallGraph(outlined[i], CG);
+    CPCallRecord::recalcFunctionAttr(outlined[i]);
+  }
+
+  debug(vl::info) << "    " << callee->getName().str() << ": outlined " 
+                  << outlined.size() << " cold regions, " 
+                  << (*_funcAttr)[callee].size << " --> " 
+                  << (*_funcAttr)[clone].size << "\n";
+
+  _clones.push_back(clone);
+  _hotClones[callee] = clone;
+
+  debug(vl::trace) << "<-- FDOInliner::getHotClone\n";
+
+  return(clone);
+}
+
+
+// as CallGraph builds its nodes
+void FDOInliner::addToCallGraph(Function* F, CallGraph& CG)
+{
+  CallGraphNode* node = CG.getOrInsertFunction(F);
+  for(Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB)
+    for(BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I)
+    {
+      CallSite cs(cast<Value>(I));
+      if(!cs || isa<DbgInfoIntrinsic>(I))
+        continue;
+      Function* callee = cs.getCalledFunction();
+      if(callee != NULL)
+        node->addCalledFunction(cs, CG.getOrInsertFunction(callee));
+      else
+        node->addCalledFunction(cs, CG.getCallsExternalNode());
+    }
+}
+
+
+// Delete the hot clones that are no longer called and drop the rest of
+// the partial inlining state.  Returns the number deleted.
+unsigned FDOInliner::removeHotClones(CallGraph& CG)
+{
+  unsigned removed = 0;
+  for(unsigned i = 0; i < _clones.size(); i++)
+  {
+    Function* clone = _clones[i];
+    clone->removeDeadConstantUsers();
+    if(!clone->use_empty())
+      continue;
+
+    CG[clone]->removeAllCalledFunctions();
+    delete CG.removeFunctionFromModule(clone);
+    removed++;
+  }
+
+  _clones.clear();
+  _hotClones.clear();
+  _cloneOrigins.clear();
+  _coldBlocks.clear();
+  return(removed);
+}
+
+
 //===================================================================//
 //                                                                   //
 //      CALLSITE EXCLUSION                                           //
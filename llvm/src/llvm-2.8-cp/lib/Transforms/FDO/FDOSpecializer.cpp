@@ -0,0 +1,316 @@
+//===- FDOSpecializer.cpp - Feedback-Directed Function Specialization -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Clone functions for the constant arguments they are hot with, and
+// call the clones, as PartialSpecialization does for common constants.
+// This gets the constant-argument part of the inlining benefit with one
+// copy of the callee instead of one per caller.
+//
+// Call sites come from a combined call profile: a site is hot if, at
+// -FDSP-quantile over all runs, its block executes at least
+// -FDSP-threshold times per entry of its caller.  Each (callee,
+// argument, constant) is scored by the instructions its hot sites are
+// expected to save (CPCallRecord's ArgImpact, as for inlining) over
+// the size of the clone, and the best are made until the code-growth
+// budget (-FDSP-budget, as for FDO inlining) is spent.  A call site is
+// redirected at most once.
+//
+// The constant is substituted into the clone; later passes fold it.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "FDOSpecializer"
+#include "llvm/Attributes.h"
+#include "llvm/Constants.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ValueHandle.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/FDO.h"
+#include "llvm/Transforms/FDO/CPCallRecord.h"
+#include "llvm/Transforms/FDO/FDOBudget.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumSpecialized, "Number of specialized functions created");
+STATISTIC(NumRedirected, "Number of calls redirected to a specialization");
+
+static cl::opt<std::string>
+CPCallFile("FDSP-cprof", cl::init("call.cp"),
+           cl::desc("FDO specialization combined call-profile file name"));
+
+static cl::opt<double>
+FDSPQuantile("FDSP-quantile", cl::init(0.5),
+             cl::desc("FDO specialization quantile (over all runs) at "
+                      "which a call site must be hot"));
+
+static cl::opt<double>
+FDSPThreshold("FDSP-threshold", cl::init(1.0),
+              cl::desc("FDO specialization: executions per caller entry "
+                       "above which a call site is hot"));
+
+static cl::opt<unsigned>
+FDSPBudget("FDSP-budget", cl::init(1),
+           cl::desc("FDO specialization code-growth budget: 0=unlimited, "
+                    "1=auto, else budget in IR instructions"));
+
+namespace {
+  // A specialization of callee for arg == value, and the hot calls
+  // that would use it.
+  struct SpecCandidate {
+    Function* callee;
+    unsigned arg;
+    Constant* value;
+    double freq;      // hot calls per caller entry, summed over the calls
+    double score;     // instructions saved per instruction of growth
+    int cost;         // IR instructions
+    std::vector<WeakVH> calls;  // null once redirected
+
+    bool operator<(const SpecCandidate& rhs) const
+    { return(score < rhs.score); }
+  };
+
+  typedef std::pair<Function*, std::pair<unsigned,Constant*> > SpecKey;
+  typedef std::map<SpecKey,SpecCandidate> SpecMap;
+
+  class FDOSpecializer : public ModulePass {
+  public:
+    static char ID; // Pass identification, replacement for typeid
+    FDOSpecializer() : ModulePass(ID) {}
+
+    virtual bool runOnModule(Module& M);
+
+  private:
+    static bool canSpecialize(Function* F);
+    static bool scoreCandidate(SpecCandidate& cand);
+    static AttrListPtr dropArgAttrs(const AttrListPtr& PAL, unsigned arg);
+    static Function* specialize(SpecCandidate& cand);
+  };
+}
+
+char FDOSpecializer::ID = 0;
+INITIALIZE_PASS(FDOSpecializer, "FDOSpecializer",
+                "FDO Function Specialization Pass", false, false);
+
+ModulePass* llvm::createFDOSpecializerPass() { return new FDOSpecializer(); }
+
+
+bool FDOSpecializer::canSpecialize(Function* F)
+{
+  return( (F != NULL) && !F->isDeclaration() && !F->mayBeOverridden()
+          && !F->isVarArg() );
+}
+
+
+// Fill in the cost and score; false if specializing saves nothing.
+bool FDOSpecializer::scoreCandidate(SpecCandidate& cand)
+{
+  ArgImpact* impact = CPCallRecord::getArgImpact(cand.callee, cand.arg);
+  double saved = impact->instrRemIfConst * inlineWeights::instr
+    + impact->branchRemIfConst * inlineWeights::branch
+    + impact->icallRemIfConst * inlineWeights::icall;
+  if(saved <= 0)
+    return(false);
+
+  FuncAttrMap& attrs = *CPCallRecord::getFuncAttrMap();
+  cand.cost = std::max(1, (int)attrs[cand.callee].size
+                       - (int)impact->instrRemIfConst);
+  cand.score = cand.freq * saved / cand.cost;
+  return(true);
+}
+
+
+// The call attributes without argument arg's, and the later
+// arguments' moved down one.
+AttrListPtr FDOSpecializer::dropArgAttrs(const AttrListPtr& PAL, unsigned arg)
+{
+  SmallVector<AttributeWithIndex, 8> AttributesVec;
+  for(unsigned i = 0; i < PAL.getNumSlots(); i++)
+  {
+    AttributeWithIndex AWI = PAL.getSlot(i);
+    if( (AWI.Index == 0) || (AWI.Index == ~0U) || (AWI.Index <= arg) )
+      AttributesVec.push_back(AWI);
+    else if(AWI.Index > arg + 1)
+      AttributesVec.push_back(AttributeWithIndex::get(AWI.Index - 1,
+                                                      AWI.Attrs));
+  }
+  return(AttrListPtr::get(AttributesVec.begin(), AttributesVec.end()));
+}
+
+
+// Clone the callee with the argument replaced by the constant, and
+// redirect the candidate's calls that have not already been redirected.
+Function* FDOSpecializer::specialize(SpecCandidate& cand)
+{
+  Function* F = cand.callee;
+  Function::arg_iterator A = F->arg_begin();
+  for(unsigned i = 0; i < cand.arg; i++)
+    ++A;
+
+  // mapped arguments are left out of the clone
+  ValueMap<const Value*, Value*> VMap;
+  VMap[&*A] = cand.value;
+  Function* NF = CloneFunction(F, VMap, /*ModuleLevelChanges=*/false);
+  NF->setLinkage(GlobalValue::InternalLinkage);
+  F->getParent()->getFunctionList().push_back(NF);
+  NF->setName(F->getName() + ".spec");
+
+  for(unsigned c = 0; c < cand.calls.size(); c++)
+  {
+    Instruction* I = cast_or_null<Instruction>((Value*)cand.calls[c]);
+    if(I == NULL)
+      continue;
+
+    CallSite CS(I);
+    AttrListPtr PAL = dropArgAttrs(CS.getAttributes(), cand.arg);
+    std::vector<Value*> args;
+    for(unsigned i = 0; i < CS.arg_size(); i++)
+      if(i != cand.arg)
+        args.push_back(CS.getArgument(i));
+
+    Instruction* NCall;
+    if(CallInst* CI = dyn_cast<CallInst>(I))
+    {
+      CallInst* NCI = CallInst::Create(NF, args.begin(), args.end(), "", CI);
+      NCI->setTailCall(CI->isTailCall());
+      NCI->setCallingConv(CI->getCallingConv());
+      NCI->setAttributes(PAL);
+      NCall = NCI;
+    }
+    else
+    {
+      InvokeInst* II = cast<InvokeInst>(I);
+      InvokeInst* NII = InvokeInst::Create(NF, II->getNormalDest(),
+                                           II->getUnwindDest(),
+                                           args.begin(), args.end(), "", II);
+      NII->setCallingConv(II->getCallingConv());
+      NII->setAttributes(PAL);
+      NCall = NII;
+    }
+    NCall->takeName(I);
+    NCall->setDebugLoc(I->getDebugLoc());
+    I->replaceAllUsesWith(NCall);
+    I->eraseFromParent();
+    NumRedirected++;
+  }
+
+  return(NF);
+}
+
+
+bool FDOSpecializer::runOnModule(Module& M)
+{
+  CPFactory fact(M);
+  if( !fact.loadProfiles(CPCallFile) || !fact.hasCallCP() )
+  {
+    errs() << "FDOSpecializer::runOnModule Error: no combined call profile "
+           << "in '" << CPCallFile << "'\n";
+    return(false);
+  }
+  CombinedCallProfile* ccp = fact.takeCallCP();
+
+  // Collect the hot calls with constant arguments, by specialization
+  int totalSize = 0;
+  SpecMap specs;
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    totalSize += CPCallRecord::recalcFunctionAttr(F);
+
+    for(Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB)
+      for(BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I)
+      {
+        if(!ccp->isFDOInliningCandidate(I))
+          continue;
+
+        CallSite CS(cast<Value>(I));
+        Function* callee = CS.getCalledFunction();
+        if(!canSpecialize(callee))
+          continue;
+
+        double freq = (*ccp)[BB].quantile(FDSPQuantile, true);
+        if(freq < FDSPThreshold)
+          continue;
+
+        for(unsigned a = 0; a < CS.arg_size(); a++)
+        {
+          Constant* C = dyn_cast<Constant>(CS.getArgument(a));
+          if( (C == NULL) || isa<UndefValue>(C) )
+            continue;
+
+          SpecCandidate& cand = specs[SpecKey(callee, std::make_pair(a, C))];
+          if(cand.calls.empty())
+          {
+            cand.callee = callee;
+            cand.arg = a;
+            cand.value = C;
+            cand.freq = 0;
+          }
+          cand.freq += freq;
+          cand.calls.push_back(WeakVH(I));
+        }
+      }
+  }
+
+  delete ccp;
+  CPFactory::freeStaticData();
+
+  std::vector<SpecCandidate> ranked;
+  for(SpecMap::iterator S = specs.begin(), E = specs.end(); S != E; ++S)
+    if(scoreCandidate(S->second))
+      ranked.push_back(S->second);
+  std::sort(ranked.rbegin(), ranked.rend());
+
+  int budget = computeFDOBudget(totalSize, FDSPBudget);
+  DEBUG(dbgs() << "FDOSpecializer: " << ranked.size() << " candidates, "
+               << "budget " << budget << "\n");
+
+  // Best first, while the budget lasts.  Calls redirected by an
+  // earlier specialization are gone.
+  bool changed = false;
+  for(unsigned s = 0; (s < ranked.size()) && (budget > 0); s++)
+  {
+    SpecCandidate& cand = ranked[s];
+    if(cand.cost > budget)
+      continue;
+
+    unsigned live = 0;
+    for(unsigned c = 0; c < cand.calls.size(); c++)
+      if(cand.calls[c] != NULL)
+        live++;
+    if(live == 0)
+      continue;
+
+    Function* NF = specialize(cand);
+    DEBUG(dbgs() << "FDOSpecializer: " << NF->getName() << ": arg "
+                 << cand.arg << " = " << *cand.value << ", " << live
+                 << " calls (score " << cand.score << ", cost "
+                 << cand.cost << ")\n");
+    budget -= cand.cost;
+    NumSpecialized++;
+    changed = true;
+  }
+
+  CPCallRecord::freeStaticData();
+  return(changed);
+}
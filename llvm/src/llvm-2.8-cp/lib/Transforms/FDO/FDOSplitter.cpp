@@ -0,0 +1,198 @@
+//===- FDOSplitter.cpp - Feedback-Directed Hot/Cold Splitting -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Outline code that is cold across the whole training distribution into
+// separate functions in their own section, to shrink the hot footprint.
+//
+// A block is cold if, at a high quantile over all runs (-FDS-quantile),
+// it executes less than -FDS-threshold times per function entry, or if
+// it is reached in at most -FDS-coverage of the runs.  Using a high
+// quantile rather than one run's counts keeps code that is hot for a
+// few inputs in place.  Block frequencies come from a combined edge
+// profile through CPBlockWeights.
+//
+// Maximal dominator subtrees of cold blocks are single-entry regions,
+// and are extracted with CodeExtractor.  Functions that never ran in
+// any profiled run are not split: the whole function goes into the
+// cold section.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "FDOSplitter"
+#include "llvm/Attributes.h"
+#include "llvm/Function.h"
+#include "llvm/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CPBlockWeights.h"
+#include "llvm/Analysis/Dominators.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Transforms/FDO.h"
+#include "llvm/Transforms/Utils/FunctionUtils.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumColdBlocks, "Number of cold blocks outlined");
+STATISTIC(NumColdRegions, "Number of cold regions outlined");
+STATISTIC(NumColdFunctions, "Number of never-run functions moved");
+
+static cl::opt<std::string>
+CPEdgeFile("FDS-cprof", cl::init("edge.cp"),
+           cl::desc("FDO splitting combined edge-profile file name"));
+
+static cl::opt<double>
+FDSQuantile("FDS-quantile", cl::init(0.99),
+            cl::desc("FDO splitting quantile (over all runs) at which a "
+                     "block must be cold"));
+
+static cl::opt<double>
+FDSThreshold("FDS-threshold", cl::init(0.001),
+             cl::desc("FDO splitting: executions per function entry "
+                      "below which a block is cold"));
+
+static cl::opt<double>
+FDSCoverage("FDS-coverage", cl::init(0.0),
+            cl::desc("FDO splitting: blocks reached in at most this "
+                     "fraction of runs are cold"));
+
+static cl::opt<unsigned>
+FDSMinSize("FDS-min-size", cl::init(8),
+           cl::desc("FDO splitting minimum region size (IR instructions)"));
+
+static cl::opt<std::string>
+FDSSection("FDS-section", cl::init(".text.unlikely"),
+           cl::desc("FDO splitting section for outlined cold code"));
+
+namespace {
+  typedef std::set<BasicBlock*> BlockSet;
+  typedef std::vector<BasicBlock*> BlockVec;
+
+  class FDOSplitter : public ModulePass {
+  public:
+    static char ID; // Pass identification, replacement for typeid
+    FDOSplitter() : ModulePass(ID) {}
+
+    virtual bool runOnModule(Module& M);
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<DominatorTree>();
+    }
+
+  private:
+    void findColdBlocks(Function& F, const CPBlockWeights& weights,
+                        BlockSet& cold);
+    static unsigned regionSize(const BlockVec& region);
+  };
+}
+
+char FDOSplitter::ID = 0;
+INITIALIZE_PASS(FDOSplitter, "FDOSplitter", "FDO Hot/Cold Splitting Pass",
+                false, false);
+
+ModulePass* llvm::createFDOSplitterPass() { return new FDOSplitter(); }
+
+
+void FDOSplitter::findColdBlocks(Function& F, const CPBlockWeights& weights,
+                                 BlockSet& cold)
+{
+  for(Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+  {
+    if(&*BB == &F.getEntryBlock())
+      continue;
+    if( (weights.blockWeight(BB) < FDSThreshold)
+        || (weights.blockCoverage(BB) <= FDSCoverage) )
+      cold.insert(BB);
+  }
+}
+
+
+unsigned FDOSplitter::regionSize(const BlockVec& region)
+{
+  unsigned size = 0;
+  for(unsigned i = 0; i < region.size(); i++)
+    size += region[i]->size();
+  return(size);
+}
+
+
+bool FDOSplitter::runOnModule(Module& M)
+{
+  // Find the cold blocks before changing anything: the weights are
+  // numbered for the program as profiled.
+  CPBlockWeights weights;
+  if( !weights.load(M, CPEdgeFile, FDSQuantile) )
+    return(false);
+
+  bool changed = false;
+  std::map<Function*,BlockSet> coldBlocks;
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if(F->isDeclaration())
+      continue;
+
+    if(weights.neverRan(F))
+    {
+      if(!F->hasSection())
+      {
+        DEBUG(dbgs() << "FDOSplitter: " << F->getName() 
+                     << " never ran\n");
+        F->setSection(FDSSection);
+        NumColdFunctions++;
+        changed = true;
+      }
+      continue;
+    }
+
+    BlockSet cold;
+    findColdBlocks(*F, weights, cold);
+    if(!cold.empty())
+      coldBlocks[F].swap(cold);
+  }
+  weights.clear();
+
+  for(std::map<Function*,BlockSet>::iterator i = coldBlocks.begin(),
+        E = coldBlocks.end(); i != E; ++i)
+  {
+    Function* F = i->first;
+    DominatorTree& DT = getAnalysis<DominatorTree>(*F);
+
+    std::vector<BlockVec> regions;
+    findColdSubtrees(DT, i->second, regions);
+
+    for(unsigned r = 0; r < regions.size(); r++)
+    {
+      if(regionSize(regions[r]) < FDSMinSize)
+        continue;
+
+      Function* coldF = ExtractCodeRegion(DT, regions[r]);
+      if(coldF == NULL)
+        continue;
+
+      DEBUG(dbgs() << "FDOSplitter: outlined " << regions[r].size()
+                   << " blocks of " << F->getName() << " into "
+                   << coldF->getName() << "\n");
+
+      coldF->setSection(FDSSection);
+      coldF->addFnAttr(Attribute::NoInline);
+      coldF->addFnAttr(Attribute::OptimizeForSize);
+
+      NumColdBlocks += regions[r].size();
+      NumColdRegions++;
+      changed = true;
+    }
+  }
+
+  return(changed);
+}
@@ -0,0 +1,399 @@
+//===- FDOSuperblock.cpp - Path-Profile-Guided Superblock Formation -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Form superblocks along the Ball-Larus paths that are hot across the
+// whole training distribution, using tail duplication (Hwu et al., "The
+// Superblock", J. Supercomputing '93).
+//
+// A path is hot if, at -FDSB-quantile over all runs, it is at least
+// -FDSB-threshold of its function's path executions.  Hot paths are
+// decoded into block traces through the Ball-Larus DAG, cut at repeated
+// blocks (loop back edges), and taken hottest first.  A trace is made
+// single-entry by cloning it from its first side entrance to its end:
+// the trace runs through the clones, and the side entrances keep the
+// original blocks.  Cloned instructions are bounded by a code-growth
+// budget (-FDSB-budget, as for FDO inlining).
+//
+// Combined path profiles identify functions by their position in the
+// module, so this must run before any pass that adds or removes
+// functions, and before anything that changes the CFG.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "FDOSuperblock"
+#include "llvm/BasicBlock.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Analysis/PathProfileInfo.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Transforms/FDO.h"
+#include "llvm/Transforms/FDO/FDOBudget.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumSuperblocks, "Number of superblocks formed");
+STATISTIC(NumDupBlocks, "Number of blocks tail-duplicated");
+STATISTIC(NumDupInsts, "Number of instructions tail-duplicated");
+
+static cl::opt<std::string>
+CPPathFile("FDSB-cprof", cl::init("path.cp"),
+           cl::desc("FDO superblock combined path-profile file name"));
+
+static cl::opt<double>
+FDSBQuantile("FDSB-quantile", cl::init(0.25),
+             cl::desc("FDO superblock quantile (over all runs) at which a "
+                      "path must be hot"));
+
+static cl::opt<double>
+FDSBThreshold("FDSB-threshold", cl::init(0.2),
+              cl::desc("FDO superblock: fraction of the function's path "
+                       "executions above which a path is hot"));
+
+static cl::opt<unsigned>
+FDSBBudget("FDSB-budget", cl::init(1),
+           cl::desc("FDO superblock duplication budget: 0=unlimited, "
+                    "1=auto, else budget in IR instructions"));
+
+namespace {
+  typedef std::vector<BasicBlock*> BlockVec;
+  typedef std::set<BasicBlock*> BlockSet;
+  typedef DenseMap<Instruction*, Value*> InstMap;
+
+  // a hot path, decoded into its blocks
+  struct Trace {
+    double freq;
+    unsigned order;     // discovery order, to break ties
+    Function* F;
+    BlockVec blocks;
+    bool operator<(const Trace& rhs) const
+    {
+      if(freq != rhs.freq) return(freq > rhs.freq);
+      return(order < rhs.order);
+    }
+  };
+
+  class FDOSuperblock : public ModulePass {
+  public:
+    static char ID; // Pass identification, replacement for typeid
+    FDOSuperblock() : ModulePass(ID) {}
+
+    virtual bool runOnModule(Module& M);
+
+  private:
+    std::vector<Trace> _traces;
+
+    void findTraces(Function& F, FunctionIndex fnum,
+                    CombinedPathProfile& cpp, PathSet& paths);
+    static unsigned sideEntrance(const BlockVec& blocks);
+    static unsigned tailSize(const BlockVec& blocks, unsigned first);
+    static void duplicateTail(BlockVec& blocks, unsigned first);
+  };
+}
+
+char FDOSuperblock::ID = 0;
+INITIALIZE_PASS(FDOSuperblock, "FDOSuperblock",
+                "FDO Superblock Formation Pass", false, false);
+
+ModulePass* llvm::createFDOSuperblockPass() { return new FDOSuperblock(); }
+
+
+// number of edges from the terminator of from to to
+static unsigned countEdges(BasicBlock* from, BasicBlock* to)
+{
+  TerminatorInst* T = from->getTerminator();
+  unsigned n = 0;
+  for(unsigned s = 0, S = T->getNumSuccessors(); s < S; s++)
+    if(T->getSuccessor(s) == to)
+      n++;
+  return(n);
+}
+
+
+// Decode the hot paths of F into traces.  A trace stops before the
+// first repeated block, and before any block it cannot be duplicated
+// into: the trace edges must be single CFG edges.
+void FDOSuperblock::findTraces(Function& F, FunctionIndex fnum,
+                               CombinedPathProfile& cpp, PathSet& paths)
+{
+  PathProfileInfo ppi;
+  ppi.setCurrentFunction(&F);
+
+  for(PathSet::iterator p = paths.lower_bound(PathID(fnum, 0)),
+        E = paths.end(); (p != E) && (p->first == fnum); ++p)
+  {
+    double freq = cpp.getHistogram(*p).quantile(FDSBQuantile, true);
+    if( (freq < FDSBThreshold) || (p->second >= ppi.getPotentialPathCount()) )
+      continue;
+
+    Path path(p->second, 0, 0, &ppi);
+    PathBlockVector* pbv = path.getPathBlocks();
+
+    Trace t;
+    t.freq = freq;
+    t.order = _traces.size();
+    t.F = &F;
+
+    BlockSet seen;
+    for(unsigned i = 0; i < pbv->size(); i++)
+    {
+      BasicBlock* BB = (*pbv)[i];
+      if( seen.count(BB) || BB->hasAddressTaken() )
+        break;
+      if( !t.blocks.empty() && (countEdges(t.blocks.back(), BB) != 1) )
+        break;
+      seen.insert(BB);
+      t.blocks.push_back(BB);
+    }
+    delete pbv;
+
+    if(t.blocks.size() >= 2)
+      _traces.push_back(t);
+  }
+}
+
+
+// index of the first block with a predecessor off the trace, or 0
+unsigned FDOSuperblock::sideEntrance(const BlockVec& blocks)
+{
+  for(unsigned i = 1; i < blocks.size(); i++)
+    for(pred_iterator P = pred_begin(blocks[i]), E = pred_end(blocks[i]);
+        P != E; ++P)
+      if(*P != blocks[i-1])
+        return(i);
+  return(0);
+}
+
+
+unsigned FDOSuperblock::tailSize(const BlockVec& blocks, unsigned first)
+{
+  unsigned size = 0;
+  for(unsigned i = first; i < blocks.size(); i++)
+    size += blocks[i]->size();
+  return(size);
+}
+
+
+// Clone blocks[first..] and run the trace through the clones.  The
+// clones have one predecessor each: the previous block on the trace.
+void FDOSuperblock::duplicateTail(BlockVec& blocks, unsigned first)
+{
+  Function* F = blocks[0]->getParent();
+  unsigned n = blocks.size();
+  BlockVec clones(n, (BasicBlock*)NULL);
+  std::vector<InstMap> maps(n);
+
+  for(unsigned k = first; k < n; k++)
+  {
+    ValueToValueMapTy VMap;
+    clones[k] = CloneBasicBlock(blocks[k], VMap, ".sb", F);
+
+    // operands defined in the same block refer to the clones
+    for(BasicBlock::iterator I = blocks[k]->begin(), IE = blocks[k]->end(),
+          C = clones[k]->begin(); I != IE; ++I, ++C)
+      maps[k][I] = C;
+    for(BasicBlock::iterator C = clones[k]->begin(), CE = clones[k]->end();
+        C != CE; ++C)
+      for(unsigned o = 0, O = C->getNumOperands(); o < O; o++)
+        if(Instruction* Op = dyn_cast<Instruction>(C->getOperand(o)))
+        {
+          InstMap::iterator i = maps[k].find(Op);
+          if(i != maps[k].end())
+            C->setOperand(o, i->second);
+        }
+  }
+
+  // clone PHIs keep only the entry for the previous block on the trace
+  for(unsigned k = first; k < n; k++)
+  {
+    BasicBlock* pred = (k == first) ? blocks[k-1] : clones[k-1];
+    for(BasicBlock::iterator C = clones[k]->begin(); isa<PHINode>(C); ++C)
+    {
+      PHINode* PN = cast<PHINode>(C);
+      for(unsigned e = PN->getNumIncomingValues(); e-- > 0; )
+        if(PN->getIncomingBlock(e) != blocks[k-1])
+          PN->removeIncomingValue(e, false);
+      PN->setIncomingBlock(0, pred);
+    }
+  }
+
+  // clone successors: the next clone on the trace, or the original
+  // block, which gets the clone as a new predecessor
+  for(unsigned k = first; k < n; k++)
+  {
+    TerminatorInst* T = clones[k]->getTerminator();
+    for(unsigned s = 0, S = T->getNumSuccessors(); s < S; s++)
+    {
+      BasicBlock* succ = T->getSuccessor(s);
+      if( (k+1 < n) && (succ == blocks[k+1]) )
+      {
+        T->setSuccessor(s, clones[k+1]);
+        continue;
+      }
+
+      for(BasicBlock::iterator I = succ->begin(); isa<PHINode>(I); ++I)
+      {
+        PHINode* PN = cast<PHINode>(I);
+        Value* V = PN->getIncomingValueForBlock(blocks[k]);
+        if(Instruction* VI = dyn_cast<Instruction>(V))
+        {
+          InstMap::iterator i = maps[k].find(VI);
+          if(i != maps[k].end())
+            V = i->second;
+        }
+        PN->addIncoming(V, clones[k]);
+      }
+    }
+  }
+
+  // enter the clones from the trace
+  TerminatorInst* T = blocks[first-1]->getTerminator();
+  for(unsigned s = 0, S = T->getNumSuccessors(); s < S; s++)
+    if(T->getSuccessor(s) == blocks[first])
+      T->setSuccessor(s, clones[first]);
+  for(BasicBlock::iterator I = blocks[first]->begin(); isa<PHINode>(I); ++I)
+    cast<PHINode>(I)->removeIncomingValue(blocks[first-1], false);
+
+  // Each original value now has two definitions; rewrite the uses
+  // outside the defining block, as JumpThreading does.
+  SSAUpdater SSAUpdate;
+  SmallVector<Use*, 16> UsesToRename;
+  for(unsigned k = first; k < n; k++)
+  {
+    BasicBlock* BB = blocks[k];
+    for(BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I)
+    {
+      for(Value::use_iterator UI = I->use_begin(), UE = I->use_end();
+          UI != UE; ++UI)
+      {
+        Instruction* User = cast<Instruction>(*UI);
+        if(PHINode* UserPN = dyn_cast<PHINode>(User))
+        {
+          if(UserPN->getIncomingBlock(UI) == BB)
+            continue;
+        }
+        else if(User->getParent() == BB)
+          continue;
+
+        UsesToRename.push_back(&UI.getUse());
+      }
+
+      if(UsesToRename.empty())
+        continue;
+
+      SSAUpdate.Initialize(I->getType(), I->getName());
+      SSAUpdate.AddAvailableValue(BB, I);
+      SSAUpdate.AddAvailableValue(clones[k], maps[k][I]);
+      while(!UsesToRename.empty())
+        SSAUpdate.RewriteUse(*UsesToRename.pop_back_val());
+    }
+  }
+
+  // the trace now runs through the clones
+  for(unsigned k = first; k < n; k++)
+  {
+    NumDupInsts += clones[k]->size();
+    blocks[k] = clones[k];
+  }
+  NumDupBlocks += n - first;
+}
+
+
+bool FDOSuperblock::runOnModule(Module& M)
+{
+  _traces.clear();
+
+  CPFactory fact(M);
+  if( !fact.loadProfiles(CPPathFile) || !fact.hasPathCP() )
+  {
+    errs() << "FDOSuperblock::runOnModule Error: no combined path profile "
+           << "in '" << CPPathFile << "'\n";
+    return(false);
+  }
+  CombinedPathProfile* cpp = fact.takePathCP();
+
+  // Decode every hot path before changing anything: functions are
+  // numbered from 1, the same way as CombinedPathProfile.
+  PathSet paths;
+  cpp->getPathSet(paths);
+
+  int size = 0;
+  FunctionIndex fnum = 0;
+  for(Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if(!F->isDeclaration())
+      for(Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB)
+        size += BB->size();
+
+    if(!isCPDefinition(*F))
+      continue;
+    findTraces(*F, ++fnum, *cpp, paths);
+  }
+
+  delete cpp;
+  CPFactory::freeStaticData();
+
+  std::sort(_traces.begin(), _traces.end());
+
+  int budget = computeFDOBudget(size, FDSBBudget);
+  DEBUG(dbgs() << "FDOSuperblock: " << _traces.size() << " hot traces, budget "
+               << budget << "\n");
+
+  bool changed = false;
+  BlockSet used;
+  for(unsigned t = 0; t < _traces.size(); t++)
+  {
+    // blocks of hotter superblocks are taken
+    BlockVec& blocks = _traces[t].blocks;
+    unsigned len = 0;
+    while( (len < blocks.size()) && !used.count(blocks[len]) )
+      len++;
+    blocks.resize(len);
+    if(len < 2)
+      continue;
+
+    unsigned first = sideEntrance(blocks);
+    unsigned cost = (first == 0) ? 0 : tailSize(blocks, first);
+    if((int)cost > budget)
+      continue;
+
+    used.insert(blocks.begin(), blocks.end());
+    if(first != 0)
+    {
+      DEBUG(dbgs() << "FDOSuperblock: " << _traces[t].F->getName() << ": "
+                   << len << " blocks from " << blocks[0]->getName()
+                   << ", duplicating " << len - first << " (" << cost
+                   << " insts)\n");
+      duplicateTail(blocks, first);
+      budget -= cost;
+      changed = true;
+    }
+    NumSuperblocks++;
+  }
+
+  return(changed);
+}
@@ -0,0 +1,232 @@
+//===- TripCountProfiling.cpp - Insert counters for loop trip counts ------===//
+//
+//                      The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass instruments the specified program to record, for every
+// natural loop, how many times its header runs per invocation of the
+// loop.  Each loop gets a local counter that is reset on the edges
+// entering the loop and incremented in the header; the edges leaving
+// the loop pass the count to the runtime, which keeps a bucketed
+// histogram of trip counts per loop (see ProfileInfoTypes.h).
+//
+// Loops are numbered as in CombinedTripCountProfile: by function, then
+// by the position of their header in the function.  Invocations that
+// leave a loop by returning or unwinding are not recorded.
+//
+//===----------------------------------------------------------------------===//
+#define DEBUG_TYPE "insert-tripcount-profiling"
+
+#include "ProfilingUtils.h"
+#include "llvm/Constants.h"
+#include "llvm/Instructions.h"
+#include "llvm/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Instrumentation.h"
+#include "llvm/ADT/Statistic.h"
+#include <map>
+#include <vector>
+using namespace llvm;
+
+STATISTIC(NumLoopsInstrumented, "The # of loops with trip count counters.");
+
+namespace {
+  // work to do on one CFG edge: record or reset the counter of a loop
+  struct TripCountAction {
+    unsigned loop;
+    AllocaInst* counter;
+    bool record;
+  };
+
+  typedef std::pair<BasicBlock*,BasicBlock*> CFGEdge;
+  typedef std::map<CFGEdge, std::vector<TripCountAction> > EdgeActionMap;
+
+  class TripCountProfiler : public ModulePass {
+    bool runOnModule(Module &M);
+  public:
+    static char ID; // Pass identification, replacement for typeid
+    TripCountProfiler() : ModulePass(ID) {}
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<LoopInfo>();
+    }
+
+    virtual const char *getPassName() const {
+      return "Loop Trip Count Profiler";
+    }
+
+  private:
+    Constant* _recordFn;
+
+    unsigned instrumentFunction(Function& F, unsigned firstLoop);
+    Instruction* edgeInsertPoint(const CFGEdge& edge);
+  };
+}
+
+char TripCountProfiler::ID = 0;
+INITIALIZE_PASS(TripCountProfiler, "insert-tripcount-profiling",
+                "Insert instrumentation for loop trip count profiling",
+                false, false);
+
+ModulePass *llvm::createTripCountProfilerPass() {
+  return new TripCountProfiler();
+}
+
+
+bool TripCountProfiler::runOnModule(Module &M) {
+  Function *Main = M.getFunction("main");
+  if (Main == 0) {
+    errs() << "WARNING: cannot insert trip count profiling into a module"
+           << " with no main function!\n";
+    return false;  // No main, no instrumentation!
+  }
+
+  LLVMContext& Context = M.getContext();
+  _recordFn = M.getOrInsertFunction("llvm_record_trip_count",
+                                    Type::getVoidTy(Context),  // return type
+                                    Type::getInt32Ty(Context), // loop number
+                                    Type::getInt32Ty(Context), // trip count
+                                    NULL);
+
+  unsigned NumLoops = 0;
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if (F->isDeclaration()) continue;
+    NumLoops += instrumentFunction(*F, NumLoops);
+  }
+
+  errs() << "\n\nTrip Count Profiling: Inserting counters for " << NumLoops
+         << " loops\n\n\n";
+
+  // per-loop trip count histograms, filled in by the runtime
+  const Type *ATy = ArrayType::get(Type::getInt32Ty(Context),
+                                   NumLoops * TRIPCOUNT_BUCKETS);
+  GlobalVariable *Counters =
+    new GlobalVariable(M, ATy, false, GlobalValue::InternalLinkage,
+                       Constant::getNullValue(ATy), "TripCountProfCounters");
+
+  // Add the initialization call to main.
+  InsertProfilingInitCall(Main, "llvm_start_trip_count_profiling", Counters);
+  return true;
+}
+
+
+// Instrument the loops of F, numbered from firstLoop.  Returns the
+// number of loops in F, including any that could not be instrumented.
+unsigned TripCountProfiler::instrumentFunction(Function& F,
+                                               unsigned firstLoop)
+{
+  std::vector<BasicBlock*> headers;
+  CombinedTripCountProfile::getLoopHeaders(F, headers);
+  if(headers.empty())
+    return(0);
+
+  LoopInfo& LI = getAnalysis<LoopInfo>(F);
+  LLVMContext& Context = F.getContext();
+  const Type* Int32 = Type::getInt32Ty(Context);
+  Instruction* allocaPoint = F.getEntryBlock().begin();
+
+  // Collect the work on every edge before changing the CFG
+  EdgeActionMap actions;
+  for(unsigned i = 0; i < headers.size(); i++)
+  {
+    BasicBlock* header = headers[i];
+    Loop* L = LI.getLoopFor(header);
+    if( (L == NULL) || (L->getHeader() != header) )
+      continue;
+
+    TripCountAction act;
+    act.loop = firstLoop + i;
+    act.counter = new AllocaInst(Int32, "tripcount", allocaPoint);
+
+    // count header executions
+    Instruction* incPoint = header->getFirstNonPHI();
+    Value* oldCount = new LoadInst(act.counter, "oldTripCount", incPoint);
+    Value* newCount = BinaryOperator::Create(Instruction::Add, oldCount,
+                                             ConstantInt::get(Int32, 1),
+                                             "newTripCount", incPoint);
+    new StoreInst(newCount, act.counter, incPoint);
+
+    act.record = false;
+    for(pred_iterator P = pred_begin(header), E = pred_end(header);
+        P != E; ++P)
+      if(!L->contains(*P))
+        actions[CFGEdge(*P, header)].push_back(act);
+
+    act.record = true;
+    SmallVector<Loop::Edge, 8> exits;
+    L->getExitEdges(exits);
+    for(unsigned e = 0; e < exits.size(); e++)
+      actions[exits[e]].push_back(act);
+
+    NumLoopsInstrumented++;
+  }
+
+  for(EdgeActionMap::iterator i = actions.begin(), E = actions.end();
+      i != E; ++i)
+  {
+    std::vector<TripCountAction>& acts = i->second;
+    Instruction* insertPoint = edgeInsertPoint(i->first);
+    if(insertPoint == NULL)
+    {
+      errs() << "WARNING: cannot instrument a loop edge from "
+             << i->first.first->getName() << " to "
+             << i->first.second->getName() << " in " << F.getName() << "\n";
+      continue;
+    }
+
+    for(unsigned a = 0; a < acts.size(); a++)
+    {
+      // parallel edges (eg, switch cases) are listed more than once,
+      // but are split together
+      if( (a > 0) && (acts[a].counter == acts[a-1].counter) )
+        continue;
+
+      if(acts[a].record)
+      {
+        Value* args[2];
+        args[0] = ConstantInt::get(Int32, acts[a].loop);
+        args[1] = new LoadInst(acts[a].counter, "tripCount", insertPoint);
+        CallInst::Create(_recordFn, args, args+2, "", insertPoint);
+      }
+      else
+        new StoreInst(ConstantInt::get(Int32, 0), acts[a].counter,
+                      insertPoint);
+    }
+  }
+
+  return(headers.size());
+}
+
+
+// Where to put code that runs exactly when the edge is taken,
+// splitting the edge if it is critical.  Parallel edges (eg, switch
+// cases to the same block) count as one.  Returns NULL if the edge
+// can't be split (eg, from an indirectbr).
+Instruction* TripCountProfiler::edgeInsertPoint(const CFGEdge& edge)
+{
+  BasicBlock* from = edge.first;
+  BasicBlock* to = edge.second;
+
+  if(to->getUniquePredecessor() == from)
+    return(to->getFirstNonPHI());
+
+  if(from->getTerminator()->getNumSuccessors() == 1)
+    return(from->getTerminator());
+
+  if(isa<IndirectBrInst>(from->getTerminator()))
+    return(NULL);
+  BasicBlock* split = SplitCriticalEdge(from, to, NULL, true);
+  if(split == NULL)
+    return(NULL);
+  return(split->getTerminator());
+}
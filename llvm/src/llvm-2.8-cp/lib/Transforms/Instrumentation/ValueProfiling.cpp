@@ -0,0 +1,134 @@
+//===- ValueProfiling.cpp - Insert counters for indirect call targets -----===//
+//
+//                      The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass instruments the specified program to record the targets of
+// every indirect call site.  Each site passes its number and the called
+// pointer to the runtime, which keeps counters for a few of the targets
+// seen at the site (see ProfileInfoTypes.h).  Targets are identified by
+// their position in a table of the module's function definitions.
+//
+// Sites are numbered as in CombinedValueProfile: by function, then in
+// instruction order.
+//
+//===----------------------------------------------------------------------===//
+#define DEBUG_TYPE "insert-value-profiling"
+
+#include "ProfilingUtils.h"
+#include "llvm/Constants.h"
+#include "llvm/Instructions.h"
+#include "llvm/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Instrumentation.h"
+#include "llvm/ADT/Statistic.h"
+#include <vector>
+using namespace llvm;
+
+STATISTIC(NumSitesInstrumented, "The # of indirect call sites profiled.");
+
+namespace {
+  class ValueProfiler : public ModulePass {
+    bool runOnModule(Module &M);
+  public:
+    static char ID; // Pass identification, replacement for typeid
+    ValueProfiler() : ModulePass(ID) {}
+
+    virtual const char *getPassName() const {
+      return "Indirect Call Target Profiler";
+    }
+  };
+}
+
+char ValueProfiler::ID = 0;
+INITIALIZE_PASS(ValueProfiler, "insert-value-profiling",
+                "Insert instrumentation for indirect call target profiling",
+                false, false);
+
+ModulePass *llvm::createValueProfilerPass() {
+  return new ValueProfiler();
+}
+
+
+bool ValueProfiler::runOnModule(Module &M) {
+  Function *Main = M.getFunction("main");
+  if (Main == 0) {
+    errs() << "WARNING: cannot insert value profiling into a module"
+           << " with no main function!\n";
+    return false;  // No main, no instrumentation!
+  }
+
+  // Number the sites and targets before adding any calls
+  std::vector<Instruction*> Sites;
+  std::vector<Constant*> Targets;
+  LLVMContext& Context = M.getContext();
+  const Type *Int8Ptr = Type::getInt8PtrTy(Context);
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if (F->isDeclaration()) continue;
+    Targets.push_back(ConstantExpr::getBitCast(F, Int8Ptr));
+    CombinedValueProfile::getIndirectCalls(*F, Sites);
+  }
+
+  errs() << "\n\nValue Profiling: Inserting counters for " << Sites.size()
+         << " indirect call sites (" << Targets.size() << " targets)\n\n\n";
+
+  Constant *RecordFn =
+    M.getOrInsertFunction("llvm_record_indirect_call",
+                          Type::getVoidTy(Context),  // return type
+                          Type::getInt32Ty(Context), // site number
+                          Int8Ptr,                   // called pointer
+                          NULL);
+
+  for (unsigned i = 0; i < Sites.size(); i++)
+  {
+    CallSite CS(Sites[i]);
+    Value* args[2];
+    args[0] = ConstantInt::get(Type::getInt32Ty(Context), i);
+    args[1] = new BitCastInst(CS.getCalledValue(), Int8Ptr, "target",
+                              Sites[i]);
+    CallInst::Create(RecordFn, args, args+2, "", Sites[i]);
+    NumSitesInstrumented++;
+  }
+
+  // per-site target counters, filled in by the runtime
+  const Type *ATy = ArrayType::get(Type::getInt32Ty(Context),
+                                   Sites.size() * VALUE_SITE_COUNTERS);
+  GlobalVariable *Counters =
+    new GlobalVariable(M, ATy, false, GlobalValue::InternalLinkage,
+                       Constant::getNullValue(ATy), "ValueProfCounters");
+
+  const ArrayType *TTy = ArrayType::get(Int8Ptr, Targets.size());
+  GlobalVariable *Table =
+    new GlobalVariable(M, TTy, true, GlobalValue::InternalLinkage,
+                       ConstantArray::get(TTy, Targets),
+                       "ValueProfTargets");
+
+  // Add the initialization call to main, and hand the runtime the target
+  // table before it.
+  InsertProfilingInitCall(Main, "llvm_start_value_profiling", Counters);
+
+  Constant *TargetsFn =
+    M.getOrInsertFunction("llvm_set_value_profiling_targets",
+                          Type::getVoidTy(Context),
+                          PointerType::getUnqual(Int8Ptr),
+                          Type::getInt32Ty(Context),
+                          NULL);
+  BasicBlock::iterator InsertPos = Main->getEntryBlock().begin();
+  while (isa<AllocaInst>(InsertPos)) ++InsertPos;
+
+  Constant *Zero = Constant::getNullValue(Type::getInt32Ty(Context));
+  Constant *GEPIndices[2] = { Zero, Zero };
+  Value *targetArgs[2];
+  targetArgs[0] = ConstantExpr::getGetElementPtr(Table, GEPIndices, 2);
+  targetArgs[1] = ConstantInt::get(Type::getInt32Ty(Context), Targets.size());
+  CallInst::Create(TargetsFn, targetArgs, targetArgs+2, "", InsertPos);
+  return true;
+}
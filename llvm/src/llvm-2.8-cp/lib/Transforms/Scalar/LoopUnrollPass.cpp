@@ -10,19 +10,35 @@
 // This pass implements a simple loop unroller.  It works best when loops have
 // been canonicalized by the -indvars pass, allowing it to determine the trip
 // counts of loops easily.
+//
+// Given a combined trip count profile (-unroll-cprof), loops without a
+// constant trip count are unrolled by the distribution of their profiled
+// trip counts: a loop that usually runs a fixed small number of times is
+// versioned on that trip count and the copy is fully unrolled; otherwise
+// the unroll factor is taken from -unroll-cprof-quantile of the
+// distribution, keeping the exit test in every copy.
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "loop-unroll"
 #include "llvm/IntrinsicInst.h"
+#include "llvm/Module.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Analysis/LoopPass.h"
 #include "llvm/Analysis/InlineCost.h"
 #include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Analysis/CPModule.h"
+#include "llvm/Analysis/ProfileInfoTypes.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/UnrollLoop.h"
 #include <climits>
+#include <cmath>
+#include <map>
 
 using namespace llvm;
 
@@ -39,11 +55,31 @@ UnrollAllowPartial("unroll-allow-partial", cl::init(false), cl::Hidden,
   cl::desc("Allows loops to be partially unrolled until "
            "-unroll-threshold loop size is reached."));
 
+static cl::opt<std::string>
+UnrollCPFile("unroll-cprof", cl::init(""), cl::value_desc("filename"),
+  cl::desc("Unroll loops by the trip counts in this combined profile"));
+
+static cl::opt<double>
+UnrollCPQuantile("unroll-cprof-quantile", cl::init(0.25),
+  cl::desc("Quantile (over all invocations) of the profiled trip count "
+           "used for partial unrolling"));
+
+static cl::opt<double>
+UnrollCPVersion("unroll-cprof-version", cl::init(0.5),
+  cl::desc("Version a loop on its most common trip count when at least "
+           "this fraction of invocations have it"));
+
+STATISTIC(NumProfileUnrolled, "Number of loops unrolled by trip count profile");
+STATISTIC(NumProfileVersioned,
+          "Number of loops versioned by trip count profile");
+
 namespace {
   class LoopUnroll : public LoopPass {
   public:
     static char ID; // Pass ID, replacement for typeid
-    LoopUnroll() : LoopPass(ID) {}
+    LoopUnroll() : LoopPass(ID), Profile(0), ProfileLoaded(false),
+                   ProfileFunc(0) {}
+    ~LoopUnroll() { delete Profile; }
 
     /// A magic value for use with the Threshold parameter to indicate
     /// that the loop unroll should be performed regardless of how much
@@ -56,8 +92,18 @@ namespace {
     
     unsigned CurrentThreshold;
 
+    /// Trip count profile state; the profile is loaded on the first loop.
+    CombinedTripCountProfile *Profile;
+    bool ProfileLoaded;
+    std::map<const Function*, unsigned> ProfileFuncNum;
+    const Function *ProfileFunc;
+    std::map<const BasicBlock*, CPHistogram*> ProfileLoops;
+
     bool runOnLoop(Loop *L, LPPassManager &LPM);
 
+    CPHistogram *getTripCounts(Loop *L);
+    bool unrollByProfile(Loop *L, LPPassManager &LPM, CPHistogram &Trips);
+
     /// This transformation requires natural loop information & requires that
     /// loop preheaders be inserted into the CFG...
     ///
@@ -115,6 +161,12 @@ bool LoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
   unsigned TripCount = L->getSmallConstantTripCount();
   unsigned Count = UnrollCount;
 
+  // Without a constant trip count, use the profiled distribution.
+  if (TripCount == 0 && Count == 0 && !UnrollCPFile.empty()) {
+    CPHistogram *Trips = getTripCounts(L);
+    return Trips && unrollByProfile(L, LPM, *Trips);
+  }
+
   // Automatically select an unroll count.
   if (Count == 0) {
     // Conservative heuristic: if we know the trip count, see if we can
@@ -167,3 +219,137 @@ bool LoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
     DT->runOnFunction(*F);
   return true;
 }
+
+/// getTripCounts - Return the profiled trip count distribution of L, if the
+/// profile has one that matches the current function.
+CPHistogram *LoopUnroll::getTripCounts(Loop *L) {
+  Function *F = L->getHeader()->getParent();
+  Module *M = F->getParent();
+
+  if (!ProfileLoaded) {
+    ProfileLoaded = true;
+    CPFactory Fact(*M);
+    if (!Fact.loadProfiles(UnrollCPFile) || !Fact.hasTripCountCP()) {
+      errs() << "LoopUnroll: error: no combined trip count profile in '"
+             << UnrollCPFile << "'\n";
+      return 0;
+    }
+    Profile = Fact.takeTripCountCP();
+    CPFactory::freeStaticData();
+
+    unsigned FuncNum = 0;
+    for (Module::iterator I = M->begin(), E = M->end(); I != E; ++I)
+      if (isCPDefinition(*I))
+        ProfileFuncNum[I] = FuncNum++;
+    if (FuncNum != Profile->getFunctionCount()) {
+      errs() << "LoopUnroll: error: trip count profile is inconsistent with "
+             << "the current program\n";
+      delete Profile;
+      Profile = 0;
+    }
+  }
+  if (!Profile)
+    return 0;
+
+  // Loops are numbered by header position, so match them all up before
+  // anything in F is unrolled.
+  if (F != ProfileFunc) {
+    ProfileFunc = F;
+    ProfileLoops.clear();
+
+    std::map<const Function*, unsigned>::iterator FI = ProfileFuncNum.find(F);
+    if (FI == ProfileFuncNum.end())
+      return 0;
+
+    std::vector<BasicBlock*> Headers;
+    CombinedTripCountProfile::getLoopHeaders(*F, Headers);
+    if (Headers.size() != Profile->getLoopCount(FI->second)) {
+      DEBUG(dbgs() << "  Trip count profile does not match the loops of "
+            << F->getName() << "\n");
+      return 0;
+    }
+    for (unsigned i = 0, e = Headers.size(); i != e; ++i)
+      ProfileLoops[Headers[i]] = &Profile->getHistogram(FI->second, i);
+  }
+
+  // Each loop is considered once; its header may be reused afterwards.
+  std::map<const BasicBlock*, CPHistogram*>::iterator I =
+    ProfileLoops.find(L->getHeader());
+  if (I == ProfileLoops.end())
+    return 0;
+  CPHistogram *Trips = I->second;
+  ProfileLoops.erase(I);
+  return Trips;
+}
+
+/// unrollByProfile - Unroll L, whose trip count is not a known constant,
+/// by its profiled trip count distribution.
+bool LoopUnroll::unrollByProfile(Loop *L, LPPassManager &LPM,
+                                 CPHistogram &Trips) {
+  LoopInfo *LI = &getAnalysis<LoopInfo>();
+  Function *F = L->getHeader()->getParent();
+
+  if (!Trips.nonZero())
+    return false;
+
+  unsigned NumCalls;
+  unsigned LoopSize = ApproximateLoopSize(L, NumCalls);
+  if (NumCalls != 0) {
+    DEBUG(dbgs() << "  Not unrolling loop with function calls.\n");
+    return false;
+  }
+  if (LoopSize == 0)
+    LoopSize = 1;
+
+  // The typical trip count, and the fraction of invocations that have it;
+  // only small trip counts are recorded exactly.
+  unsigned Typical = (unsigned)floor(Trips.quantile(0.5) + 0.5);
+  double Share = Trips.probBetween(Typical - 0.5, Typical + 0.5);
+  unsigned Largest = (unsigned)ceil(Trips.max());
+  DEBUG(dbgs() << "  Profiled trip count " << Typical << " (" << Share
+        << " of invocations), at most " << Largest << "\n");
+
+  bool Changed = false;
+  if (Typical >= 2 && Typical < TRIPCOUNT_EXACT && Share >= UnrollCPVersion &&
+      (uint64_t)LoopSize * Typical <= CurrentThreshold) {
+    // Run a fully unrolled copy when the trip count is the typical one.
+    // The copy is only made if it can be unrolled.
+    if (Loop *NewLoop = VersionLoopByTripCount(L, Typical, LI, &LPM, this)) {
+      bool Unrolled = UnrollLoop(NewLoop, Typical, LI, &LPM, Typical);
+      assert(Unrolled && "Versioned loop could not be unrolled!");
+      (void)Unrolled;
+      ++NumProfileVersioned;
+      ++NumProfileUnrolled;
+      Changed = true;
+    }
+  }
+
+  // Otherwise, or if L could not be versioned, unroll L itself.
+  if (!Changed && Largest >= 2 &&
+      (uint64_t)LoopSize * Largest <= CurrentThreshold) {
+    // Every invocation seen runs in one pass through the unrolled body.
+    if (UnrollLoop(L, Largest, LI, &LPM)) {
+      ++NumProfileUnrolled;
+      Changed = true;
+    }
+  } else if (!Changed && UnrollAllowPartial) {
+    double Low = Trips.quantile(UnrollCPQuantile);
+    unsigned Limit = CurrentThreshold / LoopSize;
+    if (Low < Limit)
+      Limit = (unsigned)Low;
+    unsigned Count = 1;
+    while (Count * 2 <= Limit)
+      Count *= 2;
+    if (Count >= 2 && UnrollLoop(L, Count, LI, &LPM)) {
+      DEBUG(dbgs() << "  partially unrolling with count: " << Count << "\n");
+      ++NumProfileUnrolled;
+      Changed = true;
+    }
+  }
+
+  // FIXME: Reconstruct dom info, because it is not preserved properly.
+  if (Changed)
+    if (DominatorTree *DT = getAnalysisIfAvailable<DominatorTree>())
+      DT->runOnFunction(*F);
+  return Changed;
+}
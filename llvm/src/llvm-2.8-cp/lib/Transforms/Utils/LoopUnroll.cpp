@@ -8,8 +8,8 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements some loop unrolling utilities. It does not define any
-// actual pass or policy, but provides a single function to perform loop
-// unrolling.
+// actual pass or policy, but provides functions to perform loop unrolling
+// and trip count versioning.
 //
 // It works best when loops have been canonicalized by the -indvars pass,
 // allowing it to determine the trip counts of loops easily.
@@ -21,10 +21,15 @@
 #define DEBUG_TYPE "loop-unroll"
 #include "llvm/Transforms/Utils/UnrollLoop.h"
 #include "llvm/BasicBlock.h"
+#include "llvm/Constants.h"
+#include "llvm/Instructions.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/Dominators.h"
 #include "llvm/Analysis/LoopPass.h"
 #include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Support/CFG.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
@@ -36,6 +41,7 @@ using namespace llvm;
 // TODO: Should these be here or in LoopUnroll?
 STATISTIC(NumCompletelyUnrolled, "Number of loops completely unrolled");
 STATISTIC(NumUnrolled,    "Number of loops unrolled (completely or otherwise)");
+STATISTIC(NumVersioned,   "Number of loops versioned by trip count");
 
 /// RemapInstruction - Convert the instruction operands from referencing the
 /// current values into those specified by VMap.
@@ -105,7 +111,11 @@ static BasicBlock *FoldBlockIntoPredecessor(BasicBlock *BB, LoopInfo* LI) {
 ///
 /// If a LoopPassManager is passed in, and the loop is fully removed, it will be
 /// removed from the LoopPassManager as well. LPM can also be NULL.
-bool llvm::UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM) {
+///
+/// A non-zero TripCount is used when the trip count is not a known constant,
+/// and must be guaranteed by the caller (eg, by VersionLoopByTripCount).
+bool llvm::UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM,
+                      unsigned TripCount) {
   BasicBlock *Preheader = L->getLoopPreheader();
   if (!Preheader) {
     DEBUG(dbgs() << "  Can't unroll; loop preheader-insertion failed.\n");
@@ -134,7 +144,8 @@ bool llvm::UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM)
     SE->forgetLoop(L);
 
   // Find trip count
-  unsigned TripCount = L->getSmallConstantTripCount();
+  if (TripCount == 0)
+    TripCount = L->getSmallConstantTripCount();
   // Find trip multiple if count is not available
   unsigned TripMultiple = 1;
   if (TripCount == 0)
@@ -236,21 +247,6 @@ bool llvm::UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM)
 
       L->addBasicBlockToLoop(New, LI->getBase());
 
-      // Add phi entries for newly created values to all exit blocks except
-      // the successor of the latch block.  The successor of the exit block will
-      // be updated specially after unrolling all the way.
-      if (*BB != LatchBlock)
-        for (Value::use_iterator UI = (*BB)->use_begin(), UE = (*BB)->use_end();
-             UI != UE;) {
-          Instruction *UseInst = cast<Instruction>(*UI);
-          ++UI;
-          if (isa<PHINode>(UseInst) && !L->contains(UseInst)) {
-            PHINode *phi = cast<PHINode>(UseInst);
-            Value *Incoming = phi->getIncomingValueForBlock(*BB);
-            phi->addIncoming(Incoming, New);
-          }
-        }
-
       // Keep track of new headers and latches as we create them, so that
       // we can insert the proper branches later.
       if (*BB == Header)
@@ -275,17 +271,33 @@ bool llvm::UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM)
       for (BasicBlock::iterator I = NewBlocks[i]->begin(),
            E = NewBlocks[i]->end(); I != E; ++I)
         RemapInstruction(I, LastValueMap);
+
+    // Every exit edge is copied, latches included, so add phi entries to the
+    // exit blocks for this iteration's values.  Latches that stop exiting
+    // lose theirs when the branches are set up below.
+    for (unsigned i = 0; i < NewBlocks.size(); ++i)
+      for (Value::use_iterator UI = LoopBlocks[i]->use_begin(),
+           UE = LoopBlocks[i]->use_end(); UI != UE; ++UI) {
+        PHINode *phi = dyn_cast<PHINode>(*UI);
+        if (!phi || L->contains(phi))
+          continue;
+        Value *Incoming = phi->getIncomingValueForBlock(LoopBlocks[i]);
+        ValueToValueMapTy::iterator VI = LastValueMap.find(Incoming);
+        if (VI != LastValueMap.end())
+          Incoming = VI->second;
+        phi->addIncoming(Incoming, NewBlocks[i]);
+      }
   }
   
-  // The latch block exits the loop.  If there are any PHI nodes in the
-  // successor blocks, update them to use the appropriate values computed as the
-  // last iteration of the loop.
+  // The header PHIs now come around from the last iteration's latch, with
+  // the values computed in the last iteration.
   if (Count != 1) {
     SmallPtrSet<PHINode*, 8> Users;
     for (Value::use_iterator UI = LatchBlock->use_begin(),
          UE = LatchBlock->use_end(); UI != UE; ++UI)
       if (PHINode *phi = dyn_cast<PHINode>(*UI))
-        Users.insert(phi);
+        if (L->contains(phi))
+          Users.insert(phi);
     
     BasicBlock *LastIterationBB = cast<BasicBlock>(LastValueMap[LatchBlock]);
     for (SmallPtrSet<PHINode*,8>::iterator SI = Users.begin(), SE = Users.end();
@@ -342,6 +354,11 @@ bool llvm::UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM)
       // iteration.
       Term->setSuccessor(!ContinueOnTrue, Dest);
     } else {
+      // This latch no longer exits the loop.
+      if (Dest != LoopExit)
+        for (BasicBlock::iterator I = LoopExit->begin();
+             PHINode *PN = dyn_cast<PHINode>(I); ++I)
+          PN->removeIncomingValue(Latches[i], false);
       Term->setUnconditionalDest(Dest);
       // Merge adjacent basic blocks, if possible.
       if (BasicBlock *Fold = FoldBlockIntoPredecessor(Dest, LI)) {
@@ -376,3 +393,124 @@ bool llvm::UnrollLoop(Loop *L, unsigned Count, LoopInfo* LI, LPPassManager* LPM)
 
   return true;
 }
+
+/// VersionLoopByTripCount - Make a copy of the innermost loop L that runs
+/// instead of L when the header of L will execute exactly TripCount times,
+/// as computed by ScalarEvolution in the preheader.  L must be in
+/// loop-simplify and LCSSA form, and both loops are left that way.  Returns
+/// the copy, or NULL if L was not changed.  L is only copied if UnrollLoop
+/// can unroll the copy.
+///
+/// P must be a loop pass; the LoopInfo and DominatorTree are kept consistent.
+Loop *llvm::VersionLoopByTripCount(Loop *L, unsigned TripCount, LoopInfo *LI,
+                                   LPPassManager *LPM, Pass *P) {
+  BasicBlock *Preheader = L->getLoopPreheader();
+  if (!L->empty() || !Preheader || !L->getLoopLatch() ||
+      !L->hasDedicatedExits() || TripCount == 0) {
+    DEBUG(dbgs() << "  Can't version; not a simplified innermost loop.\n");
+    return 0;
+  }
+
+  // UnrollLoop needs the latch to leave the loop with a conditional branch.
+  BranchInst *LatchBr = dyn_cast<BranchInst>(L->getLoopLatch()->getTerminator());
+  if (!LatchBr || LatchBr->isUnconditional() ||
+      L->contains(LatchBr->getSuccessor(0)) ==
+      L->contains(LatchBr->getSuccessor(1))) {
+    DEBUG(dbgs() << "  Can't version; latch does not exit the loop with a "
+          << "conditional branch.\n");
+    return 0;
+  }
+
+  // Every value used outside L must go through an exit block PHI, and the
+  // exit edges must be splittable.
+  DominatorTree *DT = P->getAnalysisIfAvailable<DominatorTree>();
+  if (DT && !L->isLCSSAForm(*DT)) {
+    DEBUG(dbgs() << "  Can't version; loop is not in LCSSA form.\n");
+    return 0;
+  }
+  for (Loop::block_iterator I = L->block_begin(), E = L->block_end();
+       I != E; ++I)
+    if (isa<IndirectBrInst>((*I)->getTerminator())) {
+      DEBUG(dbgs() << "  Can't version; loop contains an indirectbr.\n");
+      return 0;
+    }
+
+  ScalarEvolution *SE = P->getAnalysisIfAvailable<ScalarEvolution>();
+  if (!SE) {
+    DEBUG(dbgs() << "  Can't version; ScalarEvolution not available.\n");
+    return 0;
+  }
+
+  const SCEV *BECount = SE->getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(BECount) ||
+      !BECount->getType()->isIntegerTy()) {
+    DEBUG(dbgs() << "  Can't version; trip count not computable.\n");
+    return 0;
+  }
+
+  // The exit edges are split below.
+  SmallVector<BasicBlock*, 8> ExitBlocks;
+  L->getUniqueExitBlocks(ExitBlocks);
+
+  DEBUG(dbgs() << "VERSIONING loop %" << L->getHeader()->getName()
+        << " for trip count " << TripCount << "\n");
+
+  // Compute the condition before anything changes.
+  TerminatorInst *PreTerm = Preheader->getTerminator();
+  SCEVExpander Expander(*SE);
+  Value *BEValue = Expander.expandCodeFor(BECount, BECount->getType(),
+                                          PreTerm);
+  Value *IsTrip = new ICmpInst(PreTerm, ICmpInst::ICMP_EQ, BEValue,
+                               ConstantInt::get(BECount->getType(),
+                                                TripCount - 1),
+                               "tripcount.version");
+  SE->forgetLoop(L);
+
+  ValueMap<const Value*, Value*> VMap;
+  Loop *NewLoop = CloneLoop(L, LPM, LI, VMap, P);
+  BasicBlock *Header = L->getHeader();
+  BasicBlock *NewHeader = cast<BasicBlock>(VMap[Header]);
+
+  BranchInst::Create(NewHeader, Header, IsTrip, Preheader);
+  PreTerm->eraseFromParent();
+
+  // The copy leaves through the same exit blocks; in LCSSA form their PHIs
+  // name every value used outside the loop.
+  for (unsigned i = 0, e = ExitBlocks.size(); i != e; ++i)
+    for (BasicBlock::iterator I = ExitBlocks[i]->begin();
+         PHINode *PN = dyn_cast<PHINode>(I); ++I)
+      for (unsigned j = 0, je = PN->getNumIncomingValues(); j != je; ++j) {
+        BasicBlock *Pred = PN->getIncomingBlock(j);
+        if (!L->contains(Pred))
+          continue;
+        Value *V = PN->getIncomingValue(j);
+        ValueMap<const Value*, Value*>::iterator VI = VMap.find(V);
+        if (VI != VMap.end())
+          V = VI->second;
+        PN->addIncoming(V, cast<BasicBlock>(VMap[Pred]));
+      }
+
+  // The exit blocks now have new dominators.
+  if (DT)
+    DT->runOnFunction(*Header->getParent());
+
+  // Restore dedicated exits and preheaders for both loops.
+  for (unsigned i = 0, e = ExitBlocks.size(); i != e; ++i) {
+    SmallVector<BasicBlock*, 8> OrigPreds, NewPreds;
+    for (pred_iterator PI = pred_begin(ExitBlocks[i]),
+         PE = pred_end(ExitBlocks[i]); PI != PE; ++PI)
+      if (L->contains(*PI))
+        OrigPreds.push_back(*PI);
+      else
+        NewPreds.push_back(*PI);
+    SplitBlockPredecessors(ExitBlocks[i], &NewPreds[0], NewPreds.size(),
+                           ".vexit", P);
+    SplitBlockPredecessors(ExitBlocks[i], &OrigPreds[0], OrigPreds.size(),
+                           ".exit", P);
+  }
+  SplitEdge(Preheader, NewHeader, P);
+  SplitEdge(Preheader, Header, P);
+
+  ++NumVersioned;
+  return NewLoop;
+}
@@ -0,0 +1,68 @@
+/*===-- TripCountProfiling.c - Support library for trip count profiling ---===*\
+|*
+|*                     The LLVM Compiler Infrastructure
+|*
+|* This file is distributed under the University of Illinois Open Source      
+|* License. See LICENSE.TXT for details.                                      
+|* 
+|*===----------------------------------------------------------------------===*|
+|* 
+|* This file implements the call back routines for the loop trip count
+|* profiling instrumentation pass.  This should be used with the
+|* -insert-tripcount-profiling LLVM pass.
+|*
+\*===----------------------------------------------------------------------===*/
+
+#include "Profiling.h"
+#include <stdlib.h>
+
+static unsigned *ArrayStart;
+static unsigned NumElements;
+
+/* TripCountProfAtExitHandler - When the program exits, just write out the
+ * profiling data.
+ */
+static void TripCountProfAtExitHandler() {
+  write_profiling_data(TripCountInfo, ArrayStart, NumElements);
+}
+
+
+/* llvm_start_trip_count_profiling - This is the main entry point of the trip
+ * count profiling library.  It is responsible for setting up the atexit
+ * handler.
+ */
+int llvm_start_trip_count_profiling(int argc, const char **argv,
+                                    unsigned *arrayStart,
+                                    unsigned numElements) {
+  int Ret = save_arguments(argc, argv);
+  ArrayStart = arrayStart;
+  NumElements = numElements;
+  atexit(TripCountProfAtExitHandler);
+  return Ret;
+}
+
+
+/* llvm_record_trip_count - Count one invocation of loop that ran its header
+ * tripCount times, in the bucket described in ProfileInfoTypes.h.  Counters
+ * saturate instead of wrapping.  Loops that run before main are not counted.
+ */
+void llvm_record_trip_count(unsigned loop, unsigned tripCount) {
+  unsigned bucket = tripCount;
+  unsigned *counter;
+
+  if (ArrayStart == 0)
+    return;
+
+  if (tripCount >= TRIPCOUNT_EXACT) {
+    bucket = TRIPCOUNT_EXACT;
+    tripCount /= TRIPCOUNT_EXACT;
+    while (tripCount > 1 && bucket < TRIPCOUNT_BUCKETS - 1) {
+      tripCount >>= 1;
+      ++bucket;
+    }
+  }
+
+  counter = &ArrayStart[loop * TRIPCOUNT_BUCKETS + bucket];
+  if (loop * TRIPCOUNT_BUCKETS + bucket < NumElements && *counter != ~0u)
+    ++*counter;
+}
@@ -0,0 +1,128 @@
+/*===-- ValueProfiling.c - Support library for value profiling ------------===*\
+|*
+|*                     The LLVM Compiler Infrastructure
+|*
+|* This file is distributed under the University of Illinois Open Source
+|* License. See LICENSE.TXT for details.
+|*
+|*===----------------------------------------------------------------------===*|
+|*
+|* This file implements the call back routines for the indirect call target
+|* (value) profiling instrumentation pass.  This should be used with the
+|* -insert-value-profiling LLVM pass.
+|*
+\*===----------------------------------------------------------------------===*/
+
+#include "Profiling.h"
+#include <stdlib.h>
+
+typedef struct {
+  void *Address;
+  unsigned Number;    /* function number, from 1 */
+} TargetEntry;
+
+static unsigned *ArrayStart;
+static unsigned NumElements;
+static TargetEntry *Targets;
+static unsigned NumTargets;
+
+/* ValueProfAtExitHandler - When the program exits, just write out the
+ * profiling data.
+ */
+static void ValueProfAtExitHandler() {
+  write_profiling_data(ValueInfo, ArrayStart, NumElements);
+}
+
+
+static int compareTargets(const void *A, const void *B) {
+  const char *a = (const char *)((const TargetEntry *)A)->Address;
+  const char *b = (const char *)((const TargetEntry *)B)->Address;
+  return (a < b) ? -1 : (a > b);
+}
+
+
+/* llvm_start_value_profiling - This is the main entry point of the value
+ * profiling library.  It is responsible for setting up the atexit handler.
+ */
+int llvm_start_value_profiling(int argc, const char **argv,
+                               unsigned *arrayStart, unsigned numElements) {
+  int Ret = save_arguments(argc, argv);
+  ArrayStart = arrayStart;
+  NumElements = numElements;
+  atexit(ValueProfAtExitHandler);
+  return Ret;
+}
+
+
+/* llvm_set_value_profiling_targets - Number the possible call targets by
+ * their position in the table, from 1, and sort them by address for lookup.
+ */
+void llvm_set_value_profiling_targets(void **table, unsigned numTargets) {
+  unsigned i;
+
+  Targets = (TargetEntry *)malloc(numTargets * sizeof(TargetEntry));
+  if (Targets == 0) {
+    NumTargets = 0;
+    return;
+  }
+
+  for (i = 0; i < numTargets; ++i) {
+    Targets[i].Address = table[i];
+    Targets[i].Number = i + 1;
+  }
+  qsort(Targets, numTargets, sizeof(TargetEntry), compareTargets);
+  NumTargets = numTargets;
+}
+
+
+/* llvm_record_indirect_call - Count one call to target at site.  Targets
+ * outside the module, and those without one of the site's VALUE_TARGETS
+ * slots, are counted together.  When that count would exceed the smallest
+ * slot's, the slot's target joins them and the new target takes the slot,
+ * so a hot target first seen late still gets one.  Counters saturate
+ * instead of wrapping.
+ */
+void llvm_record_indirect_call(unsigned site, void *target) {
+  unsigned *counters, *counter, number = 0, t, min;
+  TargetEntry key, *found;
+
+  if (ArrayStart == 0 || (site + 1) * VALUE_SITE_COUNTERS > NumElements)
+    return;
+  counters = &ArrayStart[site * VALUE_SITE_COUNTERS];
+
+  key.Address = target;
+  found = (TargetEntry *)bsearch(&key, Targets, NumTargets,
+                                 sizeof(TargetEntry), compareTargets);
+  if (found)
+    number = found->Number;
+
+  counter = &counters[2 * VALUE_TARGETS];
+  for (t = 0; number != 0 && t < VALUE_TARGETS; ++t) {
+    if (counters[2 * t] == 0)
+      counters[2 * t] = number;
+    if (counters[2 * t] == number) {
+      counter = &counters[2 * t + 1];
+      break;
+    }
+  }
+
+  if (number != 0 && t == VALUE_TARGETS) {
+    min = 0;
+    for (t = 1; t < VALUE_TARGETS; ++t)
+      if (counters[2 * t + 1] < counters[2 * min + 1])
+        min = t;
+
+    if (*counter >= counters[2 * min + 1]) {
+      if (~0u - *counter < counters[2 * min + 1])
+        *counter = ~0u;
+      else
+        *counter += counters[2 * min + 1];
+      counters[2 * min] = number;
+      counters[2 * min + 1] = 0;
+      counter = &counters[2 * min + 1];
+    }
+  }
+
+  if (*counter != ~0u)
+    ++*counter;
+}
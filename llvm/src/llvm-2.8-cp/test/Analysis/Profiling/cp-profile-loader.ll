@@ -0,0 +1,34 @@
+; RUN: opt < %s -cp-profile-loader -cp-profile-file=%p/cp-profile-loader.cp \
+; RUN:   -block-placement -S | FileCheck %s
+;
+; cp-profile-loader.cp is an edge profile of this module over three
+; runs, two of which took %small.  Block placement, reading it through
+; ProfileInfo, puts %small right after the entry and %big last.
+
+; CHECK: define internal i32 @pick(
+; CHECK: entry:
+; CHECK: small:
+; CHECK: join:
+; CHECK: big:
+; CHECK: define i32 @main(
+
+define internal i32 @pick(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 1
+  br i1 %c, label %big, label %small
+big:
+  %b = mul i32 %x, 3
+  br label %join
+small:
+  %s = add i32 %x, 1
+  br label %join
+join:
+  %r = phi i32 [ %b, %big ], [ %s, %small ]
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %v = call i32 @pick(i32 %argc)
+  ret i32 0
+}
@@ -0,0 +1,37 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: llvm-cprof -bc=8 -half-life=1 -age=0,1 -cpFile=%t.cp %t.bc \
+; RUN:   %p/cprof-decay-1.out %p/cprof-decay-2.out
+; RUN: llvm-cpmetrics %t.bc %t.cp -print | FileCheck %s
+;
+; cprof-decay-1.out and cprof-decay-2.out are raw edge profiles of this
+; module: the first run (argc 1) took %small, the second (argc 2) %big.
+; With a half-life of 1, the second run, of age 1, counts half.
+
+; CHECK: Total Weight: 1.500000e+00
+; CHECK: Index 1:
+; CHECK: point[1.000000e+00] 5.000000e-01
+; CHECK: Index 2:
+; CHECK: point[1.000000e+00] 1.000000e+00
+; CHECK: Index 5:
+; CHECK: point[1.000000e+00] 1.500000e+00
+
+define internal i32 @pick(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 1
+  br i1 %c, label %big, label %small
+big:
+  %b = mul i32 %x, 3
+  br label %join
+small:
+  %s = add i32 %x, 1
+  br label %join
+join:
+  %r = phi i32 [ %b, %big ], [ %s, %small ]
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %v = call i32 @pick(i32 %argc)
+  ret i32 0
+}
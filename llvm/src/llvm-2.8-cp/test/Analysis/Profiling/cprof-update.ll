@@ -0,0 +1,48 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: rm -f %t.cp %t.all.cp %t.icp %t.all.icp
+;
+; Folding the second run into a profile of the first in place gives the
+; same file as building from both, plain or indexed: -update keeps the
+; file's format whatever -indexed says.
+; RUN: llvm-cprof -bc=8 -cpFile=%t.cp %t.bc %p/cprof-update-1.out
+; RUN: llvm-cprof -update -indexed -cpFile=%t.cp %t.bc %p/cprof-update-2.out
+; RUN: llvm-cprof -bc=8 -cpFile=%t.all.cp %t.bc \
+; RUN:   %p/cprof-update-1.out %p/cprof-update-2.out
+; RUN: diff %t.cp %t.all.cp
+; RUN: llvm-cprof -bc=8 -indexed -cpFile=%t.icp %t.bc %p/cprof-update-1.out
+; RUN: llvm-cprof -update -cpFile=%t.icp %t.bc %p/cprof-update-2.out
+; RUN: llvm-cprof -bc=8 -indexed -cpFile=%t.all.icp %t.bc \
+; RUN:   %p/cprof-update-1.out %p/cprof-update-2.out
+; RUN: diff %t.icp %t.all.icp
+; RUN: llvm-cpmetrics %t.bc %t.cp -print | FileCheck %s
+;
+; cprof-update-1.out and cprof-update-2.out are raw edge profiles of
+; this module: the first run (argc 1) took %small, the second (argc 2)
+; %big.
+
+; CHECK: Total Weight: 2.000000e+00
+; CHECK: Index 1:
+; CHECK: Sums (Val / W:!0+0 / Sq): 1.000 / 2.000:1.000+1.000 / 0.000
+; CHECK: Index 2:
+; CHECK: Sums (Val / W:!0+0 / Sq): 1.000 / 2.000:1.000+1.000 / 0.000
+
+define internal i32 @pick(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 1
+  br i1 %c, label %big, label %small
+big:
+  %b = mul i32 %x, 3
+  br label %join
+small:
+  %s = add i32 %x, 1
+  br label %join
+join:
+  %r = phi i32 [ %b, %big ], [ %s, %small ]
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %v = call i32 @pick(i32 %argc)
+  ret i32 0
+}
@@ -0,0 +1,55 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: rm -f %t.cp %t.edge.cp
+; RUN: llvm-cprof -bc=8 -edges-from-paths -cpFile=%t.cp %t.bc \
+; RUN:   %p/edges-from-paths-1.out %p/edges-from-paths-2.out \
+; RUN:   %p/edges-from-paths-edge.out
+; RUN: opt %t.bc -FDOSplitter -FDS-cprof=%t.cp -S | FileCheck %s
+; RUN: llvm-cprof -bc=8 -cpFile=%t.edge.cp %t.bc \
+; RUN:   %p/edges-from-paths-1.out %p/edges-from-paths-2.out \
+; RUN:   %p/edges-from-paths-edge.out
+; RUN: opt %t.bc -FDOSplitter -FDS-cprof=%t.edge.cp -S \
+; RUN:   | FileCheck %s -check-prefix=EDGE
+;
+; edges-from-paths-1.out and edges-from-paths-2.out are raw path
+; profiles of this module, from runs with argc 1 and 2, which never
+; took %cold.  edges-from-paths-edge.out is a raw edge profile of a run
+; with argc 3, which did.  The edge profile derived from the paths
+; alone has %cold never running, so the splitter outlines it; built
+; from the edge run, %cold is hot and stays.
+
+; CHECK: define internal i32 @pick(
+; CHECK: call void @pick_cold(
+; CHECK: define i32 @main(
+; CHECK: define internal void @pick_cold(
+
+; EDGE: define internal i32 @pick(
+; EDGE: %a8 = add i32 %a7, 1
+; EDGE: define i32 @main(
+
+define internal i32 @pick(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 2
+  br i1 %c, label %cold, label %hot
+cold:
+  %a1 = mul i32 %x, 3
+  %a2 = add i32 %a1, 7
+  %a3 = mul i32 %a2, %x
+  %a4 = sub i32 %a3, 9
+  %a5 = mul i32 %a4, 11
+  %a6 = add i32 %a5, %a1
+  %a7 = xor i32 %a6, %a2
+  %a8 = add i32 %a7, 1
+  br label %join
+hot:
+  %h = add i32 %x, 1
+  br label %join
+join:
+  %r = phi i32 [ %a8, %cold ], [ %h, %hot ]
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %v = call i32 @pick(i32 %argc)
+  ret i32 0
+}
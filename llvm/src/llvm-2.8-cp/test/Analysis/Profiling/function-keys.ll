@@ -0,0 +1,62 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: rm -f %t.cp
+; RUN: llvm-cprof -bc=8 -cpFile=%t.cp %t.bc %p/function-keys.cp 2>&1 \
+; RUN:   | FileCheck %s -check-prefix=MATCH
+; RUN: llvm-cpmetrics %t.bc %t.cp -print | FileCheck %s
+;
+; function-keys.cp is an edge profile, over two runs, of an older build
+; of this module in which @work2 was called @work, @leaf did not call
+; it, and @main had a single block.  The renamed function and the one
+; with a new call keep their edge histograms; @main's are dropped.
+
+; MATCH: profile is for another build: 3 of 3 functions matched (1 renamed), 2 changed, 3 in the module
+
+; @leaf
+; CHECK: Index 1:
+; CHECK-NEXT: Sums (Val / W:!0+0 / Sq): 1.000 / 2.000:1.000+1.000 / 0.000
+; @work2
+; CHECK: Index 7:
+; CHECK-NEXT: Sums (Val / W:!0+0 / Sq): 6.000 / 2.000:2.000+0.000 / 8.000
+; @main
+; CHECK: Index 9:
+; CHECK-NEXT: Sums (Val / W:!0+0 / Sq): 0.000 / 0.000:0.000+0.000 / 0.000
+
+define internal i32 @leaf(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 1
+  br i1 %c, label %big, label %small
+big:
+  %b0 = call i32 @work2(i32 %x)
+  %b = mul i32 %b0, 3
+  br label %join
+small:
+  %s = add i32 %x, 1
+  br label %join
+join:
+  %r = phi i32 [ %b, %big ], [ %s, %small ]
+  ret i32 %r
+}
+
+define internal i32 @work2(i32 %x) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i2, %loop ]
+  %i2 = add i32 %i, 1
+  %c = icmp slt i32 %i2, %x
+  br i1 %c, label %loop, label %exit
+exit:
+  ret i32 %i2
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %v = call i32 @leaf(i32 %argc)
+  %w = call i32 @work2(i32 %v)
+  %z = icmp eq i32 %w, 0
+  br i1 %z, label %zero, label %done
+zero:
+  ret i32 1
+done:
+  ret i32 0
+}
@@ -0,0 +1,41 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: rm -f %t.cp
+; RUN: llvm-cprof -bc=8 -cpFile=%t.cp %t.bc \
+; RUN:   %p/top-paths-1.out %p/top-paths-1.out %p/top-paths-2.out
+; RUN: llvm-cpmetrics %t.bc %t.cp -top-paths=1 -path-blocks | FileCheck %s
+; RUN: llvm-cpmetrics %t.bc %t.cp -path-coverage=0.9 \
+; RUN:   | FileCheck %s -check-prefix=COVER
+;
+; top-paths-1.out and top-paths-2.out are raw path profiles of this
+; module, from runs with argc 1 (through %small) and 2 (through %big).
+; The first run is counted twice.
+
+; CHECK: function 1 pick: 1 of 2 paths
+; CHECK-NEXT: path 1 mean 0.6667 freq 0.6667
+; CHECK-NEXT: entry small join
+; CHECK-NEXT: function 2 main: 1 of 1 paths
+
+; COVER: function 1 pick: 2 of 2 paths
+; COVER-NEXT: path 1 mean 0.6667 freq 0.6667
+; COVER-NEXT: path 0 mean 0.3333 freq 0.3333
+
+define internal i32 @pick(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 1
+  br i1 %c, label %big, label %small
+big:
+  %b = mul i32 %x, 3
+  br label %join
+small:
+  %s = add i32 %x, 1
+  br label %join
+join:
+  %r = phi i32 [ %b, %big ], [ %s, %small ]
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %v = call i32 @pick(i32 %argc)
+  ret i32 0
+}
@@ -0,0 +1,70 @@
+; RUN: llc < %s -march=x86-64 | FileCheck %s -check-prefix=NOPROF
+; RUN: llc < %s -march=x86-64 -code-place-cprof=%p/code-place-cprof.cp \
+; RUN:   | FileCheck %s
+;
+; code-place-cprof.cp is an edge profile of this module over three runs,
+; none of which called @rare.
+
+; Without a profile, the call to @rare falls through from the loop header.
+; NOPROF: f:
+; NOPROF: cmpl $1000
+; NOPROF-NEXT: jne
+; NOPROF: callq rare
+; NOPROF: callq often
+
+; With the profile, the hot block falls through and @rare is moved past
+; the return.
+; CHECK: f:
+; CHECK: cmpl $1000
+; CHECK-NEXT: je [[COLD:.LBB[0-9_]+]]
+; CHECK-NEXT: movl
+; CHECK-NEXT: callq often
+; CHECK: ret
+; CHECK-NEXT: [[COLD]]:
+; CHECK-NEXT: movl
+; CHECK-NEXT: callq rare
+; CHECK-NEXT: jmp
+
+@count = global i32 0
+
+define void @rare(i32 %i) nounwind noinline {
+entry:
+  volatile store i32 %i, i32* @count
+  ret void
+}
+
+define void @often(i32 %i) nounwind noinline {
+entry:
+  %c = volatile load i32* @count
+  %c1 = add i32 %c, %i
+  volatile store i32 %c1, i32* @count
+  ret void
+}
+
+define void @f(i32 %n) nounwind {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i2, %latch ]
+  %c = icmp eq i32 %i, 1000
+  br i1 %c, label %cold, label %hot
+cold:
+  call void @rare(i32 %i)
+  br label %latch
+hot:
+  call void @often(i32 %i)
+  br label %latch
+latch:
+  %i2 = add i32 %i, 1
+  %lc = icmp slt i32 %i2, %n
+  br i1 %lc, label %loop, label %exit
+exit:
+  ret void
+}
+
+define i32 @main(i32 %argc, i8** %argv) nounwind {
+entry:
+  %n = mul i32 %argc, 100
+  call void @f(i32 %n)
+  ret i32 0
+}
@@ -0,0 +1,80 @@
+; RUN: llc < %s -march=x86 | FileCheck %s -check-prefix=NOPROF
+; RUN: llc < %s -march=x86 -spill-weight-cprof=%p/spill-weight-cprof.cp \
+; RUN:   | FileCheck %s
+;
+; spill-weight-cprof.cp is an edge profile of this module over three runs,
+; none of which entered %loop.  Eight values are live out of %entry, more
+; than the registers i386 has left.
+
+; By loop depth, the values used in %loop are worth more, and %hot
+; reloads the others from the stack.
+; NOPROF: f:
+; NOPROF: jl [[HOT:.LBB[0-9_]+]]
+; NOPROF: [[HOT]]:
+; NOPROF-NEXT: movl {{[0-9]*}}(%esp)
+
+; By the profile, %hot runs every time and %loop never does: %hot keeps
+; its values in registers.
+; CHECK: f:
+; CHECK: jl [[HOT:.LBB[0-9_]+]]
+; CHECK: [[HOT]]:
+; CHECK-NEXT: leal (%e{{[a-z]+}},%e{{[a-z]+}}), [[T:%e[a-z]+]]
+; CHECK-NEXT: xorl %e{{[a-z]+}}, [[T]]
+; CHECK-NEXT: imull %e{{[a-z]+}}, [[T]]
+; CHECK-NEXT: movl [[T]], g+8
+
+@g = global [16 x i32] zeroinitializer
+
+define i32 @f(i32 %n) nounwind {
+entry:
+  %p1 = getelementptr [16 x i32]* @g, i32 0, i32 1
+  %p2 = getelementptr [16 x i32]* @g, i32 0, i32 2
+  %p3 = getelementptr [16 x i32]* @g, i32 0, i32 3
+  %p4 = getelementptr [16 x i32]* @g, i32 0, i32 4
+  %p5 = getelementptr [16 x i32]* @g, i32 0, i32 5
+  %p6 = getelementptr [16 x i32]* @g, i32 0, i32 6
+  %p7 = getelementptr [16 x i32]* @g, i32 0, i32 7
+  %p8 = getelementptr [16 x i32]* @g, i32 0, i32 8
+  %a = volatile load i32* %p1
+  %b = volatile load i32* %p2
+  %c = volatile load i32* %p3
+  %d = volatile load i32* %p4
+  %e = volatile load i32* %p5
+  %f = volatile load i32* %p6
+  %g = volatile load i32* %p7
+  %h = volatile load i32* %p8
+  %big = icmp sgt i32 %n, 1000
+  br i1 %big, label %loop, label %hot
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s4, %loop ]
+  %s1 = add i32 %s, %a
+  %s2 = xor i32 %s1, %b
+  %s3 = mul i32 %s2, %c
+  %s4 = sub i32 %s3, %d
+  volatile store i32 %s4, i32* %p1
+  %i.next = add i32 %i, 1
+  %more = icmp slt i32 %i.next, %n
+  br i1 %more, label %loop, label %join
+hot:
+  %t1 = add i32 %e, %f
+  %t2 = xor i32 %t1, %g
+  %t3 = mul i32 %t2, %h
+  volatile store i32 %t3, i32* %p2
+  br label %join
+join:
+  %u1 = add i32 %a, %b
+  %u2 = add i32 %u1, %c
+  %u3 = add i32 %u2, %d
+  %u4 = add i32 %u3, %e
+  %u5 = add i32 %u4, %f
+  %u6 = add i32 %u5, %g
+  %u7 = add i32 %u6, %h
+  ret i32 %u7
+}
+
+define i32 @main(i32 %argc, i8** %argv) nounwind {
+entry:
+  %r = call i32 @f(i32 %argc)
+  ret i32 %r
+}
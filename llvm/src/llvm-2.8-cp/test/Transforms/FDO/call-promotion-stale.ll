@@ -0,0 +1,46 @@
+; RUN: opt < %s -FDOCallPromotion -FDCP-cprof=%p/call-promotion-stale.cp -S \
+; RUN:   | FileCheck %s
+;
+; call-promotion-stale.cp is a value profile, over three runs, of an
+; older build of this module in which @often had a single block.  Nine
+; in ten calls through %fp went to @often.  Targets are matched by name,
+; so @often is still promoted although its body changed.
+
+; CHECK: define i32 @main(
+; CHECK: %icp.guard = icmp eq i32 (i32)* %fp, @often
+; CHECK: %v.direct = call i32 @often(i32 %i)
+
+define internal i32 @often(i32 %x) {
+entry:
+  %c = icmp slt i32 %x, 0
+  br i1 %c, label %neg, label %pos
+neg:
+  ret i32 0
+pos:
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define internal i32 @seldom(i32 %x) {
+entry:
+  %r = mul i32 %x, 3
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i2, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s2, %loop ]
+  %r = urem i32 %i, 10
+  %rare = icmp eq i32 %r, 0
+  %fp = select i1 %rare, i32 (i32)* @seldom, i32 (i32)* @often
+  %v = call i32 %fp(i32 %i)
+  %s2 = add i32 %s, %v
+  %i2 = add i32 %i, 1
+  %lc = icmp slt i32 %i2, 100
+  br i1 %lc, label %loop, label %exit
+exit:
+  ret i32 %s2
+}
@@ -0,0 +1,48 @@
+; RUN: opt < %s -FDOCallPromotion -FDCP-cprof=%p/call-promotion.cp -S \
+; RUN:   | FileCheck %s
+;
+; call-promotion.cp is a value profile of this module over three runs.
+; Nine in ten calls through %fp go to @often and the rest to @seldom,
+; so only @often is called directly, behind a guard.
+
+; CHECK: define i32 @main(
+; CHECK: %icp.guard = icmp eq i32 (i32)* %fp, @often
+; CHECK-NEXT: br i1 %icp.guard, label %icp.direct, label %icp.indirect
+; CHECK: icp.direct:
+; CHECK-NEXT: %v.direct = call i32 @often(i32 %i)
+; CHECK: icp.indirect:
+; CHECK-NEXT: %v = call i32 %fp(i32 %i)
+; CHECK: icp.merge:
+; CHECK-NEXT: %icp.result = phi i32 [ %v.direct, %icp.direct ], [ %v, %icp.indirect ]
+; CHECK-NOT: @seldom(
+; CHECK: ret i32
+
+define internal i32 @often(i32 %x) {
+entry:
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define internal i32 @seldom(i32 %x) {
+entry:
+  %r = mul i32 %x, 3
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i2, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s2, %loop ]
+  %r = urem i32 %i, 10
+  %rare = icmp eq i32 %r, 0
+  %fp = select i1 %rare, i32 (i32)* @seldom, i32 (i32)* @often
+  %v = call i32 %fp(i32 %i)
+  %s2 = add i32 %s, %v
+  %i2 = add i32 %i, 1
+  %lc = icmp slt i32 %i2, 100
+  br i1 %lc, label %loop, label %exit
+exit:
+  ret i32 %s2
+}
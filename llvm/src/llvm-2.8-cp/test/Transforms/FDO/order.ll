@@ -0,0 +1,61 @@
+; RUN: opt < %s -FDOOrder -FDOrder-cprof=%p/order.cp -FDOrder-file=%t -S \
+; RUN:   | FileCheck %s
+; RUN: FileCheck %s -check-prefix=FILE < %t
+; RUN: not grep rare %t
+;
+; order.cp is a call profile of this module over three runs: @main
+; calls @mid every iteration, @mid calls @leaf, and @rare is never
+; called.  The chain that calls each other most comes first, the
+; function never called last, and only the functions that ran are in
+; the ordering file.
+
+; CHECK: define internal i32 @leaf(
+; CHECK: define internal i32 @mid(
+; CHECK: define i32 @main(
+; CHECK: define internal i32 @rare(
+
+; FILE: leaf
+; FILE-NEXT: mid
+; FILE-NEXT: main
+
+define internal i32 @rare(i32 %x) {
+entry:
+  %r = mul i32 %x, 7
+  ret i32 %r
+}
+
+define internal i32 @leaf(i32 %x) {
+entry:
+  %r = add i32 %x, 3
+  ret i32 %r
+}
+
+define internal i32 @mid(i32 %x) {
+entry:
+  %v = call i32 @leaf(i32 %x)
+  %r = mul i32 %v, 2
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %n = mul i32 %argc, 100
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i2, %next ]
+  %s = phi i32 [ 0, %entry ], [ %s2, %next ]
+  %w = call i32 @mid(i32 %i)
+  %c = icmp sgt i32 %w, 100000
+  br i1 %c, label %odd, label %next
+odd:
+  %u = call i32 @rare(i32 %w)
+  br label %next
+next:
+  %t = phi i32 [ %w, %loop ], [ %u, %odd ]
+  %s2 = add i32 %s, %t
+  %i2 = add i32 %i, 1
+  %lc = icmp slt i32 %i2, %n
+  br i1 %lc, label %loop, label %exit
+exit:
+  ret i32 %s2
+}
@@ -0,0 +1,67 @@
+; RUN: opt < %s -FDOInliner -FDI-budget=4 -FDI-log=%t \
+; RUN:   -FDI-cprof=%p/partial-inline-call.cp -FDI-partial \
+; RUN:   -FDI-edge-cprof=%p/partial-inline-edge.cp -S | FileCheck %s
+;
+; partial-inline-call.cp and partial-inline-edge.cp are call and edge
+; profiles of this module over three runs.  @work is too big for the
+; budget, but its cold block runs once in 997 calls: the rest of @work
+; is inlined into @main and the cold block is outlined.
+
+
+define internal i32 @leaf(i32 %v) {
+entry:
+  %r = mul i32 %v, 3
+  ret i32 %r
+}
+
+define internal i32 @work(i32 %x) {
+entry:
+  %m = srem i32 %x, 997
+  %c = icmp eq i32 %m, 0
+  br i1 %c, label %cold, label %hot
+cold:
+  %a1 = add i32 %x, 1
+  %a2 = mul i32 %a1, %x
+  %a3 = xor i32 %a2, 12345
+  %a4 = add i32 %a3, %a1
+  %a5 = mul i32 %a4, 7
+  %a6 = sub i32 %a5, %a2
+  %a7 = xor i32 %a6, %a4
+  %a8 = call i32 @leaf(i32 %a7)
+  %a9 = add i32 %a8, %a6
+  %a10 = mul i32 %a9, %a9
+  br label %join
+hot:
+  %h1 = mul i32 %x, 3
+  %h2 = add i32 %h1, 1
+  br label %join
+join:
+  %r = phi i32 [ %a10, %cold ], [ %h2, %hot ]
+  ret i32 %r
+}
+
+; CHECK: define i32 @main(
+; CHECK: %c.i = icmp eq i32 %m.i, 0
+; CHECK-NEXT: br i1 %c.i, label %codeRepl.i, label %hot.i
+; CHECK: codeRepl.i:
+; CHECK-NEXT: call void @work.hot_cold(i32 %i,
+; CHECK: hot.i:
+; CHECK-NEXT: %h1.i = mul i32 %i, 3
+; CHECK-NOT: define internal i32 @work.hot(
+; CHECK: define internal void @work.hot_cold(
+; CHECK: %a10 = mul i32 %a9, %a9
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %n = mul i32 %argc, 5000
+  br label %loop
+loop:
+  %i = phi i32 [ 1, %entry ], [ %i2, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s2, %loop ]
+  %w = call i32 @work(i32 %i)
+  %s2 = add i32 %s, %w
+  %i2 = add i32 %i, 1
+  %lc = icmp slt i32 %i2, %n
+  br i1 %lc, label %loop, label %exit
+exit:
+  ret i32 %s2
+}
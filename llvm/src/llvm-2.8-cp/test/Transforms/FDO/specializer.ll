@@ -0,0 +1,48 @@
+; RUN: opt < %s -FDOSpecializer -FDSP-cprof=%p/specializer.cp -S | FileCheck %s
+;
+; specializer.cp is a call profile of this module over three runs.  The
+; call in the loop always passes 2 and is redirected to a clone of @sel
+; without that argument, keeping the attributes of the other arguments;
+; the cold call after the loop is left alone.
+
+
+define internal i32 @sel(i32 %mode, i32 %x) {
+entry:
+  %c = icmp eq i32 %mode, 2
+  br i1 %c, label %two, label %other
+two:
+  %t1 = mul i32 %x, 2
+  %t2 = add i32 %t1, 7
+  br label %join
+other:
+  %o1 = mul i32 %x, %mode
+  %o2 = xor i32 %o1, 99
+  %o3 = add i32 %o2, %mode
+  %o4 = mul i32 %o3, %o3
+  br label %join
+join:
+  %r = phi i32 [ %t2, %two ], [ %o4, %other ]
+  ret i32 %r
+}
+
+; CHECK: define i32 @main(
+; CHECK: %w = call zeroext i32 @sel.spec(i32 signext %i) nounwind
+; CHECK: %z = call i32 @sel(i32 %argc, i32 %s2)
+; CHECK: define internal i32 @sel.spec(i32 %x) {
+; CHECK: %c = icmp eq i32 2, 2
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %n = mul i32 %argc, 5000
+  br label %loop
+loop:
+  %i = phi i32 [ 1, %entry ], [ %i2, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s2, %loop ]
+  %w = call zeroext i32 @sel(i32 inreg 2, i32 signext %i) nounwind
+  %s2 = add i32 %s, %w
+  %i2 = add i32 %i, 1
+  %lc = icmp slt i32 %i2, %n
+  br i1 %lc, label %loop, label %exit
+exit:
+  %z = call i32 @sel(i32 %argc, i32 %s2)
+  ret i32 %z
+}
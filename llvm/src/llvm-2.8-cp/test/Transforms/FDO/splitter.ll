@@ -0,0 +1,59 @@
+; RUN: opt < %s -FDOSplitter -FDS-cprof=%p/splitter.cp -S | FileCheck %s
+;
+; splitter.cp is an edge profile of this module over three runs, none
+; of which took the large block in @g or called @never.
+
+; The block no run took is outlined into the cold section.
+; CHECK: define internal i32 @g(
+; CHECK: call void @g_cold(
+; CHECK: %h = add i32 %x, 1
+define internal i32 @g(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 1000
+  br i1 %c, label %cold, label %hot
+cold:
+  %a1 = mul i32 %x, 3
+  %a2 = add i32 %a1, 7
+  %a3 = mul i32 %a2, %x
+  %a4 = sub i32 %a3, 9
+  %a5 = mul i32 %a4, 11
+  %a6 = add i32 %a5, %a1
+  %a7 = xor i32 %a6, %a2
+  %a8 = add i32 %a7, 1
+  br label %exit
+hot:
+  %h = add i32 %x, 1
+  br label %exit
+exit:
+  %r = phi i32 [ %a8, %cold ], [ %h, %hot ]
+  ret i32 %r
+}
+
+; A function no run entered moves whole, unsplit.
+; CHECK: define i32 @never(i32 %x) section ".text.unlikely" {
+; CHECK-NOT: call
+; CHECK: ret i32 2
+define i32 @never(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 10
+  br i1 %c, label %a, label %b
+a:
+  ret i32 1
+b:
+  ret i32 2
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %v = call i32 @g(i32 %argc)
+  %c = icmp sgt i32 %argc, 100
+  br i1 %c, label %call, label %done
+call:
+  %w = call i32 @never(i32 %v)
+  ret i32 %w
+done:
+  ret i32 0
+}
+
+; CHECK: define internal void @g_cold({{.*}} section ".text.unlikely"
+; CHECK: %a8 = add i32 %a7, 1
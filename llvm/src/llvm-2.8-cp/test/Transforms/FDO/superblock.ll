@@ -0,0 +1,101 @@
+; RUN: opt < %s -FDOSuperblock -FDSB-cprof=%p/superblock.cp -FDSB-budget=10 -S | FileCheck %s
+;
+; superblock.cp is a path profile of this module over three runs.  In
+; @f and @g nearly every call takes %a, so entry -> a -> join -> ... is
+; the hot path, and %b is a side entrance into %join.
+
+; The tail of the hot path in @f is duplicated, and the trace runs
+; through the clones.
+; CHECK: define i32 @f(
+; CHECK: a:
+; CHECK-NEXT: %va = add i32 %x, 1
+; CHECK-NEXT: br label %join.sb
+; The side entrance keeps the original %join, which loses its %a entry.
+; CHECK: join:
+; CHECK-NEXT: %p = phi i32 [ %vb, %b ]
+; %big is reached from both copies of %join: %j needs a new PHI there.
+; CHECK: big:
+; CHECK-NEXT: [[J:%[a-z.0-9]+]] = phi i32 [ %j.sb, %join.sb ], [ %j, %join ]
+; CHECK-NEXT: %k = add i32 [[J]], 7
+; CHECK: done:
+; CHECK-NEXT: %r = phi i32 [ %j, %join ], [ %k, %big ]
+; CHECK: join.sb:
+; CHECK-NEXT: %p.sb = phi i32 [ %va, %a ]
+; CHECK-NEXT: %j.sb = add i32 %p.sb, 5
+; CHECK: br i1 %c2.sb, label %big, label %done.sb
+; CHECK: done.sb:
+; CHECK-NEXT: %r.sb = phi i32 [ %j.sb, %join.sb ]
+; CHECK-NEXT: ret i32 %r.sb
+define i32 @f(i32 %x) {
+entry:
+  %c = icmp ult i32 %x, 14
+  br i1 %c, label %a, label %b
+a:
+  %va = add i32 %x, 1
+  br label %join
+b:
+  %vb = mul i32 %x, 3
+  br label %join
+join:
+  %p = phi i32 [ %va, %a ], [ %vb, %b ]
+  %j = add i32 %p, 5
+  %c2 = icmp sgt i32 %j, 100
+  br i1 %c2, label %big, label %done
+big:
+  %k = add i32 %j, 7
+  br label %done
+done:
+  %r = phi i32 [ %j, %join ], [ %k, %big ]
+  ret i32 %r
+}
+
+; The hot path in @g is as hot, but its tail is larger than what is left
+; of the budget, so @g is left alone.  So is the first iteration of the
+; loop in @main, which alone is larger than the whole budget.
+; CHECK: define i32 @g(
+; CHECK-NOT: .sb
+; CHECK: define i32 @main(
+; CHECK-NOT: .sb
+; CHECK: ret i32 %s.next
+define i32 @g(i32 %x) {
+entry:
+  %c = icmp ult i32 %x, 14
+  br i1 %c, label %a, label %b
+a:
+  %va = add i32 %x, 1
+  br label %join
+b:
+  %vb = mul i32 %x, 3
+  br label %join
+join:
+  %p = phi i32 [ %va, %a ], [ %vb, %b ]
+  %t1 = add i32 %p, 5
+  %t2 = mul i32 %t1, 3
+  %t3 = xor i32 %t2, %p
+  %t4 = add i32 %t3, 11
+  %t5 = mul i32 %t4, %t1
+  %t6 = sub i32 %t5, 13
+  %t7 = xor i32 %t6, %t3
+  %t8 = add i32 %t7, %t2
+  ret i32 %t8
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %n = mul i32 %argc, 50
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %loop ]
+  %x = urem i32 %i, 16
+  %rf = call i32 @f(i32 %x)
+  %rg = call i32 @g(i32 %x)
+  %s1 = add i32 %s, %rf
+  %s2 = add i32 %s1, %rg
+  %s.next = xor i32 %s2, %i
+  %i.next = add i32 %i, 1
+  %more = icmp ult i32 %i.next, %n
+  br i1 %more, label %loop, label %exit
+exit:
+  ret i32 %s.next
+}
@@ -0,0 +1,70 @@
+; RUN: opt < %s -indvars -loop-unroll -unroll-cprof=%p/unroll-by-profile.cp -S \
+; RUN:   | FileCheck %s
+; RUN: opt < %s -indvars -loop-unroll -unroll-cprof=%p/unroll-by-profile.cp \
+; RUN:   -unroll-cprof-version=0.95 -S | FileCheck %s -check-prefix=NOVER
+;
+; unroll-by-profile.cp is a trip count profile of this module over
+; three runs.  Nine in ten invocations of the loop in @sum run it 4
+; times, the rest 5 to 7 times.
+
+; The common trip count gets a fully unrolled copy of the loop; the
+; rest run the original.
+; CHECK: define internal i32 @sum(
+; CHECK: %tripcount.version = icmp eq i32 %{{.*}}, 3
+; CHECK: br i1 %tripcount.version, label
+; CHECK: loop.clone:
+; CHECK: %x.clone.3 = load
+; CHECK-NEXT: %s1.clone.3 = add
+; CHECK-NEXT: br label %done
+; CHECK: loop:
+; CHECK: br i1 %exitcond, label %loop, label
+
+; Without versioning, the loop is unrolled by the largest trip count
+; seen.
+; NOVER: define internal i32 @sum(
+; NOVER-NOT: tripcount.version
+; NOVER: %x.6 = load
+; NOVER: br i1 %exitcond.6, label %loop, label %done
+
+@buf = internal global [64 x i32] zeroinitializer
+
+define internal i32 @sum(i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s1, %loop ]
+  %p = getelementptr [64 x i32]* @buf, i32 0, i32 %i
+  %x = load i32* %p
+  %s1 = add i32 %s, %x
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %loop, label %done
+done:
+  ret i32 %s1
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  br label %outer
+outer:
+  %k = phi i32 [ 0, %entry ], [ %k1, %next ]
+  %t = phi i32 [ 0, %entry ], [ %t1, %next ]
+  %r = urem i32 %k, 10
+  %rare = icmp eq i32 %r, 0
+  br i1 %rare, label %long, label %short
+long:
+  %m = add i32 %argc, 4
+  br label %next
+short:
+  br label %next
+next:
+  %n = phi i32 [ %m, %long ], [ 4, %short ]
+  %v = call i32 @sum(i32 %n)
+  %t1 = add i32 %t, %v
+  %k1 = add i32 %k, 1
+  %c = icmp slt i32 %k1, 50
+  br i1 %c, label %outer, label %end
+end:
+  ret i32 %t1
+}
@@ -35,6 +35,7 @@
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetRegistry.h"
 #include "llvm/Target/TargetSelect.h"
+#include "llvm/Transforms/FDO.h"
 #include <memory>
 using namespace llvm;
 
@@ -101,6 +102,12 @@ DisableRedZone("disable-red-zone",
   cl::desc("Do not emit code that uses the red zone."),
   cl::init(false));
 
+static cl::opt<bool>
+FDOOrder("fdo-order",
+  cl::desc("Order functions for emission using a combined call profile "
+           "(see -FDOrder-cprof)"),
+  cl::init(false));
+
 static cl::opt<bool>
 NoImplicitFloats("no-implicit-float",
   cl::desc("Don't generate implicit floating point instructions (x86-only)"),
@@ -299,6 +306,9 @@ int main(int argc, char **argv) {
   else
     PM.add(new TargetData(&mod));
 
+  if (FDOOrder)
+    PM.add(createFDOFunctionOrderPass());
+
   // Override default to generate verbose assembly.
   Target.setAsmVerbosityDefault(true);
 
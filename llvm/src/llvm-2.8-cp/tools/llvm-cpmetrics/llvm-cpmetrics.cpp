@@ -16,12 +16,17 @@
 #include "llvm/Module.h"
 #include "llvm/Analysis/CPFactory.h"
 #include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPDrift.h"
+#include "llvm/Analysis/CPStats.h"
+#include "llvm/Analysis/CPPathIndex.h"
+#include "llvm/Analysis/CPServer.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/System/Signals.h"
 
@@ -45,19 +50,61 @@ namespace {
 	cl::opt<bool> Drift("drift",
 		cl::desc("Compute drift between first and second combined profiles"));
 
+	cl::opt<bool> DriftEMD("emd",
+		cl::desc("Add an earth-mover distance column to -drift output"));
+
+	cl::opt<unsigned> DriftThreads("j", cl::init(1),
+		cl::desc("Number of threads used to compute -drift"));
+
+	// Server mode: keep the module and loaded profiles resident and
+	// read commands (see CPServer.h) from stdin or a Unix domain socket
+	cl::opt<bool> Server("server",
+		cl::desc("Serve profile commands from stdin (or -socket)"));
+
+	cl::opt<std::string> SocketPath("socket", cl::value_desc("path"),
+		cl::desc("Unix domain socket for -server"));
+
+	// The CP classes only need the CFGs: read function bodies on demand
+	cl::opt<bool> LazyBitcode("lazy-bitcode", cl::init(true),
+		cl::desc("Read function bodies only while building profile structure"));
+
 	cl::opt<bool> Print("print",
 		cl::desc("print the profile"));
 
 	cl::opt<bool> Summary("summary",
 		cl::desc("print 1-line summary (default)"));
 
+	// hot paths of a combined path profile (see CPPathIndex.h)
+	cl::opt<unsigned> TopPaths("top-paths", cl::init(0), cl::value_desc("K"),
+		cl::desc("print the K hottest paths of each function"));
+
+	cl::opt<double> PathCoverage("path-coverage", cl::init(0),
+		cl::value_desc("fraction"),
+		cl::desc("print the hottest paths carrying this fraction of "
+             "each function's executions"));
+
+	cl::opt<CPPathRank> PathRank("path-rank", cl::init(CPRankMean),
+		cl::desc("Rank -top-paths/-path-coverage by"),
+		cl::values(
+			clEnumValN(CPRankMean, "mean", "mean executions per call"),
+			clEnumValN(CPRankQuantile, "quantile",
+                 "-path-quantile of executions per call"),
+			clEnumValN(CPRankCoverage, "coverage", "fraction of runs executed in"),
+			clEnumValEnd));
+
+	cl::opt<double> PathQuantile("path-quantile", cl::init(0.5),
+		cl::desc("Quantile for -path-rank=quantile"));
+
+	cl::opt<bool> PathBlocks("path-blocks",
+		cl::desc("print the blocks of each hot path"));
+
 	// Verbose: output specifics regarding which edges/ paths are merged
 	cl::opt<bool>
 		Verbose("v",
 		cl::desc("Spew extra info"));
 
 	// Profiling files to be merged into the "master" combined profiling files
-	cl::list<std::string> InputFilenames(cl::Positional, cl::OneOrMore,
+	cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
 		cl::desc("<input edge/path files>"));
 
   // ---------------------------------------------------------------------------
@@ -65,16 +112,27 @@ namespace {
   // load a module's bitcode into memory
 	Module* loadModule() 
   {
+    TimeRegion timer(CPStats::getTimer(CPTimeBitcode));
 		LLVMContext &Context = getGlobalContext();
-    Module* M;
+    Module* M = NULL;
     
 		// Read in the bitcode file ...
 		std::string ErrorMessage;
 		if (MemoryBuffer *Buffer = MemoryBuffer::getFileOrSTDIN(BitcodeFile,
                                                             &ErrorMessage)) 
     {
-			M = ParseBitcodeFile(Buffer, Context, &ErrorMessage);
-			delete Buffer;
+      if(LazyBitcode)
+      {
+        // the module owns the buffer on success
+        M = getLazyBitcodeModule(Buffer, Context, &ErrorMessage);
+        if(M == NULL)
+          delete Buffer;
+      }
+      else
+      {
+        M = ParseBitcodeFile(Buffer, Context, &ErrorMessage);
+        delete Buffer;
+      }
 		}
 
 		// Ensure the module has been loaded
@@ -93,13 +151,14 @@ CombinedProfile* getCP(const std::string& filename, Module& M)
   CombinedProfile* rc = NULL;
   CPFactory fact = CPFactory(M);
 
-  if( !fact.buildProfiles(InputFilenames[0]) )
+  if( !fact.buildProfiles(filename) )
   {
     errs() << "Failed to read profile\n";
     return(rc);
   }
   
-  int numProfs = fact.hasEdgeCP() + fact.hasPathCP() + fact.hasCallCP();
+  int numProfs = fact.hasEdgeCP() + fact.hasPathCP() + fact.hasCallCP()
+    + fact.hasTripCountCP() + fact.hasValueCP();
   if(numProfs != 1)
   {
     errs() << "Error: CP file has more than one type of profile\n";
@@ -109,10 +168,53 @@ CombinedProfile* getCP(const std::string& filename, Module& M)
   if(fact.hasEdgeCP()) rc = fact.takeEdgeCP();
   if(fact.hasPathCP()) rc = fact.takePathCP();
   if(fact.hasCallCP()) rc = fact.takeCallCP();
+  if(fact.hasTripCountCP()) rc = fact.takeTripCountCP();
+  if(fact.hasValueCP()) rc = fact.takeValueCP();
   
   return(rc);
 }
 
+// -top-paths and -path-coverage
+void printHotPaths(CombinedPathProfile& cpp, raw_ostream& stream)
+{
+  CPPathIndex index(cpp, PathRank, PathQuantile);
+  const char* rank = CPPathIndex::getRankName(PathRank);
+
+  std::vector<FunctionIndex> functions;
+  index.getFunctions(functions);
+  for(unsigned i = 0; i < functions.size(); i++)
+  {
+    FunctionIndex f = functions[i];
+    CPHotPathVec paths;
+    if(PathCoverage > 0)
+      index.getCoveringPaths(f, PathCoverage, paths);
+    if( (TopPaths > 0) && ((PathCoverage == 0) || (paths.size() > TopPaths)) )
+      index.getTopPaths(f, TopPaths, paths);
+
+    Function* F = cpp.getFunction(f);
+    stream << "function " << f << " "
+           << (F ? F->getNameStr() : std::string("<unknown>")) << ": "
+           << paths.size() << " of " << index.getPaths(f).size()
+           << " paths\n";
+
+    for(unsigned p = 0; p < paths.size(); p++)
+    {
+      stream << "  path " << paths[p].path << " " << rank << " "
+             << format("%.4f", paths[p].score) << " freq "
+             << format("%.4f", paths[p].freq) << "\n";
+      if(!PathBlocks)
+        continue;
+
+      const PathBlockVector& blocks = index.getPathBlocks(f, paths[p].path);
+      stream << "   ";
+      for(unsigned b = 0; b < blocks.size(); b++)
+        stream << " " << (blocks[b]->hasName() ? blocks[b]->getNameStr()
+                          : std::string("<unnamed>"));
+      stream << "\n";
+    }
+  }
+}
+
 int main(int argc, char *argv[]) 
 {
 	CombinedProfile *cp1 = NULL;
@@ -129,7 +231,8 @@ int main(int argc, char *argv[])
   cl::ParseCommandLineOptions(argc, argv,
 		"llvm combined edge/path profile analyzer\n");
 
-  if( !Summary && !Stats && !Drift && !Print )
+  bool hotPaths = (TopPaths > 0) || (PathCoverage > 0);
+  if( !Summary && !Stats && !Drift && !Print && !hotPaths )
   {
     // no output selected, set default
     Summary = true;
@@ -139,6 +242,23 @@ int main(int argc, char *argv[])
   Module* currentModule = loadModule();
   if( currentModule == NULL ) return 1;
 
+  // Server mode: everything else comes from the command stream
+  if(Server)
+  {
+    CPServer server(*currentModule, DriftThreads);
+    bool ok = true;
+
+    if(SocketPath.empty())
+      server.serve(stdin, outs());
+    else
+      ok = server.serveSocket(SocketPath);
+
+    server.dropAll();
+    delete currentModule;
+    CPFactory::freeStaticData();
+    return(ok ? 0 : 1);
+  }
+
   CPFactory fact = CPFactory(*currentModule); 
 
   // check number of input files and load the profiles
@@ -158,7 +278,7 @@ int main(int argc, char *argv[])
       errs() << "Failed to load two profiles\n";
       return(-1);
     }
-    if( cp1->getProfilingType() != cp1->getProfilingType() )
+    if( cp1->getProfilingType() != cp2->getProfilingType() )
     {
       errs() << "Profiles are not of the same type\n";
       return(-1);
@@ -206,13 +326,34 @@ int main(int argc, char *argv[])
     VERBOSE(errs() << "end print\n");
   }
 
+  //
+  // Hot paths
+  //
+  if(hotPaths)
+  {
+    VERBOSE(errs() << "Printing Hot Paths:\n");
+    if(cp1->getProfilingType() == CombinedPathInfo)
+      printHotPaths(*(CombinedPathProfile*)cp1, outs());
+    else
+      errs() << "error: hot paths need a combined path profile\n";
+    VERBOSE(errs() << "end hot paths\n");
+  }
+
   //
   // Drift
   //
   if(Drift)
   {
     VERBOSE(errs() << "Printing Drift:\n");
-    cp1->printDrift(*cp2, outs());
+    CPDrift drift(DriftThreads);
+
+    // path histograms are matched by PathID, not by index
+    if(cp1->getProfilingType() == CombinedPathInfo)
+      drift.compare(*(CombinedPathProfile*)cp1, *(CombinedPathProfile*)cp2);
+    else
+      drift.compare(*cp1, *cp2);
+
+    drift.print(outs(), cp1->getNameStr(), DriftEMD);
     VERBOSE(errs() << "end drift\n");
   }
 
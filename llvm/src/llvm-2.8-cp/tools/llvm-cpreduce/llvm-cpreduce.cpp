@@ -0,0 +1,489 @@
+//===- llvm-cpreduce.cpp - Merge very many combined profiles --------------===//
+//
+//                      The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Merge more profiles than fit in memory at once.  llvm-cprof (through
+// CPFactory) holds every input profile until the merge, so this tool
+// merges in a tree instead: the inputs are split into groups of at most
+// -fan-in, each group is merged by an llvm-cprof process into a
+// temporary profile, and the temporaries are merged the same way until
+// one profile is left.  No process holds more than -fan-in profiles.
+//
+// The inputs are sorted by name and the groups are fixed by their
+// position, so the same inputs and -fan-in always give the same tree
+// and the same result.  Weights and histogram sums are exact at every
+// level; only bin shapes depend on the tree, through re-binning.  A
+// group whose inputs are all merged can run at once, so up to -j
+// groups in different subtrees run side by side.
+//
+// Temporaries go in -tmp (default <output>.reduce), each written under
+// a '.part' name and renamed when done.  If the reduction is stopped,
+// running it again with the same inputs picks up from the temporaries
+// that were finished.  The directory records the inputs and options,
+// and a different reduction will not reuse it.  A temporary is deleted
+// once the group that reads it is done (unless -keep-temps).
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/SystemUtils.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/System/Path.h"
+#include "llvm/System/Program.h"
+#include "llvm/System/Signals.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <list>
+#include <vector>
+
+#define VERBOSE(s) if( Verbose ) { s; }
+
+using namespace llvm;
+
+namespace {
+	// Uninstrumented bitcode file, passed on to llvm-cprof
+	cl::opt<std::string> BitcodeFile(cl::Positional,
+		cl::desc("<program bitcode file>"), cl::Required);
+
+	// Combined (or raw) profiles to merge
+	cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
+		cl::desc("<input profiles>"));
+
+	cl::opt<std::string> InputList("list", cl::value_desc("filename"),
+		cl::desc("Also merge the profiles named in this file, one per line"));
+
+	cl::opt<std::string> OutFile("o", cl::init("combined.cp"),
+		cl::value_desc("filename"),
+		cl::desc("Merged combined profile"));
+
+	cl::opt<unsigned> FanIn("fan-in", cl::init(16),
+		cl::desc("Most profiles merged by one llvm-cprof process"));
+
+	cl::opt<unsigned> Jobs("j", cl::init(1),
+		cl::desc("Number of llvm-cprof processes run at once"));
+
+	cl::opt<std::string> TmpDir("tmp", cl::value_desc("directory"),
+		cl::desc("Directory for partial merges (default <output>.reduce)"));
+
+	cl::opt<bool> KeepTemps("keep-temps", cl::init(false),
+		cl::desc("Keep the partial merges"));
+
+	cl::opt<std::string> CProfPath("cprof", cl::value_desc("path"),
+		cl::desc("llvm-cprof to run (default: next to this tool, or PATH)"));
+
+	// passed on to llvm-cprof
+	cl::opt<unsigned> BinCount("bc", cl::init(0), cl::value_desc("number"),
+		cl::desc("Number of bins for constructed combined profiles."));
+
+	cl::opt<bool> Indexed("indexed", cl::init(false),
+		cl::desc("Write an indexed combined profile"));
+
+	// Verbose: report every merge
+	cl::opt<bool>
+  Verbose("v", cl::init(false),
+          cl::desc("Verbose output."));
+
+  // ---------------------------------------------------------------------------
+
+  // One llvm-cprof run: merge 'inputs' (item numbers) into 'out'.
+  // Items [0,inputs) are the input files; item inputs+g is group g.
+  struct MergeGroup {
+    std::vector<unsigned> inputs;
+    std::string out;
+    std::string log;
+    bool needed;
+    bool done;
+    sys::Program* process;
+  };
+
+  class Reducer {
+  public:
+    Reducer(const std::vector<std::string>& files, const sys::Path& cprof,
+            const sys::Path& tmp) :
+      _files(files), _cprof(cprof), _tmp(tmp), _failed(false) {};
+    ~Reducer();
+
+    void plan();
+    // true if the temporaries are from this same reduction
+    bool resume();
+    bool run();
+    void cleanUp();
+
+  private:
+    std::vector<std::string> _files;
+    sys::Path _cprof;
+    sys::Path _tmp;
+    std::vector<MergeGroup> _groups;
+    std::list<unsigned> _running;
+    bool _failed;
+
+    bool isGroup(unsigned item) const {return(item >= _files.size());};
+    MergeGroup& group(unsigned item) {return(_groups[item - _files.size()]);};
+    const std::string& path(unsigned item)
+    {return( isGroup(item) ? group(item).out : _files[item] );};
+
+    std::string manifest() const;
+    bool ready(const MergeGroup& g);
+    bool launch(MergeGroup& g);
+    void waitOldest();
+  };
+
+  Reducer::~Reducer()
+  {
+    for(unsigned g = 0; g < _groups.size(); g++)
+      if(_groups[g].process != NULL)
+        delete _groups[g].process;
+  }
+
+
+  // Group each level by position.  A group left with one item at the
+  // end of a level moves up unmerged; the last group writes OutFile.
+  void Reducer::plan()
+  {
+    unsigned fanIn = std::max(2u, (unsigned)FanIn);
+    std::vector<unsigned> level;
+    for(unsigned i = 0; i < _files.size(); i++)
+      level.push_back(i);
+
+    unsigned depth = 0;
+    do
+    {
+      depth++;
+      std::vector<unsigned> next;
+      for(unsigned first = 0, g = 0; first < level.size(); first += fanIn, g++)
+      {
+        unsigned last = std::min((unsigned)level.size(), first + fanIn);
+        if( (last - first == 1) && (level.size() > 1) )
+        {
+          next.push_back(level[first]);
+          continue;
+        }
+
+        MergeGroup mg;
+        mg.inputs.assign(level.begin() + first, level.begin() + last);
+        char name[32];
+        snprintf(name, sizeof(name), "L%u-%05u", depth, g);
+        sys::Path out(_tmp);
+        out.appendComponent(name);
+        mg.log = out.str() + ".log";
+        mg.out = out.str() + ".cp";
+        mg.needed = true;
+        mg.done = false;
+        mg.process = NULL;
+
+        next.push_back(_files.size() + _groups.size());
+        _groups.push_back(mg);
+      }
+      level.swap(next);
+    } while(level.size() > 1);
+
+    _groups.back().out = OutFile;
+  }
+
+
+  std::string Reducer::manifest() const
+  {
+    std::string s;
+    raw_string_ostream os(s);
+    os << "fan-in " << std::max(2u, (unsigned)FanIn) << "\nbc " << BinCount
+       << "\nindexed " << Indexed << "\nbitcode " << BitcodeFile
+       << "\noutput " << OutFile << "\n";
+    for(unsigned i = 0; i < _files.size(); i++)
+      os << _files[i] << "\n";
+    return(os.str());
+  }
+
+
+  // Check (or start) the manifest in the temporary directory, and mark
+  // the groups already done.  A group isn't needed if the group that
+  // reads it is done.
+  bool Reducer::resume()
+  {
+    std::string err;
+    if(_tmp.createDirectoryOnDisk(true, &err))
+    {
+      errs() << "error: " << err << "\n";
+      return(false);
+    }
+
+    sys::Path manifestPath(_tmp);
+    manifestPath.appendComponent("manifest");
+    std::string expected = manifest();
+
+    bool resuming = false;
+    if(manifestPath.exists())
+    {
+      MemoryBuffer* buf = MemoryBuffer::getFile(manifestPath.str(), &err);
+      if( (buf == NULL) || (buf->getBuffer() != expected) )
+      {
+        errs() << "error: '" << _tmp.str() << "' holds a different reduction;"
+               << " remove it or use another -tmp\n";
+        delete buf;
+        return(false);
+      }
+      delete buf;
+      resuming = true;
+    }
+    else
+    {
+      std::ofstream os(manifestPath.c_str());
+      os << expected;
+      if(!os)
+      {
+        errs() << "error: cannot write '" << manifestPath.str() << "'\n";
+        return(false);
+      }
+    }
+
+    for(unsigned g = _groups.size(); g-- > 0; )
+    {
+      MergeGroup& mg = _groups[g];
+      mg.done = resuming && sys::Path(mg.out).exists();
+      if(!mg.needed || mg.done)
+        for(unsigned i = 0; i < mg.inputs.size(); i++)
+          if(isGroup(mg.inputs[i]))
+            group(mg.inputs[i]).needed = false;
+    }
+
+    unsigned done = 0;
+    for(unsigned g = 0; g < _groups.size(); g++)
+      if(!_groups[g].needed || _groups[g].done)
+        done++;
+    if(resuming)
+      outs() << "resuming: " << done << " of " << _groups.size()
+             << " merges already done\n";
+    return(true);
+  }
+
+
+  bool Reducer::ready(const MergeGroup& g)
+  {
+    for(unsigned i = 0; i < g.inputs.size(); i++)
+      if( isGroup(g.inputs[i]) && !group(g.inputs[i]).done )
+        return(false);
+    return(true);
+  }
+
+
+  bool Reducer::launch(MergeGroup& g)
+  {
+    std::vector<std::string> args;
+    args.push_back(_cprof.str());
+    args.push_back(BitcodeFile);
+    args.push_back("-cpFile=" + g.out + ".part");
+    if(BinCount > 0)
+    {
+      char bc[32];
+      snprintf(bc, sizeof(bc), "-bc=%u", (unsigned)BinCount);
+      args.push_back(bc);
+    }
+    if( Indexed && (&g == &_groups.back()) )
+      args.push_back("-indexed");
+    for(unsigned i = 0; i < g.inputs.size(); i++)
+      args.push_back(path(g.inputs[i]));
+
+    std::vector<const char*> argv;
+    for(unsigned i = 0; i < args.size(); i++)
+      argv.push_back(args[i].c_str());
+    argv.push_back(NULL);
+
+    // llvm-cprof reports on stderr: keep it out of the way
+    sys::Path null;
+    sys::Path log(g.log);
+    const sys::Path* redirects[3] = { &null, &log, &log };
+
+    VERBOSE(errs() << "merging " << g.inputs.size() << " into " << g.out
+            << "\n");
+    std::string err;
+    g.process = new sys::Program();
+    if(!g.process->Execute(_cprof, &argv[0], 0, redirects, 0, &err))
+    {
+      errs() << "error: cannot run '" << _cprof.str() << "': " << err << "\n";
+      delete g.process;
+      g.process = NULL;
+      return(false);
+    }
+    _running.push_back(&g - &_groups[0]);
+    return(true);
+  }
+
+
+  // Wait for the oldest llvm-cprof; on success, move its output into
+  // place and delete the temporaries it read.
+  void Reducer::waitOldest()
+  {
+    MergeGroup& g = _groups[_running.front()];
+    _running.pop_front();
+
+    std::string err;
+    int rc = g.process->Wait(0, &err);
+    delete g.process;
+    g.process = NULL;
+
+    sys::Path part(g.out + ".part");
+    if( (rc != 0) || part.renamePathOnDisk(sys::Path(g.out), &err) )
+    {
+      errs() << "error: merge into '" << g.out << "' failed";
+      if(rc != 0)
+        errs() << " (exit " << rc << "); see '" << g.log << "'";
+      else
+        errs() << ": " << err;
+      errs() << "\n";
+      _failed = true;
+      return;
+    }
+
+    g.done = true;
+    sys::Path(g.log).eraseFromDisk();
+    if(!KeepTemps)
+      for(unsigned i = 0; i < g.inputs.size(); i++)
+        if(isGroup(g.inputs[i]))
+          sys::Path(group(g.inputs[i]).out).eraseFromDisk();
+  }
+
+
+  // Start every needed group whose inputs are done, up to -j at a
+  // time.  Groups are in level order, so a group's inputs are always
+  // started before it.
+  bool Reducer::run()
+  {
+    unsigned jobs = std::max(1u, (unsigned)Jobs);
+    std::list<unsigned> pending;
+    for(unsigned g = 0; g < _groups.size(); g++)
+      if(_groups[g].needed && !_groups[g].done)
+        pending.push_back(g);
+
+    unsigned total = pending.size();
+    unsigned finished = 0;
+    while( !_failed && (!pending.empty() || !_running.empty()) )
+    {
+      bool started = false;
+      for(std::list<unsigned>::iterator P = pending.begin();
+          (P != pending.end()) && (_running.size() < jobs); )
+      {
+        if(!ready(_groups[*P]))
+        {
+          ++P;
+          continue;
+        }
+        if(!launch(_groups[*P]))
+        {
+          _failed = true;
+          break;
+        }
+        P = pending.erase(P);
+        started = true;
+      }
+
+      if( !started && !_running.empty() )
+      {
+        waitOldest();
+        finished++;
+        VERBOSE(errs() << finished << " of " << total << " merges done\n");
+      }
+    }
+
+    // let the others finish, so their outputs are complete
+    while(!_running.empty())
+      waitOldest();
+
+    return(!_failed);
+  }
+
+
+  // only the files this reduction made: -tmp may hold others
+  void Reducer::cleanUp()
+  {
+    if(KeepTemps)
+      return;
+    for(unsigned g = 0; g + 1 < _groups.size(); g++)
+      sys::Path(_groups[g].out).eraseFromDisk();
+    sys::Path manifestPath(_tmp);
+    manifestPath.appendComponent("manifest");
+    manifestPath.eraseFromDisk();
+    _tmp.eraseFromDisk();
+  }
+
+
+  sys::Path findCProf(const char* argv0)
+  {
+    if(!CProfPath.empty())
+      return(sys::Path(CProfPath));
+
+    sys::Path cprof = FindExecutable("llvm-cprof", argv0,
+                                     (void*)(intptr_t)findCProf);
+    if(cprof.isEmpty())
+      cprof = sys::Program::FindProgramByName("llvm-cprof");
+    return(cprof);
+  }
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  // Print a stack trace if we signal out.
+  sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+
+  // Call llvm_shutdown() on exit.
+  llvm_shutdown_obj Y;
+
+  cl::ParseCommandLineOptions(argc, argv,
+                              "llvm out-of-core combined profile merge.\n");
+
+  std::vector<std::string> files(InputFilenames.begin(), InputFilenames.end());
+  if(!InputList.empty())
+  {
+    std::ifstream list(InputList.c_str());
+    if(!list)
+    {
+      errs() << "error: cannot read '" << InputList << "'\n";
+      return(1);
+    }
+    std::string line;
+    while(std::getline(list, line))
+      if(!line.empty())
+        files.push_back(line);
+  }
+
+  if(files.empty())
+  {
+    errs() << "error: no input profiles\n";
+    return(1);
+  }
+  std::sort(files.begin(), files.end());
+
+  sys::Path cprof = findCProf(argv[0]);
+  if(cprof.isEmpty())
+  {
+    errs() << "error: cannot find llvm-cprof; use -cprof\n";
+    return(1);
+  }
+
+  sys::Path tmp(TmpDir.empty() ? OutFile + ".reduce" : TmpDir);
+  Reducer reducer(files, cprof, tmp);
+  reducer.plan();
+  if(!reducer.resume())
+    return(1);
+
+  if(!reducer.run())
+  {
+    errs() << "error: reduction stopped; run again to resume\n";
+    return(1);
+  }
+
+  reducer.cleanUp();
+  VERBOSE(errs() << "merged " << files.size() << " profiles into "
+          << OutFile << "\n");
+  return(0);
+}
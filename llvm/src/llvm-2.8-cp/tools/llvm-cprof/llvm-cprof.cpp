@@ -15,16 +15,22 @@
 #include "llvm/LLVMContext.h"
 #include "llvm/Module.h"
 #include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPConvergence.h"
 #include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPServer.h"
+#include "llvm/Analysis/CPStats.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/System/Path.h"
 #include "llvm/System/Signals.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <vector>
 #include <map>
@@ -43,13 +49,56 @@ namespace {
 		cl::init("combined.cp"), cl::value_desc("filename"),
 		cl::desc("Combined edge profiling cumulative storage file."));
 
+	// Indexed output can be read lazily by the optimization passes
+	cl::opt<bool> Indexed("indexed", cl::init(false),
+		cl::desc("Write indexed combined profiles"));
+
 	// Verbose: output specifics regarding which edges/ paths are merged
 	cl::opt<bool> 
   Verbose("v", cl::init(false),
           cl::desc("Verbose output."));
 
+	// Server mode: keep the module and loaded profiles resident and
+	// read commands (see CPServer.h) from stdin or a Unix domain socket
+	cl::opt<bool> Server("server",
+		cl::desc("Serve profile commands from stdin (or -socket)"));
+
+	cl::opt<std::string> SocketPath("socket", cl::value_desc("path"),
+		cl::desc("Unix domain socket for -server"));
+
+	// The CP classes only need the CFGs: read function bodies on demand
+	cl::opt<bool> LazyBitcode("lazy-bitcode", cl::init(true),
+		cl::desc("Read function bodies only while building profile structure"));
+
+	// Convergence report: the first run after which -converge-window
+	// runs in a row drifted less than -converge (CPConvergence.h)
+	cl::opt<double> Converge("converge", cl::init(0), cl::value_desc("drift"),
+		cl::desc("Report when raw runs stop moving the profile by this much"));
+
+	cl::opt<unsigned> ConvergeWindow("converge-window", cl::init(10),
+		cl::desc("Runs in a row that must be under -converge"));
+
+	// Time decay: an input's histograms count for 2^(-age/half-life).
+	// Ages are in the same unit as -half-life; without -age they are
+	// days since the newest input was last modified.
+	cl::opt<double> HalfLife("half-life", cl::init(0), cl::value_desc("age"),
+		cl::desc("Age at which an input's weight is halved (0: no decay)"));
+
+	cl::list<double> Ages("age", cl::CommaSeparated, cl::value_desc("a,b,..."),
+		cl::desc("Age of each input, in order (default: from file times)"));
+
+	// Counters only; -time-cprof also times each phase (CPStats.h)
+	cl::opt<bool,true> Stats("stats", cl::location(CPStats::Counting),
+		cl::desc("Print combined profiling counters"));
+
+	// Update mode: fold raw runs into the existing -cpFile in place
+	// (CombinedProfile::updateProfile) instead of rebuilding it.  The
+	// file keeps its format; -indexed is ignored.
+	cl::opt<bool> Update("update", cl::init(false),
+		cl::desc("Add raw profiles to the existing -cpFile in place"));
+
 	// Profiling files to be merged into the "master" combined profiling files
-	cl::list<std::string> InputFilenames(cl::Positional, cl::OneOrMore,
+	cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
 		cl::desc("<input edge/path files>"));
 
   // ---------------------------------------------------------------------------
@@ -57,6 +106,7 @@ namespace {
   // load a module's bitcode into memory
 	Module* loadModule() 
   {
+    TimeRegion timer(CPStats::getTimer(CPTimeBitcode));
 		LLVMContext &Context = getGlobalContext();
     Module* M = NULL;
     
@@ -65,8 +115,18 @@ namespace {
 		if (MemoryBuffer *Buffer = MemoryBuffer::getFileOrSTDIN(BitcodeFile,
                                                             &ErrorMessage)) 
     {
-			M = ParseBitcodeFile(Buffer, Context, &ErrorMessage);
-			delete Buffer;
+      if(LazyBitcode)
+      {
+        // the module owns the buffer on success
+        M = getLazyBitcodeModule(Buffer, Context, &ErrorMessage);
+        if(M == NULL)
+          delete Buffer;
+      }
+      else
+      {
+        M = ParseBitcodeFile(Buffer, Context, &ErrorMessage);
+        delete Buffer;
+      }
 		}
 
 		// Ensure the module has been loaded
@@ -77,6 +137,173 @@ namespace {
 		return(M);
 	}
 
+  // the decayed weight of each input; false if an age is unknown
+  bool getDecayWeights(std::vector<double>& weights)
+  {
+    std::vector<double> ages(InputFilenames.size(), 0);
+    if(!Ages.empty())
+    {
+      if(Ages.size() != InputFilenames.size())
+      {
+        errs() << "error: " << Ages.size() << " ages for "
+               << InputFilenames.size() << " inputs\n";
+        return(false);
+      }
+      for(unsigned i = 0; i < Ages.size(); i++)
+        ages[i] = Ages[i];
+    }
+    else
+    {
+      // days before the newest input
+      std::vector<uint64_t> times(InputFilenames.size());
+      uint64_t newest = 0;
+      for(unsigned i = 0; i < InputFilenames.size(); i++)
+      {
+        std::string err;
+        sys::PathWithStatus path(InputFilenames[i]);
+        const sys::FileStatus* status = path.getFileStatus(false, &err);
+        if(status == NULL)
+        {
+          errs() << InputFilenames[i] << ": " << err << "\n";
+          return(false);
+        }
+        times[i] = status->getTimestamp().toEpochTime();
+        newest = std::max(newest, times[i]);
+      }
+      for(unsigned i = 0; i < times.size(); i++)
+        ages[i] = (newest - times[i]) / 86400.0;
+    }
+
+    for(unsigned i = 0; i < ages.size(); i++)
+    {
+      weights.push_back(CPFactory::decayWeight(ages[i], HalfLife));
+      VERBOSE(errs() << InputFilenames[i] << ": age " << ages[i]
+              << ", weight " << weights.back() << "\n");
+    }
+    return(true);
+  }
+
+  // Fold the raw runs into the profiles in CPOutFile, and write them
+  // back in the same format.  Only the histograms the runs reach are
+  // changed; the file is replaced once everything is written.
+  bool updateProfiles(Module& M)
+  {
+    CPFactory fact(M);
+    if(!fact.loadProfiles(CPOutFile))
+    {
+      errs() << "error: no combined profiles in '" << CPOutFile << "'\n";
+      return(false);
+    }
+
+    // in output order; indexed by the raw type they take
+    CombinedProfile* cps[5] = { fact.takeEdgeCP(), fact.takePathCP(),
+                                fact.takeCallCP(), fact.takeTripCountCP(),
+                                fact.takeValueCP() };
+    bool ok = true;
+    for(unsigned i = 0; ok && (i < InputFilenames.size()); i++)
+    {
+      FILE* file = fopen(InputFilenames[i].c_str(), "rb");
+      if(!file)
+      {
+        errs() << "error: cannot open '" << InputFilenames[i] << "'\n";
+        ok = false;
+        break;
+      }
+
+      ProfilingType profType;
+      while( ok && (fread(&profType, sizeof(ProfilingType), 1, file) > 0) )
+      {
+        int cp = -1;
+        switch(profType)
+        {
+        case ArgumentInfo:
+          ok = CPFactory::skipArgumentInfo(file);
+          continue;
+        case EdgeInfo:      cp = 0; break;
+        case PathInfo:      cp = 1; break;
+        case CallInfo:      cp = 2; break;
+        case TripCountInfo: cp = 3; break;
+        case ValueInfo:     cp = 4; break;
+        default:
+          errs() << "error: -update takes raw profiles; '"
+                 << InputFilenames[i] << "' has "
+                 << CPFactory::profilingTypeToString(profType) << "\n";
+          ok = false;
+          continue;
+        }
+
+        if(cps[cp] == NULL)
+        {
+          errs() << "error: no combined profile for "
+                 << CPFactory::profilingTypeToString(profType) << " in '"
+                 << CPOutFile << "'\n";
+          ok = false;
+        }
+        else if(!cps[cp]->updateProfile(file))
+        {
+          errs() << "error: cannot read "
+                 << CPFactory::profilingTypeToString(profType) << " in '"
+                 << InputFilenames[i] << "'\n";
+          ok = false;
+        }
+      }
+      fclose(file);
+      VERBOSE(if(ok) errs() << "Added '" << InputFilenames[i] << "'\n");
+    }
+
+    // the profiles may still be reading the old file: write a new one
+    bool indexed = fact.loadedIndexed();
+    std::string tmpFile = CPOutFile + ".tmp";
+    FILE* file = ok ? fopen(tmpFile.c_str(), "wb") : NULL;
+    if( ok && (file == NULL) )
+    {
+      errs() << "  error: cannot open '" << tmpFile << "' for writing.\n";
+      ok = false;
+    }
+    if(ok)
+      ok = fact.getFunctionKeys().serialize(file);
+
+    for(unsigned i = 0; i < 5; i++)
+    {
+      if(cps[i] == NULL)
+        continue;
+      if(ok)
+      {
+        unsigned written = indexed ? cps[i]->serializeIndexed(file)
+          : cps[i]->serialize(file);
+        // an empty profile writes 0 histograms too
+        if( (written == 0) && ferror(file) )
+        {
+          errs() << "  error: cannot write " << cps[i]->getNameStr()
+                 << " to '" << tmpFile << "'\n";
+          ok = false;
+        }
+        VERBOSE(if(ok) errs() << cps[i]->getNameStr() << ": weight "
+                << format("%.2f", cps[i]->getTotalWeight()) << ", wrote "
+                << written << " histograms.\n");
+      }
+      delete cps[i];
+    }
+
+    if(file != NULL)
+    {
+      CPStats::count(CPBytesWritten, ftell(file));
+      if( (fclose(file) != 0) && ok )
+      {
+        errs() << "  error: cannot write '" << tmpFile << "'\n";
+        ok = false;
+      }
+      if(!ok)
+        remove(tmpFile.c_str());
+    }
+    if( ok && (rename(tmpFile.c_str(), CPOutFile.c_str()) != 0) )
+    {
+      errs() << "  error: cannot replace '" << CPOutFile << "'\n";
+      ok = false;
+    }
+    return(ok);
+  }
+
 } // namespace
 
 int main(int argc, char *argv[]) 
@@ -97,10 +324,75 @@ int main(int argc, char *argv[])
   Module* currentModule = loadModule();
   if( currentModule == NULL ) return 1;
   
+  // Server mode: everything else comes from the command stream
+  if(Server)
+  {
+    CPServer server(*currentModule);
+    bool ok = true;
+
+    if(SocketPath.empty())
+      server.serve(stdin, outs());
+    else
+      ok = server.serveSocket(SocketPath);
+
+    server.dropAll();
+    delete currentModule;
+    CPFactory::freeStaticData();
+    return(ok ? 0 : 1);
+  }
+
+  if(InputFilenames.size() == 0)
+  {
+    errs() << "error: no input profiles\n";
+    return(1);
+  }
+
+  // Feed the raw runs to the monitor in order
+  if(Converge > 0)
+  {
+    CPConvergence monitor(*currentModule);
+    unsigned convergedAt = 0;
+    for(unsigned i = 0; i < InputFilenames.size(); i++)
+    {
+      if(!monitor.addRun(InputFilenames[i]))
+      {
+        errs() << "Failed to read '" << InputFilenames[i] << "'\n";
+        return(-1);
+      }
+      VERBOSE(errs() << "run " << monitor.runs() << " (" << InputFilenames[i]
+              << "): drift " << monitor.lastDrift() << "\n");
+      if( (convergedAt == 0) && monitor.converged(Converge, ConvergeWindow) )
+        convergedAt = monitor.runs();
+    }
+
+    if(convergedAt > 0)
+      outs() << "converged after " << convergedAt << " of "
+             << monitor.runs() << " runs\n";
+    else
+      outs() << "not converged after " << monitor.runs() << " runs (drift "
+             << monitor.lastDrift() << ")\n";
+  }
+
+  if(Update)
+  {
+    bool ok = updateProfiles(*currentModule);
+    delete currentModule;
+    CPFactory::freeStaticData();
+    return(ok ? 0 : -1);
+  }
+
+  std::vector<double> weights;
+  if( (HalfLife > 0) && !getDecayWeights(weights) )
+  {
+    delete currentModule;
+    return(-1);
+  }
+
+  FilenameVec inputs(InputFilenames.begin(), InputFilenames.end());
   CPFactory fact = CPFactory(*currentModule); 
   
   // build the combined profile(s)
-  if( !fact.buildProfiles(InputFilenames) )
+  if( !fact.buildProfiles(inputs, weights) )
   {
     errs() << "Failed to read profiles\n";
     return(-1);
@@ -119,6 +411,10 @@ int main(int argc, char *argv[])
     return -1;
   }
   
+  // the identity of each function, so the profiles can be used with
+  // later builds
+  fact.getFunctionKeys().serialize(file);
+
   // Write the combined edge profile
   if(fact.hasEdgeCP())
   {
@@ -126,7 +422,8 @@ int main(int argc, char *argv[])
     VERBOSE(errs() << "CEP: " << cepOut->size() << " edges\n");
     VERBOSE(errs() << "Writing combined edge profile to '" 
             << CPOutFile.c_str() << "'\n");
-    unsigned written = cepOut->serialize(file);
+    unsigned written = Indexed ? cepOut->serializeIndexed(file) 
+      : cepOut->serialize(file);
     VERBOSE(errs() << "CEP: wrote " << written << " histograms.\n");
     delete cepOut;
   }
@@ -139,7 +436,8 @@ int main(int argc, char *argv[])
             << " functions, " << cppOut->size() << "paths\n");
     VERBOSE(errs() << "Writing combined path profile to '" 
             << CPOutFile.c_str() << "'\n");
-    unsigned written = cppOut->serialize(file);
+    unsigned written = Indexed ? cppOut->serializeIndexed(file) 
+      : cppOut->serialize(file);
     VERBOSE(errs() << "CPP: wrote " << written << " histograms.\n");
     delete cppOut;
   }
@@ -151,11 +449,39 @@ int main(int argc, char *argv[])
     VERBOSE(errs() << "CCP: " << ccpOut->size() << " BBs with calls\n");
     VERBOSE(errs() << "Writing combined call profile to '" 
             << CPOutFile.c_str() << "'\n");
-    unsigned written = ccpOut->serialize(file);
+    unsigned written = Indexed ? ccpOut->serializeIndexed(file) 
+      : ccpOut->serialize(file);
     VERBOSE(errs() << "CCP: wrote " << written << " histograms.\n");
     delete ccpOut;
   }
+
+  // write the combined trip count profile
+  if(fact.hasTripCountCP())
+  {
+    CombinedTripCountProfile* ctpOut = fact.takeTripCountCP();
+    VERBOSE(errs() << "CTP: " << ctpOut->size() << " loops\n");
+    VERBOSE(errs() << "Writing combined trip count profile to '" 
+            << CPOutFile.c_str() << "'\n");
+    unsigned written = Indexed ? ctpOut->serializeIndexed(file) 
+      : ctpOut->serialize(file);
+    VERBOSE(errs() << "CTP: wrote " << written << " histograms.\n");
+    delete ctpOut;
+  }
+
+  // write the combined value profile
+  if(fact.hasValueCP())
+  {
+    CombinedValueProfile* cvpOut = fact.takeValueCP();
+    VERBOSE(errs() << "CVP: " << cvpOut->size() << " histograms\n");
+    VERBOSE(errs() << "Writing combined value profile to '" 
+            << CPOutFile.c_str() << "'\n");
+    unsigned written = Indexed ? cvpOut->serializeIndexed(file) 
+      : cvpOut->serialize(file);
+    VERBOSE(errs() << "CVP: wrote " << written << " histograms.\n");
+    delete cvpOut;
+  }
   
+  CPStats::count(CPBytesWritten, ftell(file));
   fclose(file);
   
   // clean up loaded module
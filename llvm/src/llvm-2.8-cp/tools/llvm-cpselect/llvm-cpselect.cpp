@@ -0,0 +1,753 @@
+//===- llvm-cpselect.cpp - Pick representative training runs -------------===//
+//
+//                      The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Pick a small weighted subset of raw profiles whose combined profile
+// matches the combined profile of all of them, so that later rounds of
+// training only need to run the representative inputs.
+//
+// Each run is described by the values CombinedEdgeProfile and
+// CombinedCallProfile would add to their histograms for it.  Whole
+// vectors are far too big to keep for every run, so each run keeps:
+//   - a count sketch of its vector (-sketch buckets): every index is
+//     hashed to one bucket with a random sign, so distances between
+//     sketches approximate distances between the vectors, and
+//   - its values at -sample indices, spread evenly over the vector,
+//     for measuring drift.
+// Runs are clustered by farthest-first traversal of their sketches;
+// each cluster is represented by the run nearest its mean, weighted by
+// the size of the cluster.  Drift at one sampled index is the earth
+// mover's distance between the histograms of all runs and of the
+// weighted representatives (as a fraction of the histogram's range),
+// plus the difference in the share of runs that are 0.  The selection
+// is the fewest clusters whose mean drift over the sampled indices
+// that vary is at most -tolerance.
+//
+// Reading runs, updating clusters, and measuring drift are split over
+// -j threads.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CPStats.h"
+#include "llvm/Analysis/CPHistogram.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Config/config.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/System/Signals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#if defined(ENABLE_THREADS) && ENABLE_THREADS && defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#define CPSELECT_THREADS 1
+#endif
+
+#define VERBOSE(s) if( Verbose ) { s; }
+
+using namespace llvm;
+
+// from CPFactory: -bc
+extern cl::opt<unsigned> CPBinCount;
+
+namespace {
+	// Uninstrumented bitcode file
+	cl::opt<std::string> BitcodeFile(cl::Positional,
+		cl::desc("<program bitcode file>"), cl::Required);
+
+	// Raw profiles to choose from
+	cl::list<std::string> InputFilenames(cl::Positional, cl::OneOrMore,
+		cl::desc("<raw edge/call profiles>"));
+
+	cl::opt<std::string> OutFile("o", cl::init("-"),
+		cl::value_desc("filename"),
+		cl::desc("Write '<weight> <profile>' lines here (default stdout)"));
+
+	cl::opt<double> Tolerance("tolerance", cl::init(0.02),
+		cl::desc("Largest mean drift from the full combined profile"));
+
+	cl::opt<unsigned> SketchSize("sketch", cl::init(256),
+		cl::desc("Buckets in the sketch of each run"));
+
+	cl::opt<unsigned> SampleSize("sample", cl::init(2048),
+		cl::desc("Indices per run kept for measuring drift"));
+
+	cl::opt<unsigned> Seed("seed", cl::init(1),
+		cl::desc("Seed for the sketch hash"));
+
+	cl::opt<unsigned> Threads("j", cl::init(1),
+		cl::desc("Number of threads"));
+
+	// Verbose: report every selection tried
+	cl::opt<bool>
+  Verbose("v", cl::init(false),
+          cl::desc("Verbose output."));
+
+	// The CP classes only need the CFGs: read function bodies on demand
+	cl::opt<bool> LazyBitcode("lazy-bitcode", cl::init(true),
+		cl::desc("Read function bodies only while building profile structure"));
+
+  // ---------------------------------------------------------------------------
+
+  // load a module's bitcode into memory
+	Module* loadModule()
+  {
+    TimeRegion timer(CPStats::getTimer(CPTimeBitcode));
+		LLVMContext &Context = getGlobalContext();
+    Module* M = NULL;
+
+		std::string ErrorMessage;
+		if (MemoryBuffer *Buffer = MemoryBuffer::getFileOrSTDIN(BitcodeFile,
+                                                            &ErrorMessage))
+    {
+      if(LazyBitcode)
+      {
+        // the module owns the buffer on success
+        M = getLazyBitcodeModule(Buffer, Context, &ErrorMessage);
+        if(M == NULL)
+          delete Buffer;
+      }
+      else
+      {
+        M = ParseBitcodeFile(Buffer, Context, &ErrorMessage);
+        delete Buffer;
+      }
+		}
+
+		if (M == NULL)
+			errs() << BitcodeFile << ": " << ErrorMessage << "\n";
+		return(M);
+	}
+
+  // ---------------------------------------------------------------------------
+
+  // Call fn(ctx, begin, end) on contiguous pieces of [0,n), one per
+  // thread.
+  typedef void (*RangeFn)(void* ctx, unsigned begin, unsigned end);
+
+  struct RangeJob {
+    RangeFn fn;
+    void* ctx;
+    unsigned begin;
+    unsigned end;
+  };
+
+  void* runRangeJob(void* arg)
+  {
+    RangeJob* job = (RangeJob*)arg;
+    job->fn(job->ctx, job->begin, job->end);
+    return(NULL);
+  }
+
+  void forEachRange(RangeFn fn, void* ctx, unsigned n)
+  {
+    unsigned threads = std::max(1U, std::min((unsigned)Threads, n));
+    std::vector<RangeJob> jobs(threads);
+    for(unsigned t = 0; t < threads; t++)
+    {
+      jobs[t].fn = fn;
+      jobs[t].ctx = ctx;
+      jobs[t].begin = (unsigned)((unsigned long long)n * t / threads);
+      jobs[t].end = (unsigned)((unsigned long long)n * (t+1) / threads);
+    }
+
+#ifdef CPSELECT_THREADS
+    std::vector<pthread_t> ids(threads);
+    std::vector<bool> started(threads, false);
+    for(unsigned t = 1; t < threads; t++)
+      started[t] = (pthread_create(&ids[t], NULL, runRangeJob, &jobs[t]) == 0);
+    runRangeJob(&jobs[0]);
+    for(unsigned t = 1; t < threads; t++)
+    {
+      if(started[t])
+        pthread_join(ids[t], NULL);
+      else
+        runRangeJob(&jobs[t]);
+    }
+#else
+    for(unsigned t = 0; t < threads; t++)
+      runRangeJob(&jobs[t]);
+#endif
+  }
+
+  // ---------------------------------------------------------------------------
+
+  // 32-bit mix (the MurmurHash3 finalizer)
+  unsigned hashIndex(unsigned i, unsigned seed)
+  {
+    unsigned h = i ^ (seed * 0x9e3779b9U);
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return(h);
+  }
+
+  typedef std::vector<double> Sketch;
+
+  double distance2(const Sketch& a, const Sketch& b)
+  {
+    double d = 0;
+    for(unsigned i = 0; i < a.size(); i++)
+      d += (a[i] - b[i]) * (a[i] - b[i]);
+    return(d);
+  }
+
+  // What is kept of one run
+  struct RunInfo {
+    Sketch sketch;
+    std::vector<float> sample;  // values at RunSelector::_sampleIndex
+    bool ok;
+  };
+
+  // Clusters from the first k farthest-first centers, and the result
+  // of measuring them
+  struct Selection {
+    unsigned k;
+    std::vector<unsigned> reps;     // run representing each cluster
+    std::vector<double> weights;    // runs in each cluster
+    double drift;                   // mean over varying sampled indices
+    double maxDrift;
+  };
+
+  class RunSelector {
+  public:
+    RunSelector(Module& M, const FilenameVec& files);
+    ~RunSelector();
+
+    bool readRuns();
+    bool select(Selection& best);
+
+  private:
+    Module& _M;
+    const FilenameVec& _files;
+    CombinedEdgeProfile* _cep;
+    CombinedCallProfile* _ccp;
+    unsigned _edgeCount;       // edge values come first in a run's vector
+    unsigned _callCount;       // ... then call block values
+    unsigned _bincount;
+
+    std::vector<unsigned> _sampleIndex;
+    std::vector<RunInfo> _runs;
+
+    // farthest-first traversal: _centers[c] is the c'th center; run r
+    // is nearest center _history[r][h] for prefixes of _centers
+    // between that center and the next entry
+    std::vector<unsigned> _centers;
+    std::vector<double> _minDist;
+    std::vector<std::vector<unsigned> > _history;
+
+    // full-profile histogram of each sampled index that varies, and
+    // the sample position it came from
+    std::vector<CPHistogram*> _full;
+    std::vector<unsigned> _fullSample;
+
+    // scratch for the threaded steps
+    std::vector<CPHistogram*> _subset;
+    std::vector<double> _drift;
+    const Selection* _current;
+
+    bool readRun(unsigned r, std::vector<double>& edges,
+                 std::vector<double>& calls);
+    void summarize(unsigned r, const std::vector<double>& edges,
+                   const std::vector<double>& calls);
+    void chooseSample();
+    void buildFull();
+    void addCenter();
+    void evaluate(Selection& sel);
+
+    static void readRange(void* ctx, unsigned begin, unsigned end);
+    static void centerRange(void* ctx, unsigned begin, unsigned end);
+    static void driftRange(void* ctx, unsigned begin, unsigned end);
+  };
+
+  RunSelector::RunSelector(Module& M, const FilenameVec& files) :
+    _M(M), _files(files), _cep(NULL), _ccp(NULL), _edgeCount(0),
+    _callCount(0), _current(NULL)
+  {
+    _bincount = (CPBinCount > 0) ? (unsigned)CPBinCount : DEFAULT_BINS;
+  }
+
+  RunSelector::~RunSelector()
+  {
+    for(unsigned i = 0; i < _full.size(); i++)
+    {
+      delete _full[i];
+      delete _subset[i];
+    }
+    if(_cep != NULL) delete _cep;
+    if(_ccp != NULL) delete _ccp;
+  }
+
+
+  // Read the raw edge and call sections of run r.  The first run
+  // decides which sections every run must have.
+  bool RunSelector::readRun(unsigned r, std::vector<double>& edges,
+                            std::vector<double>& calls)
+  {
+    FILE* file = fopen(_files[r].c_str(), "rb");
+    if(!file)
+    {
+      errs() << "llvm-cpselect: Error: cannot open '" << _files[r] << "'\n";
+      return(false);
+    }
+
+    bool error = false;
+    bool sawEdges = false;
+    bool sawCalls = false;
+    ProfilingType profType;
+    while( !error &&
+           (fread(&profType, sizeof(ProfilingType), 1, file) > 0) )
+    {
+      switch(profType)
+      {
+      case ArgumentInfo:
+        error = !CPFactory::skipArgumentInfo(file);
+        break;
+
+      case EdgeInfo:
+        if( (r == 0) && (_cep == NULL) )
+          _cep = new CombinedEdgeProfile(_M);
+        error = (_cep == NULL) || !_cep->readNormalized(file, edges);
+        sawEdges = true;
+        break;
+
+      case CallInfo:
+        if( (r == 0) && (_ccp == NULL) )
+          _ccp = new CombinedCallProfile(_M);
+        error = (_ccp == NULL) || !_ccp->readNormalized(file, calls);
+        sawCalls = true;
+        break;
+
+        // counter arrays that play no part in the selection
+      case FunctionInfo:
+      case BlockInfo:
+      case TripCountInfo:
+      case ValueInfo:
+        {
+          unsigned count;
+          error = (fread(&count, sizeof(unsigned), 1, file) != 1) ||
+            (fseek(file, count * sizeof(unsigned), SEEK_CUR) != 0);
+          break;
+        }
+
+      default:
+        error = true;
+      }
+    }
+    fclose(file);
+
+    if(error)
+    {
+      errs() << "llvm-cpselect: Error: cannot read "
+             << CPFactory::profilingTypeToString(profType) << " in '"
+             << _files[r] << "'\n";
+      return(false);
+    }
+    if( (sawEdges != (_cep != NULL)) || (sawCalls != (_ccp != NULL)) )
+    {
+      errs() << "llvm-cpselect: Error: '" << _files[r]
+             << "' does not have the same profiles as '" << _files[0]
+             << "'\n";
+      return(false);
+    }
+    if( (r > 0) && ((sawEdges && (edges.size() != _edgeCount)) ||
+                    (sawCalls && (calls.size() != _callCount))) )
+    {
+      errs() << "llvm-cpselect: Error: '" << _files[r]
+             << "' does not match the size of '" << _files[0] << "'\n";
+      return(false);
+    }
+    return(true);
+  }
+
+
+  // Keep the sketch and sample of run r's vector: edges, then calls
+  void RunSelector::summarize(unsigned r, const std::vector<double>& edges,
+                              const std::vector<double>& calls)
+  {
+    RunInfo& run = _runs[r];
+    run.sketch.assign(SketchSize, 0);
+    for(unsigned i = 0, E = _edgeCount + _callCount; i < E; i++)
+    {
+      double v = (i < _edgeCount) ? edges[i] : calls[i - _edgeCount];
+      if(v == 0)
+        continue;
+      unsigned h = hashIndex(i, Seed);
+      run.sketch[h % SketchSize] += (h & 0x80000000U) ? -v : v;
+    }
+
+    run.sample.resize(_sampleIndex.size());
+    for(unsigned s = 0; s < _sampleIndex.size(); s++)
+    {
+      unsigned i = _sampleIndex[s];
+      run.sample[s] = (i < _edgeCount) ? edges[i] : calls[i - _edgeCount];
+    }
+  }
+
+
+  // One index from each of SampleSize equal strides, at a hashed offset
+  void RunSelector::chooseSample()
+  {
+    unsigned total = _edgeCount + _callCount;
+    _sampleIndex.clear();
+    if(total <= SampleSize)
+    {
+      for(unsigned i = 0; i < total; i++)
+        _sampleIndex.push_back(i);
+      return;
+    }
+
+    for(unsigned s = 0; s < SampleSize; s++)
+    {
+      unsigned lo = (unsigned)((unsigned long long)total * s / SampleSize);
+      unsigned hi = (unsigned)((unsigned long long)total * (s+1) / SampleSize);
+      _sampleIndex.push_back(lo + hashIndex(s, ~Seed) % (hi - lo));
+    }
+  }
+
+
+  // runs [begin+1, end+1): run 0 is read first, alone
+  void RunSelector::readRange(void* ctx, unsigned begin, unsigned end)
+  {
+    RunSelector* self = (RunSelector*)ctx;
+    std::vector<double> edges, calls;
+    for(unsigned r = begin + 1; r < end + 1; r++)
+    {
+      self->_runs[r].ok = self->readRun(r, edges, calls);
+      if(self->_runs[r].ok)
+        self->summarize(r, edges, calls);
+    }
+  }
+
+
+  // Read the first run alone to build the profile structure, then the
+  // rest in parallel.
+  bool RunSelector::readRuns()
+  {
+    _runs.resize(_files.size());
+
+    std::vector<double> edges, calls;
+    if(!readRun(0, edges, calls))
+      return(false);
+    if( (_cep == NULL) && (_ccp == NULL) )
+    {
+      errs() << "llvm-cpselect: Error: '" << _files[0]
+             << "' has no edge or call profile\n";
+      return(false);
+    }
+    _edgeCount = edges.size();
+    _callCount = calls.size();
+    chooseSample();
+    summarize(0, edges, calls);
+    _runs[0].ok = true;
+
+    forEachRange(readRange, this, _runs.size() - 1);
+    for(unsigned r = 1; r < _runs.size(); r++)
+      if(!_runs[r].ok)
+        return(false);
+
+    VERBOSE(errs() << "llvm-cpselect: " << _runs.size() << " runs, "
+            << _edgeCount << " edges, " << _callCount << " call blocks, "
+            << _sampleIndex.size() << " sampled\n");
+    return(true);
+  }
+
+
+  // Histograms of the full profile at the sampled indices that differ
+  // between runs; nothing can drift anywhere else.
+  void RunSelector::buildFull()
+  {
+    double total = _runs.size();
+    for(unsigned s = 0; s < _sampleIndex.size(); s++)
+    {
+      bool varies = false;
+      for(unsigned r = 1; !varies && (r < _runs.size()); r++)
+        varies = (_runs[r].sample[s] != _runs[0].sample[s]);
+      if(!varies)
+        continue;
+
+      CPHistogram* h = new CPHistogram();
+      for(unsigned r = 0; r < _runs.size(); r++)
+        h->addToList(_runs[r].sample[s]);
+      h->buildFromList(_bincount, total);
+      _full.push_back(h);
+      _fullSample.push_back(s);
+      _subset.push_back(new CPHistogram());
+    }
+    _drift.resize(_full.size());
+  }
+
+
+  void RunSelector::centerRange(void* ctx, unsigned begin, unsigned end)
+  {
+    RunSelector* self = (RunSelector*)ctx;
+    unsigned c = self->_centers.size() - 1;
+    const Sketch& center = self->_runs[self->_centers[c]].sketch;
+    for(unsigned r = begin; r < end; r++)
+    {
+      double d = distance2(self->_runs[r].sketch, center);
+      if( (c == 0) || (d < self->_minDist[r]) )
+      {
+        self->_minDist[r] = d;
+        self->_history[r].push_back(c);
+      }
+    }
+  }
+
+
+  // The first center is the run nearest the mean of all runs; each
+  // later one is the run farthest from every center so far.
+  void RunSelector::addCenter()
+  {
+    unsigned next = 0;
+    if(_centers.empty())
+    {
+      _minDist.resize(_runs.size());
+      _history.resize(_runs.size());
+
+      Sketch mean(SketchSize, 0);
+      for(unsigned r = 0; r < _runs.size(); r++)
+        for(unsigned b = 0; b < SketchSize; b++)
+          mean[b] += _runs[r].sketch[b] / _runs.size();
+      double best = -1;
+      for(unsigned r = 0; r < _runs.size(); r++)
+      {
+        double d = distance2(_runs[r].sketch, mean);
+        if( (best < 0) || (d < best) )
+        {
+          best = d;
+          next = r;
+        }
+      }
+    }
+    else
+    {
+      for(unsigned r = 1; r < _runs.size(); r++)
+        if(_minDist[r] > _minDist[next])
+          next = r;
+    }
+
+    _centers.push_back(next);
+    forEachRange(centerRange, this, _runs.size());
+  }
+
+
+  void RunSelector::driftRange(void* ctx, unsigned begin, unsigned end)
+  {
+    RunSelector* self = (RunSelector*)ctx;
+    const Selection& sel = *self->_current;
+    double total = self->_runs.size();
+    for(unsigned i = begin; i < end; i++)
+    {
+      const CPHistogram& full = *self->_full[i];
+      CPHistogram& sub = *self->_subset[i];
+      unsigned s = self->_fullSample[i];
+      for(unsigned c = 0; c < sel.reps.size(); c++)
+        sub.addToList(self->_runs[sel.reps[c]].sample[s], sel.weights[c]);
+      // the same range as the full histogram, so the bins line up
+      sub.buildFromList(self->_bincount, total, full.min(), full.max());
+
+      double drift = fabs(full.zeroWeight() - sub.zeroWeight()) / total;
+      if( !full.isPoint() && sub.nonZero() )
+        drift += full.earthMover(sub) / self->_bincount
+          * full.nonZeroWeight() / total;
+      self->_drift[i] = drift;
+    }
+  }
+
+
+  // Cluster by the first sel.k centers, pick the representatives, and
+  // measure the drift.
+  void RunSelector::evaluate(Selection& sel)
+  {
+    while(_centers.size() < sel.k)
+      addCenter();
+
+    // the nearest of the first k centers, from the traversal history
+    std::vector<unsigned> cluster(_runs.size());
+    for(unsigned r = 0; r < _runs.size(); r++)
+    {
+      std::vector<unsigned>& h = _history[r];
+      cluster[r] = *(std::lower_bound(h.begin(), h.end(), sel.k) - 1);
+    }
+
+    std::vector<Sketch> means(sel.k, Sketch(SketchSize, 0));
+    std::vector<double> sizes(sel.k, 0);
+    for(unsigned r = 0; r < _runs.size(); r++)
+    {
+      sizes[cluster[r]] += 1;
+      for(unsigned b = 0; b < SketchSize; b++)
+        means[cluster[r]][b] += _runs[r].sketch[b];
+    }
+    for(unsigned c = 0; c < sel.k; c++)
+      for(unsigned b = 0; (sizes[c] > 0) && (b < SketchSize); b++)
+        means[c][b] /= sizes[c];
+
+    std::vector<double> best(sel.k, -1);
+    sel.reps.assign(sel.k, 0);
+    for(unsigned r = 0; r < _runs.size(); r++)
+    {
+      unsigned c = cluster[r];
+      double d = distance2(_runs[r].sketch, means[c]);
+      if( (best[c] < 0) || (d < best[c]) )
+      {
+        best[c] = d;
+        sel.reps[c] = r;
+      }
+    }
+
+    // a center with the same sketch as an earlier one has no runs
+    sel.weights.clear();
+    for(unsigned c = 0, used = 0; c < sel.k; c++)
+    {
+      if(sizes[c] == 0)
+        continue;
+      sel.reps[used++] = sel.reps[c];
+      sel.weights.push_back(sizes[c]);
+    }
+    sel.reps.resize(sel.weights.size());
+
+    _current = &sel;
+    forEachRange(driftRange, this, _full.size());
+    _current = NULL;
+
+    sel.drift = sel.maxDrift = 0;
+    for(unsigned i = 0; i < _drift.size(); i++)
+    {
+      sel.drift += _drift[i];
+      sel.maxDrift = std::max(sel.maxDrift, _drift[i]);
+    }
+    if(!_drift.empty())
+      sel.drift /= _drift.size();
+
+    VERBOSE(errs() << "llvm-cpselect: " << sel.k << " runs: drift "
+            << format("%.4f", sel.drift) << " (max "
+            << format("%.4f", sel.maxDrift) << ")\n");
+  }
+
+
+  // The fewest clusters within tolerance: double k until the drift is
+  // small enough, then bisect.
+  bool RunSelector::select(Selection& best)
+  {
+    buildFull();
+    unsigned n = _runs.size();
+
+    Selection sel;
+    unsigned lo = 0;
+    sel.k = 1;
+    for(;;)
+    {
+      evaluate(sel);
+      if( (sel.drift <= Tolerance) || (sel.k == n) )
+        break;
+      lo = sel.k;
+      sel.k = std::min(2 * sel.k, n);
+    }
+    best = sel;
+
+    unsigned hi = best.k;
+    while(lo + 1 < hi)
+    {
+      sel.k = lo + (hi - lo) / 2;
+      evaluate(sel);
+      if(sel.drift <= Tolerance)
+      {
+        best = sel;
+        hi = sel.k;
+      }
+      else
+        lo = sel.k;
+    }
+    return(best.drift <= Tolerance);
+  }
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  // Print a stack trace if we signal out.
+  sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+
+  // Call llvm_shutdown() on exit.
+  llvm_shutdown_obj Y;
+
+  cl::ParseCommandLineOptions(argc, argv,
+                              "llvm training run selector.\n");
+
+  if(SketchSize == 0)
+  {
+    errs() << "error: -sketch must be at least 1\n";
+    return(1);
+  }
+
+  Module* currentModule = loadModule();
+  if( currentModule == NULL ) return 1;
+
+  FilenameVec files;
+  for(unsigned i = 0; i < InputFilenames.size(); i++)
+    files.push_back(InputFilenames[i]);
+
+  Selection best;
+  bool ok = false;
+  {
+    RunSelector selector(*currentModule, files);
+    if(!selector.readRuns())
+    {
+      errs() << "Failed to read profiles\n";
+      delete currentModule;
+      return(1);
+    }
+    ok = selector.select(best);
+  }
+
+  std::string ErrorInfo;
+  raw_fd_ostream out(OutFile.c_str(), ErrorInfo);
+  if(!ErrorInfo.empty())
+  {
+    errs() << "  error: cannot open '" << OutFile << "' for writing: "
+           << ErrorInfo << "\n";
+    delete currentModule;
+    return(1);
+  }
+
+  // heaviest first
+  std::vector<std::pair<double,unsigned> > order;
+  for(unsigned c = 0; c < best.reps.size(); c++)
+    order.push_back(std::make_pair(best.weights[c], best.reps[c]));
+  std::sort(order.rbegin(), order.rend());
+  for(unsigned c = 0; c < order.size(); c++)
+    out << format("%.0f", order[c].first) << " "
+        << files[order[c].second] << "\n";
+
+  errs() << "llvm-cpselect: " << best.reps.size() << " of " << files.size()
+         << " runs, drift " << format("%.4f", best.drift) << " (max "
+         << format("%.4f", best.maxDrift) << ")\n";
+  if(!ok)
+    errs() << "llvm-cpselect: Warning: drift is above -tolerance "
+           << Tolerance << "\n";
+
+  delete currentModule;
+  CPFactory::freeStaticData();
+  return(0);
+}
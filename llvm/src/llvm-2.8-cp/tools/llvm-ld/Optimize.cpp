@@ -19,6 +19,7 @@
 #include "llvm/System/DynamicLibrary.h"
 #include "llvm/Target/TargetData.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/FDO.h"
 #include "llvm/Support/PassNameParser.h"
 #include "llvm/Support/PluginLoader.h"
 using namespace llvm;
@@ -53,6 +54,10 @@ static cl::opt<bool> Strip("strip-all",
 static cl::alias A0("s", cl::desc("Alias for --strip-all"), 
   cl::aliasopt(Strip));
 
+static cl::opt<bool> FDOOrder("fdo-order",
+  cl::desc("Order functions using a combined call profile "
+           "(see -FDOrder-cprof)"));
+
 static cl::opt<bool> StripDebug("strip-debug",
   cl::desc("Strip debugger symbol info from executable"));
 
@@ -87,6 +92,11 @@ void Optimize(Module* M) {
   // Add an appropriate TargetData instance for this module...
   addPass(Passes, new TargetData(M));
 
+  // Order functions while the module still matches the profile; the
+  // passes below keep the relative order of the functions they keep.
+  if (FDOOrder)
+    addPass(Passes, createFDOFunctionOrderPass());
+
   if (!DisableOptimizations)
     createStandardLTOPasses(&Passes, !DisableInternalize, !DisableInline,
                             VerifyEach);
@@ -0,0 +1,624 @@
+//===- cpbench.cpp - Combined profiling performance benchmark -------------===//
+//
+//                      The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Times the combined profiling pipeline on a synthetic program and
+// synthetic raw profiles, so that regressions can be tracked and
+// optimizations judged without a real benchmark suite.
+//
+// The program has -functions functions.  Each is a chain of -diamonds
+// if/else diamonds (2^diamonds paths), and the 'then' arm of
+// the first -calls diamonds calls one of the following functions.
+// Each of the -runs raw profiles holds an edge, a path and a call
+// section.  In a run, a function executes with probability
+// 1 - sparsity, from 1 to -entries times; every diamond has a branch
+// probability of its own, which moves a little from run to run; and at
+// most -paths-per-run distinct paths are recorded per function.
+//
+// Every stage prints its wall and user time, the items it processed
+// (runs, histograms, bytes), their throughput and the peak RSS so far:
+//
+//   addProfile       the raw runs, into edge/path/call add lists
+//   buildHistograms  the add lists, into histograms
+//   buildProfiles    CPFactory, from the raw files, end to end
+//   serialize        the three profiles, to one .cp file
+//   deserialize      the same file, back
+//   buildFromList    -merge copies of each profile, into one
+//   drift            CPDrift of the edge and path profiles against
+//                    the ones read back, with -j
+//   FDOInliner       FDOInliner::initialize on the call profile
+//
+// The files go to -dir, which is removed afterwards unless -keep is
+// given; it then also holds the program as cpbench.bc.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/PassManager.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/CPDrift.h"
+#include "llvm/Analysis/CPFactory.h"
+#include "llvm/Analysis/CombinedProfile.h"
+#include "llvm/Analysis/ProfileInfoTypes.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/IRBuilder.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/System/Path.h"
+#include "llvm/System/Signals.h"
+#include "llvm/Transforms/FDO/FDOInlinerPass.h"
+
+#include <cstdio>
+#include <map>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+// from CPFactory: -bc
+extern cl::opt<unsigned> CPBinCount;
+
+namespace {
+	// synthetic program
+	cl::opt<unsigned> Functions("functions", cl::init(200),
+		cl::desc("Number of functions"));
+
+	cl::opt<unsigned> Diamonds("diamonds", cl::init(8),
+		cl::desc("If/else diamonds per function (2^diamonds paths, at most 30)"));
+
+	cl::opt<unsigned> Calls("calls", cl::init(2),
+		cl::desc("Diamonds per function that call another function"));
+
+	// synthetic runs
+	cl::opt<unsigned> Runs("runs", cl::init(20),
+		cl::desc("Number of raw profiles"));
+
+	cl::opt<double> Sparsity("sparsity", cl::init(0.2),
+		cl::desc("Probability that a function does not execute in a run"));
+
+	cl::opt<unsigned> Entries("entries", cl::init(1000),
+		cl::desc("Maximum calls of a function in a run"));
+
+	cl::opt<unsigned> PathsPerRun("paths-per-run", cl::init(64),
+		cl::desc("Maximum distinct paths of a function in a run"));
+
+	cl::opt<unsigned> Seed("seed", cl::init(1),
+		cl::desc("Random seed"));
+
+	// stages
+	cl::opt<unsigned> Merge("merge", cl::init(4),
+		cl::desc("Profiles merged by the buildFromList stage"));
+
+	cl::opt<unsigned> DriftThreads("j", cl::init(1),
+		cl::desc("Number of threads used by the drift stage"));
+
+	cl::opt<std::string> WorkDir("dir", cl::init("cpbench.tmp"),
+		cl::value_desc("directory"),
+		cl::desc("Directory for the generated files"));
+
+	cl::opt<bool> Keep("keep",
+		cl::desc("Keep the generated files (and write cpbench.bc)"));
+
+  // ---------------------------------------------------------------------------
+
+  // xorshift: the same inputs from the same seed everywhere
+  class Random {
+  public:
+    explicit Random(unsigned seed) : _x(seed ? seed : 1) {};
+    unsigned next()
+    {
+      _x ^= _x << 13;
+      _x ^= _x >> 17;
+      _x ^= _x << 5;
+      return(_x);
+    };
+    // [0,1)
+    double uniform() {return(next() / 4294967296.0);};
+  private:
+    unsigned _x;
+  };
+
+  // callee of the call in diamond d of function f, or f if none
+  unsigned getCallee(unsigned f, unsigned d)
+  {
+    if(d >= Calls) return(f);
+    return( (f + d + 1) % Functions );
+  }
+
+  // Blocks are entry, then cond/then/else/join for each diamond; the
+  // last join returns.
+  Module* buildModule()
+  {
+    LLVMContext& Context = getGlobalContext();
+    Module* M = new Module("cpbench", Context);
+    const IntegerType* Int32 = Type::getInt32Ty(Context);
+
+    // the branches load this, so nothing folds them away
+    GlobalVariable* sel =
+      new GlobalVariable(*M, Int32, false, GlobalValue::ExternalLinkage,
+                         ConstantInt::get(Int32, 0), "cpbench.sel");
+
+    FunctionType* FT = FunctionType::get(Type::getVoidTy(Context), false);
+    std::vector<Function*> functions;
+    for(unsigned f = 0; f < Functions; f++)
+      functions.push_back(Function::Create(FT, Function::ExternalLinkage,
+                                           "f" + utostr(f), M));
+
+    IRBuilder<> B(Context);
+    for(unsigned f = 0; f < Functions; f++)
+    {
+      Function* F = functions[f];
+      BasicBlock* entry = BasicBlock::Create(Context, "entry", F);
+      BasicBlock* prev = entry;
+
+      for(unsigned d = 0; d < Diamonds; d++)
+      {
+        BasicBlock* cond = BasicBlock::Create(Context, "cond", F);
+        BasicBlock* then = BasicBlock::Create(Context, "then", F);
+        BasicBlock* other = BasicBlock::Create(Context, "else", F);
+        B.SetInsertPoint(prev);
+        B.CreateBr(cond);
+
+        B.SetInsertPoint(cond);
+        Value* v = B.CreateLoad(sel, true, "v");
+        B.CreateCondBr(B.CreateICmpSLT(v, ConstantInt::get(Int32, d)),
+                       then, other);
+
+        B.SetInsertPoint(then);
+        if(getCallee(f, d) != f)
+          B.CreateCall(functions[getCallee(f, d)]);
+
+        // then and else meet again in join
+        B.SetInsertPoint(other);
+        BasicBlock* join = BasicBlock::Create(Context, "join", F);
+        B.CreateBr(join);
+        B.SetInsertPoint(then);
+        B.CreateBr(join);
+        prev = join;
+      }
+
+      B.SetInsertPoint(prev);
+      B.CreateRetVoid();
+    }
+
+    return(M);
+  }
+
+  // the raw profile of one run: an edge, a path and a call section
+  bool writeRun(const std::string& filename, Random& rnd,
+                const std::vector<double>& bias, unsigned long long& bytes)
+  {
+    std::vector<unsigned> edges, entries, callCounts, paths;
+    unsigned pathFunctions = 0;
+
+    for(unsigned f = 0; f < Functions; f++)
+    {
+      unsigned n = 0;
+      if(rnd.uniform() >= Sparsity)
+        n = 1 + rnd.next() % Entries;
+      entries.push_back(n);
+
+      // the entry edge, then entry -> cond
+      edges.push_back(n);
+      if(Diamonds > 0)
+        edges.push_back(n);
+
+      std::vector<double> prob(Diamonds);
+      for(unsigned d = 0; d < Diamonds; d++)
+      {
+        double p = bias[f * Diamonds + d] + 0.2 * (rnd.uniform() - 0.5);
+        prob[d] = (p < 0) ? 0 : ((p > 1) ? 1 : p);
+
+        unsigned taken = (unsigned)(n * prob[d] + 0.5);
+        edges.push_back(taken);      // cond -> then
+        edges.push_back(n - taken);  // cond -> else
+        edges.push_back(taken);      // then -> join
+        edges.push_back(n - taken);  // else -> join
+        if(d + 1 < Diamonds)
+          edges.push_back(n);        // join -> next cond
+        if(getCallee(f, d) != f)
+          callCounts.push_back(taken);
+      }
+
+      if(n == 0)
+        continue;
+
+      // choose the paths one diamond at a time, and share the calls
+      // out among them
+      std::map<unsigned,unsigned> counts;
+      unsigned draws = (n < PathsPerRun) ? n : (unsigned)PathsPerRun;
+      for(unsigned k = 0; k < draws; k++)
+      {
+        unsigned path = 0;
+        for(unsigned d = 0; d < Diamonds; d++)
+          if(rnd.uniform() >= prob[d])
+            path |= 1u << (Diamonds - 1 - d);
+        counts[path] += n / draws + ((k == 0) ? n % draws : 0);
+      }
+
+      paths.push_back(f + 1);
+      paths.push_back(counts.size());
+      for(std::map<unsigned,unsigned>::iterator P = counts.begin(),
+            E = counts.end(); P != E; ++P)
+      {
+        paths.push_back(P->first);
+        paths.push_back(P->second);
+      }
+      pathFunctions++;
+    }
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if(file == NULL)
+    {
+      errs() << "error: cannot write '" << filename << "'\n";
+      return(false);
+    }
+
+    std::vector<unsigned> out;
+    out.push_back(EdgeInfo);
+    out.push_back(edges.size());
+    out.insert(out.end(), edges.begin(), edges.end());
+    out.push_back(PathInfo);
+    out.push_back(pathFunctions);
+    out.insert(out.end(), paths.begin(), paths.end());
+    out.push_back(CallInfo);
+    out.push_back(entries.size() + callCounts.size());
+    out.insert(out.end(), entries.begin(), entries.end());
+    out.insert(out.end(), callCounts.begin(), callCounts.end());
+
+    bool ok = (fwrite(&out[0], sizeof(unsigned), out.size(), file)
+               == out.size());
+    fclose(file);
+    bytes += out.size() * sizeof(unsigned);
+    return(ok);
+  }
+
+  // ---------------------------------------------------------------------------
+
+  // one line per stage
+  class Stage {
+  public:
+    explicit Stage(const char* name) : _name(name)
+    {_start = TimeRecord::getCurrentTime(true);};
+
+    void done(double items, const char* unit, double bytes = 0)
+    {
+      TimeRecord t = TimeRecord::getCurrentTime(false);
+      t -= _start;
+
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      double wall = t.getWallTime();
+      double rate = (wall > 0) ? items / wall : 0;
+
+      outs() << format("%-16s", _name)
+             << format(" %9.3f %9.3f", wall, t.getUserTime())
+             << format(" %12.0f %-10s", items, unit)
+             << format(" %12.1f", rate);
+      if( (bytes > 0) && (wall > 0) )
+        outs() << format(" %9.2f", bytes / wall / (1024 * 1024));
+      else
+        outs() << "         -";
+      outs() << format(" %10.1f\n", usage.ru_maxrss / 1024.0);
+      outs().flush();
+    };
+
+    static void header()
+    {
+      outs() << "stage              wall(s)   user(s)        items"
+                "                 items/s      MB/s peakRSS(MB)\n";
+    };
+
+  private:
+    const char* _name;
+    TimeRecord _start;
+  };
+
+  double fileSize(const std::string& filename)
+  {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == NULL) return(0);
+    fseek(file, 0, SEEK_END);
+    double size = ftell(file);
+    fclose(file);
+    return(size);
+  }
+
+  // read every profile in filename into profs: the types are known
+  bool readProfiles(const std::string& filename, Module& M,
+                    CombinedProfile* profs[3])
+  {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == NULL) return(false);
+
+    bool ok = true;
+    unsigned ptype;
+    while(ok && (fread(&ptype, sizeof(unsigned), 1, file) == 1))
+    {
+      switch(ptype)
+      {
+      case CombinedFunctionKeys:
+        {
+          CPFunctionKeys keys;
+          ok = keys.deserialize(file);
+          break;
+        }
+      case CombinedEdgeInfo:
+        profs[0] = new CombinedEdgeProfile(M);
+        ok = profs[0]->deserialize(file);
+        break;
+      case CombinedPathInfo:
+        profs[1] = new CombinedPathProfile(M);
+        ok = profs[1]->deserialize(file);
+        break;
+      case CombinedCallInfo:
+        profs[2] = new CombinedCallProfile(M);
+        ok = profs[2]->deserialize(file);
+        break;
+      default:
+        ok = false;
+      }
+    }
+    fclose(file);
+    return(ok);
+  }
+
+  unsigned countHistograms(CombinedProfile* profs[3])
+  {
+    unsigned count = 0;
+    for(unsigned i = 0; i < 3; i++)
+      if(profs[i] != NULL)
+        count += profs[i]->size();
+    return(count);
+  }
+
+  // FDOInliner::initialize, without the inlining
+  class InlinerInit : public FDOInliner {
+  public:
+    InlinerInit() : _size(0) {};
+    bool runOnModule(Module& M)
+    {
+      _size = initialize(M, getAnalysis<CallGraph>(), NULL);
+      return(false);
+    };
+    unsigned size() const {return(_size);};
+  private:
+    unsigned _size;
+  };
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+  // Print a stack trace if we signal out.
+	sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+
+	// Call llvm_shutdown() on exit.
+  llvm_shutdown_obj Y;
+
+  cl::ParseCommandLineOptions(argc, argv,
+		"combined profiling benchmark\n");
+
+  if( (Diamonds > 30) || (Functions == 0) || (Runs == 0) )
+  {
+    errs() << "error: need 1+ functions, 1+ runs and at most 30 diamonds\n";
+    return(1);
+  }
+  if(CPBinCount == 0)
+    CPBinCount = DEFAULT_BINS;
+
+  // the FDOInliner reads call.cp, and writes its logs, here
+  sys::Path cwd = sys::Path::GetCurrentDirectory();
+  sys::Path dir(WorkDir);
+  std::string err;
+  if( dir.createDirectoryOnDisk(true, &err) || (chdir(dir.c_str()) != 0) )
+  {
+    errs() << "error: cannot use directory '" << WorkDir << "': " << err
+           << "\n";
+    return(1);
+  }
+
+  outs() << Functions << " functions, " << (1u << Diamonds)
+         << " paths each, " << Runs << " runs, sparsity "
+         << format("%.2f", (double)Sparsity) << ", " << CPBinCount
+         << " bins\n";
+  Stage::header();
+
+  //
+  // inputs
+  //
+  Stage genModule("module");
+  Module* M = buildModule();
+  genModule.done(Functions, "functions");
+
+  if(Keep)
+  {
+    raw_fd_ostream bc("cpbench.bc", err, raw_fd_ostream::F_Binary);
+    if(err.empty())
+      WriteBitcodeToFile(M, bc);
+  }
+
+  Random rnd(Seed);
+  std::vector<double> bias(Functions * Diamonds);
+  for(unsigned i = 0; i < bias.size(); i++)
+    bias[i] = 0.05 + 0.9 * rnd.uniform();
+
+  FilenameVec runFiles;
+  unsigned long long rawBytes = 0;
+  Stage genRuns("raw profiles");
+  for(unsigned r = 0; r < Runs; r++)
+  {
+    runFiles.push_back("run." + utostr(r) + ".out");
+    if( !writeRun(runFiles.back(), rnd, bias, rawBytes) )
+      return(1);
+  }
+  genRuns.done(Runs, "runs", rawBytes);
+
+  //
+  // raw runs -> histograms
+  //
+  CombinedProfile* built[3] = {
+    new CombinedEdgeProfile(*M), new CombinedPathProfile(*M),
+    new CombinedCallProfile(*M) };
+
+  Stage add("addProfile");
+  for(unsigned r = 0; r < Runs; r++)
+  {
+    FILE* file = fopen(runFiles[r].c_str(), "rb");
+    unsigned ptype;
+    bool ok = (file != NULL);
+    while(ok && (fread(&ptype, sizeof(unsigned), 1, file) == 1))
+    {
+      switch(ptype)
+      {
+      case EdgeInfo: ok = built[0]->addProfile(file); break;
+      case PathInfo: ok = built[1]->addProfile(file); break;
+      case CallInfo: ok = built[2]->addProfile(file); break;
+      default:       ok = false;
+      }
+    }
+    if(file != NULL) fclose(file);
+    if(!ok)
+    {
+      errs() << "error: cannot add '" << runFiles[r] << "'\n";
+      return(1);
+    }
+  }
+  add.done(Runs, "runs", rawBytes);
+
+  Stage build("buildHistograms");
+  for(unsigned i = 0; i < 3; i++)
+    built[i]->buildHistograms(CPBinCount);
+  build.done(countHistograms(built), "histograms");
+
+  Stage factory("buildProfiles");
+  {
+    CPFactory fact(*M);
+    if( !fact.buildProfiles(runFiles) )
+      return(1);
+  }
+  factory.done(Runs, "runs", rawBytes);
+
+  //
+  // .cp files
+  //
+  Stage write("serialize");
+  {
+    FILE* file = fopen("bench.cp", "wb");
+    bool ok = (file != NULL) && CPFunctionKeys(*M).serialize(file);
+    for(unsigned i = 0; ok && (i < 3); i++)
+      ok = (built[i]->serialize(file) > 0);
+    if(file != NULL) fclose(file);
+    if(!ok)
+    {
+      errs() << "error: cannot write bench.cp\n";
+      return(1);
+    }
+  }
+  write.done(countHistograms(built), "histograms", fileSize("bench.cp"));
+
+  CombinedProfile* read[3] = { NULL, NULL, NULL };
+  Stage readBack("deserialize");
+  if( !readProfiles("bench.cp", *M, read) )
+  {
+    errs() << "error: cannot read bench.cp\n";
+    return(1);
+  }
+  readBack.done(countHistograms(read), "histograms", fileSize("bench.cp"));
+
+  // -merge copies of each, read outside the stage
+  std::vector<CombinedProfile*> copies;
+  CPList lists[3];
+  for(unsigned m = 0; m < Merge; m++)
+  {
+    CombinedProfile* copy[3] = { NULL, NULL, NULL };
+    if( !readProfiles("bench.cp", *M, copy) )
+      return(1);
+    for(unsigned i = 0; i < 3; i++)
+    {
+      lists[i].push_back(copy[i]);
+      copies.push_back(copy[i]);
+    }
+  }
+
+  CombinedProfile* merged[3] = {
+    new CombinedEdgeProfile(*M), new CombinedPathProfile(*M),
+    new CombinedCallProfile(*M) };
+  Stage fromList("buildFromList");
+  for(unsigned i = 0; i < 3; i++)
+    merged[i]->buildFromList(lists[i], CPBinCount);
+  fromList.done(Merge * countHistograms(read), "histograms");
+
+  Stage drift("drift");
+  {
+    CPDrift edgeDrift(DriftThreads);
+    edgeDrift.compare(*built[0], *read[0]);
+    CPDrift pathDrift(DriftThreads);
+    pathDrift.compare(*(CombinedPathProfile*)built[1],
+                      *(CombinedPathProfile*)read[1]);
+    drift.done(edgeDrift.size() + pathDrift.size(), "pairs");
+  }
+
+  //
+  // consumers
+  //
+  {
+    FILE* file = fopen("call.cp", "wb");
+    bool ok = (file != NULL) && CPFunctionKeys(*M).serialize(file) &&
+      (built[2]->serialize(file) > 0);
+    if(file != NULL) fclose(file);
+    if(!ok)
+    {
+      errs() << "error: cannot write call.cp\n";
+      return(1);
+    }
+  }
+
+  for(unsigned i = 0; i < 3; i++)
+  {
+    delete built[i];
+    delete read[i];
+    delete merged[i];
+  }
+  for(unsigned i = 0; i < copies.size(); i++)
+    delete copies[i];
+
+  // last: the inliner frees the CP classes' static data
+  Stage inliner("FDOInliner");
+  {
+    PassManager PM;
+    InlinerInit* init = new InlinerInit();
+    PM.add(init);
+    PM.run(*M);
+    if(init->size() == 0)
+      errs() << "warning: FDOInliner initialization failed\n";
+  }
+  inliner.done(Functions, "functions");
+
+  delete M;
+  CPFactory::freeStaticData();
+
+  if(chdir(cwd.c_str()) != 0)
+    return(1);
+  if(!Keep)
+    dir.eraseFromDisk(true);
+
+  return(0);
+}